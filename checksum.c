@@ -0,0 +1,643 @@
+/**
+ * PROJECT:         Native Shell
+ * COPYRIGHT:       LGPL; See LICENSE in the top level directory
+ * FILE:            checksum.c
+ * DESCRIPTION:     Checksum kernels.
+ * DEVELOPERS:      See CONTRIBUTORS.md in the top level directory
+ */
+
+#include "precomp.h"
+
+#if defined(_M_IX86) || defined(_M_AMD64)
+#include <intrin.h>
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#define CHECKSUM_HAVE_PCLMUL 1
+#endif
+
+// CPUID leaf 1 feature bits
+#define CPUID_ECX_PCLMULQDQ (1 << 1)
+#define CPUID_EDX_SSE2 (1 << 26)
+
+// Not probed yet, no usable kernel, PCLMULQDQ folding
+#define CRC32_KERNEL_UNKNOWN 0
+#define CRC32_KERNEL_PORTABLE 1
+#define CRC32_KERNEL_PCLMUL 2
+
+static LONG Crc32Kernel = CRC32_KERNEL_UNKNOWN;
+
+#ifdef CHECKSUM_HAVE_PCLMUL
+
+/*++
+ * @name RtlClipCrc32Pclmul
+ *
+ * The RtlClipCrc32Pclmul routine folds a buffer into a CRC32 with carry-less
+ * multiplication.
+ *
+ * @param Crc
+ *        Running CRC, not inverted.
+ *
+ * @param Buffer
+ *        Data, at least 64 bytes.
+ *
+ * @param Length
+ *        Size of the data, a multiple of 16.
+ *
+ * @return Updated CRC, not inverted.
+ *
+ * @remarks Four 128-bit lanes are folded 64 bytes at a time, then into one
+ *          lane, then reduced to 32 bits with a Barrett reduction. The
+ *          constants are the bit reflected ones for the CRC32 polynomial
+ *          used by RtlComputeCrc32, from Intel's "Fast CRC Computation for
+ *          Generic Polynomials Using PCLMULQDQ Instruction". Only SSE2 and
+ *          PCLMULQDQ are used.
+ *
+ *--*/
+ULONG
+RtlClipCrc32Pclmul(IN ULONG Crc, IN const UCHAR *Buffer, IN ULONG Length)
+{
+    __m128i K1K2, K3K4, K5K0, Poly, Mask32;
+    __m128i X1, X2, X3, X4, X5, X6, X7, X8;
+
+    K1K2 = _mm_set_epi32(0x00000001, 0xc6e41596, 0x00000001, 0x54442bd4);
+    K3K4 = _mm_set_epi32(0x00000000, 0xccaa009e, 0x00000001, 0x751997d0);
+    K5K0 = _mm_set_epi32(0x00000000, 0x00000000, 0x00000001, 0x63cd6124);
+    Poly = _mm_set_epi32(0x00000001, 0xf7011641, 0x00000001, 0xdb710641);
+    Mask32 = _mm_set_epi32(0, ~0, 0, ~0);
+
+    X1 = _mm_loadu_si128((const __m128i *)(Buffer + 0x00));
+    X2 = _mm_loadu_si128((const __m128i *)(Buffer + 0x10));
+    X3 = _mm_loadu_si128((const __m128i *)(Buffer + 0x20));
+    X4 = _mm_loadu_si128((const __m128i *)(Buffer + 0x30));
+    X1 = _mm_xor_si128(X1, _mm_cvtsi32_si128((int)Crc));
+
+    Buffer += 64;
+    Length -= 64;
+
+    // Fold 64 bytes at a time
+    while (Length >= 64)
+    {
+        X5 = _mm_clmulepi64_si128(X1, K1K2, 0x00);
+        X6 = _mm_clmulepi64_si128(X2, K1K2, 0x00);
+        X7 = _mm_clmulepi64_si128(X3, K1K2, 0x00);
+        X8 = _mm_clmulepi64_si128(X4, K1K2, 0x00);
+
+        X1 = _mm_clmulepi64_si128(X1, K1K2, 0x11);
+        X2 = _mm_clmulepi64_si128(X2, K1K2, 0x11);
+        X3 = _mm_clmulepi64_si128(X3, K1K2, 0x11);
+        X4 = _mm_clmulepi64_si128(X4, K1K2, 0x11);
+
+        X1 = _mm_xor_si128(_mm_xor_si128(X1, X5), _mm_loadu_si128((const __m128i *)(Buffer + 0x00)));
+        X2 = _mm_xor_si128(_mm_xor_si128(X2, X6), _mm_loadu_si128((const __m128i *)(Buffer + 0x10)));
+        X3 = _mm_xor_si128(_mm_xor_si128(X3, X7), _mm_loadu_si128((const __m128i *)(Buffer + 0x20)));
+        X4 = _mm_xor_si128(_mm_xor_si128(X4, X8), _mm_loadu_si128((const __m128i *)(Buffer + 0x30)));
+
+        Buffer += 64;
+        Length -= 64;
+    }
+
+    // Fold the four lanes into one
+    X5 = _mm_clmulepi64_si128(X1, K3K4, 0x00);
+    X1 = _mm_clmulepi64_si128(X1, K3K4, 0x11);
+    X1 = _mm_xor_si128(_mm_xor_si128(X1, X2), X5);
+
+    X5 = _mm_clmulepi64_si128(X1, K3K4, 0x00);
+    X1 = _mm_clmulepi64_si128(X1, K3K4, 0x11);
+    X1 = _mm_xor_si128(_mm_xor_si128(X1, X3), X5);
+
+    X5 = _mm_clmulepi64_si128(X1, K3K4, 0x00);
+    X1 = _mm_clmulepi64_si128(X1, K3K4, 0x11);
+    X1 = _mm_xor_si128(_mm_xor_si128(X1, X4), X5);
+
+    // Fold the remaining 16 byte blocks
+    while (Length >= 16)
+    {
+        X5 = _mm_clmulepi64_si128(X1, K3K4, 0x00);
+        X1 = _mm_clmulepi64_si128(X1, K3K4, 0x11);
+        X1 = _mm_xor_si128(_mm_xor_si128(X1, _mm_loadu_si128((const __m128i *)Buffer)), X5);
+
+        Buffer += 16;
+        Length -= 16;
+    }
+
+    // 128 to 64 bits
+    X2 = _mm_clmulepi64_si128(X1, K3K4, 0x10);
+    X1 = _mm_xor_si128(_mm_srli_si128(X1, 8), X2);
+
+    X2 = _mm_srli_si128(X1, 4);
+    X1 = _mm_and_si128(X1, Mask32);
+    X1 = _mm_clmulepi64_si128(X1, K5K0, 0x00);
+    X1 = _mm_xor_si128(X1, X2);
+
+    // Barrett reduction to 32 bits
+    X2 = _mm_and_si128(X1, Mask32);
+    X2 = _mm_clmulepi64_si128(X2, Poly, 0x10);
+    X2 = _mm_and_si128(X2, Mask32);
+    X2 = _mm_clmulepi64_si128(X2, Poly, 0x00);
+    X1 = _mm_xor_si128(X1, X2);
+
+    return (ULONG)_mm_cvtsi128_si32(_mm_srli_si128(X1, 4));
+}
+
+#endif
+
+/*++
+ * @name RtlClipSelectCrc32Kernel
+ *
+ * The RtlClipSelectCrc32Kernel routine picks the fastest CRC32 kernel the
+ * processor supports.
+ *
+ * @param None.
+ *
+ * @return CRC32_KERNEL_PORTABLE or CRC32_KERNEL_PCLMUL.
+ *
+ * @remarks Every thread that gets here first computes the same answer, so
+ *          the race on Crc32Kernel is harmless.
+ *
+ *--*/
+LONG
+RtlClipSelectCrc32Kernel(VOID)
+{
+    LONG Kernel = CRC32_KERNEL_PORTABLE;
+#ifdef CHECKSUM_HAVE_PCLMUL
+    int CpuInfo[4];
+
+    __cpuid(CpuInfo, 0);
+    if (CpuInfo[0] >= 1)
+    {
+        __cpuid(CpuInfo, 1);
+        if ((CpuInfo[2] & CPUID_ECX_PCLMULQDQ) && (CpuInfo[3] & CPUID_EDX_SSE2))
+            Kernel = CRC32_KERNEL_PCLMUL;
+    }
+#endif
+
+    Crc32Kernel = Kernel;
+    return Kernel;
+}
+
+/*++
+ * @name RtlCliCrc32
+ *
+ * The RtlCliCrc32 routine adds a buffer to a running CRC32.
+ *
+ * @param Crc
+ *        CRC of the data so far, 0 to start.
+ *
+ * @param Buffer
+ *        Data to add.
+ *
+ * @param Length
+ *        Size of the data.
+ *
+ * @return CRC of the data so far and Buffer.
+ *
+ * @remarks The result is the same as RtlComputeCrc32, which is also the
+ *          fallback when the processor has no PCLMULQDQ.
+ *
+ *--*/
+ULONG
+RtlCliCrc32(IN ULONG Crc, IN PVOID Buffer, IN ULONG Length)
+{
+    PUCHAR Data = Buffer;
+    LONG Kernel = Crc32Kernel;
+
+    if (Kernel == CRC32_KERNEL_UNKNOWN)
+        Kernel = RtlClipSelectCrc32Kernel();
+
+#ifdef CHECKSUM_HAVE_PCLMUL
+    if (Kernel == CRC32_KERNEL_PCLMUL && Length >= 64)
+    {
+        // Whole 16 byte blocks for the kernel, the tail goes to the fallback
+        ULONG Bulk = Length & ~15UL;
+
+        Crc = ~RtlClipCrc32Pclmul(~Crc, Data, Bulk);
+        Data += Bulk;
+        Length -= Bulk;
+    }
+#endif
+
+    if (Length)
+        Crc = RtlComputeCrc32(Crc, Data, Length);
+
+    return Crc;
+}
+
+/*++
+ * @name RtlCliCrc32KernelName
+ *
+ * The RtlCliCrc32KernelName routine names the CRC32 kernel in use.
+ *
+ * @param None.
+ *
+ * @return "pclmul" or "portable".
+ *
+ * @remarks None.
+ *
+ *--*/
+PCSTR
+RtlCliCrc32KernelName(VOID)
+{
+    LONG Kernel = Crc32Kernel;
+
+    if (Kernel == CRC32_KERNEL_UNKNOWN)
+        Kernel = RtlClipSelectCrc32Kernel();
+
+    return (Kernel == CRC32_KERNEL_PCLMUL) ? "pclmul" : "portable";
+}
+
+#define XXH_PRIME64_1 ((ULONGLONG)0x9E3779B185EBCA87)
+#define XXH_PRIME64_2 ((ULONGLONG)0xC2B2AE3D27D4EB4F)
+#define XXH_PRIME64_3 ((ULONGLONG)0x165667B19E3779F9)
+#define XXH_PRIME64_4 ((ULONGLONG)0x85EBCA77C2B2AE63)
+#define XXH_PRIME64_5 ((ULONGLONG)0x27D4EB2F165667C5)
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+#define ROTR32(x, r) (((x) >> (r)) | ((x) << (32 - (r))))
+
+// Little endian loads, x86 handles the misalignment
+#define READ64(p) (*(UNALIGNED ULONGLONG *)(p))
+#define READ32(p) (*(UNALIGNED ULONG *)(p))
+
+// One lane step of XXH64
+ULONGLONG
+RtlClipXxh64Round(IN ULONGLONG Accumulator, IN ULONGLONG Input)
+{
+    Accumulator += Input * XXH_PRIME64_2;
+    Accumulator = ROTL64(Accumulator, 31);
+    return Accumulator * XXH_PRIME64_1;
+}
+
+// Folds a lane into the final hash
+ULONGLONG
+RtlClipXxh64Merge(IN ULONGLONG Hash, IN ULONGLONG Accumulator)
+{
+    Hash ^= RtlClipXxh64Round(0, Accumulator);
+    return Hash * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/*++
+ * @name RtlClipXxh64Stripes
+ *
+ * The RtlClipXxh64Stripes routine runs the four XXH64 lanes over whole 32
+ * byte stripes.
+ *
+ * @param State
+ *        Hash state.
+ *
+ * @param Data
+ *        Data, a multiple of 32 bytes.
+ *
+ * @param Length
+ *        Size of the data.
+ *
+ * @return None.
+ *
+ * @remarks The lanes are independent, so the processor overlaps their
+ *          multiplications.
+ *
+ *--*/
+VOID
+RtlClipXxh64Stripes(IN OUT PCLI_XXH64_STATE State, IN const UCHAR *Data, IN ULONG Length)
+{
+    ULONGLONG V1 = State->Accumulators[0];
+    ULONGLONG V2 = State->Accumulators[1];
+    ULONGLONG V3 = State->Accumulators[2];
+    ULONGLONG V4 = State->Accumulators[3];
+    const UCHAR *End = Data + Length;
+
+    while (Data < End)
+    {
+        V1 = RtlClipXxh64Round(V1, READ64(Data));
+        V2 = RtlClipXxh64Round(V2, READ64(Data + 8));
+        V3 = RtlClipXxh64Round(V3, READ64(Data + 16));
+        V4 = RtlClipXxh64Round(V4, READ64(Data + 24));
+        Data += 32;
+    }
+
+    State->Accumulators[0] = V1;
+    State->Accumulators[1] = V2;
+    State->Accumulators[2] = V3;
+    State->Accumulators[3] = V4;
+}
+
+// XXH64 with seed 0, as printed by xxhsum
+VOID
+RtlCliXxh64Init(OUT PCLI_HASH_CONTEXT Context)
+{
+    PCLI_XXH64_STATE State = &Context->Xxh64;
+
+    // Seed 0
+    State->Total = 0;
+    State->Accumulators[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+    State->Accumulators[1] = XXH_PRIME64_2;
+    State->Accumulators[2] = 0;
+    State->Accumulators[3] = 0 - XXH_PRIME64_1;
+    State->BufferSize = 0;
+}
+
+VOID
+RtlCliXxh64Update(IN OUT PCLI_HASH_CONTEXT Context, IN PVOID Buffer, IN ULONG Length)
+{
+    PCLI_XXH64_STATE State = &Context->Xxh64;
+    const UCHAR *Data = Buffer;
+    ULONG Fill;
+
+    State->Total += Length;
+
+    // Complete a stripe left over from the last call
+    if (State->BufferSize)
+    {
+        Fill = min(32 - State->BufferSize, Length);
+        RtlCopyMemory(State->Buffer + State->BufferSize, Data, Fill);
+        State->BufferSize += Fill;
+        Data += Fill;
+        Length -= Fill;
+
+        if (State->BufferSize < 32)
+            return;
+
+        RtlClipXxh64Stripes(State, State->Buffer, 32);
+        State->BufferSize = 0;
+    }
+
+    RtlClipXxh64Stripes(State, Data, Length & ~31UL);
+    Data += Length & ~31UL;
+    Length &= 31;
+
+    RtlCopyMemory(State->Buffer, Data, Length);
+    State->BufferSize = Length;
+}
+
+VOID
+RtlCliXxh64Final(IN PCLI_HASH_CONTEXT Context, OUT PUCHAR Digest)
+{
+    PCLI_XXH64_STATE State = &Context->Xxh64;
+    const UCHAR *Data = State->Buffer;
+    ULONG Length = State->BufferSize;
+    ULONGLONG Hash;
+    ULONG i;
+
+    if (State->Total >= 32)
+    {
+        Hash = ROTL64(State->Accumulators[0], 1) + ROTL64(State->Accumulators[1], 7) +
+               ROTL64(State->Accumulators[2], 12) + ROTL64(State->Accumulators[3], 18);
+        for (i = 0; i < 4; i++)
+            Hash = RtlClipXxh64Merge(Hash, State->Accumulators[i]);
+    }
+    else
+    {
+        Hash = XXH_PRIME64_5;
+    }
+
+    Hash += State->Total;
+
+    for (; Length >= 8; Data += 8, Length -= 8)
+    {
+        Hash ^= RtlClipXxh64Round(0, READ64(Data));
+        Hash = ROTL64(Hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (Length >= 4)
+    {
+        Hash ^= (ULONGLONG)READ32(Data) * XXH_PRIME64_1;
+        Hash = ROTL64(Hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        Data += 4;
+        Length -= 4;
+    }
+    for (; Length; Data++, Length--)
+    {
+        Hash ^= *Data * XXH_PRIME64_5;
+        Hash = ROTL64(Hash, 11) * XXH_PRIME64_1;
+    }
+
+    Hash ^= Hash >> 33;
+    Hash *= XXH_PRIME64_2;
+    Hash ^= Hash >> 29;
+    Hash *= XXH_PRIME64_3;
+    Hash ^= Hash >> 32;
+
+    for (i = 0; i < 8; i++)
+        Digest[i] = (UCHAR)(Hash >> (56 - i * 8));
+}
+
+static const ULONG Sha256Constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+/*++
+ * @name RtlClipSha256Blocks
+ *
+ * The RtlClipSha256Blocks routine runs the SHA-256 compression function
+ * over whole 64 byte blocks.
+ *
+ * @param State
+ *        Hash state.
+ *
+ * @param Data
+ *        Data, a multiple of 64 bytes.
+ *
+ * @param Length
+ *        Size of the data.
+ *
+ * @return None.
+ *
+ * @remarks Portable C. The message schedule is kept in a 16 word ring.
+ *
+ *--*/
+VOID
+RtlClipSha256Blocks(IN OUT PCLI_SHA256_STATE State, IN const UCHAR *Data, IN ULONG Length)
+{
+    ULONG W[16];
+    ULONG A, B, C, D, E, F, G, H;
+    ULONG S0, S1, T1, T2;
+    ULONG i;
+
+    for (; Length >= 64; Data += 64, Length -= 64)
+    {
+        A = State->State[0];
+        B = State->State[1];
+        C = State->State[2];
+        D = State->State[3];
+        E = State->State[4];
+        F = State->State[5];
+        G = State->State[6];
+        H = State->State[7];
+
+        for (i = 0; i < 64; i++)
+        {
+            if (i < 16)
+            {
+                W[i] = ((ULONG)Data[i * 4] << 24) | ((ULONG)Data[i * 4 + 1] << 16) |
+                       ((ULONG)Data[i * 4 + 2] << 8) | Data[i * 4 + 3];
+            }
+            else
+            {
+                S0 = W[(i + 1) & 15];
+                S0 = ROTR32(S0, 7) ^ ROTR32(S0, 18) ^ (S0 >> 3);
+                S1 = W[(i + 14) & 15];
+                S1 = ROTR32(S1, 17) ^ ROTR32(S1, 19) ^ (S1 >> 10);
+                W[i & 15] += S0 + S1 + W[(i + 9) & 15];
+            }
+
+            T1 = H + (ROTR32(E, 6) ^ ROTR32(E, 11) ^ ROTR32(E, 25)) + ((E & F) ^ (~E & G)) +
+                 Sha256Constants[i] + W[i & 15];
+            T2 = (ROTR32(A, 2) ^ ROTR32(A, 13) ^ ROTR32(A, 22)) + ((A & B) ^ (A & C) ^ (B & C));
+
+            H = G;
+            G = F;
+            F = E;
+            E = D + T1;
+            D = C;
+            C = B;
+            B = A;
+            A = T1 + T2;
+        }
+
+        State->State[0] += A;
+        State->State[1] += B;
+        State->State[2] += C;
+        State->State[3] += D;
+        State->State[4] += E;
+        State->State[5] += F;
+        State->State[6] += G;
+        State->State[7] += H;
+    }
+}
+
+// SHA-256 (FIPS 180-4)
+VOID
+RtlCliSha256Init(OUT PCLI_HASH_CONTEXT Context)
+{
+    PCLI_SHA256_STATE State = &Context->Sha256;
+
+    State->State[0] = 0x6a09e667;
+    State->State[1] = 0xbb67ae85;
+    State->State[2] = 0x3c6ef372;
+    State->State[3] = 0xa54ff53a;
+    State->State[4] = 0x510e527f;
+    State->State[5] = 0x9b05688c;
+    State->State[6] = 0x1f83d9ab;
+    State->State[7] = 0x5be0cd19;
+    State->Total = 0;
+    State->BufferSize = 0;
+}
+
+VOID
+RtlCliSha256Update(IN OUT PCLI_HASH_CONTEXT Context, IN PVOID Buffer, IN ULONG Length)
+{
+    PCLI_SHA256_STATE State = &Context->Sha256;
+    const UCHAR *Data = Buffer;
+    ULONG Fill;
+
+    State->Total += Length;
+
+    if (State->BufferSize)
+    {
+        Fill = min(64 - State->BufferSize, Length);
+        RtlCopyMemory(State->Buffer + State->BufferSize, Data, Fill);
+        State->BufferSize += Fill;
+        Data += Fill;
+        Length -= Fill;
+
+        if (State->BufferSize < 64)
+            return;
+
+        RtlClipSha256Blocks(State, State->Buffer, 64);
+        State->BufferSize = 0;
+    }
+
+    RtlClipSha256Blocks(State, Data, Length & ~63UL);
+    Data += Length & ~63UL;
+    Length &= 63;
+
+    RtlCopyMemory(State->Buffer, Data, Length);
+    State->BufferSize = Length;
+}
+
+VOID
+RtlCliSha256Final(IN PCLI_HASH_CONTEXT Context, OUT PUCHAR Digest)
+{
+    PCLI_SHA256_STATE State = &Context->Sha256;
+    ULONGLONG Bits = State->Total * 8;
+    ULONG i;
+
+    // 0x80, zeros, then the length in bits, ending on a block boundary
+    State->Buffer[State->BufferSize++] = 0x80;
+    if (State->BufferSize > 56)
+    {
+        RtlZeroMemory(State->Buffer + State->BufferSize, 64 - State->BufferSize);
+        RtlClipSha256Blocks(State, State->Buffer, 64);
+        State->BufferSize = 0;
+    }
+    RtlZeroMemory(State->Buffer + State->BufferSize, 56 - State->BufferSize);
+
+    for (i = 0; i < 8; i++)
+        State->Buffer[56 + i] = (UCHAR)(Bits >> (56 - i * 8));
+
+    RtlClipSha256Blocks(State, State->Buffer, 64);
+
+    for (i = 0; i < 32; i++)
+        Digest[i] = (UCHAR)(State->State[i / 4] >> (24 - (i % 4) * 8));
+}
+
+// CRC32 through the hash interface
+VOID
+RtlCliCrc32Init(OUT PCLI_HASH_CONTEXT Context)
+{
+    Context->Crc32 = 0;
+}
+
+VOID
+RtlCliCrc32Update(IN OUT PCLI_HASH_CONTEXT Context, IN PVOID Buffer, IN ULONG Length)
+{
+    Context->Crc32 = RtlCliCrc32(Context->Crc32, Buffer, Length);
+}
+
+VOID
+RtlCliCrc32Final(IN PCLI_HASH_CONTEXT Context, OUT PUCHAR Digest)
+{
+    Digest[0] = (UCHAR)(Context->Crc32 >> 24);
+    Digest[1] = (UCHAR)(Context->Crc32 >> 16);
+    Digest[2] = (UCHAR)(Context->Crc32 >> 8);
+    Digest[3] = (UCHAR)Context->Crc32;
+}
+
+// Name, digest size, init, update, final, kernel name (NULL for portable C)
+CLI_HASH_ALGORITHM RtlCliHashAlgorithms[] = {
+    {"crc32", 4, RtlCliCrc32Init, RtlCliCrc32Update, RtlCliCrc32Final, RtlCliCrc32KernelName},
+    {"xxh64", 8, RtlCliXxh64Init, RtlCliXxh64Update, RtlCliXxh64Final, NULL},
+    {"sha256", 32, RtlCliSha256Init, RtlCliSha256Update, RtlCliSha256Final, NULL}};
+
+ULONG RtlCliHashAlgorithmCount = RTL_NUMBER_OF(RtlCliHashAlgorithms);
+
+/*++
+ * @name RtlCliFindHashAlgorithm
+ *
+ * The RtlCliFindHashAlgorithm routine looks up a hash algorithm by name.
+ *
+ * @param Name
+ *        Algorithm name, any case.
+ *
+ * @return The algorithm, or NULL if there is none by that name.
+ *
+ * @remarks None.
+ *
+ *--*/
+PCLI_HASH_ALGORITHM
+RtlCliFindHashAlgorithm(IN PCSTR Name)
+{
+    ULONG i;
+
+    for (i = 0; i < RtlCliHashAlgorithmCount; i++)
+    {
+        if (!_stricmp(Name, RtlCliHashAlgorithms[i].Name))
+            return &RtlCliHashAlgorithms[i];
+    }
+
+    return NULL;
+}
@@ -0,0 +1,998 @@
+/**
+ * PROJECT:         Native Shell
+ * COPYRIGHT:       LGPL; See LICENSE in the top level directory
+ * FILE:            compress.c
+ * DESCRIPTION:     Chunked parallel compression.
+ * DEVELOPERS:      See CONTRIBUTORS.md in the top level directory
+ */
+
+#include "precomp.h"
+#include "ntfile.h"
+
+#ifndef STATUS_BUFFER_ALL_ZEROS
+#define STATUS_BUFFER_ALL_ZEROS ((NTSTATUS)0x00000117L)
+#endif
+
+// Archive layout: ARCHIVE_HEADER, the chunks back to back, then the index
+// of ChunkCount ARCHIVE_CHUNK entries. Chunks are compressed on their own,
+// so any of them can be expanded without the ones before it.
+#define ARCHIVE_SIGNATURE 0x315A434E // "NCZ1"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_FORMAT_ZEROS 0xFFFF // chunk of zeros, nothing is stored
+#define ARCHIVE_PAGE_SIZE 4096
+
+typedef struct _ARCHIVE_HEADER
+{
+    ULONG Signature;
+    USHORT Version;
+    USHORT Format;         // format the chunks were compressed with
+    ULONG ChunkSize;       // uncompressed size of every chunk but the last
+    ULONG ChunkCount;
+    LONGLONG OriginalSize;
+    LONGLONG IndexOffset;
+} ARCHIVE_HEADER, *PARCHIVE_HEADER;
+
+typedef struct _ARCHIVE_CHUNK
+{
+    LONGLONG Offset; // of the stored bytes in the archive
+    ULONG Length;    // stored bytes
+    ULONG Crc;       // CRC32 of the uncompressed data
+    USHORT Format;   // COMPRESSION_FORMAT_NONE if stored as is, or ARCHIVE_FORMAT_ZEROS
+    USHORT Reserved[3];
+} ARCHIVE_CHUNK, *PARCHIVE_CHUNK;
+
+C_ASSERT(sizeof(ARCHIVE_HEADER) == 32);
+C_ASSERT(sizeof(ARCHIVE_CHUNK) == 24);
+
+struct _ARCHIVE_BATCH;
+
+// One chunk on its way through a pool thread
+typedef struct _ARCHIVE_JOB
+{
+    struct _ARCHIVE_BATCH *Batch;
+    PUCHAR Plain;     // ChunkSize bytes, uncompressed data
+    PUCHAR Packed;    // ChunkSize bytes, compressed data
+    PVOID WorkSpace;  // compression only
+    ULONG Chunk;
+    ULONG PlainLength;
+    ULONG PackedLength;
+    USHORT Format;
+    ULONG Crc;
+    NTSTATUS Status;
+} ARCHIVE_JOB, *PARCHIVE_JOB;
+
+// Chunks handed to the pool together, and written out together
+typedef struct _ARCHIVE_BATCH
+{
+    struct _ARCHIVE_CONTEXT *Context;
+    HANDLE DoneEvent;
+    LONG Remaining;
+    ULONG Count;
+    ARCHIVE_JOB Jobs[CLI_POOL_MAX_THREADS];
+} ARCHIVE_BATCH, *PARCHIVE_BATCH;
+
+typedef struct _ARCHIVE_CONTEXT
+{
+    CLI_THREAD_POOL Pool;
+    HANDLE hInput;
+    HANDLE hOutput;
+    ARCHIVE_HEADER Header;
+    PARCHIVE_CHUNK Index;
+    ULONG NextChunk;     // next chunk to read
+    ULONG EndChunk;      // one past the last chunk to process
+    LONGLONG NextOffset; // where the next chunk is written in the archive
+    LONGLONG RangeStart; // bytes to expand
+    LONGLONG RangeEnd;
+    LONGLONG PackedBytes;
+    ULONG BatchSize;
+    PVOID Buffers;
+    ARCHIVE_BATCH Batches[2];
+} ARCHIVE_CONTEXT, *PARCHIVE_CONTEXT;
+
+typedef NTSTATUS (*PARCHIVE_STAGE)(IN PARCHIVE_CONTEXT Context, IN PARCHIVE_BATCH Batch);
+
+/*++
+ * @name RtlClipArchiveIo
+ *
+ * The RtlClipArchiveIo routine reads or writes a whole buffer at an
+ * offset.
+ *
+ * @param hFile
+ *        Synchronous handle.
+ *
+ * @param Write
+ *        TRUE to write, FALSE to read.
+ *
+ * @param Buffer
+ *        Data.
+ *
+ * @param Length
+ *        Bytes to move.
+ *
+ * @param Offset
+ *        File offset.
+ *
+ * @return STATUS_SUCCESS, STATUS_END_OF_FILE if a read came back short,
+ *         or the failing status.
+ *
+ * @remarks None.
+ *
+ *--*/
+NTSTATUS
+RtlClipArchiveIo(IN HANDLE hFile, IN BOOLEAN Write, IN PVOID Buffer, IN ULONG Length, IN LONGLONG Offset)
+{
+    IO_STATUS_BLOCK IoStatus;
+    LARGE_INTEGER ByteOffset;
+    NTSTATUS Status;
+
+    if (Length == 0)
+        return STATUS_SUCCESS;
+
+    ByteOffset.QuadPart = Offset;
+    memset(&IoStatus, 0, sizeof(IO_STATUS_BLOCK));
+
+    if (Write)
+        Status = NtWriteFile(hFile, NULL, NULL, NULL, &IoStatus, Buffer, Length, &ByteOffset, NULL);
+    else
+        Status = NtReadFile(hFile, NULL, NULL, NULL, &IoStatus, Buffer, Length, &ByteOffset, NULL);
+
+    if (NT_SUCCESS(Status) && IoStatus.Information != Length)
+        Status = Write ? STATUS_DISK_FULL : STATUS_END_OF_FILE;
+
+    return Status;
+}
+
+/*++
+ * @name RtlClipArchiveJobDone
+ *
+ * The RtlClipArchiveJobDone routine signals the batch of a job once its
+ * last job is done.
+ *
+ * @param Job
+ *        Job that just ran.
+ *
+ * @return None.
+ *
+ * @remarks Called last by every worker, the job must not be touched
+ *          afterwards.
+ *
+ *--*/
+VOID
+RtlClipArchiveJobDone(IN PARCHIVE_JOB Job)
+{
+    PARCHIVE_BATCH Batch = Job->Batch;
+
+    if (InterlockedDecrement(&Batch->Remaining) == 0)
+        NtSetEvent(Batch->DoneEvent, NULL);
+}
+
+/*++
+ * @name RtlClipCompressWorker
+ *
+ * The RtlClipCompressWorker routine compresses one chunk on a pool
+ * thread.
+ *
+ * @param Parameter
+ *        The ARCHIVE_JOB.
+ *
+ * @return None.
+ *
+ * @remarks Chunks that don't get smaller are stored as they are, and
+ *          chunks of zeros are not stored at all.
+ *
+ *--*/
+VOID
+RtlClipCompressWorker(IN PVOID Parameter)
+{
+    PARCHIVE_JOB Job = Parameter;
+    USHORT Format = Job->Batch->Context->Header.Format;
+    ULONG Length = 0;
+    NTSTATUS Status;
+
+    Job->Crc = RtlCliCrc32(0, Job->Plain, Job->PlainLength);
+    Job->Status = STATUS_SUCCESS;
+
+    Status = RtlCompressBuffer(Format | COMPRESSION_ENGINE_STANDARD,
+                               Job->Plain,
+                               Job->PlainLength,
+                               Job->Packed,
+                               Job->PlainLength,
+                               ARCHIVE_PAGE_SIZE,
+                               &Length,
+                               Job->WorkSpace);
+
+    if (Status == STATUS_BUFFER_ALL_ZEROS)
+    {
+        Job->Format = ARCHIVE_FORMAT_ZEROS;
+        Job->PackedLength = 0;
+    }
+    else if (NT_SUCCESS(Status) && Length < Job->PlainLength)
+    {
+        Job->Format = Format;
+        Job->PackedLength = Length;
+    }
+    else if (NT_SUCCESS(Status) || Status == STATUS_BUFFER_TOO_SMALL)
+    {
+        Job->Format = COMPRESSION_FORMAT_NONE;
+        Job->PackedLength = Job->PlainLength;
+    }
+    else
+    {
+        Job->Status = Status;
+    }
+
+    RtlClipArchiveJobDone(Job);
+}
+
+/*++
+ * @name RtlClipExpandWorker
+ *
+ * The RtlClipExpandWorker routine expands one chunk on a pool thread and
+ * checks it against its CRC.
+ *
+ * @param Parameter
+ *        The ARCHIVE_JOB.
+ *
+ * @return None.
+ *
+ * @remarks Stored chunks were read straight into the Plain buffer.
+ *
+ *--*/
+VOID
+RtlClipExpandWorker(IN PVOID Parameter)
+{
+    PARCHIVE_JOB Job = Parameter;
+    ULONG Length = 0;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (Job->Format == ARCHIVE_FORMAT_ZEROS)
+    {
+        RtlZeroMemory(Job->Plain, Job->PlainLength);
+    }
+    else if (Job->Format != COMPRESSION_FORMAT_NONE)
+    {
+        Status = RtlDecompressBuffer(Job->Format,
+                                     Job->Plain,
+                                     Job->PlainLength,
+                                     Job->Packed,
+                                     Job->PackedLength,
+                                     &Length);
+
+        if (NT_SUCCESS(Status) && Length != Job->PlainLength)
+            Status = STATUS_BAD_COMPRESSION_BUFFER;
+    }
+
+    if (NT_SUCCESS(Status) && RtlCliCrc32(0, Job->Plain, Job->PlainLength) != Job->Crc)
+        Status = STATUS_CRC_ERROR;
+
+    Job->Status = Status;
+
+    RtlClipArchiveJobDone(Job);
+}
+
+/*++
+ * @name RtlClipReadPlainBatch
+ *
+ * The RtlClipReadPlainBatch routine reads the next chunks of the file
+ * being compressed.
+ *
+ * @param Context
+ *        The archive context.
+ *
+ * @param Batch
+ *        Batch to fill.
+ *
+ * @return STATUS_SUCCESS or the failing status.
+ *
+ * @remarks None.
+ *
+ *--*/
+NTSTATUS
+RtlClipReadPlainBatch(IN PARCHIVE_CONTEXT Context, IN PARCHIVE_BATCH Batch)
+{
+    PARCHIVE_JOB Job;
+    LONGLONG Offset;
+    NTSTATUS Status;
+
+    while (Batch->Count < Context->BatchSize && Context->NextChunk < Context->EndChunk)
+    {
+        Job = &Batch->Jobs[Batch->Count];
+        Job->Chunk = Context->NextChunk;
+
+        Offset = (LONGLONG)Job->Chunk * Context->Header.ChunkSize;
+        Job->PlainLength = (ULONG)min(Context->Header.ChunkSize, Context->Header.OriginalSize - Offset);
+
+        Status = RtlClipArchiveIo(Context->hInput, FALSE, Job->Plain, Job->PlainLength, Offset);
+        if (!NT_SUCCESS(Status))
+            return Status;
+
+        Batch->Count++;
+        Context->NextChunk++;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*++
+ * @name RtlClipWritePackedBatch
+ *
+ * The RtlClipWritePackedBatch routine appends compressed chunks to the
+ * archive and records them in the index.
+ *
+ * @param Context
+ *        The archive context.
+ *
+ * @param Batch
+ *        Batch the pool is done with.
+ *
+ * @return STATUS_SUCCESS or the failing status.
+ *
+ * @remarks None.
+ *
+ *--*/
+NTSTATUS
+RtlClipWritePackedBatch(IN PARCHIVE_CONTEXT Context, IN PARCHIVE_BATCH Batch)
+{
+    PARCHIVE_CHUNK Entry;
+    PARCHIVE_JOB Job;
+    NTSTATUS Status;
+    ULONG i;
+
+    for (i = 0; i < Batch->Count; i++)
+    {
+        Job = &Batch->Jobs[i];
+        if (!NT_SUCCESS(Job->Status))
+            return Job->Status;
+
+        Status = RtlClipArchiveIo(Context->hOutput,
+                                  TRUE,
+                                  Job->Format == COMPRESSION_FORMAT_NONE ? Job->Plain : Job->Packed,
+                                  Job->PackedLength,
+                                  Context->NextOffset);
+        if (!NT_SUCCESS(Status))
+            return Status;
+
+        Entry = &Context->Index[Job->Chunk];
+        Entry->Offset = Context->NextOffset;
+        Entry->Length = Job->PackedLength;
+        Entry->Crc = Job->Crc;
+        Entry->Format = Job->Format;
+
+        Context->NextOffset += Job->PackedLength;
+        Context->PackedBytes += Job->PackedLength;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*++
+ * @name RtlClipReadPackedBatch
+ *
+ * The RtlClipReadPackedBatch routine reads the next chunks of the range
+ * being expanded.
+ *
+ * @param Context
+ *        The archive context.
+ *
+ * @param Batch
+ *        Batch to fill.
+ *
+ * @return STATUS_SUCCESS or the failing status.
+ *
+ * @remarks The index was checked when the archive was opened, so every
+ *          chunk fits its buffer.
+ *
+ *--*/
+NTSTATUS
+RtlClipReadPackedBatch(IN PARCHIVE_CONTEXT Context, IN PARCHIVE_BATCH Batch)
+{
+    PARCHIVE_CHUNK Entry;
+    PARCHIVE_JOB Job;
+    LONGLONG Offset;
+    NTSTATUS Status;
+
+    while (Batch->Count < Context->BatchSize && Context->NextChunk < Context->EndChunk)
+    {
+        Job = &Batch->Jobs[Batch->Count];
+        Job->Chunk = Context->NextChunk;
+        Entry = &Context->Index[Job->Chunk];
+
+        Offset = (LONGLONG)Job->Chunk * Context->Header.ChunkSize;
+        Job->PlainLength = (ULONG)min(Context->Header.ChunkSize, Context->Header.OriginalSize - Offset);
+        Job->PackedLength = Entry->Length;
+        Job->Format = Entry->Format;
+        Job->Crc = Entry->Crc;
+
+        Status = RtlClipArchiveIo(Context->hInput,
+                                  FALSE,
+                                  Job->Format == COMPRESSION_FORMAT_NONE ? Job->Plain : Job->Packed,
+                                  Job->PackedLength,
+                                  Entry->Offset);
+        if (!NT_SUCCESS(Status))
+            return Status;
+
+        Batch->Count++;
+        Context->NextChunk++;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*++
+ * @name RtlClipWritePlainBatch
+ *
+ * The RtlClipWritePlainBatch routine writes the part of the expanded
+ * chunks that falls in the requested range.
+ *
+ * @param Context
+ *        The archive context.
+ *
+ * @param Batch
+ *        Batch the pool is done with.
+ *
+ * @return STATUS_SUCCESS or the failing status.
+ *
+ * @remarks Only the first and the last chunk of the range are cut.
+ *
+ *--*/
+NTSTATUS
+RtlClipWritePlainBatch(IN PARCHIVE_CONTEXT Context, IN PARCHIVE_BATCH Batch)
+{
+    PARCHIVE_JOB Job;
+    LONGLONG ChunkStart, Start, End;
+    NTSTATUS Status;
+    ULONG i;
+
+    for (i = 0; i < Batch->Count; i++)
+    {
+        Job = &Batch->Jobs[i];
+        if (!NT_SUCCESS(Job->Status))
+        {
+            RtlCliDisplayString("Chunk %u is damaged (0x%.8X)\n", Job->Chunk, Job->Status);
+            return Job->Status;
+        }
+
+        ChunkStart = (LONGLONG)Job->Chunk * Context->Header.ChunkSize;
+        Start = max(Context->RangeStart, ChunkStart);
+        End = min(Context->RangeEnd, ChunkStart + Job->PlainLength);
+
+        Status = RtlClipArchiveIo(Context->hOutput,
+                                  TRUE,
+                                  Job->Plain + (Start - ChunkStart),
+                                  (ULONG)(End - Start),
+                                  Start - Context->RangeStart);
+        if (!NT_SUCCESS(Status))
+            return Status;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*++
+ * @name RtlClipQueueBatch
+ *
+ * The RtlClipQueueBatch routine hands every chunk of a batch to the pool.
+ *
+ * @param Context
+ *        The archive context.
+ *
+ * @param Batch
+ *        Filled batch.
+ *
+ * @param Worker
+ *        RtlClipCompressWorker or RtlClipExpandWorker.
+ *
+ * @return None.
+ *
+ * @remarks The batch event is set once the last chunk is done.
+ *
+ *--*/
+VOID
+RtlClipQueueBatch(IN PARCHIVE_CONTEXT Context, IN PARCHIVE_BATCH Batch, IN PCLI_WORK_ROUTINE Worker)
+{
+    ULONG i;
+
+    Batch->Remaining = Batch->Count;
+    NtResetEvent(Batch->DoneEvent, NULL);
+
+    for (i = 0; i < Batch->Count; i++)
+        RtlCliQueueWorkItem(&Context->Pool, Worker, &Batch->Jobs[i]);
+}
+
+/*++
+ * @name RtlClipRunArchive
+ *
+ * The RtlClipRunArchive routine pushes every chunk of an archive
+ * operation through the pool.
+ *
+ * @param Context
+ *        The archive context, with the pool and the batches set up.
+ *
+ * @param Read
+ *        Routine filling a batch.
+ *
+ * @param Worker
+ *        Routine run on the pool for each chunk.
+ *
+ * @param Write
+ *        Routine writing a batch the pool is done with.
+ *
+ * @return STATUS_SUCCESS or the first failing status.
+ *
+ * @remarks There are two batches. While the pool works on one, this
+ *          thread writes out the other and reads the next chunks into it,
+ *          so the disk and the processors are busy at the same time.
+ *          Batches are written in order, which keeps the archive in chunk
+ *          order. On failure the batch in flight is waited for before the
+ *          buffers can be released.
+ *
+ *--*/
+NTSTATUS
+RtlClipRunArchive(IN PARCHIVE_CONTEXT Context,
+                  IN PARCHIVE_STAGE Read,
+                  IN PCLI_WORK_ROUTINE Worker,
+                  IN PARCHIVE_STAGE Write)
+{
+    PARCHIVE_BATCH Current = &Context->Batches[0];
+    PARCHIVE_BATCH Next = &Context->Batches[1];
+    PARCHIVE_BATCH Swap;
+    NTSTATUS Status;
+
+    Current->Count = 0;
+    Status = Read(Context, Current);
+    if (NT_SUCCESS(Status) && Current->Count)
+        RtlClipQueueBatch(Context, Current, Worker);
+
+    while (NT_SUCCESS(Status) && Current->Count)
+    {
+        Next->Count = 0;
+        Status = Read(Context, Next);
+        if (NT_SUCCESS(Status) && Next->Count)
+            RtlClipQueueBatch(Context, Next, Worker);
+
+        NtWaitForSingleObject(Current->DoneEvent, FALSE, NULL);
+
+        if (NT_SUCCESS(Status))
+            Status = Write(Context, Current);
+
+        Swap = Current;
+        Current = Next;
+        Next = Swap;
+    }
+
+    RtlCliWaitThreadPool(&Context->Pool);
+
+    return Status;
+}
+
+/*++
+ * @name RtlClipCreateArchiveContext
+ *
+ * The RtlClipCreateArchiveContext routine allocates the context, the pool
+ * and the chunk buffers of an archive operation.
+ *
+ * @param ChunkSize
+ *        Uncompressed chunk size, a multiple of ARCHIVE_PAGE_SIZE.
+ *
+ * @param WorkSpaceSize
+ *        Compression work space per chunk, 0 to expand.
+ *
+ * @param ThreadCount
+ *        Number of pool threads.
+ *
+ * @param pContext
+ *        Receives the context.
+ *
+ * @return STATUS_SUCCESS or the failing status.
+ *
+ * @remarks Each batch has one chunk per thread. If that much memory can't
+ *          be committed, the batches get fewer chunks.
+ *
+ *--*/
+NTSTATUS
+RtlClipCreateArchiveContext(IN ULONG ChunkSize,
+                            IN ULONG WorkSpaceSize,
+                            IN ULONG ThreadCount,
+                            OUT PARCHIVE_CONTEXT *pContext)
+{
+    PARCHIVE_CONTEXT Context;
+    PARCHIVE_JOB Job;
+    PUCHAR Buffer;
+    ULONG JobSize, BufferSize;
+    NTSTATUS Status;
+    ULONG i, j;
+
+    ThreadCount = min(max(ThreadCount, 1), CLI_POOL_MAX_THREADS);
+    WorkSpaceSize = (WorkSpaceSize + ARCHIVE_PAGE_SIZE - 1) & ~(ULONG)(ARCHIVE_PAGE_SIZE - 1);
+    JobSize = 2 * ChunkSize + WorkSpaceSize;
+
+    // The pool is too large for the stack
+    Context = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(ARCHIVE_CONTEXT));
+    if (!Context)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    BufferSize = 2 * ThreadCount * JobSize;
+    Status = NtFileAllocateCopyBuffer(&Context->Buffers, &BufferSize);
+    Context->BatchSize = BufferSize / (2 * JobSize);
+    if (NT_SUCCESS(Status) && Context->BatchSize == 0)
+    {
+        NtFileFreeCopyBuffer(Context->Buffers);
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+    }
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Context);
+        return Status;
+    }
+
+    Buffer = Context->Buffers;
+    for (i = 0; i < 2; i++)
+    {
+        Context->Batches[i].Context = Context;
+
+        for (j = 0; j < Context->BatchSize; j++)
+        {
+            Job = &Context->Batches[i].Jobs[j];
+            Job->Batch = &Context->Batches[i];
+            Job->Plain = Buffer;
+            Job->Packed = Buffer + ChunkSize;
+            Job->WorkSpace = WorkSpaceSize ? Buffer + 2 * ChunkSize : NULL;
+            Buffer += JobSize;
+        }
+
+        if (NT_SUCCESS(Status))
+        {
+            Status = NtCreateEvent(&Context->Batches[i].DoneEvent, EVENT_ALL_ACCESS, NULL,
+                                   NotificationEvent, FALSE);
+        }
+    }
+
+    if (NT_SUCCESS(Status))
+        Status = RtlCliCreateThreadPool(&Context->Pool, ThreadCount);
+
+    if (!NT_SUCCESS(Status))
+    {
+        for (i = 0; i < 2; i++)
+        {
+            if (Context->Batches[i].DoneEvent)
+                NtClose(Context->Batches[i].DoneEvent);
+        }
+        NtFileFreeCopyBuffer(Context->Buffers);
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Context);
+        return Status;
+    }
+
+    *pContext = Context;
+    return STATUS_SUCCESS;
+}
+
+/*++
+ * @name RtlClipDestroyArchiveContext
+ *
+ * The RtlClipDestroyArchiveContext routine releases everything
+ * RtlClipCreateArchiveContext and the operation allocated.
+ *
+ * @param Context
+ *        The archive context.
+ *
+ * @return None.
+ *
+ * @remarks The handles and the index are closed and freed if set.
+ *
+ *--*/
+VOID
+RtlClipDestroyArchiveContext(IN PARCHIVE_CONTEXT Context)
+{
+    ULONG i;
+
+    RtlCliDestroyThreadPool(&Context->Pool);
+
+    for (i = 0; i < 2; i++)
+        NtClose(Context->Batches[i].DoneEvent);
+
+    if (Context->hInput)
+        NtFileCloseFile(Context->hInput);
+    if (Context->hOutput)
+        NtFileCloseFile(Context->hOutput);
+    if (Context->Index)
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Context->Index);
+
+    NtFileFreeCopyBuffer(Context->Buffers);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Context);
+}
+
+// Name of a compression format, for the summary lines
+PCSTR
+RtlClipCompressionFormatName(IN USHORT Format)
+{
+    return Format == COMPRESSION_FORMAT_XPRESS ? "XPRESS" : "LZNT1";
+}
+
+/*++
+ * @name RtlCliCompressFile
+ *
+ * The RtlCliCompressFile routine compresses a file into a chunked
+ * archive.
+ *
+ * @param Source
+ *        File to compress, full path in DOS format.
+ *
+ * @param Destination
+ *        Archive to create, full path in DOS format. It is overwritten.
+ *
+ * @param Format
+ *        COMPRESSION_FORMAT_LZNT1, COMPRESSION_FORMAT_XPRESS, or 0 for
+ *        XPRESS where the system has it and LZNT1 elsewhere.
+ *
+ * @param ChunkSize
+ *        Uncompressed chunk size, CLI_ARCHIVE_MIN_CHUNK to
+ *        CLI_ARCHIVE_MAX_CHUNK, rounded to a page.
+ *
+ * @param ThreadCount
+ *        Number of compression threads.
+ *
+ * @return STATUS_SUCCESS or the failing status.
+ *
+ * @remarks The chunks are compressed with RtlCompressBuffer on a pool of
+ *          threads and written in order, followed by an index of their
+ *          offsets, sizes and CRC32s. The header goes last, so an archive
+ *          cut short has no valid header. XPRESS needs Windows 8 or later
+ *          to compress and to expand.
+ *
+ *--*/
+NTSTATUS
+RtlCliCompressFile(IN PCWSTR Source,
+                   IN PCWSTR Destination,
+                   IN USHORT Format,
+                   IN ULONG ChunkSize,
+                   IN ULONG ThreadCount)
+{
+    PARCHIVE_CONTEXT Context;
+    LARGE_INTEGER StartTime, EndTime, Frequency;
+    ULONG WorkSpaceSize, FragmentSize, IndexSize;
+    LONGLONG FileSize;
+    HANDLE hFile;
+    NTSTATUS Status;
+
+    NtQueryPerformanceCounter(&StartTime, &Frequency);
+
+    ChunkSize = min(max(ChunkSize, CLI_ARCHIVE_MIN_CHUNK), CLI_ARCHIVE_MAX_CHUNK);
+    ChunkSize = (ChunkSize + ARCHIVE_PAGE_SIZE - 1) & ~(ULONG)(ARCHIVE_PAGE_SIZE - 1);
+
+    if (Format == 0)
+    {
+        Format = COMPRESSION_FORMAT_XPRESS;
+        if (!NT_SUCCESS(RtlGetCompressionWorkSpaceSize(Format | COMPRESSION_ENGINE_STANDARD,
+                                                       &WorkSpaceSize, &FragmentSize)))
+        {
+            Format = COMPRESSION_FORMAT_LZNT1;
+        }
+    }
+
+    Status = RtlGetCompressionWorkSpaceSize(Format | COMPRESSION_ENGINE_STANDARD, &WorkSpaceSize, &FragmentSize);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlCliDisplayString("%s is not supported here.\n", RtlClipCompressionFormatName(Format));
+        return Status;
+    }
+
+    if (!NtFileOpenFileForRead(&hFile, Source))
+        return STATUS_UNSUCCESSFUL;
+
+    if (!NtFileGetFileSize(hFile, &FileSize) ||
+        (FileSize + ChunkSize - 1) / ChunkSize > MAXULONG / sizeof(ARCHIVE_CHUNK))
+    {
+        RtlCliDisplayString("Can't get the size of the source, or it is too large.\n");
+        NtFileCloseFile(hFile);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    Status = RtlClipCreateArchiveContext(ChunkSize, WorkSpaceSize, ThreadCount, &Context);
+    if (!NT_SUCCESS(Status))
+    {
+        NtFileCloseFile(hFile);
+        return Status;
+    }
+
+    Context->hInput = hFile;
+    Context->Header.Signature = ARCHIVE_SIGNATURE;
+    Context->Header.Version = ARCHIVE_VERSION;
+    Context->Header.Format = Format;
+    Context->Header.ChunkSize = ChunkSize;
+    Context->Header.ChunkCount = (ULONG)((FileSize + ChunkSize - 1) / ChunkSize);
+    Context->Header.OriginalSize = FileSize;
+    Context->EndChunk = Context->Header.ChunkCount;
+    Context->NextOffset = sizeof(ARCHIVE_HEADER);
+
+    IndexSize = Context->Header.ChunkCount * sizeof(ARCHIVE_CHUNK);
+    Context->Index = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, max(IndexSize, 1));
+    if (!Context->Index)
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+    else if (!NtFileOpenFile(&Context->hOutput, (PWSTR)Destination, TRUE, TRUE))
+        Status = STATUS_UNSUCCESSFUL;
+
+    if (NT_SUCCESS(Status))
+    {
+        Status = RtlClipRunArchive(Context, RtlClipReadPlainBatch, RtlClipCompressWorker, RtlClipWritePackedBatch);
+    }
+
+    if (NT_SUCCESS(Status))
+    {
+        Context->Header.IndexOffset = Context->NextOffset;
+        Status = RtlClipArchiveIo(Context->hOutput, TRUE, Context->Index, IndexSize, Context->NextOffset);
+    }
+
+    if (NT_SUCCESS(Status))
+    {
+        Status = RtlClipArchiveIo(Context->hOutput, TRUE, &Context->Header, sizeof(ARCHIVE_HEADER), 0);
+    }
+
+    NtQueryPerformanceCounter(&EndTime, NULL);
+
+    if (NT_SUCCESS(Status))
+    {
+        RtlCliDisplayThroughput(FileSize, EndTime.QuadPart - StartTime.QuadPart, Frequency.QuadPart);
+        RtlCliDisplayString(" -> %I64u bytes (%u%%), %u chunks of %u KB, %u threads, %s\n",
+                            Context->Header.IndexOffset + IndexSize,
+                            FileSize ? (ULONG)(Context->PackedBytes * 100 / FileSize) : 0,
+                            Context->Header.ChunkCount,
+                            ChunkSize / 1024,
+                            Context->Pool.ThreadCount,
+                            RtlClipCompressionFormatName(Format));
+    }
+
+    RtlClipDestroyArchiveContext(Context);
+
+    return Status;
+}
+
+/*++
+ * @name RtlCliExpandFile
+ *
+ * The RtlCliExpandFile routine expands a byte range of an archive made by
+ * RtlCliCompressFile.
+ *
+ * @param Source
+ *        Archive, full path in DOS format.
+ *
+ * @param Destination
+ *        File to create, full path in DOS format. It is overwritten.
+ *
+ * @param Offset
+ *        First byte of the original file to expand.
+ *
+ * @param Length
+ *        Number of bytes to expand, -1 for everything after Offset.
+ *
+ * @param ThreadCount
+ *        Number of expansion threads.
+ *
+ * @return STATUS_SUCCESS, STATUS_FILE_CORRUPT_ERROR if the archive is not
+ *         valid, or the failing status.
+ *
+ * @remarks Only the chunks covering the range are read, found through
+ *          the index, and each is checked against its CRC32 once
+ *          expanded.
+ *
+ *--*/
+NTSTATUS
+RtlCliExpandFile(IN PCWSTR Source,
+                 IN PCWSTR Destination,
+                 IN LONGLONG Offset,
+                 IN LONGLONG Length,
+                 IN ULONG ThreadCount)
+{
+    PARCHIVE_CONTEXT Context;
+    ARCHIVE_HEADER Header;
+    PARCHIVE_CHUNK Entry;
+    LARGE_INTEGER StartTime, EndTime, Frequency;
+    LONGLONG FileSize;
+    ULONG IndexSize;
+    ULONG FirstChunk = 0;
+    HANDLE hFile;
+    NTSTATUS Status;
+    ULONG i;
+
+    NtQueryPerformanceCounter(&StartTime, &Frequency);
+
+    if (!NtFileOpenFileForRead(&hFile, Source))
+        return STATUS_UNSUCCESSFUL;
+
+    Status = RtlClipArchiveIo(hFile, FALSE, &Header, sizeof(ARCHIVE_HEADER), 0);
+
+    if (!NT_SUCCESS(Status) ||
+        !NtFileGetFileSize(hFile, &FileSize) ||
+        Header.Signature != ARCHIVE_SIGNATURE ||
+        Header.Version != ARCHIVE_VERSION ||
+        Header.ChunkSize < CLI_ARCHIVE_MIN_CHUNK ||
+        Header.ChunkSize > CLI_ARCHIVE_MAX_CHUNK ||
+        Header.ChunkSize % ARCHIVE_PAGE_SIZE ||
+        Header.OriginalSize < 0 ||
+        Header.ChunkCount != Header.OriginalSize / Header.ChunkSize + (Header.OriginalSize % Header.ChunkSize != 0) ||
+        Header.ChunkCount > MAXULONG / sizeof(ARCHIVE_CHUNK) ||
+        Header.IndexOffset < sizeof(ARCHIVE_HEADER) ||
+        Header.IndexOffset > FileSize ||
+        Header.IndexOffset + Header.ChunkCount * sizeof(ARCHIVE_CHUNK) != FileSize)
+    {
+        RtlCliDisplayString("Not an archive, or a damaged one.\n");
+        NtFileCloseFile(hFile);
+        return STATUS_FILE_CORRUPT_ERROR;
+    }
+
+    if (Offset < 0 || Offset > Header.OriginalSize)
+    {
+        RtlCliDisplayString("The offset is past the end, the file has %I64u bytes.\n", Header.OriginalSize);
+        NtFileCloseFile(hFile);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (Length < 0 || Length > Header.OriginalSize - Offset)
+        Length = Header.OriginalSize - Offset;
+
+    Status = RtlClipCreateArchiveContext(Header.ChunkSize, 0, ThreadCount, &Context);
+    if (!NT_SUCCESS(Status))
+    {
+        NtFileCloseFile(hFile);
+        return Status;
+    }
+
+    Context->hInput = hFile;
+    Context->Header = Header;
+    Context->RangeStart = Offset;
+    Context->RangeEnd = Offset + Length;
+
+    if (Length)
+    {
+        FirstChunk = (ULONG)(Offset / Header.ChunkSize);
+        Context->NextChunk = FirstChunk;
+        Context->EndChunk = (ULONG)((Offset + Length - 1) / Header.ChunkSize) + 1;
+    }
+
+    IndexSize = Header.ChunkCount * sizeof(ARCHIVE_CHUNK);
+    Context->Index = RtlAllocateHeap(RtlGetProcessHeap(), 0, max(IndexSize, 1));
+    if (!Context->Index)
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+    else
+        Status = RtlClipArchiveIo(hFile, FALSE, Context->Index, IndexSize, Header.IndexOffset);
+
+    // Every chunk read must fit its buffer and lie between the header and the index
+    for (i = 0; NT_SUCCESS(Status) && i < Header.ChunkCount; i++)
+    {
+        Entry = &Context->Index[i];
+
+        if (Entry->Offset < sizeof(ARCHIVE_HEADER) ||
+            Entry->Offset > Header.IndexOffset ||
+            Entry->Length > Header.ChunkSize ||
+            Entry->Offset + Entry->Length > Header.IndexOffset ||
+            (Entry->Format == COMPRESSION_FORMAT_NONE &&
+             Entry->Length != min(Header.ChunkSize, Header.OriginalSize - (LONGLONG)i * Header.ChunkSize)))
+        {
+            RtlCliDisplayString("The index of the archive is damaged at chunk %u.\n", i);
+            Status = STATUS_FILE_CORRUPT_ERROR;
+        }
+    }
+
+    if (NT_SUCCESS(Status) && !NtFileOpenFile(&Context->hOutput, (PWSTR)Destination, TRUE, TRUE))
+        Status = STATUS_UNSUCCESSFUL;
+
+    if (NT_SUCCESS(Status))
+    {
+        Status = RtlClipRunArchive(Context, RtlClipReadPackedBatch, RtlClipExpandWorker, RtlClipWritePlainBatch);
+    }
+
+    NtQueryPerformanceCounter(&EndTime, NULL);
+
+    if (NT_SUCCESS(Status))
+    {
+        RtlCliDisplayThroughput(Length, EndTime.QuadPart - StartTime.QuadPart, Frequency.QuadPart);
+        RtlCliDisplayString(" from %u of %u chunks, %u threads, %s\n",
+                            Context->EndChunk - FirstChunk,
+                            Header.ChunkCount,
+                            Context->Pool.ThreadCount,
+                            RtlClipCompressionFormatName(Header.Format));
+    }
+
+    RtlClipDestroyArchiveContext(Context);
+
+    return Status;
+}
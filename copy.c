@@ -0,0 +1,2200 @@
+/**
+ * PROJECT:         Native Shell
+ * COPYRIGHT:       LGPL; See LICENSE in the top level directory
+ * FILE:            copy.c
+ * DESCRIPTION:     File copy engine.
+ * DEVELOPERS:      See CONTRIBUTORS.md in the top level directory
+ */
+
+#include "precomp.h"
+#include "ntfile.h"
+
+#define COPY_MIN_BUFFER (1024 * 1024)
+#define COPY_MAX_BUFFER (16 * 1024 * 1024)
+#define COPY_FALLBACK_BUFFER (64 * 1024)
+#define COPY_MAX_CHUNK (64 * 1024 * 1024)
+#define COPY_PAGE_SIZE 4096
+#define COPY_MAP_THRESHOLD (64 * 1024 * 1024)
+#define COPY_MAP_WINDOW (16 * 1024 * 1024)
+#define COPY_SPARSE_RANGES 64
+#define COPY_PROGRESS_SECONDS 5
+
+// Unbuffered transfers are padded to this, a multiple of every sector size
+#define COPY_ALIGN(x) (((x) + COPY_PAGE_SIZE - 1) & ~(ULONG)(COPY_PAGE_SIZE - 1))
+
+// Sparse file controls, not in the headers this tree includes
+#ifndef FSCTL_SET_SPARSE
+#define FSCTL_SET_SPARSE CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 49, METHOD_BUFFERED, FILE_SPECIAL_ACCESS)
+#define FSCTL_QUERY_ALLOCATED_RANGES CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 51, METHOD_NEITHER, FILE_READ_DATA)
+
+typedef struct _FILE_ALLOCATED_RANGE_BUFFER
+{
+    LARGE_INTEGER FileOffset;
+    LARGE_INTEGER Length;
+} FILE_ALLOCATED_RANGE_BUFFER, *PFILE_ALLOCATED_RANGE_BUFFER;
+#endif
+
+/*++
+ * @name NtFileCopyBufferSize
+ *
+ * The NtFileCopyBufferSize routine picks the transfer size for a copy.
+ *
+ * @param FileSize
+ *        Size of the source file.
+ *
+ * @return Buffer size in bytes.
+ *
+ * @remarks Large files are copied in about 64 transfers of 1 to 16 MB,
+ *          rounded to whole megabytes. Files below 1 MB get a buffer that
+ *          holds them completely so they are copied with one read.
+ *
+ *--*/
+ULONG
+NtFileCopyBufferSize(IN LONGLONG FileSize)
+{
+    LONGLONG Size = FileSize / 64;
+
+    if (FileSize < COPY_MIN_BUFFER)
+    {
+        Size = (FileSize + COPY_PAGE_SIZE - 1) & ~(LONGLONG)(COPY_PAGE_SIZE - 1);
+        return Size ? (ULONG)Size : COPY_PAGE_SIZE;
+    }
+
+    if (Size <= COPY_MIN_BUFFER)
+        return COPY_MIN_BUFFER;
+
+    if (Size >= COPY_MAX_BUFFER)
+        return COPY_MAX_BUFFER;
+
+    return (ULONG)((Size + COPY_MIN_BUFFER - 1) & ~(LONGLONG)(COPY_MIN_BUFFER - 1));
+}
+
+/*++
+ * @name NtFileAllocateCopyBuffer
+ *
+ * The NtFileAllocateCopyBuffer routine allocates a page aligned transfer
+ * buffer.
+ *
+ * @param Buffer
+ *        Receives the buffer.
+ *
+ * @param Size
+ *        Requested size on input, allocated size on output.
+ *
+ * @return STATUS_SUCCESS or the status of the last allocation attempt.
+ *
+ * @remarks If the requested size can't be committed the size is halved,
+ *          down to 64 KB, before giving up.
+ *
+ *--*/
+NTSTATUS
+NtFileAllocateCopyBuffer(OUT PVOID *Buffer, IN OUT PULONG Size)
+{
+    NTSTATUS Status;
+    SIZE_T RegionSize;
+
+    for (;;)
+    {
+        *Buffer = NULL;
+        RegionSize = *Size;
+
+        Status = NtAllocateVirtualMemory(NtCurrentProcess(),
+                                         Buffer,
+                                         0,
+                                         &RegionSize,
+                                         MEM_RESERVE | MEM_COMMIT,
+                                         PAGE_READWRITE);
+
+        if (NT_SUCCESS(Status) || *Size <= COPY_FALLBACK_BUFFER)
+            return Status;
+
+        *Size /= 2;
+    }
+}
+
+/*++
+ * @name NtFileFreeCopyBuffer
+ *
+ * The NtFileFreeCopyBuffer routine releases a buffer allocated by
+ * NtFileAllocateCopyBuffer.
+ *
+ * @param Buffer
+ *        Buffer to release.
+ *
+ * @return None.
+ *
+ * @remarks None.
+ *
+ *--*/
+VOID
+NtFileFreeCopyBuffer(IN PVOID Buffer)
+{
+    SIZE_T RegionSize = 0;
+
+    NtFreeVirtualMemory(NtCurrentProcess(), &Buffer, &RegionSize, MEM_RELEASE);
+}
+
+/*++
+ * @name NtFileOpenCopyHandle
+ *
+ * The NtFileOpenCopyHandle routine opens the source or destination of a
+ * copy.
+ *
+ * @param phRetFile
+ *        Receives the file handle.
+ *
+ * @param pwszFileName
+ *        Full path in DOS format.
+ *
+ * @param bWrite
+ *        TRUE to create or overwrite the destination, FALSE to open the
+ *        source for reading.
+ *
+ * @param bAsync
+ *        TRUE to open the file for overlapped I/O with explicit offsets.
+ *
+ * @param ExtraOptions
+ *        More create options, such as FILE_NO_INTERMEDIATE_BUFFERING.
+ *
+ * @return STATUS_SUCCESS, STATUS_NAME_TOO_LONG or the status of
+ *         NtCreateFile.
+ *
+ * @remarks The source is opened read-only and shared for reading, so
+ *          read-only files and files other readers hold open can be copied.
+ *
+ *--*/
+NTSTATUS
+NtFileOpenCopyHandle(OUT PHANDLE phRetFile,
+                     IN PCWSTR pwszFileName,
+                     IN BOOLEAN bWrite,
+                     IN BOOLEAN bAsync,
+                     IN ULONG ExtraOptions)
+{
+    UNICODE_STRING ustrFileName;
+    IO_STATUS_BLOCK IoStatusBlock;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    WCHAR wszFileName[1024] = L"\\??\\";
+    ULONG CreateOptions = FILE_NON_DIRECTORY_FILE | FILE_SEQUENTIAL_ONLY | ExtraOptions;
+    NTSTATUS ntStatus;
+
+    ntStatus = NtFileAppendPath(wszFileName, RTL_NUMBER_OF(wszFileName), pwszFileName);
+    if (!NT_SUCCESS(ntStatus))
+    {
+        RtlCliDisplayString("Path too long: %S\n", pwszFileName);
+        return ntStatus;
+    }
+
+    RtlInitUnicodeString(&ustrFileName, wszFileName);
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &ustrFileName,
+                               OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+
+    if (!bAsync)
+    {
+        CreateOptions |= FILE_SYNCHRONOUS_IO_NONALERT;
+    }
+
+    ntStatus = NtCreateFile(phRetFile,
+                            (bWrite ? GENERIC_WRITE : GENERIC_READ) | SYNCHRONIZE,
+                            &ObjectAttributes,
+                            &IoStatusBlock,
+                            NULL,
+                            FILE_ATTRIBUTE_NORMAL,
+                            bWrite ? 0 : FILE_SHARE_READ,
+                            bWrite ? FILE_OVERWRITE_IF : FILE_OPEN,
+                            CreateOptions,
+                            NULL,
+                            0);
+
+    if (!NT_SUCCESS(ntStatus))
+    {
+        RtlCliDisplayString("NtCreateFile() failed 0x%.8X\n", ntStatus);
+    }
+
+    return ntStatus;
+}
+
+/*++
+ * @name NtFileCopySynchronous
+ *
+ * The NtFileCopySynchronous routine copies between two synchronous handles
+ * through one transfer buffer.
+ *
+ * @param hSrc
+ *        Source handle.
+ *
+ * @param hDst
+ *        Destination handle.
+ *
+ * @param pChunkSize
+ *        Transfer size. Receives the size actually used.
+ *
+ * @param pBytesCopied
+ *        Receives the number of bytes written.
+ *
+ * @param pCrc
+ *        Optional, receives the CRC32 of the data copied.
+ *
+ * @param Unbuffered
+ *        TRUE if the destination was opened with
+ *        FILE_NO_INTERMEDIATE_BUFFERING.
+ *
+ * @return TRUE if the whole file was copied, FALSE otherwise.
+ *
+ * @remarks The copy stops at end of file rather than at the size seen when
+ *          the source was opened. The CRC is computed on each chunk while
+ *          it is in the transfer buffer. Unbuffered, the last chunk is
+ *          written with zeros up to COPY_PAGE_SIZE, which the caller trims
+ *          off with the end of file.
+ *
+ *--*/
+BOOLEAN
+NtFileCopySynchronous(IN HANDLE hSrc,
+                      IN HANDLE hDst,
+                      IN OUT PULONG pChunkSize,
+                      OUT PLONGLONG pBytesCopied,
+                      OUT PULONG pCrc,
+                      IN BOOLEAN Unbuffered)
+{
+    PVOID Buffer = NULL;
+    ULONG ChunkSize = *pChunkSize;
+    IO_STATUS_BLOCK sIoStatus;
+    ULONG dwReadSize, dwWriteSize;
+    NTSTATUS ntStatus;
+
+    *pBytesCopied = 0;
+    if (pCrc)
+        *pCrc = 0;
+
+    if (!NT_SUCCESS(NtFileAllocateCopyBuffer(&Buffer, &ChunkSize)))
+    {
+        RtlCliDisplayString("Out of memory for the copy buffer.\n");
+        return FALSE;
+    }
+    *pChunkSize = ChunkSize;
+
+    while (1)
+    {
+        memset(&sIoStatus, 0, sizeof(IO_STATUS_BLOCK));
+
+        ntStatus = NtReadFile(hSrc, NULL, NULL, NULL, &sIoStatus, Buffer, ChunkSize, NULL, NULL);
+        if (ntStatus == STATUS_END_OF_FILE)
+        {
+            break;
+        }
+        if (!NT_SUCCESS(ntStatus))
+        {
+            RtlCliDisplayString("NtReadFile() failed 0x%.8X\n", ntStatus);
+            NtFileFreeCopyBuffer(Buffer);
+            return FALSE;
+        }
+
+        dwReadSize = sIoStatus.Information & MAXULONG;
+        if (dwReadSize == 0)
+        {
+            break;
+        }
+
+        if (pCrc)
+        {
+            *pCrc = RtlCliCrc32(*pCrc, Buffer, dwReadSize);
+        }
+
+        dwWriteSize = dwReadSize;
+        if (Unbuffered)
+        {
+            dwWriteSize = COPY_ALIGN(dwReadSize);
+            memset((PUCHAR)Buffer + dwReadSize, 0, dwWriteSize - dwReadSize);
+        }
+
+        memset(&sIoStatus, 0, sizeof(IO_STATUS_BLOCK));
+
+        ntStatus = NtWriteFile(hDst, NULL, NULL, NULL, &sIoStatus, Buffer, dwWriteSize, NULL, NULL);
+        if (!NT_SUCCESS(ntStatus) || sIoStatus.Information != dwWriteSize)
+        {
+            RtlCliDisplayString("NtWriteFile() failed 0x%.8X\n", ntStatus);
+            NtFileFreeCopyBuffer(Buffer);
+            return FALSE;
+        }
+
+        *pBytesCopied += dwReadSize;
+    }
+
+    NtFileFreeCopyBuffer(Buffer);
+    return TRUE;
+}
+
+// One transfer of the overlapped copy, either reading or writing its chunk
+typedef struct _COPY_SLOT
+{
+    HANDLE Event;
+    IO_STATUS_BLOCK IoStatus;
+    LARGE_INTEGER Offset;
+    PUCHAR Buffer;
+    ULONG Length;
+    ULONG Padding; // zeros written after the data, for unbuffered writes
+    BOOLEAN Busy;
+    BOOLEAN Writing;
+    BOOLEAN Parked; // written, waiting to be reused
+    BOOLEAN Hashed;
+} COPY_SLOT, *PCOPY_SLOT;
+
+/*++
+ * @name NtFileStartCopyIo
+ *
+ * The NtFileStartCopyIo routine starts the read or write of a slot.
+ *
+ * @param hFile
+ *        Handle opened for overlapped I/O.
+ *
+ * @param Slot
+ *        Slot with its offset, buffer and length set.
+ *
+ * @param Write
+ *        TRUE to write Slot->Length + Slot->Padding bytes, FALSE to read
+ *        a chunk.
+ *
+ * @return None.
+ *
+ * @remarks The slot event is always signaled when the request is done. If
+ *          the request fails before being queued, the failure is stored in
+ *          the slot and the event is set here, so the caller handles every
+ *          completion in one place.
+ *
+ *--*/
+VOID
+NtFileStartCopyIo(IN HANDLE hFile, IN OUT PCOPY_SLOT Slot, IN BOOLEAN Write)
+{
+    NTSTATUS Status;
+
+    Slot->Busy = TRUE;
+    Slot->Writing = Write;
+    memset(&Slot->IoStatus, 0, sizeof(IO_STATUS_BLOCK));
+
+    if (Write)
+    {
+        Status = NtWriteFile(hFile, Slot->Event, NULL, NULL, &Slot->IoStatus,
+                             Slot->Buffer, Slot->Length + Slot->Padding, &Slot->Offset, NULL);
+    }
+    else
+    {
+        Status = NtReadFile(hFile, Slot->Event, NULL, NULL, &Slot->IoStatus,
+                            Slot->Buffer, Slot->Length, &Slot->Offset, NULL);
+    }
+
+    if (!NT_SUCCESS(Status))
+    {
+        Slot->IoStatus.Status = Status;
+        Slot->IoStatus.Information = 0;
+        NtSetEvent(Slot->Event, NULL);
+    }
+}
+
+/*++
+ * @name NtFileHashCopySlots
+ *
+ * The NtFileHashCopySlots routine adds the chunks that are next in file
+ * order to the CRC of an overlapped copy.
+ *
+ * @param Slots
+ *        Slots of the copy.
+ *
+ * @param QueueDepth
+ *        Number of slots.
+ *
+ * @param HashOffset
+ *        Offset of the first chunk not hashed yet, updated.
+ *
+ * @param pCrc
+ *        CRC of the data before HashOffset, updated.
+ *
+ * @return None.
+ *
+ * @remarks A chunk is in its buffer from the end of its read until the
+ *          slot is reused, whether the write is still running or not.
+ *          Reads complete in any order, so a chunk is only hashed once
+ *          every chunk before it has been.
+ *
+ *--*/
+VOID
+NtFileHashCopySlots(IN PCOPY_SLOT Slots, IN ULONG QueueDepth, IN OUT PLONGLONG HashOffset, IN OUT PULONG pCrc)
+{
+    PCOPY_SLOT Slot;
+    BOOLEAN Progress;
+    ULONG i;
+
+    do
+    {
+        Progress = FALSE;
+
+        for (i = 0; i < QueueDepth; i++)
+        {
+            Slot = &Slots[i];
+
+            if (Slot->Writing && (Slot->Busy || Slot->Parked) && !Slot->Hashed &&
+                Slot->Offset.QuadPart == *HashOffset)
+            {
+                *pCrc = RtlCliCrc32(*pCrc, Slot->Buffer, Slot->Length);
+                *HashOffset += Slot->Length;
+                Slot->Hashed = TRUE;
+                Progress = TRUE;
+            }
+        }
+    } while (Progress);
+}
+
+/*++
+ * @name NtFileIsZeroChunk
+ *
+ * The NtFileIsZeroChunk routine tells if a chunk holds only zeros.
+ *
+ * @param Buffer
+ *        Chunk, page aligned.
+ *
+ * @param Length
+ *        Size of the chunk.
+ *
+ * @return TRUE if every byte is zero, FALSE otherwise.
+ *
+ * @remarks The chunk is scanned a word at a time and the scan stops at
+ *          the first word that isn't zero, which in data is almost always
+ *          the first one.
+ *
+ *--*/
+BOOLEAN
+NtFileIsZeroChunk(IN PUCHAR Buffer, IN ULONG Length)
+{
+    PULONG_PTR Words = (PULONG_PTR)Buffer;
+    ULONG Count = Length / sizeof(ULONG_PTR);
+    ULONG i;
+
+    for (i = 0; i < Count; i++)
+    {
+        if (Words[i])
+            return FALSE;
+    }
+
+    for (i = Count * sizeof(ULONG_PTR); i < Length; i++)
+    {
+        if (Buffer[i])
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*++
+ * @name NtFileCopyPipelined
+ *
+ * The NtFileCopyPipelined routine copies between two overlapped handles
+ * with several reads and writes in flight.
+ *
+ * @param hSrc
+ *        Source handle, opened for overlapped I/O.
+ *
+ * @param hDst
+ *        Destination handle, opened for overlapped I/O.
+ *
+ * @param FileSize
+ *        Bytes to copy. Reads never go past it, so for unbuffered
+ *        sources it is the file size rounded up to COPY_PAGE_SIZE, or the
+ *        exact size of a device.
+ *
+ * @param pQueueDepth
+ *        Number of chunks in flight, 2 to COPY_MAX_QUEUE_DEPTH. Receives
+ *        the number actually used.
+ *
+ * @param pChunkSize
+ *        Transfer size. Receives the size actually used.
+ *
+ * @param pBytesCopied
+ *        Receives the number of bytes written.
+ *
+ * @param pCrc
+ *        Optional, receives the CRC32 of the data copied.
+ *
+ * @param Flags
+ *        NT_FILE_COPY_UNBUFFERED if the destination is a file opened with
+ *        FILE_NO_INTERMEDIATE_BUFFERING, NT_FILE_COPY_SKIP_ZEROS and
+ *        NT_FILE_COPY_PROGRESS. Other flags are ignored.
+ *
+ * @param pZeroBytes
+ *        Optional, receives the number of bytes not written because their
+ *        chunk was all zeros.
+ *
+ * @return TRUE if the whole file was copied, FALSE otherwise.
+ *
+ * @remarks Each slot reads the next chunk of the source and writes it at
+ *          the same offset of the destination, so the source and the
+ *          destination disk work at the same time. Completions are picked
+ *          up with NtWaitForMultipleObjects on the slot events. On error no
+ *          new requests are started and the loop waits for the ones in
+ *          flight before the buffers are released. The copy covers the
+ *          size seen when the source was opened, or less if the source
+ *          shrinks. With a CRC, a written slot is only reused once its
+ *          chunk has been hashed. Skipping zeros, a chunk that is all
+ *          zeros counts as written as soon as it is read, so the
+ *          destination must already read back zeros there.
+ *          If the transfer buffer had to be cut down, the chunks shrink
+ *          and, below a page each, so does the queue.
+ *
+ *--*/
+BOOLEAN
+NtFileCopyPipelined(IN HANDLE hSrc,
+                    IN HANDLE hDst,
+                    IN LONGLONG FileSize,
+                    IN OUT PULONG pQueueDepth,
+                    IN OUT PULONG pChunkSize,
+                    OUT PLONGLONG pBytesCopied,
+                    OUT PULONG pCrc,
+                    IN ULONG Flags,
+                    OUT PLONGLONG pZeroBytes)
+{
+    COPY_SLOT Slots[COPY_MAX_QUEUE_DEPTH];
+    HANDLE WaitHandles[COPY_MAX_QUEUE_DEPTH];
+    ULONG WaitSlots[COPY_MAX_QUEUE_DEPTH];
+    PVOID Buffer = NULL;
+    ULONG QueueDepth = *pQueueDepth;
+    ULONG ChunkSize = *pChunkSize;
+    ULONG BufferSize = QueueDepth * ChunkSize;
+    LONGLONG NextOffset = 0;
+    LONGLONG HashOffset = 0;
+    PCOPY_SLOT Slot;
+    ULONG i, Count;
+    NTSTATUS Status;
+    BOOLEAN Failed = FALSE;
+    BOOLEAN EndOfFile = FALSE;
+    LARGE_INTEGER StartTime, Now, Frequency;
+    LONGLONG NextReport;
+
+    *pBytesCopied = 0;
+    if (pCrc)
+        *pCrc = 0;
+    if (pZeroBytes)
+        *pZeroBytes = 0;
+
+    NtQueryPerformanceCounter(&StartTime, &Frequency);
+    NextReport = StartTime.QuadPart + COPY_PROGRESS_SECONDS * Frequency.QuadPart;
+
+    if (!NT_SUCCESS(NtFileAllocateCopyBuffer(&Buffer, &BufferSize)))
+    {
+        RtlCliDisplayString("Out of memory for the copy buffer.\n");
+        return FALSE;
+    }
+
+    // The allocation may have been cut down, share what we got in whole
+    // pages, with fewer slots if there isn't a page for each
+    QueueDepth = min(QueueDepth, BufferSize / COPY_PAGE_SIZE);
+    if (!QueueDepth)
+    {
+        RtlCliDisplayString("The copy buffer is smaller than a page.\n");
+        NtFileFreeCopyBuffer(Buffer);
+        return FALSE;
+    }
+    ChunkSize = (BufferSize / QueueDepth) & ~(ULONG)(COPY_PAGE_SIZE - 1);
+    *pQueueDepth = QueueDepth;
+    *pChunkSize = ChunkSize;
+
+    memset(Slots, 0, sizeof(Slots));
+    for (i = 0; i < QueueDepth; i++)
+    {
+        Slots[i].Buffer = (PUCHAR)Buffer + i * ChunkSize;
+
+        Status = NtCreateEvent(&Slots[i].Event, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE);
+        if (!NT_SUCCESS(Status))
+        {
+            RtlCliDisplayString("NtCreateEvent() failed 0x%.8X\n", Status);
+            Failed = TRUE;
+            break;
+        }
+    }
+
+    // Prime the pipeline with one read per slot
+    for (i = 0; !Failed && i < QueueDepth && NextOffset < FileSize; i++)
+    {
+        Slots[i].Offset.QuadPart = NextOffset;
+        Slots[i].Length = (ULONG)min(ChunkSize, FileSize - NextOffset);
+        NextOffset += Slots[i].Length;
+
+        NtFileStartCopyIo(hSrc, &Slots[i], FALSE);
+    }
+
+    for (;;)
+    {
+        Count = 0;
+        for (i = 0; i < QueueDepth; i++)
+        {
+            if (Slots[i].Busy)
+            {
+                WaitHandles[Count] = Slots[i].Event;
+                WaitSlots[Count] = i;
+                Count++;
+            }
+        }
+
+        if (Count == 0)
+            break;
+
+        Status = NtWaitForMultipleObjects(Count, WaitHandles, WaitAny, FALSE, NULL);
+        if ((ULONG)Status >= Count)
+        {
+            // Can't tell which request is done, don't touch the buffers
+            RtlCliDisplayString("NtWaitForMultipleObjects() failed 0x%.8X\n", Status);
+            NtCancelIoFile(hSrc, &Slots[0].IoStatus);
+            NtCancelIoFile(hDst, &Slots[0].IoStatus);
+            NtWaitForMultipleObjects(Count, WaitHandles, WaitAll, FALSE, NULL);
+            Failed = TRUE;
+            break;
+        }
+
+        Slot = &Slots[WaitSlots[Status]];
+        Slot->Busy = FALSE;
+
+        if (!Slot->Writing)
+        {
+            // A read is done, write what it got
+            if (Slot->IoStatus.Status == STATUS_END_OF_FILE || Slot->IoStatus.Information == 0)
+            {
+                EndOfFile = TRUE;
+                continue;
+            }
+            if (!NT_SUCCESS(Slot->IoStatus.Status))
+            {
+                if (!Failed)
+                    RtlCliDisplayString("NtReadFile() failed 0x%.8X\n", Slot->IoStatus.Status);
+                Failed = TRUE;
+                continue;
+            }
+            if (Failed)
+                continue;
+
+            if (Slot->IoStatus.Information < Slot->Length)
+                EndOfFile = TRUE;
+
+            Slot->Length = Slot->IoStatus.Information & MAXULONG;
+            Slot->Hashed = FALSE;
+
+            if ((Flags & NT_FILE_COPY_SKIP_ZEROS) && NtFileIsZeroChunk(Slot->Buffer, Slot->Length))
+            {
+                // Nothing to write, the slot is done with its chunk
+                Slot->Writing = TRUE;
+                Slot->Parked = TRUE;
+                *pBytesCopied += Slot->Length;
+                if (pZeroBytes)
+                    *pZeroBytes += Slot->Length;
+            }
+            else
+            {
+                // Only the last chunk can be short, pad it to the sector size
+                if (Flags & NT_FILE_COPY_UNBUFFERED)
+                {
+                    Slot->Padding = COPY_ALIGN(Slot->Length) - Slot->Length;
+                    memset(Slot->Buffer + Slot->Length, 0, Slot->Padding);
+                }
+
+                NtFileStartCopyIo(hDst, Slot, TRUE);
+            }
+        }
+        else
+        {
+            // A write is done, reuse the slot for the next chunk
+            if (!NT_SUCCESS(Slot->IoStatus.Status) || Slot->IoStatus.Information != Slot->Length + Slot->Padding)
+            {
+                if (!Failed)
+                    RtlCliDisplayString("NtWriteFile() failed 0x%.8X\n", Slot->IoStatus.Status);
+                Failed = TRUE;
+                continue;
+            }
+
+            *pBytesCopied += Slot->Length;
+            Slot->Parked = TRUE;
+        }
+
+        if (Flags & NT_FILE_COPY_PROGRESS)
+        {
+            NtQueryPerformanceCounter(&Now, NULL);
+            if (Now.QuadPart >= NextReport && FileSize)
+            {
+                RtlCliDisplayString("%3u%% ", (ULONG)(*pBytesCopied * 100 / FileSize));
+                RtlCliDisplayThroughput(*pBytesCopied, Now.QuadPart - StartTime.QuadPart, Frequency.QuadPart);
+                RtlCliDisplayString("\n");
+                NextReport = Now.QuadPart + COPY_PROGRESS_SECONDS * Frequency.QuadPart;
+            }
+        }
+
+        if (pCrc)
+            NtFileHashCopySlots(Slots, QueueDepth, &HashOffset, pCrc);
+
+        // Reuse the slots that are written, and hashed if needed, for the next chunks
+        for (i = 0; i < QueueDepth; i++)
+        {
+            Slot = &Slots[i];
+            if (!Slot->Parked || (pCrc && !Slot->Hashed))
+                continue;
+
+            Slot->Parked = FALSE;
+
+            if (!Failed && !EndOfFile && NextOffset < FileSize)
+            {
+                Slot->Offset.QuadPart = NextOffset;
+                Slot->Length = (ULONG)min(ChunkSize, FileSize - NextOffset);
+                NextOffset += Slot->Length;
+
+                NtFileStartCopyIo(hSrc, Slot, FALSE);
+            }
+        }
+    }
+
+    // Only when the source shrank under us
+    if (!Failed && pCrc && HashOffset != *pBytesCopied)
+    {
+        RtlCliDisplayString("The source changed during the copy.\n");
+        Failed = TRUE;
+    }
+
+    for (i = 0; i < QueueDepth; i++)
+    {
+        if (Slots[i].Event)
+            NtClose(Slots[i].Event);
+    }
+
+    NtFileFreeCopyBuffer(Buffer);
+
+    return !Failed;
+}
+
+/*++
+ * @name NtFileCopyMapped
+ *
+ * The NtFileCopyMapped routine copies a file by writing straight from
+ * mapped views of the source.
+ *
+ * @param hSrc
+ *        Source handle, opened for reading.
+ *
+ * @param hDst
+ *        Destination handle, synchronous or overlapped.
+ *
+ * @param FileSize
+ *        Size of the source file.
+ *
+ * @param pBytesCopied
+ *        Receives the number of bytes written.
+ *
+ * @return STATUS_SUCCESS, or the failing status. If nothing was written
+ *         yet, the caller can still copy the file another way.
+ *
+ * @remarks The source is mapped in COPY_MAP_WINDOW sized views, one at a
+ *          time, and each view is handed to NtWriteFile as is. There is no
+ *          bounce buffer: the source pages are read in by the page fault
+ *          handler while the write runs. Read errors on the source come
+ *          back from NtWriteFile as STATUS_IN_PAGE_ERROR instead of
+ *          raising an exception in the shell.
+ *
+ *--*/
+NTSTATUS
+NtFileCopyMapped(IN HANDLE hSrc, IN HANDLE hDst, IN LONGLONG FileSize, OUT PLONGLONG pBytesCopied)
+{
+    HANDLE hSection = NULL;
+    HANDLE hEvent = NULL;
+    PVOID View;
+    SIZE_T ViewSize;
+    LARGE_INTEGER Offset;
+    IO_STATUS_BLOCK sIoStatus;
+    ULONG Length;
+    NTSTATUS Status;
+
+    *pBytesCopied = 0;
+
+    Status = NtCreateSection(&hSection,
+                             SECTION_MAP_READ | SECTION_QUERY,
+                             NULL,
+                             NULL,
+                             PAGE_READONLY,
+                             SEC_COMMIT,
+                             hSrc);
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    // The destination may be overlapped, wait for every write on this event
+    Status = NtCreateEvent(&hEvent, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE);
+    if (!NT_SUCCESS(Status))
+    {
+        NtClose(hSection);
+        return Status;
+    }
+
+    Offset.QuadPart = 0;
+    while (Offset.QuadPart < FileSize)
+    {
+        Length = (ULONG)min(FileSize - Offset.QuadPart, COPY_MAP_WINDOW);
+
+        View = NULL;
+        ViewSize = Length;
+        Status = NtMapViewOfSection(hSection,
+                                    NtCurrentProcess(),
+                                    &View,
+                                    0,
+                                    0,
+                                    &Offset,
+                                    &ViewSize,
+                                    ViewUnmap,
+                                    0,
+                                    PAGE_READONLY);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        memset(&sIoStatus, 0, sizeof(IO_STATUS_BLOCK));
+
+        Status = NtWriteFile(hDst, hEvent, NULL, NULL, &sIoStatus, View, Length, &Offset, NULL);
+        if (Status == STATUS_PENDING)
+        {
+            NtWaitForSingleObject(hEvent, FALSE, NULL);
+            Status = sIoStatus.Status;
+        }
+
+        NtUnmapViewOfSection(NtCurrentProcess(), View);
+
+        if (NT_SUCCESS(Status) && sIoStatus.Information != Length)
+        {
+            Status = STATUS_UNSUCCESSFUL;
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        *pBytesCopied += Length;
+        Offset.QuadPart += Length;
+    }
+
+    NtClose(hEvent);
+    NtClose(hSection);
+
+    return Status;
+}
+
+/*++
+ * @name NtFileCopySparseRange
+ *
+ * The NtFileCopySparseRange routine copies one allocated range of a
+ * sparse copy.
+ *
+ * @param hSrc
+ *        Source handle, synchronous.
+ *
+ * @param hDst
+ *        Destination handle, synchronous.
+ *
+ * @param Buffer
+ *        Transfer buffer.
+ *
+ * @param ChunkSize
+ *        Size of the buffer.
+ *
+ * @param Offset
+ *        Start of the range, updated to the end of the data copied.
+ *
+ * @param End
+ *        End of the range.
+ *
+ * @param pCrc
+ *        Optional, CRC32 of the data before Offset, updated.
+ *
+ * @param Unbuffered
+ *        TRUE if both files were opened with FILE_NO_INTERMEDIATE_BUFFERING.
+ *
+ * @return STATUS_SUCCESS, STATUS_END_OF_FILE if the source ended inside
+ *         the range, or the failing status.
+ *
+ * @remarks Ranges start on cluster boundaries, so unbuffered transfers
+ *          stay aligned. Their lengths are padded to COPY_PAGE_SIZE, which
+ *          can only copy a few zeros past the range.
+ *
+ *--*/
+NTSTATUS
+NtFileCopySparseRange(IN HANDLE hSrc,
+                      IN HANDLE hDst,
+                      IN PVOID Buffer,
+                      IN ULONG ChunkSize,
+                      IN OUT PLONGLONG Offset,
+                      IN LONGLONG End,
+                      IN OUT PULONG pCrc,
+                      IN BOOLEAN Unbuffered)
+{
+    IO_STATUS_BLOCK sIoStatus;
+    LARGE_INTEGER ByteOffset;
+    ULONG Length, ReadSize, WriteSize;
+    NTSTATUS Status;
+
+    while (*Offset < End)
+    {
+        Length = (ULONG)min(End - *Offset, ChunkSize);
+        if (Unbuffered)
+            Length = COPY_ALIGN(Length);
+
+        ByteOffset.QuadPart = *Offset;
+        memset(&sIoStatus, 0, sizeof(IO_STATUS_BLOCK));
+
+        Status = NtReadFile(hSrc, NULL, NULL, NULL, &sIoStatus, Buffer, Length, &ByteOffset, NULL);
+        if (Status == STATUS_END_OF_FILE || (NT_SUCCESS(Status) && sIoStatus.Information == 0))
+            return STATUS_END_OF_FILE;
+        if (!NT_SUCCESS(Status))
+        {
+            RtlCliDisplayString("NtReadFile() failed 0x%.8X\n", Status);
+            return Status;
+        }
+
+        ReadSize = sIoStatus.Information & MAXULONG;
+
+        WriteSize = ReadSize;
+        if (Unbuffered)
+        {
+            WriteSize = COPY_ALIGN(ReadSize);
+            memset((PUCHAR)Buffer + ReadSize, 0, WriteSize - ReadSize);
+        }
+
+        if (pCrc)
+            *pCrc = RtlCliCrc32(*pCrc, Buffer, ReadSize);
+
+        memset(&sIoStatus, 0, sizeof(IO_STATUS_BLOCK));
+
+        Status = NtWriteFile(hDst, NULL, NULL, NULL, &sIoStatus, Buffer, WriteSize, &ByteOffset, NULL);
+        if (!NT_SUCCESS(Status) || sIoStatus.Information != WriteSize)
+        {
+            RtlCliDisplayString("NtWriteFile() failed 0x%.8X\n", Status);
+            return NT_SUCCESS(Status) ? STATUS_UNSUCCESSFUL : Status;
+        }
+
+        *Offset += ReadSize;
+
+        if (ReadSize < Length)
+            return STATUS_END_OF_FILE;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*++
+ * @name NtFileCopySparse
+ *
+ * The NtFileCopySparse routine copies the allocated ranges of a file and
+ * skips its holes.
+ *
+ * @param hSrc
+ *        Source handle, synchronous.
+ *
+ * @param hDst
+ *        Destination handle, synchronous, already sparse and sized.
+ *
+ * @param FileSize
+ *        Size of the source file.
+ *
+ * @param pChunkSize
+ *        Transfer size. Receives the size actually used.
+ *
+ * @param pBytesCopied
+ *        Receives the size of the file copied, holes included.
+ *
+ * @param pHoleBytes
+ *        Receives the number of bytes in holes, which were not copied.
+ *
+ * @param pCrc
+ *        Optional, receives the CRC32 of the data copied, holes included.
+ *
+ * @param Unbuffered
+ *        TRUE if both files were opened with FILE_NO_INTERMEDIATE_BUFFERING.
+ *
+ * @return TRUE if the whole file was copied, FALSE otherwise.
+ *
+ * @remarks The ranges come from FSCTL_QUERY_ALLOCATED_RANGES,
+ *          COPY_SPARSE_RANGES at a time. Holes are never read or written:
+ *          the destination reads back zeros there. File systems without
+ *          the control, and files that aren't sparse, are one range. The
+ *          CRC of a hole is computed over a zeroed buffer, so a verified
+ *          sparse copy checks the same data as a full copy.
+ *
+ *--*/
+BOOLEAN
+NtFileCopySparse(IN HANDLE hSrc,
+                 IN HANDLE hDst,
+                 IN LONGLONG FileSize,
+                 IN OUT PULONG pChunkSize,
+                 OUT PLONGLONG pBytesCopied,
+                 OUT PLONGLONG pHoleBytes,
+                 OUT PULONG pCrc,
+                 IN BOOLEAN Unbuffered)
+{
+    FILE_ALLOCATED_RANGE_BUFFER Query;
+    FILE_ALLOCATED_RANGE_BUFFER Ranges[COPY_SPARSE_RANGES];
+    IO_STATUS_BLOCK sIoStatus;
+    PVOID Buffer = NULL;
+    ULONG ChunkSize = *pChunkSize;
+    LONGLONG Offset = 0;
+    LONGLONG Start, End;
+    ULONG Count, Length, i;
+    NTSTATUS Status = STATUS_SUCCESS;
+    BOOLEAN More = TRUE;
+
+    *pBytesCopied = 0;
+    *pHoleBytes = 0;
+    if (pCrc)
+        *pCrc = 0;
+
+    if (!NT_SUCCESS(NtFileAllocateCopyBuffer(&Buffer, &ChunkSize)))
+    {
+        RtlCliDisplayString("Out of memory for the copy buffer.\n");
+        return FALSE;
+    }
+    *pChunkSize = ChunkSize;
+
+    while (More && Offset < FileSize && NT_SUCCESS(Status))
+    {
+        Query.FileOffset.QuadPart = Offset;
+        Query.Length.QuadPart = FileSize - Offset;
+
+        Status = NtFsControlFile(hSrc, NULL, NULL, NULL, &sIoStatus, FSCTL_QUERY_ALLOCATED_RANGES,
+                                 &Query, sizeof(Query), Ranges, sizeof(Ranges));
+        if (Status == STATUS_BUFFER_OVERFLOW)
+        {
+            Count = (ULONG)(sIoStatus.Information / sizeof(FILE_ALLOCATED_RANGE_BUFFER));
+            Status = STATUS_SUCCESS;
+        }
+        else if (NT_SUCCESS(Status))
+        {
+            Count = (ULONG)(sIoStatus.Information / sizeof(FILE_ALLOCATED_RANGE_BUFFER));
+            More = FALSE;
+        }
+        else if (Offset == 0)
+        {
+            // No sparse support, the whole file is data
+            Ranges[0] = Query;
+            Count = 1;
+            More = FALSE;
+            Status = STATUS_SUCCESS;
+        }
+        else
+        {
+            RtlCliDisplayString("Can't query the allocated ranges (0x%.8X)\n", Status);
+            break;
+        }
+
+        // An overflow that returned nothing can't make progress
+        if (Count == 0)
+            More = FALSE;
+
+        for (i = 0; i < Count && NT_SUCCESS(Status); i++)
+        {
+            // Padded unbuffered transfers can run into the next range
+            Start = max(Ranges[i].FileOffset.QuadPart, Offset);
+            End = min(Ranges[i].FileOffset.QuadPart + Ranges[i].Length.QuadPart, FileSize);
+            if (Start >= End)
+                continue;
+
+            if (pCrc && Start > Offset)
+                memset(Buffer, 0, ChunkSize);
+
+            // The hole before the range
+            *pHoleBytes += Start - Offset;
+            while (pCrc && Offset < Start)
+            {
+                Length = (ULONG)min(Start - Offset, ChunkSize);
+                *pCrc = RtlCliCrc32(*pCrc, Buffer, Length);
+                Offset += Length;
+            }
+            Offset = Start;
+
+            Status = NtFileCopySparseRange(hSrc, hDst, Buffer, ChunkSize, &Offset, End, pCrc, Unbuffered);
+        }
+    }
+
+    // The hole at the end, unless the source shrank
+    if (NT_SUCCESS(Status) && Offset < FileSize)
+    {
+        *pHoleBytes += FileSize - Offset;
+
+        if (pCrc)
+            memset(Buffer, 0, ChunkSize);
+
+        while (pCrc && Offset < FileSize)
+        {
+            Length = (ULONG)min(FileSize - Offset, ChunkSize);
+            *pCrc = RtlCliCrc32(*pCrc, Buffer, Length);
+            Offset += Length;
+        }
+        Offset = FileSize;
+    }
+
+    NtFileFreeCopyBuffer(Buffer);
+
+    *pBytesCopied = Offset;
+
+    // The end of the file is where the source ended
+    return (NT_SUCCESS(Status) || Status == STATUS_END_OF_FILE);
+}
+
+// Attributes that FileBasicInformation can set on a plain file
+#define COPY_ATTRIBUTE_MASK (FILE_ATTRIBUTE_READONLY | FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM |      \
+                             FILE_ATTRIBUTE_ARCHIVE | FILE_ATTRIBUTE_TEMPORARY | FILE_ATTRIBUTE_OFFLINE | \
+                             FILE_ATTRIBUTE_NOT_CONTENT_INDEXED)
+
+/*++
+ * @name NtFilePreallocate
+ *
+ * The NtFilePreallocate routine reserves space for the whole destination
+ * before the copy starts.
+ *
+ * @param hDst
+ *        Destination handle.
+ *
+ * @param FileSize
+ *        Final size of the file.
+ *
+ * @param Sparse
+ *        TRUE to make the destination sparse instead of allocating it.
+ *
+ * @return STATUS_SUCCESS or the status of setting the end of file.
+ *
+ * @remarks The allocation is only a hint to the file system and its
+ *          failure is ignored. So is the failure to make the file sparse,
+ *          the holes then read back as zeros from the file system. Setting
+ *          the end of file up front means no write extends the file, so
+ *          the file system can lay it out in one go and overlapped writes
+ *          are not serialized by extension. If there is not enough space,
+ *          the copy fails here instead of half way.
+ *
+ *--*/
+NTSTATUS
+NtFilePreallocate(IN HANDLE hDst, IN LONGLONG FileSize, IN BOOLEAN Sparse)
+{
+    IO_STATUS_BLOCK sIoStatus;
+    FILE_ALLOCATION_INFORMATION AllocationInfo;
+    FILE_END_OF_FILE_INFORMATION EndOfFileInfo;
+
+    if (FileSize == 0)
+        return STATUS_SUCCESS;
+
+    if (Sparse)
+    {
+        NtFsControlFile(hDst, NULL, NULL, NULL, &sIoStatus, FSCTL_SET_SPARSE, NULL, 0, NULL, 0);
+    }
+    else
+    {
+        AllocationInfo.AllocationSize.QuadPart = FileSize;
+        NtSetInformationFile(hDst, &sIoStatus, &AllocationInfo,
+                             sizeof(FILE_ALLOCATION_INFORMATION), FileAllocationInformation);
+    }
+
+    EndOfFileInfo.EndOfFile.QuadPart = FileSize;
+    return NtSetInformationFile(hDst, &sIoStatus, &EndOfFileInfo,
+                                sizeof(FILE_END_OF_FILE_INFORMATION), FileEndOfFileInformation);
+}
+
+/*++
+ * @name NtFileFinishCopy
+ *
+ * The NtFileFinishCopy routine gives the destination its final size,
+ * timestamps and attributes.
+ *
+ * @param hDst
+ *        Destination handle.
+ *
+ * @param BytesCopied
+ *        Number of bytes actually written.
+ *
+ * @param BasicInfo
+ *        Timestamps and attributes of the source, or NULL to keep the
+ *        ones of the destination.
+ *
+ * @return STATUS_SUCCESS or the status of the failing call.
+ *
+ * @remarks The end of file is always set to the bytes written, which
+ *          trims the preallocated tail if the source shrank or the copy
+ *          failed. The basic information goes last, as every write updates
+ *          the destination timestamps.
+ *
+ *--*/
+NTSTATUS
+NtFileFinishCopy(IN HANDLE hDst, IN LONGLONG BytesCopied, IN PFILE_BASIC_INFORMATION BasicInfo)
+{
+    IO_STATUS_BLOCK sIoStatus;
+    FILE_END_OF_FILE_INFORMATION EndOfFileInfo;
+    NTSTATUS Status;
+
+    EndOfFileInfo.EndOfFile.QuadPart = BytesCopied;
+    Status = NtSetInformationFile(hDst, &sIoStatus, &EndOfFileInfo,
+                                  sizeof(FILE_END_OF_FILE_INFORMATION), FileEndOfFileInformation);
+
+    if (NT_SUCCESS(Status) && BasicInfo)
+    {
+        // Zero means "don't change" for the change time
+        BasicInfo->ChangeTime.QuadPart = 0;
+        BasicInfo->FileAttributes &= COPY_ATTRIBUTE_MASK;
+        if (!BasicInfo->FileAttributes)
+            BasicInfo->FileAttributes = FILE_ATTRIBUTE_NORMAL;
+
+        Status = NtSetInformationFile(hDst, &sIoStatus, BasicInfo,
+                                      sizeof(FILE_BASIC_INFORMATION), FileBasicInformation);
+    }
+
+    return Status;
+}
+
+/*++
+ * @name NtFileVerifyCopy
+ *
+ * The NtFileVerifyCopy routine reads the destination back and compares it
+ * with the CRC of the source.
+ *
+ * @param pszDst
+ *        Destination file, full path in DOS format.
+ *
+ * @param ChunkSize
+ *        Transfer size, a multiple of the page size.
+ *
+ * @param Length
+ *        Number of bytes copied.
+ *
+ * @param Crc
+ *        CRC32 of the source data.
+ *
+ * @return TRUE if the destination matches, FALSE otherwise.
+ *
+ * @remarks The destination is read with FILE_NO_INTERMEDIATE_BUFFERING, so
+ *          the data comes from the disk and not from the pages the copy
+ *          just wrote to the cache.
+ *
+ *--*/
+BOOLEAN
+NtFileVerifyCopy(IN PCWSTR pszDst, IN ULONG ChunkSize, IN LONGLONG Length, IN ULONG Crc)
+{
+    HANDLE hDst = NULL;
+    PVOID Buffer = NULL;
+    IO_STATUS_BLOCK sIoStatus;
+    LONGLONG lReadTotal = 0;
+    ULONG ReadCrc = 0;
+    ULONG dwReadSize;
+    NTSTATUS ntStatus;
+
+    if (!NT_SUCCESS(NtFileOpenCopyHandle(&hDst, pszDst, FALSE, FALSE, FILE_NO_INTERMEDIATE_BUFFERING)))
+    {
+        return FALSE;
+    }
+
+    if (!NT_SUCCESS(NtFileAllocateCopyBuffer(&Buffer, &ChunkSize)))
+    {
+        RtlCliDisplayString("Out of memory for the verify buffer.\n");
+        NtFileCloseFile(hDst);
+        return FALSE;
+    }
+
+    for (;;)
+    {
+        memset(&sIoStatus, 0, sizeof(IO_STATUS_BLOCK));
+
+        ntStatus = NtReadFile(hDst, NULL, NULL, NULL, &sIoStatus, Buffer, ChunkSize, NULL, NULL);
+        if (ntStatus == STATUS_END_OF_FILE)
+        {
+            ntStatus = STATUS_SUCCESS;
+            break;
+        }
+        if (!NT_SUCCESS(ntStatus))
+        {
+            RtlCliDisplayString("NtReadFile() failed 0x%.8X\n", ntStatus);
+            break;
+        }
+
+        dwReadSize = sIoStatus.Information & MAXULONG;
+        if (dwReadSize == 0)
+        {
+            break;
+        }
+
+        ReadCrc = RtlCliCrc32(ReadCrc, Buffer, dwReadSize);
+        lReadTotal += dwReadSize;
+    }
+
+    NtFileFreeCopyBuffer(Buffer);
+    NtFileCloseFile(hDst);
+
+    if (!NT_SUCCESS(ntStatus))
+    {
+        return FALSE;
+    }
+
+    if (lReadTotal != Length || ReadCrc != Crc)
+    {
+        RtlCliDisplayString("Verify failed: %I64u bytes with CRC32 %.8X, expected %I64u bytes with CRC32 %.8X\n",
+                            lReadTotal, ReadCrc, Length, Crc);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*++
+ * @name NtFileCopyFileEx
+ *
+ * The NtFileCopyFileEx routine copies a file through large transfer
+ * buffers and measures the copy.
+ *
+ * @param pszSrc
+ *        Source file, full path in DOS format.
+ *
+ * @param pszDst
+ *        Destination file, full path in DOS format. It is overwritten.
+ *
+ * @param pOptions
+ *        Optional queue depth, chunk size and flags. NULL copies
+ *        synchronously with a chunk size chosen from the file size.
+ *
+ * @param pStats
+ *        Optional, receives the number of bytes copied and the time taken.
+ *
+ * @return TRUE if the whole file was copied, FALSE otherwise.
+ *
+ * @remarks Sources of COPY_MAP_THRESHOLD bytes or more are copied from
+ *          mapped views unless NT_FILE_COPY_NO_MAP is set. If the source
+ *          can't be mapped, or the options ask for it, a queue depth of 2
+ *          or more opens both files for overlapped I/O and keeps that many
+ *          chunks in flight, and a depth of 1 copies synchronously.
+ *          The destination is preallocated to the source size and gets
+ *          the timestamps and attributes of the source once the data is
+ *          written. NT_FILE_COPY_VERIFY computes the CRC32 of the source
+ *          on the chunks in the transfer buffers and checks it against the
+ *          destination read back from disk. It never uses mapped views,
+ *          whose read errors would raise exceptions while hashing.
+ *          NT_FILE_COPY_UNBUFFERED opens both files with
+ *          FILE_NO_INTERMEDIATE_BUFFERING, so large copies don't push
+ *          everything else out of the file cache. NT_FILE_COPY_SPARSE
+ *          copies synchronously, and only the allocated ranges of the
+ *          source. NT_FILE_COPY_SKIP_ZEROS and NT_FILE_COPY_PROGRESS only
+ *          apply to overlapped copies.
+ *
+ *--*/
+BOOLEAN NtFileCopyFileEx(WCHAR *pszSrc, WCHAR *pszDst, PNT_FILE_COPY_OPTIONS pOptions, PNT_FILE_COPY_STATS pStats)
+{
+    HANDLE hSrc = NULL;
+    HANDLE hDst = NULL;
+    ULONG QueueDepth = 1;
+    ULONG ChunkSize = 0;
+    LONGLONG lFileSize = 0;
+    LONGLONG lWrittenSizeTotal = 0;
+    LARGE_INTEGER StartTime, EndTime, Frequency;
+    ULONG Flags = 0;
+    IO_STATUS_BLOCK sIoStatus;
+    FILE_BASIC_INFORMATION BasicInfo;
+    BOOLEAN bHaveBasicInfo;
+    NTSTATUS ntStatus;
+    BOOLEAN bAsync;
+    BOOLEAN bMapped = FALSE;
+    BOOLEAN bResult = FALSE;
+    ULONG Crc = 0;
+    PULONG pCrc = NULL;
+    ULONG OpenOptions = 0;
+    BOOLEAN bUnbuffered;
+    LONGLONG lHoleBytes = 0;
+    LONGLONG lReadSize;
+
+    NtQueryPerformanceCounter(&StartTime, &Frequency);
+
+    if (pOptions)
+    {
+        QueueDepth = min(max(pOptions->QueueDepth, 1), COPY_MAX_QUEUE_DEPTH);
+        ChunkSize = min(pOptions->ChunkSize, COPY_MAX_CHUNK);
+        ChunkSize = (ChunkSize + COPY_PAGE_SIZE - 1) & ~(ULONG)(COPY_PAGE_SIZE - 1);
+        Flags = pOptions->Flags;
+    }
+
+    // The ranges are copied one after the other at explicit offsets
+    if (Flags & NT_FILE_COPY_SPARSE)
+        QueueDepth = 1;
+
+    bAsync = (QueueDepth > 1);
+
+    // Mapped views always go through the cache
+    if (Flags & (NT_FILE_COPY_UNBUFFERED | NT_FILE_COPY_SPARSE))
+        Flags |= NT_FILE_COPY_NO_MAP;
+
+    bUnbuffered = (Flags & NT_FILE_COPY_UNBUFFERED) != 0;
+    if (bUnbuffered)
+        OpenOptions = FILE_NO_INTERMEDIATE_BUFFERING;
+
+    if (Flags & NT_FILE_COPY_VERIFY)
+    {
+        Flags |= NT_FILE_COPY_NO_MAP;
+        pCrc = &Crc;
+    }
+
+    if (!NT_SUCCESS(NtFileOpenCopyHandle(&hSrc, pszSrc, FALSE, bAsync, OpenOptions)))
+    {
+        return FALSE;
+    }
+
+    if (!NT_SUCCESS(NtFileOpenCopyHandle(&hDst, pszDst, TRUE, bAsync, OpenOptions)))
+    {
+        NtFileCloseFile(hSrc);
+        return FALSE;
+    }
+
+    ntStatus = NtQueryInformationFile(hSrc, &sIoStatus, &BasicInfo,
+                                      sizeof(FILE_BASIC_INFORMATION), FileBasicInformation);
+    bHaveBasicInfo = NT_SUCCESS(ntStatus);
+
+    if (NtFileGetFileSize(hSrc, &lFileSize) == FALSE)
+    {
+        RtlCliDisplayString("Can't get the size of the source.\n");
+    }
+    else if (!NT_SUCCESS(ntStatus = NtFilePreallocate(hDst, lFileSize, (Flags & NT_FILE_COPY_SPARSE) != 0)))
+    {
+        RtlCliDisplayString("Can't allocate %I64u bytes for the destination (0x%.8X)\n",
+                            lFileSize, ntStatus);
+    }
+    else
+    {
+        if (!ChunkSize)
+            ChunkSize = NtFileCopyBufferSize(lFileSize);
+
+        // Unbuffered reads are whole sectors, the last one stops short at end of file
+        lReadSize = lFileSize;
+        if (bUnbuffered)
+            lReadSize = (lFileSize + COPY_PAGE_SIZE - 1) & ~(LONGLONG)(COPY_PAGE_SIZE - 1);
+
+        if (lFileSize >= COPY_MAP_THRESHOLD && !(Flags & NT_FILE_COPY_NO_MAP))
+        {
+            ntStatus = NtFileCopyMapped(hSrc, hDst, lFileSize, &lWrittenSizeTotal);
+            bMapped = (NT_SUCCESS(ntStatus) || lWrittenSizeTotal != 0);
+            bResult = NT_SUCCESS(ntStatus);
+
+            if (!NT_SUCCESS(ntStatus))
+            {
+                RtlCliDisplayString(bMapped ? "Mapped copy failed 0x%.8X\n"
+                                            : "Can't map the source (0x%.8X), copying through buffers\n",
+                                    ntStatus);
+            }
+        }
+
+        if (!bMapped)
+        {
+            if (Flags & NT_FILE_COPY_SPARSE)
+                bResult = NtFileCopySparse(hSrc, hDst, lFileSize, &ChunkSize, &lWrittenSizeTotal, &lHoleBytes, pCrc, bUnbuffered);
+            else if (bAsync)
+                bResult = NtFileCopyPipelined(hSrc, hDst, lReadSize, &QueueDepth, &ChunkSize, &lWrittenSizeTotal, pCrc, Flags, &lHoleBytes);
+            else
+                bResult = NtFileCopySynchronous(hSrc, hDst, &ChunkSize, &lWrittenSizeTotal, pCrc, bUnbuffered);
+        }
+    }
+
+    ntStatus = NtFileFinishCopy(hDst, lWrittenSizeTotal, (bResult && bHaveBasicInfo) ? &BasicInfo : NULL);
+    if (bResult && !NT_SUCCESS(ntStatus))
+    {
+        RtlCliDisplayString("Can't set the size and attributes of the destination (0x%.8X)\n", ntStatus);
+        bResult = FALSE;
+    }
+
+    NtFileCloseFile(hSrc);
+    NtFileCloseFile(hDst);
+
+    // The throughput is the copy's, without the read back
+    NtQueryPerformanceCounter(&EndTime, NULL);
+
+    if (bResult && pCrc)
+    {
+        bResult = NtFileVerifyCopy(pszDst, ChunkSize, lWrittenSizeTotal, Crc);
+    }
+
+    if (pStats)
+    {
+        pStats->BytesCopied = lWrittenSizeTotal;
+        pStats->ElapsedTicks = EndTime.QuadPart - StartTime.QuadPart;
+        pStats->Frequency = Frequency.QuadPart;
+        pStats->QueueDepth = QueueDepth;
+        pStats->ChunkSize = bMapped ? COPY_MAP_WINDOW : ChunkSize;
+        pStats->Mapped = bMapped;
+        pStats->Checksum = Crc;
+        pStats->Verified = (bResult && pCrc);
+        pStats->Flags = Flags;
+        pStats->HoleBytes = lHoleBytes;
+    }
+
+    return bResult;
+}
+
+BOOLEAN NtFileCopyFile(WCHAR *pszSrc, WCHAR *pszDst)
+{
+    return NtFileCopyFileEx(pszSrc, pszDst, NULL, NULL);
+}
+
+/*++
+ * @name NtFileCopyImage
+ *
+ * The NtFileCopyImage routine streams a disk or a partition to an image
+ * file, or an image file back to a disk or a partition.
+ *
+ * @param pszSrc
+ *        Device to dump, or image to restore. An NT path such as
+ *        \Device\Harddisk0\Partition1, or a full path in DOS format.
+ *
+ * @param pszDst
+ *        Image to create, or device to restore to, named the same way.
+ *
+ * @param bRestore
+ *        FALSE to dump, the image is overwritten. TRUE to restore, the
+ *        destination is written in place and must be large enough.
+ *
+ * @param pOptions
+ *        Optional queue depth, 2 or more, chunk size and flags. Only
+ *        NT_FILE_COPY_SKIP_ZEROS and NT_FILE_COPY_PROGRESS are used. NULL
+ *        keeps 4 chunks of 4 MB in flight.
+ *
+ * @param pStats
+ *        Optional, receives the number of bytes copied, the zeros
+ *        skipped and the time taken.
+ *
+ * @return TRUE if the whole image was copied, FALSE otherwise.
+ *
+ * @remarks Both ends are opened with NtFileOpenRaw and go through the
+ *          overlapped copy unbuffered, so either end can be a regular file
+ *          standing in for the device. Device reads stop at the exact end
+ *          of the device, which is a whole number of sectors but not
+ *          always of pages, so writes to a device are never padded and an
+ *          image must be whole 512 byte sectors to be restored. A dumped
+ *          image is preallocated, and made sparse when skipping zeros so
+ *          the chunks skipped are holes. Restoring with skipped zeros
+ *          leaves those chunks of the device as they were, which is only
+ *          right on a device known to be zeroed.
+ *
+ *--*/
+BOOLEAN NtFileCopyImage(PCWSTR pszSrc, PCWSTR pszDst, BOOLEAN bRestore, PNT_FILE_COPY_OPTIONS pOptions, PNT_FILE_COPY_STATS pStats)
+{
+    HANDLE hSrc = NULL;
+    HANDLE hDst = NULL;
+    ULONG QueueDepth = 4;
+    ULONG ChunkSize = 4 * 1024 * 1024;
+    ULONG Flags = 0;
+    LONGLONG lImageSize = 0;
+    LONGLONG lDeviceSize = 0;
+    LONGLONG lReadSize;
+    LONGLONG lWrittenSizeTotal = 0;
+    LONGLONG lZeroBytes = 0;
+    LARGE_INTEGER StartTime, EndTime, Frequency;
+    BOOLEAN bSrcDevice = FALSE;
+    BOOLEAN bDstDevice = FALSE;
+    BOOLEAN bResult = FALSE;
+    NTSTATUS ntStatus;
+
+    NtQueryPerformanceCounter(&StartTime, &Frequency);
+
+    if (pOptions)
+    {
+        QueueDepth = min(max(pOptions->QueueDepth, 2), COPY_MAX_QUEUE_DEPTH);
+        if (pOptions->ChunkSize)
+            ChunkSize = COPY_ALIGN(min(pOptions->ChunkSize, COPY_MAX_CHUNK));
+        Flags = pOptions->Flags & (NT_FILE_COPY_SKIP_ZEROS | NT_FILE_COPY_PROGRESS);
+    }
+
+    if (!NT_SUCCESS(NtFileOpenRaw(&hSrc, pszSrc, FALSE, FALSE)))
+    {
+        return FALSE;
+    }
+
+    if (!NT_SUCCESS(NtFileOpenRaw(&hDst, pszDst, TRUE, !bRestore)))
+    {
+        NtFileCloseFile(hSrc);
+        return FALSE;
+    }
+
+    if (!NtFileGetRawSize(hSrc, &lImageSize, &bSrcDevice))
+    {
+        RtlCliDisplayString("Can't get the size of the source.\n");
+    }
+    else if (!NtFileGetRawSize(hDst, &lDeviceSize, &bDstDevice))
+    {
+        RtlCliDisplayString("Can't get the size of the destination.\n");
+    }
+    else if (bDstDevice && lDeviceSize < lImageSize)
+    {
+        RtlCliDisplayString("The destination holds %I64u bytes, the image needs %I64u.\n",
+                            lDeviceSize, lImageSize);
+    }
+    else if (bDstDevice && (lImageSize % 512))
+    {
+        RtlCliDisplayString("The image is not a whole number of sectors.\n");
+    }
+    else if (!bDstDevice &&
+             !NT_SUCCESS(ntStatus = NtFilePreallocate(hDst, lImageSize, (Flags & NT_FILE_COPY_SKIP_ZEROS) != 0)))
+    {
+        RtlCliDisplayString("Can't allocate %I64u bytes for the destination (0x%.8X)\n",
+                            lImageSize, ntStatus);
+    }
+    else
+    {
+        // A device is read to its exact end, a file in whole pages
+        lReadSize = lImageSize;
+        if (!bSrcDevice)
+            lReadSize = (lImageSize + COPY_PAGE_SIZE - 1) & ~(LONGLONG)(COPY_PAGE_SIZE - 1);
+
+        // The queue and chunk size actually used are in the statistics
+        RtlCliDisplayString("%I64u MB\n", lImageSize / (1024 * 1024));
+
+        // Only a file gets its last chunk padded, that would run past the end of a device
+        bResult = NtFileCopyPipelined(hSrc, hDst, lReadSize, &QueueDepth, &ChunkSize, &lWrittenSizeTotal, NULL,
+                                      bDstDevice ? Flags : Flags | NT_FILE_COPY_UNBUFFERED, &lZeroBytes);
+    }
+
+    if (!bDstDevice)
+    {
+        ntStatus = NtFileFinishCopy(hDst, lWrittenSizeTotal, NULL);
+        if (bResult && !NT_SUCCESS(ntStatus))
+        {
+            RtlCliDisplayString("Can't set the size of the destination (0x%.8X)\n", ntStatus);
+            bResult = FALSE;
+        }
+    }
+
+    NtFileCloseFile(hSrc);
+    NtFileCloseFile(hDst);
+
+    NtQueryPerformanceCounter(&EndTime, NULL);
+
+    if (pStats)
+    {
+        memset(pStats, 0, sizeof(NT_FILE_COPY_STATS));
+        pStats->BytesCopied = lWrittenSizeTotal;
+        pStats->ElapsedTicks = EndTime.QuadPart - StartTime.QuadPart;
+        pStats->Frequency = Frequency.QuadPart;
+        pStats->QueueDepth = QueueDepth;
+        pStats->ChunkSize = ChunkSize;
+        pStats->Flags = Flags | NT_FILE_COPY_UNBUFFERED;
+        pStats->HoleBytes = lZeroBytes;
+    }
+
+    return bResult;
+}
+
+/*++
+ * @name RtlCliDisplayThroughput
+ *
+ * The RtlCliDisplayThroughput routine prints an amount of data, the time
+ * it took and the resulting rate.
+ *
+ * @param Bytes
+ *        Amount of data.
+ *
+ * @param ElapsedTicks
+ *        Time taken, in performance counter ticks.
+ *
+ * @param Frequency
+ *        Performance counter frequency.
+ *
+ * @return None.
+ *
+ * @remarks Integer arithmetic only, with milliseconds and tenths of MB/s.
+ *          No newline is printed, so callers can add details.
+ *
+ *--*/
+VOID
+RtlCliDisplayThroughput(IN LONGLONG Bytes, IN LONGLONG ElapsedTicks, IN LONGLONG Frequency)
+{
+    ULONGLONG Milliseconds = 0;
+    ULONGLONG Rate;
+
+    if (Frequency)
+        Milliseconds = (ULONGLONG)ElapsedTicks * 1000 / Frequency;
+
+    RtlCliDisplayString("%I64u bytes in %I64u.%03u s",
+                        Bytes,
+                        Milliseconds / 1000,
+                        (ULONG)(Milliseconds % 1000));
+
+    if (Milliseconds)
+    {
+        // Tenths of MB/s
+        Rate = (ULONGLONG)Bytes * 10000 / (1024 * 1024) / Milliseconds;
+        RtlCliDisplayString(", %I64u.%u MB/s", Rate / 10, (ULONG)(Rate % 10));
+    }
+}
+
+/*++
+ * @name RtlCliDisplayCopyStats
+ *
+ * The RtlCliDisplayCopyStats routine prints the size, time and throughput
+ * of a copy.
+ *
+ * @param Stats
+ *        Statistics filled in by the copy engine.
+ *
+ * @return None.
+ *
+ * @remarks None.
+ *
+ *--*/
+VOID
+RtlCliDisplayCopyStats(IN PNT_FILE_COPY_STATS Stats)
+{
+    RtlCliDisplayThroughput(Stats->BytesCopied, Stats->ElapsedTicks, Stats->Frequency);
+
+    if (Stats->Mapped)
+        RtlCliDisplayString(" (mapped, %u KB views)", Stats->ChunkSize / 1024);
+    else
+        RtlCliDisplayString(" (%u x %u KB)", Stats->QueueDepth, Stats->ChunkSize / 1024);
+
+    if (Stats->Flags & NT_FILE_COPY_UNBUFFERED)
+        RtlCliDisplayString(", unbuffered");
+
+    if (Stats->Flags & NT_FILE_COPY_SPARSE)
+        RtlCliDisplayString(", %I64u bytes of holes skipped", Stats->HoleBytes);
+    else if (Stats->Flags & NT_FILE_COPY_SKIP_ZEROS)
+        RtlCliDisplayString(", %I64u bytes of zeros skipped", Stats->HoleBytes);
+
+    if (Stats->Verified)
+        RtlCliDisplayString(", CRC32 %.8X verified", Stats->Checksum);
+
+    RtlCliDisplayString("\n");
+}
+
+/*++
+ * @name NtFileBenchmarkPass
+ *
+ * The NtFileBenchmarkPass routine moves a whole test file once and prints
+ * how long it took.
+ *
+ * @param hFile
+ *        Test file, opened with NtFileOpenUnbuffered for writing.
+ *
+ * @param Size
+ *        Size of the file, a multiple of NT_FILE_MAX_SEGMENTS pages.
+ *
+ * @param Buffer
+ *        Contiguous buffer of NT_FILE_MAX_SEGMENTS pages, or NULL.
+ *
+ * @param Pages
+ *        NT_FILE_MAX_SEGMENTS separate pages, used when Buffer is NULL.
+ *
+ * @param Write
+ *        TRUE to write the file, FALSE to read it.
+ *
+ * @return STATUS_SUCCESS or the failing status.
+ *
+ * @remarks Both paths move the same amount per system call, so the only
+ *          difference is the layout of the memory.
+ *
+ *--*/
+NTSTATUS
+NtFileBenchmarkPass(IN HANDLE hFile, IN LONGLONG Size, IN PVOID Buffer, IN PVOID *Pages, IN BOOLEAN Write)
+{
+    const ULONG Chunk = NT_FILE_MAX_SEGMENTS * NT_FILE_PAGE_SIZE;
+    LARGE_INTEGER StartTime, EndTime, Frequency;
+    IO_STATUS_BLOCK sIoStatus;
+    LARGE_INTEGER Offset;
+    ULONG Done;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    NtQueryPerformanceCounter(&StartTime, &Frequency);
+
+    for (Offset.QuadPart = 0; Offset.QuadPart < Size; Offset.QuadPart += Chunk)
+    {
+        if (Buffer)
+        {
+            memset(&sIoStatus, 0, sizeof(IO_STATUS_BLOCK));
+
+            if (Write)
+                Status = NtWriteFile(hFile, NULL, NULL, NULL, &sIoStatus, Buffer, Chunk, &Offset, NULL);
+            else
+                Status = NtReadFile(hFile, NULL, NULL, NULL, &sIoStatus, Buffer, Chunk, &Offset, NULL);
+
+            Done = sIoStatus.Information & MAXULONG;
+        }
+        else if (Write)
+        {
+            Status = NtFileWritePages(hFile, Pages, Chunk, Offset.QuadPart, &Done);
+        }
+        else
+        {
+            Status = NtFileReadPages(hFile, Pages, Chunk, Offset.QuadPart, &Done);
+        }
+
+        if (NT_SUCCESS(Status) && Done != Chunk)
+            Status = STATUS_UNSUCCESSFUL;
+        if (!NT_SUCCESS(Status))
+            return Status;
+    }
+
+    NtQueryPerformanceCounter(&EndTime, NULL);
+
+    RtlCliDisplayString("%-10s %-5s ", Buffer ? "contiguous" : "scatter", Write ? "write" : "read");
+    RtlCliDisplayThroughput(Size, EndTime.QuadPart - StartTime.QuadPart, Frequency.QuadPart);
+    RtlCliDisplayString("\n");
+
+    return Status;
+}
+
+/*++
+ * @name RtlCliBenchmarkScatterGather
+ *
+ * The RtlCliBenchmarkScatterGather routine compares unbuffered I/O through
+ * one contiguous buffer with scatter/gather I/O on separate pages.
+ *
+ * @param Path
+ *        Test file to create, full path in DOS format. It is deleted
+ *        afterwards.
+ *
+ * @param Size
+ *        Size of the test file, rounded up to NT_FILE_MAX_SEGMENTS pages.
+ *
+ * @return STATUS_SUCCESS or the failing status.
+ *
+ * @remarks The file is written and read once per path. The pages come
+ *          from every other page of one region, in reverse order, so none
+ *          of them are next to each other like the pages of a buffer pool.
+ *
+ *--*/
+NTSTATUS
+RtlCliBenchmarkScatterGather(IN PCWSTR Path, IN LONGLONG Size)
+{
+    const ULONG Chunk = NT_FILE_MAX_SEGMENTS * NT_FILE_PAGE_SIZE;
+    PVOID Pages[NT_FILE_MAX_SEGMENTS];
+    PVOID Buffer = NULL;
+    PVOID Region = NULL;
+    ULONG BufferSize = Chunk;
+    ULONG RegionSize = 2 * Chunk;
+    HANDLE hFile;
+    NTSTATUS Status;
+    ULONG i;
+
+    Size = (Size + Chunk - 1) & ~(LONGLONG)(Chunk - 1);
+
+    if (!NT_SUCCESS(NtFileAllocateCopyBuffer(&Buffer, &BufferSize)) || BufferSize != Chunk)
+    {
+        RtlCliDisplayString("Out of memory for the buffers.\n");
+        if (Buffer)
+            NtFileFreeCopyBuffer(Buffer);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    if (!NT_SUCCESS(NtFileAllocateCopyBuffer(&Region, &RegionSize)) || RegionSize != 2 * Chunk)
+    {
+        RtlCliDisplayString("Out of memory for the buffers.\n");
+        if (Region)
+            NtFileFreeCopyBuffer(Region);
+        NtFileFreeCopyBuffer(Buffer);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    for (i = 0; i < NT_FILE_MAX_SEGMENTS; i++)
+        Pages[i] = (PUCHAR)Region + (NT_FILE_MAX_SEGMENTS - 1 - i) * 2 * NT_FILE_PAGE_SIZE;
+
+    // Same data through both paths
+    for (i = 0; i < Chunk; i++)
+        ((PUCHAR)Buffer)[i] = (UCHAR)(i * 7 + 1);
+    for (i = 0; i < NT_FILE_MAX_SEGMENTS; i++)
+        RtlCopyMemory(Pages[i], (PUCHAR)Buffer + i * NT_FILE_PAGE_SIZE, NT_FILE_PAGE_SIZE);
+
+    if (!NtFileOpenUnbuffered(&hFile, Path, TRUE))
+    {
+        NtFileFreeCopyBuffer(Region);
+        NtFileFreeCopyBuffer(Buffer);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    RtlCliDisplayString("%I64u MB, %u KB per call\n", Size / (1024 * 1024), Chunk / 1024);
+
+    // Writes inside the file don't extend it on the timed passes
+    Status = NtFilePreallocate(hFile, Size, FALSE);
+
+    if (NT_SUCCESS(Status))
+        Status = NtFileBenchmarkPass(hFile, Size, Buffer, NULL, TRUE);
+    if (NT_SUCCESS(Status))
+        Status = NtFileBenchmarkPass(hFile, Size, Buffer, NULL, FALSE);
+    if (NT_SUCCESS(Status))
+        Status = NtFileBenchmarkPass(hFile, Size, NULL, Pages, TRUE);
+    if (NT_SUCCESS(Status))
+        Status = NtFileBenchmarkPass(hFile, Size, NULL, Pages, FALSE);
+
+    // The last pass read back what the gather writes put there
+    if (NT_SUCCESS(Status))
+    {
+        for (i = 0; i < NT_FILE_MAX_SEGMENTS; i++)
+        {
+            if (memcmp(Pages[i], (PUCHAR)Buffer + i * NT_FILE_PAGE_SIZE, NT_FILE_PAGE_SIZE))
+            {
+                RtlCliDisplayString("Scatter read returned the wrong data.\n");
+                Status = STATUS_UNSUCCESSFUL;
+                break;
+            }
+        }
+    }
+
+    NtFileCloseFile(hFile);
+    NtFileDeleteByDisposition(Path, 0);
+
+    NtFileFreeCopyBuffer(Region);
+    NtFileFreeCopyBuffer(Buffer);
+
+    return Status;
+}
+
+// Tree copy state shared by the walker and the pool threads
+typedef struct _COPY_TREE_CONTEXT
+{
+    CLI_THREAD_POOL Pool;
+    RTL_CRITICAL_SECTION Lock;
+    NT_FILE_COPY_OPTIONS Options;
+    PCWSTR Destination;
+    ULONG DestinationLength;
+    BOOLEAN Recurse;
+    ULONG Files;
+    ULONG Directories;
+    ULONG Failures;
+    LONGLONG Bytes;
+} COPY_TREE_CONTEXT, *PCOPY_TREE_CONTEXT;
+
+// One file to copy, both paths follow the structure
+typedef struct _COPY_TREE_JOB
+{
+    PCOPY_TREE_CONTEXT Context;
+    PWSTR Source;
+    PWSTR Destination;
+} COPY_TREE_JOB, *PCOPY_TREE_JOB;
+
+/*++
+ * @name NtFileCopyTreeWorker
+ *
+ * The NtFileCopyTreeWorker routine copies one file of a tree copy on a
+ * pool thread.
+ *
+ * @param Parameter
+ *        The COPY_TREE_JOB, freed here.
+ *
+ * @return None.
+ *
+ * @remarks None.
+ *
+ *--*/
+VOID
+NtFileCopyTreeWorker(IN PVOID Parameter)
+{
+    PCOPY_TREE_JOB Job = Parameter;
+    PCOPY_TREE_CONTEXT Context = Job->Context;
+    NT_FILE_COPY_STATS Stats;
+    BOOLEAN bResult;
+
+    bResult = NtFileCopyFileEx(Job->Source, Job->Destination, &Context->Options, &Stats);
+    if (!bResult)
+    {
+        RtlCliDisplayString("Failed to copy %S\n", Job->Source);
+    }
+
+    RtlEnterCriticalSection(&Context->Lock);
+    if (bResult)
+    {
+        Context->Files++;
+        Context->Bytes += Stats.BytesCopied;
+    }
+    else
+    {
+        Context->Failures++;
+    }
+    RtlLeaveCriticalSection(&Context->Lock);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Job);
+}
+
+/*++
+ * @name NtFileCopyTreeVisit
+ *
+ * The NtFileCopyTreeVisit routine handles one entry of the source tree.
+ *
+ * @param Visit
+ *        Kind of visit.
+ *
+ * @param Entry
+ *        Entry in the source tree.
+ *
+ * @param Parameter
+ *        The COPY_TREE_CONTEXT.
+ *
+ * @return STATUS_SUCCESS, the walk always goes on.
+ *
+ * @remarks Directories are created right away on the walking thread, so
+ *          they exist before any of their files is queued.
+ *
+ *--*/
+NTSTATUS
+NtFileCopyTreeVisit(IN CLI_TREE_VISIT Visit, IN PCLI_TREE_ENTRY Entry, IN PVOID Parameter)
+{
+    PCOPY_TREE_CONTEXT Context = Parameter;
+    PCOPY_TREE_JOB Job;
+    SIZE_T SourceLength, RelativeLength;
+    PWSTR Destination;
+
+    if (Visit == TreeVisitError)
+    {
+        RtlCliDisplayString("Can't read %S (0x%.8X)\n", Entry->Path, Entry->Status);
+        RtlEnterCriticalSection(&Context->Lock);
+        Context->Failures++;
+        RtlLeaveCriticalSection(&Context->Lock);
+        return STATUS_SUCCESS;
+    }
+
+    if (Visit == TreeLeaveDirectory || (Visit == TreeEnterDirectory && !Context->Recurse))
+        return STATUS_SUCCESS;
+
+    SourceLength = wcslen(Entry->Path) + 1;
+    RelativeLength = wcslen(Entry->RelativePath);
+
+    Job = RtlAllocateHeap(RtlGetProcessHeap(), 0,
+                          sizeof(COPY_TREE_JOB) +
+                              (SourceLength + Context->DestinationLength + 1 + RelativeLength + 1) * sizeof(WCHAR));
+    if (!Job)
+    {
+        RtlCliDisplayString("Out of memory for %S\n", Entry->Path);
+        RtlEnterCriticalSection(&Context->Lock);
+        Context->Failures++;
+        RtlLeaveCriticalSection(&Context->Lock);
+        return STATUS_SUCCESS;
+    }
+
+    Job->Context = Context;
+    Job->Source = (PWSTR)(Job + 1);
+    Job->Destination = Job->Source + SourceLength;
+    RtlCopyMemory(Job->Source, Entry->Path, SourceLength * sizeof(WCHAR));
+
+    Destination = Job->Destination;
+    RtlCopyMemory(Destination, Context->Destination, Context->DestinationLength * sizeof(WCHAR));
+    Destination += Context->DestinationLength;
+    *Destination++ = L'\\';
+    RtlCopyMemory(Destination, Entry->RelativePath, (RelativeLength + 1) * sizeof(WCHAR));
+
+    if (Visit == TreeEnterDirectory)
+    {
+        if (NtFileCreateDirectory(Job->Destination))
+        {
+            RtlEnterCriticalSection(&Context->Lock);
+            Context->Directories++;
+            RtlLeaveCriticalSection(&Context->Lock);
+        }
+        else
+        {
+            RtlCliDisplayString("Can't create %S\n", Job->Destination);
+            RtlEnterCriticalSection(&Context->Lock);
+            Context->Failures++;
+            RtlLeaveCriticalSection(&Context->Lock);
+        }
+
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Job);
+        return STATUS_SUCCESS;
+    }
+
+    RtlCliQueueWorkItem(&Context->Pool, NtFileCopyTreeWorker, Job);
+    return STATUS_SUCCESS;
+}
+
+/*++
+ * @name RtlCliCopyTree
+ *
+ * The RtlCliCopyTree routine copies the files of a directory, and
+ * optionally its subdirectories, with a pool of threads.
+ *
+ * @param Source
+ *        Source directory, full path in DOS format.
+ *
+ * @param Destination
+ *        Destination directory, full path in DOS format. It is created if
+ *        needed.
+ *
+ * @param Recurse
+ *        TRUE to copy subdirectories as well.
+ *
+ * @param Verify
+ *        TRUE to check every file against the CRC32 of its source.
+ *
+ * @param ThreadCount
+ *        Number of copy threads.
+ *
+ * @return STATUS_SUCCESS if every file was copied, STATUS_UNSUCCESSFUL if
+ *         some failed, or the status of a failure that stopped the copy.
+ *
+ * @remarks The calling thread walks the source and creates directories.
+ *          Every file is handed to a pool thread and copied with
+ *          NtFileCopyFileEx one chunk at a time, or through mapped views
+ *          from COPY_MAP_THRESHOLD up, so many small files are copied at
+ *          the same time. A summary is printed at the end.
+ *
+ *--*/
+NTSTATUS
+RtlCliCopyTree(IN PCWSTR Source,
+               IN PCWSTR Destination,
+               IN BOOLEAN Recurse,
+               IN BOOLEAN Verify,
+               IN ULONG ThreadCount)
+{
+    PCOPY_TREE_CONTEXT Context;
+    LARGE_INTEGER StartTime, EndTime, Frequency;
+    NTSTATUS Status;
+
+    if (!NtFileCreateDirectory(Destination))
+    {
+        RtlCliDisplayString("Can't create %S\n", Destination);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    // The pool is too large for the stack
+    Context = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(COPY_TREE_CONTEXT));
+    if (!Context)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    Context->Options.QueueDepth = 1;
+    if (Verify)
+        Context->Options.Flags |= NT_FILE_COPY_VERIFY;
+    Context->Destination = Destination;
+    Context->DestinationLength = wcslen(Destination);
+    Context->Recurse = Recurse;
+
+    // Entries are appended as "\name"
+    while (Context->DestinationLength && Destination[Context->DestinationLength - 1] == L'\\')
+        Context->DestinationLength--;
+
+    Status = RtlCliCreateThreadPool(&Context->Pool, ThreadCount);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Context);
+        return Status;
+    }
+
+    RtlInitializeCriticalSection(&Context->Lock);
+
+    // The pool may run with fewer threads than asked for
+    ThreadCount = Context->Pool.ThreadCount;
+
+    NtQueryPerformanceCounter(&StartTime, &Frequency);
+
+    Status = RtlCliWalkTree(Source, Recurse, NtFileCopyTreeVisit, Context);
+
+    // Let the copies in flight finish before reporting
+    RtlCliDestroyThreadPool(&Context->Pool);
+
+    NtQueryPerformanceCounter(&EndTime, NULL);
+
+    RtlCliDisplayString("%u files, %u directories, ", Context->Files, Context->Directories);
+    RtlCliDisplayThroughput(Context->Bytes, EndTime.QuadPart - StartTime.QuadPart, Frequency.QuadPart);
+    RtlCliDisplayString(", %u threads, %u failed%s\n",
+                        ThreadCount,
+                        Context->Failures,
+                        Verify ? ", verified" : "");
+
+    if (NT_SUCCESS(Status) && Context->Failures)
+        Status = STATUS_UNSUCCESSFUL;
+
+    RtlDeleteCriticalSection(&Context->Lock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Context);
+
+    return Status;
+}
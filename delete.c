@@ -0,0 +1,360 @@
+/**
+ * PROJECT:         Native Shell
+ * COPYRIGHT:       LGPL; See LICENSE in the top level directory
+ * FILE:            delete.c
+ * DESCRIPTION:     Parallel tree delete.
+ * DEVELOPERS:      See CONTRIBUTORS.md in the top level directory
+ */
+
+#include "precomp.h"
+
+// Tree delete state shared by the walker and the pool threads
+typedef struct _DELETE_TREE_CONTEXT
+{
+    CLI_THREAD_POOL Pool;
+    RTL_CRITICAL_SECTION Lock;
+    BOOLEAN RemoveDirectories;
+    ULONG Files;
+    ULONG Directories;
+    ULONG Failures;
+} DELETE_TREE_CONTEXT, *PDELETE_TREE_CONTEXT;
+
+// One entry of the root directory, the path follows the structure
+typedef struct _DELETE_TREE_JOB
+{
+    PDELETE_TREE_CONTEXT Context;
+    ULONG Attributes;
+    ULONG Files;
+    ULONG Directories;
+    ULONG Failures;
+    PWSTR Path;
+} DELETE_TREE_JOB, *PDELETE_TREE_JOB;
+
+/*++
+ * @name NtFileDeleteTreeEntry
+ *
+ * The NtFileDeleteTreeEntry routine deletes one file or empty directory
+ * and counts the result in the job.
+ *
+ * @param Job
+ *        Job the entry belongs to.
+ *
+ * @param Path
+ *        Entry to delete, full path in DOS format.
+ *
+ * @param Attributes
+ *        Attributes of the entry from the directory listing.
+ *
+ * @return None.
+ *
+ * @remarks None.
+ *
+ *--*/
+VOID
+NtFileDeleteTreeEntry(IN PDELETE_TREE_JOB Job, IN PCWSTR Path, IN ULONG Attributes)
+{
+    NTSTATUS Status;
+
+    Status = NtFileDeleteByDisposition(Path, Attributes);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlCliDisplayString("Can't delete %S (0x%.8X)\n", Path, Status);
+        Job->Failures++;
+    }
+    else if (Attributes & FILE_ATTRIBUTE_DIRECTORY)
+    {
+        Job->Directories++;
+    }
+    else
+    {
+        Job->Files++;
+    }
+}
+
+/*++
+ * @name NtFileDeleteSubtreeVisit
+ *
+ * The NtFileDeleteSubtreeVisit routine handles one entry below a
+ * directory of the root.
+ *
+ * @param Visit
+ *        Kind of visit.
+ *
+ * @param Entry
+ *        Entry in the subtree.
+ *
+ * @param Parameter
+ *        The DELETE_TREE_JOB of the subtree.
+ *
+ * @return STATUS_SUCCESS, the walk always goes on.
+ *
+ * @remarks Files are deleted as they are listed. Directories are deleted on
+ *          TreeLeaveDirectory, after everything in them, so the tree is
+ *          removed bottom-up in a single pass.
+ *
+ *--*/
+NTSTATUS
+NtFileDeleteSubtreeVisit(IN CLI_TREE_VISIT Visit, IN PCLI_TREE_ENTRY Entry, IN PVOID Parameter)
+{
+    PDELETE_TREE_JOB Job = Parameter;
+
+    switch (Visit)
+    {
+        case TreeVisitFile:
+            NtFileDeleteTreeEntry(Job, Entry->Path, Entry->Attributes);
+            break;
+
+        case TreeLeaveDirectory:
+            if (Job->Context->RemoveDirectories)
+                NtFileDeleteTreeEntry(Job, Entry->Path, Entry->Attributes);
+            break;
+
+        case TreeVisitError:
+            RtlCliDisplayString("Can't read %S (0x%.8X)\n", Entry->Path, Entry->Status);
+            Job->Failures++;
+            break;
+
+        default:
+            break;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*++
+ * @name NtFileDeleteTreeWorker
+ *
+ * The NtFileDeleteTreeWorker routine deletes one entry of the root
+ * directory, with everything below it, on a pool thread.
+ *
+ * @param Parameter
+ *        The DELETE_TREE_JOB, freed here.
+ *
+ * @return None.
+ *
+ * @remarks Counts are kept in the job and added to the context once, so
+ *          the lock isn't taken for every file.
+ *
+ *--*/
+VOID
+NtFileDeleteTreeWorker(IN PVOID Parameter)
+{
+    PDELETE_TREE_JOB Job = Parameter;
+    PDELETE_TREE_CONTEXT Context = Job->Context;
+    NTSTATUS Status;
+
+    if (!(Job->Attributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        NtFileDeleteTreeEntry(Job, Job->Path, Job->Attributes);
+    }
+    else
+    {
+        // Junctions and links are removed, never walked into
+        if (!(Job->Attributes & FILE_ATTRIBUTE_REPARSE_POINT))
+        {
+            Status = RtlCliWalkTree(Job->Path, TRUE, NtFileDeleteSubtreeVisit, Job);
+            if (!NT_SUCCESS(Status))
+            {
+                RtlCliDisplayString("Can't read %S (0x%.8X)\n", Job->Path, Status);
+                Job->Failures++;
+            }
+        }
+
+        if (Context->RemoveDirectories)
+            NtFileDeleteTreeEntry(Job, Job->Path, Job->Attributes);
+    }
+
+    RtlEnterCriticalSection(&Context->Lock);
+    Context->Files += Job->Files;
+    Context->Directories += Job->Directories;
+    Context->Failures += Job->Failures;
+    RtlLeaveCriticalSection(&Context->Lock);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Job);
+}
+
+/*++
+ * @name NtFileDeleteTreeVisit
+ *
+ * The NtFileDeleteTreeVisit routine hands one entry of the root directory
+ * to the pool.
+ *
+ * @param Visit
+ *        Kind of visit.
+ *
+ * @param Entry
+ *        Entry in the root directory.
+ *
+ * @param Parameter
+ *        The DELETE_TREE_CONTEXT.
+ *
+ * @return STATUS_SUCCESS, the walk always goes on.
+ *
+ * @remarks Every subdirectory of the root becomes one job, so sibling
+ *          subtrees are deleted at the same time.
+ *
+ *--*/
+NTSTATUS
+NtFileDeleteTreeVisit(IN CLI_TREE_VISIT Visit, IN PCLI_TREE_ENTRY Entry, IN PVOID Parameter)
+{
+    PDELETE_TREE_CONTEXT Context = Parameter;
+    PDELETE_TREE_JOB Job;
+    SIZE_T PathLength;
+
+    if (Visit == TreeVisitError)
+    {
+        RtlCliDisplayString("Can't read %S (0x%.8X)\n", Entry->Path, Entry->Status);
+        RtlEnterCriticalSection(&Context->Lock);
+        Context->Failures++;
+        RtlLeaveCriticalSection(&Context->Lock);
+        return STATUS_SUCCESS;
+    }
+
+    if (Visit == TreeLeaveDirectory)
+        return STATUS_SUCCESS;
+
+    // Without /s a link to a directory has nothing to delete
+    if (Visit == TreeEnterDirectory && !Context->RemoveDirectories &&
+        (Entry->Attributes & FILE_ATTRIBUTE_REPARSE_POINT))
+    {
+        return STATUS_SUCCESS;
+    }
+
+    PathLength = wcslen(Entry->Path) + 1;
+
+    Job = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY,
+                          sizeof(DELETE_TREE_JOB) + PathLength * sizeof(WCHAR));
+    if (!Job)
+    {
+        RtlCliDisplayString("Out of memory for %S\n", Entry->Path);
+        RtlEnterCriticalSection(&Context->Lock);
+        Context->Failures++;
+        RtlLeaveCriticalSection(&Context->Lock);
+        return STATUS_SUCCESS;
+    }
+
+    Job->Context = Context;
+    Job->Attributes = Entry->Attributes;
+    Job->Path = (PWSTR)(Job + 1);
+    RtlCopyMemory(Job->Path, Entry->Path, PathLength * sizeof(WCHAR));
+
+    RtlCliQueueWorkItem(&Context->Pool, NtFileDeleteTreeWorker, Job);
+    return STATUS_SUCCESS;
+}
+
+/*++
+ * @name NtFileIsVolumeRoot
+ *
+ * The NtFileIsVolumeRoot routine tells if a path is the root directory of
+ * a drive.
+ *
+ * @param Path
+ *        Full path in DOS format.
+ *
+ * @return TRUE for "X:" followed by nothing but backslashes.
+ *
+ * @remarks None.
+ *
+ *--*/
+BOOLEAN
+NtFileIsVolumeRoot(IN PCWSTR Path)
+{
+    if (!Path[0] || Path[1] != L':')
+        return FALSE;
+
+    for (Path += 2; *Path == L'\\'; Path++);
+
+    return !*Path;
+}
+
+/*++
+ * @name RtlCliDeleteTree
+ *
+ * The RtlCliDeleteTree routine deletes every file below a directory, and
+ * optionally the directories too, with a pool of threads.
+ *
+ * @param Path
+ *        Directory to delete, full path in DOS format.
+ *
+ * @param RemoveDirectories
+ *        TRUE to remove the directories and Path itself as well, FALSE to
+ *        delete the files only.
+ *
+ * @param ThreadCount
+ *        Number of delete threads.
+ *
+ * @return STATUS_SUCCESS if everything was deleted, STATUS_UNSUCCESSFUL if
+ *         something failed or Path is the root directory of a drive, or
+ *         the status of a failure that stopped the delete.
+ *
+ * @remarks The calling thread lists Path only. Each of its subdirectories
+ *          is walked once, by the pool thread that deletes it. Every entry
+ *          is deleted by opening it and setting FileDispositionInformation,
+ *          with the attributes the listing already returned. Path itself
+ *          isn't listed, so it is made writable only if the first delete
+ *          finds it read-only. A summary is printed at the end.
+ *
+ *--*/
+NTSTATUS
+RtlCliDeleteTree(IN PCWSTR Path, IN BOOLEAN RemoveDirectories, IN ULONG ThreadCount)
+{
+    PDELETE_TREE_CONTEXT Context;
+    NTSTATUS Status, DeleteStatus;
+
+    // A whole drive is never deleted by accident
+    if (NtFileIsVolumeRoot(Path))
+    {
+        RtlCliDisplayString("Won't delete the root directory of a drive.\n");
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    // The pool is too large for the stack
+    Context = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DELETE_TREE_CONTEXT));
+    if (!Context)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    Context->RemoveDirectories = RemoveDirectories;
+
+    Status = RtlCliCreateThreadPool(&Context->Pool, ThreadCount);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Context);
+        return Status;
+    }
+
+    RtlInitializeCriticalSection(&Context->Lock);
+
+    Status = RtlCliWalkTree(Path, FALSE, NtFileDeleteTreeVisit, Context);
+
+    // Every subtree must be gone before the root can be removed
+    RtlCliDestroyThreadPool(&Context->Pool);
+
+    if (NT_SUCCESS(Status) && RemoveDirectories)
+    {
+        DeleteStatus = NtFileDeleteByDisposition(Path, FILE_ATTRIBUTE_DIRECTORY);
+        if (DeleteStatus == STATUS_CANNOT_DELETE)
+            DeleteStatus = NtFileDeleteByDisposition(Path, FILE_ATTRIBUTE_DIRECTORY | FILE_ATTRIBUTE_READONLY);
+        if (NT_SUCCESS(DeleteStatus))
+        {
+            Context->Directories++;
+        }
+        else
+        {
+            RtlCliDisplayString("Can't delete %S (0x%.8X)\n", Path, DeleteStatus);
+            Context->Failures++;
+        }
+    }
+
+    RtlCliDisplayString("%u files, %u directories deleted, %u failed\n",
+                        Context->Files,
+                        Context->Directories,
+                        Context->Failures);
+
+    if (NT_SUCCESS(Status) && Context->Failures)
+        Status = STATUS_UNSUCCESSFUL;
+
+    RtlDeleteCriticalSection(&Context->Lock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Context);
+
+    return Status;
+}
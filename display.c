@@ -8,10 +8,249 @@
 
 #include "precomp.h"
 
-WCHAR DisplayBuffer[1024];
+#define DISPLAY_BUFFER_SIZE 1024
+#define OUTPUT_BUFFER_SIZE 4096
+
+// Logical line as it should look (the cursor is always at its end)
+WCHAR DisplayBuffer[DISPLAY_BUFFER_SIZE];
 USHORT LinePos = 0;
-WCHAR PutChar[2] = L" ";
-UNICODE_STRING CharString = {2, 2, PutChar};
+
+// Logical line as it has been drawn, including output still pending
+WCHAR ScreenBuffer[DISPLAY_BUFFER_SIZE];
+USHORT ScreenPos = 0;
+
+// Set when DisplayBuffer has changed in a way that is not a plain append
+BOOLEAN LineDirty = FALSE;
+
+// Pending output, sent to NtDisplayString once per line or per flush
+WCHAR OutputBuffer[OUTPUT_BUFFER_SIZE];
+USHORT OutputPos = 0;
+
+// Serializes the public display routines between threads
+RTL_CRITICAL_SECTION DisplayLock;
+
+NTSTATUS
+RtlClipRenderLine(
+    VOID);
+
+NTSTATUS
+RtlClipPutChar(
+    IN WCHAR Char);
+
+/*++
+ * @name RtlCliInitializeDisplay
+ *
+ * The RtlCliInitializeDisplay routine prepares the display module.
+ *
+ * @param None.
+ *
+ * @return None.
+ *
+ * @remarks Must be called before any other display routine. Every public
+ *          routine holds the display lock, so a message printed by one
+ *          thread is never cut by another, and worker threads can report
+ *          while the shell thread prints.
+ *
+ *--*/
+VOID
+RtlCliInitializeDisplay(VOID)
+{
+    RtlInitializeCriticalSection(&DisplayLock);
+}
+
+/*++
+ * @name RtlClipFlush
+ *
+ * The RtlClipFlush routine implements RtlCliFlush.
+ *
+ * @remarks The caller holds the display lock.
+ *
+ *--*/
+NTSTATUS
+RtlClipFlush(VOID)
+{
+    UNICODE_STRING OutputString;
+
+    if (LineDirty)
+        RtlClipRenderLine();
+
+    if (!OutputPos)
+        return STATUS_SUCCESS;
+
+    OutputString.Buffer = OutputBuffer;
+    OutputString.Length = OutputPos * sizeof(WCHAR);
+    OutputString.MaximumLength = OutputString.Length;
+
+    OutputPos = 0;
+
+    return NtDisplayString(&OutputString);
+}
+
+/*++
+ * @name RtlCliFlush
+ *
+ * The RtlCliFlush routine sends all pending output to the display device.
+ *
+ * @param None.
+ *
+ * @return STATUS_SUCCESS or failure code.
+ *
+ * @remarks Output is normally flushed at the end of every line. Callers must
+ *          flush explicitly before waiting for input or giving the screen
+ *          to another process, so that a partial line becomes visible.
+ *          Pending line edits are drawn here, once per flush.
+ *
+ *--*/
+NTSTATUS
+RtlCliFlush(VOID)
+{
+    NTSTATUS Status;
+
+    RtlEnterCriticalSection(&DisplayLock);
+    Status = RtlClipFlush();
+    RtlLeaveCriticalSection(&DisplayLock);
+
+    return Status;
+}
+
+/*++
+ * @name RtlClipQueueChar
+ *
+ * The RtlClipQueueChar routine adds a character to the pending output
+ * without touching the line buffer.
+ *
+ * @param Char
+ *        Character to queue.
+ *
+ * @return STATUS_SUCCESS or failure code if a flush was needed and failed.
+ *
+ * @remarks None.
+ *
+ *--*/
+NTSTATUS
+RtlClipQueueChar(IN WCHAR Char)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    // Make room if the buffer is full
+    if (OutputPos == OUTPUT_BUFFER_SIZE)
+        Status = RtlClipFlush();
+
+    OutputBuffer[OutputPos++] = Char;
+
+    // A complete line goes out in one call
+    if (Char == L'\n')
+        Status = RtlClipFlush();
+
+    return Status;
+}
+
+/*++
+ * @name RtlClipQueueSpan
+ *
+ * The RtlClipQueueSpan routine queues a part of the logical line.
+ *
+ * @param Start
+ *        Index of the first character in DisplayBuffer.
+ *
+ * @param End
+ *        Index one past the last character in DisplayBuffer.
+ *
+ * @return STATUS_SUCCESS or failure code.
+ *
+ * @remarks None.
+ *
+ *--*/
+NTSTATUS
+RtlClipQueueSpan(IN USHORT Start,
+                 IN USHORT End)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    while (Start < End)
+        Status = RtlClipQueueChar(DisplayBuffer[Start++]);
+
+    return Status;
+}
+
+/*++
+ * @name RtlClipRenderLine
+ *
+ * The RtlClipRenderLine routine brings the drawn line up to date with the
+ * logical line.
+ *
+ * @param None.
+ *
+ * @return STATUS_SUCCESS or failure code.
+ *
+ * @remarks NtDisplayString has no way to move the cursor left other than a
+ *          carriage return to the start of the current screen row, so only
+ *          the part of the line that follows the first changed character is
+ *          considered:
+ *
+ *          - if the drawn line is a prefix of the new one, only the new
+ *            characters are printed;
+ *          - if the change is on the cursor row, only that row is printed
+ *            again, padded with spaces when it got shorter;
+ *          - if the change is on a row above (the line wraps), the line is
+ *            printed again on a fresh row, since we cannot move up.
+ *
+ *--*/
+NTSTATUS
+RtlClipRenderLine(VOID)
+{
+    NTSTATUS Status;
+    USHORT Diff, RowStart, Pad;
+
+    // Clear it first, the carriage returns below flush through here
+    LineDirty = FALSE;
+
+    // Find the first character that differs from what's on screen
+    for (Diff = 0; Diff < LinePos && Diff < ScreenPos; Diff++)
+    {
+        if (DisplayBuffer[Diff] != ScreenBuffer[Diff])
+            break;
+    }
+
+    // The cursor row starts at the last wrap point
+    RowStart = ScreenPos - (ScreenPos % DISPLAY_COLUMNS);
+
+    if (Diff == ScreenPos)
+    {
+        // Only additions, just print them
+        Status = RtlClipQueueSpan(ScreenPos, LinePos);
+    }
+    else if (Diff >= RowStart && ScreenPos != RowStart)
+    {
+        // Redraw the cursor row
+        Status = RtlClipQueueChar(L'\r');
+        Status = RtlClipQueueSpan(RowStart, LinePos);
+
+        // Blank out what's left of the old text and come back
+        if (ScreenPos > LinePos)
+        {
+            for (Pad = LinePos; Pad < ScreenPos; Pad++)
+                Status = RtlClipQueueChar(L' ');
+
+            Status = RtlClipQueueChar(L'\r');
+            Status = RtlClipQueueSpan(RowStart, LinePos);
+        }
+    }
+    else
+    {
+        // The change is above the cursor row, start over on a new row
+        Status = RtlClipQueueChar(L'\n');
+        Status = RtlClipQueueSpan(0, LinePos);
+    }
+
+    // The screen now matches the line
+    RtlCopyMemory(&ScreenBuffer[Diff],
+                  &DisplayBuffer[Diff],
+                  (LinePos - Diff) * sizeof(WCHAR));
+    ScreenPos = LinePos;
+
+    return Status;
+}
 
 /*++
  * @name RtlCliPrintString
@@ -30,16 +269,69 @@ NTSTATUS
 RtlCliPrintString(IN PUNICODE_STRING Message)
 {
     ULONG i;
-    NTSTATUS Status;
+    NTSTATUS Status = STATUS_SUCCESS;
 
+    RtlEnterCriticalSection(&DisplayLock);
     for (i = 0; i < (Message->Length / sizeof(WCHAR)); i++)
     {
-        Status = RtlCliPutChar(Message->Buffer[i]);
+        Status = RtlClipPutChar(Message->Buffer[i]);
     }
+    RtlLeaveCriticalSection(&DisplayLock);
 
     return Status;
 }
 
+/*++
+ * @name RtlClipPutChar
+ *
+ * The RtlClipPutChar routine implements RtlCliPutChar.
+ *
+ * @remarks The caller holds the display lock.
+ *
+ *--*/
+NTSTATUS
+RtlClipPutChar(IN WCHAR Char)
+{
+    // Check if it's a new line or a carriage return
+    if (Char == '\n' || Char == '\r')
+    {
+        // Finish drawing the current line first
+        if (LineDirty)
+            RtlClipRenderLine();
+
+        // Reset the display buffer
+        LinePos = 0;
+        ScreenPos = 0;
+        DisplayBuffer[LinePos] = UNICODE_NULL;
+
+        return RtlClipQueueChar(Char);
+    }
+
+    // Add the character in our buffer
+    if (LinePos < DISPLAY_BUFFER_SIZE - 1)
+    {
+        DisplayBuffer[LinePos] = Char;
+        LinePos++;
+    }
+    else
+    {
+        // Too long to track, the line can't be edited any more: draw the
+        // pending edits, the rest goes straight to the screen
+        if (LineDirty)
+            RtlClipRenderLine();
+        ScreenPos = LinePos;
+    }
+
+    if (LineDirty)
+        return STATUS_SUCCESS;
+
+    // The screen keeps up with the line, queue the character
+    if (ScreenPos < DISPLAY_BUFFER_SIZE - 1)
+        ScreenBuffer[ScreenPos++] = Char;
+
+    return RtlClipQueueChar(Char);
+}
+
 /*++
  * @name RtlCliPutChar
  *
@@ -50,35 +342,20 @@ RtlCliPrintString(IN PUNICODE_STRING Message)
  *
  * @return STATUS_SUCCESS or failure code.
  *
- * @remarks None.
+ * @remarks While the line has pending edits the character only goes to the
+ *          line buffer and is drawn with the next flush.
  *
  *--*/
 NTSTATUS
 RtlCliPutChar(IN WCHAR Char)
 {
-    // Initialize the string
-    CharString.Buffer[0] = Char;
+    NTSTATUS Status;
 
-    // Make sure that this isn't backspace
-    if (Char != '\r')
-    {
-        // Check if it's a new line
-        if (Char == '\n')
-        {
-            // Reset the display buffer
-            LinePos = 0;
-            DisplayBuffer[LinePos] = UNICODE_NULL;
-        }
-        else
-        {
-            // Add the character in our buffer
-            DisplayBuffer[LinePos] = Char;
-            LinePos++;
-        }
-    }
+    RtlEnterCriticalSection(&DisplayLock);
+    Status = RtlClipPutChar(Char);
+    RtlLeaveCriticalSection(&DisplayLock);
 
-    // Print the character
-    return NtDisplayString(&CharString);
+    return Status;
 }
 
 /*++
@@ -88,52 +365,419 @@ RtlCliPutChar(IN WCHAR Char)
  *
  * @param None.
  *
- * @return STATUS_SUCCESS or failure code if printing failed.
+ * @return STATUS_SUCCESS.
  *
- * @remarks Backspace is handled by printing the previous string minus the last
- *          two characters.
+ * @remarks Only the line buffer is changed here. The screen is updated by
+ *          RtlClipRenderLine at the next flush, so several edits between
+ *          two keyboard reads cost a single redraw.
  *
  *--*/
 NTSTATUS
 RtlClipBackspace(VOID)
 {
-    UNICODE_STRING BackString;
+    RtlEnterCriticalSection(&DisplayLock);
+
+    if (LinePos)
+    {
+        // Update the line position
+        LinePos--;
+
+        // Finalize this buffer
+        DisplayBuffer[LinePos] = UNICODE_NULL;
+
+        // Draw it later
+        LineDirty = TRUE;
+    }
+
+    RtlLeaveCriticalSection(&DisplayLock);
+
+    return STATUS_SUCCESS;
+}
+
+/*++
+ * @name RtlClipPutAnsiChar
+ *
+ * The RtlClipPutAnsiChar routine displays a character of an ANSI string.
+ *
+ * @param Char
+ *        Character to print out.
+ *
+ * @return STATUS_SUCCESS or failure code.
+ *
+ * @remarks Plain ASCII is widened directly, anything else goes through the
+ *          ANSI code page like RtlCreateUnicodeStringFromAsciiz would do.
+ *
+ *--*/
+NTSTATUS
+RtlClipPutAnsiChar(IN CHAR Char)
+{
+    WCHAR WideChar;
+
+    if ((UCHAR)Char < 0x80)
+        return RtlCliPutChar((WCHAR)Char);
+
+    WideChar = L'?';
+    RtlMultiByteToUnicodeN(&WideChar, sizeof(WCHAR), NULL, &Char, 1);
+    return RtlCliPutChar(WideChar);
+}
+
+/*++
+ * @name RtlClipPutPadding
+ *
+ * The RtlClipPutPadding routine displays a character several times.
+ *
+ * @param Char
+ *        Padding character.
+ *
+ * @param Count
+ *        How many times to print it. Zero or less prints nothing.
+ *
+ * @return STATUS_SUCCESS or failure code.
+ *
+ * @remarks None.
+ *
+ *--*/
+NTSTATUS
+RtlClipPutPadding(IN WCHAR Char,
+                  IN LONG Count)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    while (Count-- > 0)
+        Status = RtlClipPutChar(Char);
+
+    return Status;
+}
+
+/*++
+ * @name RtlClipFormatString
+ *
+ * The RtlClipFormatString routine formats a message straight into the
+ * console output buffer.
+ *
+ * @param Format
+ *        printf-style format string.
+ *
+ * @param Arguments
+ *        Arguments for the format string.
+ *
+ * @return STATUS_SUCCESS or failure code.
+ *
+ * @remarks No memory is allocated and the length of the result is not
+ *          limited. Supported are the flags '-' and '0', width and precision
+ *          (including '*'), the 'h', 'l', 'll' and 'I64' size prefixes and the
+ *          conversions c, C, s, S, d, i, u, x, X, p and %.
+ *
+ *--*/
+NTSTATUS
+RtlClipFormatString(IN PCH Format,
+                    IN va_list Arguments)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    CHAR Digits[24];
+    PCSTR HexDigits;
+    BOOLEAN LeftAlign, ZeroPad, Negative, Is64Bit;
+    LONG Width, Precision, Length, i;
+    ULONGLONG Value;
+    ULONG Base;
+    PCSTR AnsiString;
+    PCWSTR WideString;
+
+    while (*Format)
+    {
+        // Copy ordinary characters
+        if (*Format != '%')
+        {
+            Status = RtlClipPutAnsiChar(*Format++);
+            continue;
+        }
+        Format++;
+
+        // Flags
+        LeftAlign = FALSE;
+        ZeroPad = FALSE;
+        for (;; Format++)
+        {
+            if (*Format == '-')
+                LeftAlign = TRUE;
+            else if (*Format == '0')
+                ZeroPad = TRUE;
+            else if (*Format != ' ' && *Format != '+' && *Format != '#')
+                break;
+        }
+
+        // Width
+        Width = 0;
+        if (*Format == '*')
+        {
+            Width = va_arg(Arguments, INT);
+            if (Width < 0)
+            {
+                LeftAlign = TRUE;
+                Width = -Width;
+            }
+            Format++;
+        }
+        while (*Format >= '0' && *Format <= '9')
+            Width = Width * 10 + (*Format++ - '0');
+
+        // Precision
+        Precision = -1;
+        if (*Format == '.')
+        {
+            Format++;
+            Precision = 0;
+            if (*Format == '*')
+            {
+                Precision = va_arg(Arguments, INT);
+                Format++;
+            }
+            while (*Format >= '0' && *Format <= '9')
+                Precision = Precision * 10 + (*Format++ - '0');
+        }
 
-    // Update the line position
-    LinePos--;
+        // Size prefix
+        Is64Bit = FALSE;
+        if (Format[0] == 'I' && Format[1] == '6' && Format[2] == '4')
+        {
+            Is64Bit = TRUE;
+            Format += 3;
+        }
+        else if (Format[0] == 'l' && Format[1] == 'l')
+        {
+            Is64Bit = TRUE;
+            Format += 2;
+        }
+        else if (*Format == 'l' || *Format == 'h')
+        {
+            Format++;
+        }
 
-    // Finalize this buffer and make it unicode
-    DisplayBuffer[LinePos] = ANSI_NULL;
-    RtlInitUnicodeString(&BackString, DisplayBuffer);
+        Base = 10;
+        HexDigits = "0123456789abcdef";
+        Negative = FALSE;
 
-    // Display the buffer
-    return NtDisplayString(&BackString);
+        switch (*Format)
+        {
+        case 'c':
+        case 'C':
+            Status = RtlClipPutPadding(L' ', LeftAlign ? 0 : Width - 1);
+            if (*Format == 'c')
+                Status = RtlClipPutAnsiChar((CHAR)va_arg(Arguments, INT));
+            else
+                Status = RtlClipPutChar((WCHAR)va_arg(Arguments, INT));
+            Status = RtlClipPutPadding(L' ', LeftAlign ? Width - 1 : 0);
+            Format++;
+            continue;
+
+        case 's':
+            AnsiString = va_arg(Arguments, PCSTR);
+            if (!AnsiString)
+                AnsiString = "(null)";
+            for (Length = 0;
+                 (Precision < 0 || Length < Precision) && AnsiString[Length];
+                 Length++);
+            Status = RtlClipPutPadding(L' ', LeftAlign ? 0 : Width - Length);
+            for (i = 0; i < Length; i++)
+                Status = RtlClipPutAnsiChar(AnsiString[i]);
+            Status = RtlClipPutPadding(L' ', LeftAlign ? Width - Length : 0);
+            Format++;
+            continue;
+
+        case 'S':
+            WideString = va_arg(Arguments, PCWSTR);
+            if (!WideString)
+                WideString = L"(null)";
+            for (Length = 0;
+                 (Precision < 0 || Length < Precision) && WideString[Length];
+                 Length++);
+            Status = RtlClipPutPadding(L' ', LeftAlign ? 0 : Width - Length);
+            for (i = 0; i < Length; i++)
+                Status = RtlClipPutChar(WideString[i]);
+            Status = RtlClipPutPadding(L' ', LeftAlign ? Width - Length : 0);
+            Format++;
+            continue;
+
+        case 'd':
+        case 'i':
+            if (Is64Bit)
+            {
+                LONGLONG Signed = va_arg(Arguments, LONGLONG);
+                Negative = (Signed < 0);
+                Value = Negative ? 0 - (ULONGLONG)Signed : (ULONGLONG)Signed;
+            }
+            else
+            {
+                LONG Signed = va_arg(Arguments, LONG);
+                Negative = (Signed < 0);
+                Value = Negative ? 0 - (ULONG)Signed : (ULONG)Signed;
+            }
+            break;
+
+        case 'u':
+        case 'x':
+        case 'X':
+            if (*Format != 'u')
+                Base = 16;
+            if (*Format == 'X')
+                HexDigits = "0123456789ABCDEF";
+            if (Is64Bit)
+                Value = va_arg(Arguments, ULONGLONG);
+            else
+                Value = va_arg(Arguments, ULONG);
+            break;
+
+        case 'p':
+            Base = 16;
+            HexDigits = "0123456789ABCDEF";
+            Value = (ULONG_PTR)va_arg(Arguments, PVOID);
+            Precision = sizeof(PVOID) * 2;
+            break;
+
+        case '%':
+            Status = RtlClipPutChar(L'%');
+            Format++;
+            continue;
+
+        default:
+            // Unknown conversion, print it as it is
+            if (!*Format)
+                continue;
+            Status = RtlClipPutChar(L'%');
+            Status = RtlClipPutAnsiChar(*Format++);
+            continue;
+        }
+        Format++;
+
+        // Convert the number, least significant digit first
+        Length = 0;
+        do
+        {
+            Digits[Length++] = HexDigits[Value % Base];
+            Value /= Base;
+        } while (Value);
+
+        // Precision gives the minimum number of digits and turns off '0'
+        if (Precision >= 0)
+            ZeroPad = FALSE;
+        if (Precision < Length)
+            Precision = Length;
+
+        Width -= Precision + (Negative ? 1 : 0);
+
+        if (ZeroPad && !LeftAlign)
+        {
+            Precision += Width;
+            Width = 0;
+        }
+
+        if (!LeftAlign)
+            Status = RtlClipPutPadding(L' ', Width);
+        if (Negative)
+            Status = RtlClipPutChar(L'-');
+        Status = RtlClipPutPadding(L'0', Precision - Length);
+        while (Length)
+            Status = RtlClipPutChar((WCHAR)Digits[--Length]);
+        if (LeftAlign)
+            Status = RtlClipPutPadding(L' ', Width);
+    }
+
+    return Status;
 }
 
 NTSTATUS
 __cdecl RtlCliDisplayString(IN PCH Message, ...)
 {
     va_list MessageList;
-    PCHAR MessageBuffer;
-    UNICODE_STRING MessageString;
     NTSTATUS Status;
 
-    MessageBuffer = RtlAllocateHeap(RtlGetProcessHeap(), 0, 512);
-
-    // First, combine the message
+    // Format the message directly into the output buffer
     va_start(MessageList, Message);
-    _vsnprintf(MessageBuffer, 512, Message, MessageList);
+    RtlEnterCriticalSection(&DisplayLock);
+    Status = RtlClipFormatString(Message, MessageList);
+    RtlLeaveCriticalSection(&DisplayLock);
     va_end(MessageList);
 
-    // Now make it a unicode string
-    RtlCreateUnicodeStringFromAsciiz(&MessageString, MessageBuffer);
+    return Status;
+}
+
+/*++
+ * @name RtlCliFlushPrintBuffer
+ *
+ * The RtlCliFlushPrintBuffer routine displays the text collected in a
+ * print buffer and empties it.
+ *
+ * @param PrintBuffer
+ *        Buffer to flush.
+ *
+ * @return None.
+ *
+ * @remarks The text goes out under one hold of the display lock, so it is
+ *          not mixed with output from other threads.
+ *
+ *--*/
+VOID
+RtlCliFlushPrintBuffer(IN OUT PCLI_PRINT_BUFFER PrintBuffer)
+{
+    ULONG i;
+
+    if (PrintBuffer->Length)
+    {
+        RtlEnterCriticalSection(&DisplayLock);
+        for (i = 0; i < PrintBuffer->Length; i++)
+            RtlClipPutAnsiChar(PrintBuffer->Buffer[i]);
+        RtlLeaveCriticalSection(&DisplayLock);
+        PrintBuffer->Length = 0;
+    }
+}
+
+/*++
+ * @name RtlCliBufferPrint
+ *
+ * The RtlCliBufferPrint routine formats a message into a print buffer.
+ *
+ * @param PrintBuffer
+ *        Buffer to add to. Its Length must be 0 before the first call.
+ *
+ * @param Format
+ *        printf-style format string.
+ *
+ * @return None.
+ *
+ * @remarks The buffer is flushed when the next message doesn't fit, so
+ *          worker threads can print many lines while taking the display
+ *          lock only once per CLI_PRINT_BUFFER_SIZE characters. A message
+ *          of CLI_PRINT_LINE_SIZE - 1 characters or more is not cut: the
+ *          buffer is flushed and the message is displayed on its own.
+ *
+ *--*/
+VOID
+__cdecl RtlCliBufferPrint(IN OUT PCLI_PRINT_BUFFER PrintBuffer, IN PCH Format, ...)
+{
+    CHAR Line[CLI_PRINT_LINE_SIZE];
+    va_list Arguments;
+    LONG Length;
+
+    va_start(Arguments, Format);
+    Length = _vsnprintf(Line, sizeof(Line) - 1, Format, Arguments);
+    va_end(Arguments);
 
-    // Display it on screen
-    Status = RtlCliPrintString(&MessageString);
+    // Too long for a line, keep the order and display it whole
+    if (Length < 0 || Length >= (LONG)sizeof(Line) - 1)
+    {
+        RtlCliFlushPrintBuffer(PrintBuffer);
+
+        va_start(Arguments, Format);
+        RtlEnterCriticalSection(&DisplayLock);
+        RtlClipFormatString(Format, Arguments);
+        RtlLeaveCriticalSection(&DisplayLock);
+        va_end(Arguments);
+        return;
+    }
 
-    // Free Memory
-    RtlFreeHeap(RtlGetProcessHeap(), 0, MessageBuffer);
-    RtlFreeUnicodeString(&MessageString);
+    if (PrintBuffer->Length + Length > CLI_PRINT_BUFFER_SIZE)
+        RtlCliFlushPrintBuffer(PrintBuffer);
 
-    return Status;
+    RtlCopyMemory(PrintBuffer->Buffer + PrintBuffer->Length, Line, Length);
+    PrintBuffer->Length += Length;
 }
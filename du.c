@@ -0,0 +1,519 @@
+/**
+ * PROJECT:         Native Shell
+ * COPYRIGHT:       LGPL; See LICENSE in the top level directory
+ * FILE:            du.c
+ * DESCRIPTION:     Parallel disk usage.
+ * DEVELOPERS:      See CONTRIBUTORS.md in the top level directory
+ */
+
+#include "precomp.h"
+#include <stdlib.h>
+
+// Every level of a path adds at least "\x"
+#define DU_MAX_LEVELS (TREE_MAX_PATH / 2 + 1)
+
+// Totals of one directory and everything below it
+typedef struct _DU_LEVEL
+{
+    LONGLONG Size;
+    LONGLONG AllocationSize;
+    ULONG Files;
+    ULONG Directories;
+} DU_LEVEL, *PDU_LEVEL;
+
+// One line of the report, the path is relative to the root
+typedef struct _DU_RESULT
+{
+    struct _DU_RESULT *Next;
+    DU_LEVEL Totals;
+    WCHAR Path[1];
+} DU_RESULT, *PDU_RESULT;
+
+// Disk usage state shared by the walker and the pool threads
+typedef struct _DU_CONTEXT
+{
+    CLI_THREAD_POOL Pool;
+    RTL_CRITICAL_SECTION Lock;
+    CLI_ARENA Arena;
+    ULONG MaxDepth;
+    PDU_RESULT Results;
+    ULONG ResultCount;
+    DU_LEVEL Total;
+    ULONG Failures;
+} DU_CONTEXT, *PDU_CONTEXT;
+
+// One directory of the root, the name follows the structure
+typedef struct _DU_JOB
+{
+    PDU_CONTEXT Context;
+    ULONG Attributes;
+    ULONG Depth;
+    ULONG Failures;
+    PWSTR Path;
+    PWSTR Name;
+    DU_LEVEL Levels[DU_MAX_LEVELS];
+} DU_JOB, *PDU_JOB;
+
+/*++
+ * @name RtlClipAddUsage
+ *
+ * The RtlClipAddUsage routine adds the totals of a subdirectory to its
+ * parent.
+ *
+ * @param Parent
+ *        Totals of the parent directory.
+ *
+ * @param Child
+ *        Totals of the subdirectory.
+ *
+ * @return None.
+ *
+ * @remarks The subdirectory itself is counted as one more directory.
+ *
+ *--*/
+VOID
+RtlClipAddUsage(IN OUT PDU_LEVEL Parent, IN PDU_LEVEL Child)
+{
+    Parent->Size += Child->Size;
+    Parent->AllocationSize += Child->AllocationSize;
+    Parent->Files += Child->Files;
+    Parent->Directories += Child->Directories + 1;
+}
+
+/*++
+ * @name RtlClipRecordUsage
+ *
+ * The RtlClipRecordUsage routine adds a line to the report.
+ *
+ * @param Context
+ *        Disk usage in progress.
+ *
+ * @param Name
+ *        Directory of the root the line belongs to.
+ *
+ * @param RelativePath
+ *        Path below Name, empty for Name itself.
+ *
+ * @param Totals
+ *        Totals of the directory.
+ *
+ * @return STATUS_SUCCESS or STATUS_INSUFFICIENT_RESOURCES.
+ *
+ * @remarks Lines are kept in the context arena until the report is
+ *          printed, they are only recorded down to the depth asked for.
+ *
+ *--*/
+NTSTATUS
+RtlClipRecordUsage(IN PDU_CONTEXT Context, IN PCWSTR Name, IN PCWSTR RelativePath, IN PDU_LEVEL Totals)
+{
+    PDU_RESULT Result;
+    SIZE_T NameLength = wcslen(Name);
+    SIZE_T RelativeLength = wcslen(RelativePath);
+    SIZE_T PathLength = NameLength + (RelativeLength ? 1 + RelativeLength : 0);
+
+    RtlEnterCriticalSection(&Context->Lock);
+    Result = RtlCliArenaAlloc(&Context->Arena, sizeof(DU_RESULT) + PathLength * sizeof(WCHAR));
+    if (Result)
+    {
+        Result->Next = Context->Results;
+        Context->Results = Result;
+        Context->ResultCount++;
+    }
+    RtlLeaveCriticalSection(&Context->Lock);
+
+    if (!Result)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    Result->Totals = *Totals;
+    RtlCopyMemory(Result->Path, Name, NameLength * sizeof(WCHAR));
+    if (RelativeLength)
+    {
+        Result->Path[NameLength] = L'\\';
+        RtlCopyMemory(&Result->Path[NameLength + 1], RelativePath, RelativeLength * sizeof(WCHAR));
+    }
+    Result->Path[PathLength] = UNICODE_NULL;
+
+    return STATUS_SUCCESS;
+}
+
+/*++
+ * @name RtlClipDiskUsageSubtreeVisit
+ *
+ * The RtlClipDiskUsageSubtreeVisit routine counts one entry below a
+ * directory of the root.
+ *
+ * @param Visit
+ *        Kind of visit.
+ *
+ * @param Entry
+ *        Entry in the subtree.
+ *
+ * @param Parameter
+ *        The DU_JOB of the subtree.
+ *
+ * @return STATUS_SUCCESS, the walk always goes on.
+ *
+ * @remarks Job->Levels is a stack with one entry per open directory.
+ *          TreeLeaveDirectory pops the totals of a directory, records them
+ *          if it is shallow enough and adds them to its parent, so the
+ *          subtree is summed in the same pass that lists it.
+ *
+ *--*/
+NTSTATUS
+RtlClipDiskUsageSubtreeVisit(IN CLI_TREE_VISIT Visit, IN PCLI_TREE_ENTRY Entry, IN PVOID Parameter)
+{
+    PDU_JOB Job = Parameter;
+    PDU_LEVEL Level = &Job->Levels[Job->Depth];
+
+    switch (Visit)
+    {
+        case TreeVisitFile:
+            Level->Size += Entry->Size;
+            Level->AllocationSize += Entry->AllocationSize;
+            Level->Files++;
+            break;
+
+        case TreeEnterDirectory:
+            Level = &Job->Levels[++Job->Depth];
+            RtlZeroMemory(Level, sizeof(DU_LEVEL));
+            Level->AllocationSize = Entry->AllocationSize;
+            break;
+
+        case TreeLeaveDirectory:
+            // Levels[0] is the directory of the root, at depth 1
+            if (Job->Depth + 1 <= Job->Context->MaxDepth &&
+                !NT_SUCCESS(RtlClipRecordUsage(Job->Context, Job->Name, Entry->RelativePath, Level)))
+            {
+                RtlCliDisplayString("Out of memory for %S\n", Entry->Path);
+                Job->Failures++;
+            }
+
+            RtlClipAddUsage(Level - 1, Level);
+            Job->Depth--;
+            break;
+
+        case TreeVisitError:
+            RtlCliDisplayString("Can't read %S (0x%.8X)\n", Entry->Path, Entry->Status);
+            Job->Failures++;
+            break;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*++
+ * @name RtlClipDiskUsageWorker
+ *
+ * The RtlClipDiskUsageWorker routine sums one directory of the root, with
+ * everything below it, on a pool thread.
+ *
+ * @param Parameter
+ *        The DU_JOB, freed here.
+ *
+ * @return None.
+ *
+ * @remarks Totals are kept in the job and added to the context once, so
+ *          the lock is only taken for the lines of the report.
+ *
+ *--*/
+VOID
+RtlClipDiskUsageWorker(IN PVOID Parameter)
+{
+    PDU_JOB Job = Parameter;
+    PDU_CONTEXT Context = Job->Context;
+    NTSTATUS Status;
+
+    // Junctions and links are counted, never walked into
+    if (!(Job->Attributes & FILE_ATTRIBUTE_REPARSE_POINT))
+    {
+        Status = RtlCliWalkTree(Job->Path, TRUE, RtlClipDiskUsageSubtreeVisit, Job);
+        if (!NT_SUCCESS(Status))
+        {
+            RtlCliDisplayString("Can't read %S (0x%.8X)\n", Job->Path, Status);
+            Job->Failures++;
+        }
+    }
+
+    if (Context->MaxDepth >= 1 &&
+        !NT_SUCCESS(RtlClipRecordUsage(Context, Job->Name, L"", &Job->Levels[0])))
+    {
+        RtlCliDisplayString("Out of memory for %S\n", Job->Path);
+        Job->Failures++;
+    }
+
+    RtlEnterCriticalSection(&Context->Lock);
+    RtlClipAddUsage(&Context->Total, &Job->Levels[0]);
+    Context->Failures += Job->Failures;
+    RtlLeaveCriticalSection(&Context->Lock);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Job);
+}
+
+/*++
+ * @name RtlClipDiskUsageVisit
+ *
+ * The RtlClipDiskUsageVisit routine counts one entry of the root
+ * directory, and hands directories to the pool.
+ *
+ * @param Visit
+ *        Kind of visit.
+ *
+ * @param Entry
+ *        Entry in the root directory.
+ *
+ * @param Parameter
+ *        The DU_CONTEXT.
+ *
+ * @return STATUS_SUCCESS, the walk always goes on.
+ *
+ * @remarks Every subdirectory of the root becomes one job, so sibling
+ *          subtrees are listed at the same time.
+ *
+ *--*/
+NTSTATUS
+RtlClipDiskUsageVisit(IN CLI_TREE_VISIT Visit, IN PCLI_TREE_ENTRY Entry, IN PVOID Parameter)
+{
+    PDU_CONTEXT Context = Parameter;
+    PDU_JOB Job;
+    SIZE_T PathLength, NameLength;
+
+    switch (Visit)
+    {
+        case TreeVisitFile:
+            RtlEnterCriticalSection(&Context->Lock);
+            Context->Total.Size += Entry->Size;
+            Context->Total.AllocationSize += Entry->AllocationSize;
+            Context->Total.Files++;
+            RtlLeaveCriticalSection(&Context->Lock);
+            return STATUS_SUCCESS;
+
+        case TreeVisitError:
+            RtlCliDisplayString("Can't read %S (0x%.8X)\n", Entry->Path, Entry->Status);
+            RtlEnterCriticalSection(&Context->Lock);
+            Context->Failures++;
+            RtlLeaveCriticalSection(&Context->Lock);
+            return STATUS_SUCCESS;
+
+        case TreeLeaveDirectory:
+            return STATUS_SUCCESS;
+
+        default:
+            break;
+    }
+
+    PathLength = wcslen(Entry->Path) + 1;
+    NameLength = wcslen(Entry->RelativePath) + 1;
+
+    Job = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY,
+                          sizeof(DU_JOB) + (PathLength + NameLength) * sizeof(WCHAR));
+    if (!Job)
+    {
+        RtlCliDisplayString("Out of memory for %S\n", Entry->Path);
+        RtlEnterCriticalSection(&Context->Lock);
+        Context->Failures++;
+        RtlLeaveCriticalSection(&Context->Lock);
+        return STATUS_SUCCESS;
+    }
+
+    Job->Context = Context;
+    Job->Attributes = Entry->Attributes;
+    Job->Levels[0].AllocationSize = Entry->AllocationSize;
+    Job->Path = (PWSTR)(Job + 1);
+    Job->Name = Job->Path + PathLength;
+    RtlCopyMemory(Job->Path, Entry->Path, PathLength * sizeof(WCHAR));
+    RtlCopyMemory(Job->Name, Entry->RelativePath, NameLength * sizeof(WCHAR));
+
+    RtlCliQueueWorkItem(&Context->Pool, RtlClipDiskUsageWorker, Job);
+    return STATUS_SUCCESS;
+}
+
+/*++
+ * @name RtlClipCompareUsagePath
+ *
+ * The RtlClipCompareUsagePath routine orders report lines by path.
+ *
+ * @param First
+ *        First line, a PDU_RESULT pointer.
+ *
+ * @param Second
+ *        Second line, a PDU_RESULT pointer.
+ *
+ * @return Less than, equal to or greater than zero, for qsort.
+ *
+ * @remarks Paths compare case-insensitively, like the file system does.
+ *
+ *--*/
+int
+__cdecl
+RtlClipCompareUsagePath(IN const void *First, IN const void *Second)
+{
+    PDU_RESULT A = *(PDU_RESULT *)First;
+    PDU_RESULT B = *(PDU_RESULT *)Second;
+
+    return _wcsicmp(A->Path, B->Path);
+}
+
+/*++
+ * @name RtlClipCompareUsageSize
+ *
+ * The RtlClipCompareUsageSize routine orders report lines by allocated
+ * size, largest first.
+ *
+ * @param First
+ *        First line, a PDU_RESULT pointer.
+ *
+ * @param Second
+ *        Second line, a PDU_RESULT pointer.
+ *
+ * @return Less than, equal to or greater than zero, for qsort.
+ *
+ * @remarks Lines of the same size are ordered by path.
+ *
+ *--*/
+int
+__cdecl
+RtlClipCompareUsageSize(IN const void *First, IN const void *Second)
+{
+    PDU_RESULT A = *(PDU_RESULT *)First;
+    PDU_RESULT B = *(PDU_RESULT *)Second;
+
+    if (A->Totals.AllocationSize != B->Totals.AllocationSize)
+        return A->Totals.AllocationSize > B->Totals.AllocationSize ? -1 : 1;
+
+    return RtlClipCompareUsagePath(First, Second);
+}
+
+/*++
+ * @name RtlClipDisplayUsage
+ *
+ * The RtlClipDisplayUsage routine prints one line of the report.
+ *
+ * @param Totals
+ *        Totals to print.
+ *
+ * @param Path
+ *        Directory the totals belong to.
+ *
+ * @return None.
+ *
+ * @remarks None.
+ *
+ *--*/
+VOID
+RtlClipDisplayUsage(IN PDU_LEVEL Totals, IN PCWSTR Path)
+{
+    RtlCliDisplayString("%15I64u %15I64u %9u %7u  %S\n",
+                        Totals->AllocationSize,
+                        Totals->Size,
+                        Totals->Files,
+                        Totals->Directories,
+                        Path);
+}
+
+/*++
+ * @name RtlCliDiskUsage
+ *
+ * The RtlCliDiskUsage routine prints the size and file count of a
+ * directory and of the subdirectories in it, with a pool of threads.
+ *
+ * @param Path
+ *        Directory to measure, full path in DOS format.
+ *
+ * @param MaxDepth
+ *        Depth of the subdirectories to print, 0 for the total only.
+ *
+ * @param SortBySize
+ *        TRUE to print the largest subdirectories first, FALSE to print
+ *        them by path.
+ *
+ * @param ThreadCount
+ *        Number of listing threads.
+ *
+ * @return STATUS_SUCCESS if everything was read, STATUS_UNSUCCESSFUL if
+ *         something failed, or the status of a failure that stopped the
+ *         listing.
+ *
+ * @remarks The calling thread lists Path only. Each of its subdirectories
+ *          is walked once, by a pool thread, and summed bottom-up as it is
+ *          listed. Sizes are the 64-bit end of file and allocation sizes
+ *          from the directory listing; no file is opened. Directories that
+ *          can't be read are reported and left out of the totals.
+ *
+ *--*/
+NTSTATUS
+RtlCliDiskUsage(IN PCWSTR Path, IN ULONG MaxDepth, IN BOOLEAN SortBySize, IN ULONG ThreadCount)
+{
+    PDU_CONTEXT Context;
+    PDU_RESULT Result, *Sorted;
+    ULONG i;
+    NTSTATUS Status;
+
+    // The pool is too large for the stack
+    Context = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DU_CONTEXT));
+    if (!Context)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    Context->MaxDepth = MaxDepth;
+    RtlCliArenaInit(&Context->Arena);
+
+    Status = RtlCliCreateThreadPool(&Context->Pool, ThreadCount);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Context);
+        return Status;
+    }
+
+    RtlInitializeCriticalSection(&Context->Lock);
+
+    Status = RtlCliWalkTree(Path, FALSE, RtlClipDiskUsageVisit, Context);
+
+    // Every subtree must be summed before the report
+    RtlCliDestroyThreadPool(&Context->Pool);
+
+    if (NT_SUCCESS(Status))
+    {
+        RtlCliDisplayString("      Allocated            Size     Files    Dirs  Path\n");
+
+        Sorted = NULL;
+        if (Context->ResultCount)
+        {
+            Sorted = RtlAllocateHeap(RtlGetProcessHeap(), 0, Context->ResultCount * sizeof(PDU_RESULT));
+        }
+
+        if (Sorted)
+        {
+            for (i = 0, Result = Context->Results; Result; Result = Result->Next)
+                Sorted[i++] = Result;
+
+            qsort(Sorted,
+                  Context->ResultCount,
+                  sizeof(PDU_RESULT),
+                  SortBySize ? RtlClipCompareUsageSize : RtlClipCompareUsagePath);
+
+            for (i = 0; i < Context->ResultCount; i++)
+                RtlClipDisplayUsage(&Sorted[i]->Totals, Sorted[i]->Path);
+
+            RtlFreeHeap(RtlGetProcessHeap(), 0, Sorted);
+        }
+        else
+        {
+            // Out of memory for the sort, print them as they came
+            for (Result = Context->Results; Result; Result = Result->Next)
+                RtlClipDisplayUsage(&Result->Totals, Result->Path);
+        }
+
+        RtlClipDisplayUsage(&Context->Total, Path);
+
+        if (Context->Failures)
+        {
+            RtlCliDisplayString("%u entries could not be counted\n", Context->Failures);
+            Status = STATUS_UNSUCCESSFUL;
+        }
+    }
+
+    RtlCliArenaFree(&Context->Arena);
+    RtlDeleteCriticalSection(&Context->Lock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Context);
+
+    return Status;
+}
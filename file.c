@@ -71,111 +71,944 @@ RtlCliSetCurrentDirectory(PCHAR Directory)
     return STATUS_SUCCESS;
 }
 
-VOID RtlCliDumpFileInfo(PFILE_BOTH_DIR_INFORMATION DirInfo)
+// Two query buffers, one is filled while the other is printed
+#define DIR_QUERY_BUFFER_SIZE 0x10000
+
+// Entries listed before asking to continue
+#define DIR_PAGE_ENTRIES 20
+
+// Address space reserved for a sorted listing, committed as it fills
+#define DIR_SORT_MAX_ENTRIES 0x100000
+#define DIR_SORT_MAX_NAMES 0x4000000
+#define DIR_COMMIT_SIZE 0x10000
+
+// One entry of a sorted listing, the names are in the name heap
+typedef struct _DIR_RECORD
 {
-    PWCHAR Null;
-    WCHAR Save;
-    TIME_FIELDS Time;
-    CHAR SizeString[16];
-    WCHAR ShortString[12 + 1];
-    WCHAR FileString[MAX_PATH + 1];
+    LARGE_INTEGER CreationTime;
+    LARGE_INTEGER EndOfFile;
+    ULONG FileAttributes;
+    ULONG NameOffset;       // characters into the name heap, short name follows
+    USHORT NameLength;      // characters
+    USHORT ShortNameLength; // characters
+} DIR_RECORD, *PDIR_RECORD;
 
-    WCHAR FileStringSize[100];
-    WCHAR ShortStringSize[100];
+// Radix sort item
+typedef struct _DIR_SORT_KEY
+{
+    ULONGLONG Key;
+    ULONG Index;
+} DIR_SORT_KEY, *PDIR_SORT_KEY;
 
-    UINT file_size = 0;
-    UINT short_size = 0;
+// Reserved address space that is committed from the bottom up
+typedef struct _DIR_REGION
+{
+    PUCHAR Base;
+    SIZE_T Reserved;
+    SIZE_T Committed;
+    SIZE_T Used;
+} DIR_REGION, *PDIR_REGION;
 
-    // The filename isn't null-terminated, and the next structure follows
-    // right after it. So, we save the next char (which ends up being the
-    // NextEntryOffset of the next structure), then temporarly clear it so
-    // that the RtlCliDisplayString can treat it as a null-terminated string
+// State of one dir command
+typedef struct _DIR_LISTING
+{
+    CLI_PRINT_BUFFER Output;
+    ULONG Flags;
+    ULONG Files;
+    ULONG Directories;
+    LONGLONG Bytes;
+    ULONG Listed;
+    BOOLEAN Paging;
+    BOOLEAN Stopped;
+    BOOLEAN Overflow;
+    DIR_REGION Records;
+    DIR_REGION Names;
+    ULONG Count;   // records stored for sorting
+    ULONG Entries; // names seen by /b and /c
+} DIR_LISTING, *PDIR_LISTING;
 
-    Null = (PWCHAR)((PBYTE)DirInfo->FileName + DirInfo->FileNameLength);
-    Save = *Null;
-    *Null = 0;
+// Entry is the information class the enumeration asked for
+typedef BOOLEAN (*PDIR_ENTRY_ROUTINE)(IN PVOID Entry, IN PDIR_LISTING Listing);
 
-    // Get the last access time
-    RtlSystemTimeToLocalTime(&DirInfo->CreationTime, &DirInfo->CreationTime);
-    RtlTimeToTimeFields(&DirInfo->CreationTime, &Time);
+/*++
+ * @name RtlClipReserveRegion
+ *
+ * The RtlClipReserveRegion routine reserves address space without
+ * committing any of it.
+ *
+ * @param Region
+ *        Region to set up.
+ *
+ * @param Size
+ *        Largest size the region can grow to.
+ *
+ * @return STATUS_SUCCESS or the status of the reservation.
+ *
+ * @remarks None.
+ *
+ *--*/
+NTSTATUS
+RtlClipReserveRegion(OUT PDIR_REGION Region, IN SIZE_T Size)
+{
+    Region->Base = NULL;
+    Region->Reserved = Size;
+    Region->Committed = 0;
+    Region->Used = 0;
+
+    return NtAllocateVirtualMemory(NtCurrentProcess(),
+                                   (PVOID *)&Region->Base,
+                                   0,
+                                   &Region->Reserved,
+                                   MEM_RESERVE,
+                                   PAGE_READWRITE);
+}
+
+/*++
+ * @name RtlClipGrowRegion
+ *
+ * The RtlClipGrowRegion routine takes bytes from the end of a region.
+ *
+ * @param Region
+ *        Region to grow.
+ *
+ * @param Size
+ *        Number of bytes.
+ *
+ * @return Pointer to the bytes, or NULL if the region is full or the
+ *         memory can't be committed.
+ *
+ * @remarks Memory is committed DIR_COMMIT_SIZE bytes at a time, so the
+ *          region only ever holds what the listing has used.
+ *
+ *--*/
+PVOID
+RtlClipGrowRegion(IN OUT PDIR_REGION Region, IN SIZE_T Size)
+{
+    PVOID Address;
+    SIZE_T CommitSize;
+    PUCHAR Result;
+
+    if (Size > Region->Reserved - Region->Used)
+        return NULL;
+
+    if (Region->Used + Size > Region->Committed)
+    {
+        Address = Region->Base + Region->Committed;
+        CommitSize = max(Region->Used + Size - Region->Committed, DIR_COMMIT_SIZE);
+        CommitSize = min(CommitSize, Region->Reserved - Region->Committed);
+
+        if (!NT_SUCCESS(NtAllocateVirtualMemory(NtCurrentProcess(),
+                                                &Address,
+                                                0,
+                                                &CommitSize,
+                                                MEM_COMMIT,
+                                                PAGE_READWRITE)))
+        {
+            return NULL;
+        }
+
+        Region->Committed += CommitSize;
+    }
+
+    Result = Region->Base + Region->Used;
+    Region->Used += Size;
+
+    return Result;
+}
+
+/*++
+ * @name RtlClipFreeRegion
+ *
+ * The RtlClipFreeRegion routine releases a region.
+ *
+ * @param Region
+ *        Region to release, may never have been reserved.
+ *
+ * @return None.
+ *
+ * @remarks None.
+ *
+ *--*/
+VOID
+RtlClipFreeRegion(IN OUT PDIR_REGION Region)
+{
+    SIZE_T RegionSize = 0;
+
+    if (Region->Base)
+    {
+        NtFreeVirtualMemory(NtCurrentProcess(), (PVOID *)&Region->Base, &RegionSize, MEM_RELEASE);
+        Region->Base = NULL;
+    }
+}
+
+/*++
+ * @name RtlClipFormatDirectoryLine
+ *
+ * The RtlClipFormatDirectoryLine routine formats one line of a listing.
+ *
+ * @param Output
+ *        Buffer the line is added to.
+ *
+ * @param CreationTime
+ *        Creation time of the entry, in UTC.
+ *
+ * @param EndOfFile
+ *        Size of the entry.
+ *
+ * @param FileAttributes
+ *        Attributes of the entry.
+ *
+ * @param Name
+ *        Name of the entry, not null-terminated.
+ *
+ * @param NameLength
+ *        Length of Name in characters.
+ *
+ * @param ShortName
+ *        8.3 name of the entry, not null-terminated.
+ *
+ * @param ShortNameLength
+ *        Length of ShortName in characters.
+ *
+ * @return None.
+ *
+ * @remarks None.
+ *
+ *--*/
+VOID
+RtlClipFormatDirectoryLine(IN OUT PCLI_PRINT_BUFFER Output,
+                           IN PLARGE_INTEGER CreationTime,
+                           IN LONGLONG EndOfFile,
+                           IN ULONG FileAttributes,
+                           IN PCWSTR Name,
+                           IN ULONG NameLength,
+                           IN PCWSTR ShortName,
+                           IN ULONG ShortNameLength)
+{
+    LARGE_INTEGER LocalTime;
+    TIME_FIELDS Time;
+
+    RtlSystemTimeToLocalTime(CreationTime, &LocalTime);
+    RtlTimeToTimeFields(&LocalTime, &Time);
 
     // Don't display sizes for directories
-    if (!(DirInfo->FileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    if (FileAttributes & FILE_ATTRIBUTE_DIRECTORY)
     {
-        sprintf(SizeString, "%d", DirInfo->AllocationSize.LowPart);
+        RtlCliBufferPrint(Output,
+                          "%02d.%02d.%04d %02d:%02d <DIR> %9s %-28.*S %12.*S\n",
+                          Time.Day, Time.Month, Time.Year, Time.Hour, Time.Minute,
+                          "",
+                          NameLength, Name,
+                          ShortNameLength, ShortName);
     }
     else
     {
-        sprintf(SizeString, " ", DirInfo->AllocationSize.LowPart);
+        RtlCliBufferPrint(Output,
+                          "%02d.%02d.%04d %02d:%02d       %9I64u %-28.*S %12.*S\n",
+                          Time.Day, Time.Month, Time.Year, Time.Hour, Time.Minute,
+                          EndOfFile,
+                          NameLength, Name,
+                          ShortNameLength, ShortName);
     }
+}
 
-    // Display this entry
-    file_size = DirInfo->FileNameLength / sizeof(WCHAR);
-    short_size = DirInfo->ShortNameLength / sizeof(WCHAR);
+/*++
+ * @name RtlCliDumpFileInfo
+ *
+ * The RtlCliDumpFileInfo routine formats one directory entry.
+ *
+ * @param Output
+ *        Buffer the line is added to.
+ *
+ * @param DirInfo
+ *        Entry to format.
+ *
+ * @return None.
+ *
+ * @remarks The names are not null-terminated, they are printed with their
+ *          length, so the entry is never written to.
+ *
+ *--*/
+VOID
+RtlCliDumpFileInfo(IN OUT PCLI_PRINT_BUFFER Output, IN PFILE_BOTH_DIR_INFORMATION DirInfo)
+{
+    RtlClipFormatDirectoryLine(Output,
+                               &DirInfo->CreationTime,
+                               DirInfo->EndOfFile.QuadPart,
+                               DirInfo->FileAttributes,
+                               DirInfo->FileName,
+                               DirInfo->FileNameLength / sizeof(WCHAR),
+                               DirInfo->ShortName,
+                               DirInfo->ShortNameLength / sizeof(WCHAR));
+}
 
-    swprintf(ShortStringSize, L"%d", short_size);
-    swprintf(FileStringSize, L"%d", file_size);
+/*++
+ * @name RtlClipAskContinueListing
+ *
+ * The RtlClipAskContinueListing routine asks whether to list the next
+ * page.
+ *
+ * @param Paging
+ *        Set to FALSE when the rest is to be listed without asking.
+ *
+ * @return TRUE to go on, FALSE to stop.
+ *
+ * @remarks None.
+ *
+ *--*/
+BOOLEAN
+RtlClipAskContinueListing(IN OUT PBOOLEAN Paging)
+{
+    CHAR c;
 
-    if (DirInfo->ShortNameLength)
+    RtlCliDisplayString("Continue listing (y/n/a):");
+    for (;;)
     {
-        memset(ShortString, 0x00, (12 + 1) * sizeof(WCHAR));
-        wcsncpy(ShortString, DirInfo->ShortName, short_size);
+        c = RtlCliGetChar(hKeyboard);
+        if (c == 'n' || c == 'N')
+        {
+            RtlCliDisplayString("\n");
+            return FALSE;
+        }
+        if (c == 'a' || c == 'A')
+        {
+            *Paging = FALSE;
+            break;
+        }
+        if (c == 'y' || c == 'Y')
+        {
+            break;
+        }
+    }
+    RtlCliDisplayString("\n");
+
+    return TRUE;
+}
+
+/*++
+ * @name RtlClipNextListingLine
+ *
+ * The RtlClipNextListingLine routine counts a printed line and asks to
+ * continue at the end of a page.
+ *
+ * @param Listing
+ *        Listing in progress.
+ *
+ * @return TRUE to go on, FALSE if the user stopped the listing.
+ *
+ * @remarks None.
+ *
+ *--*/
+BOOLEAN
+RtlClipNextListingLine(IN OUT PDIR_LISTING Listing)
+{
+    if (Listing->Paging && ++Listing->Listed > DIR_PAGE_ENTRIES)
+    {
+        Listing->Listed = 0;
+        RtlCliFlushPrintBuffer(&Listing->Output);
+        if (!RtlClipAskContinueListing(&Listing->Paging))
+        {
+            Listing->Stopped = TRUE;
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*++
+ * @name RtlClipCountEntry
+ *
+ * The RtlClipCountEntry routine adds an entry to the totals of a listing.
+ *
+ * @param Listing
+ *        Listing in progress.
+ *
+ * @param Entry
+ *        Entry to count.
+ *
+ * @return None.
+ *
+ * @remarks None.
+ *
+ *--*/
+VOID
+RtlClipCountEntry(IN OUT PDIR_LISTING Listing, IN PFILE_BOTH_DIR_INFORMATION Entry)
+{
+    if (Entry->FileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+    {
+        Listing->Directories++;
     }
     else
     {
-        swprintf(ShortString, L" ");
+        Listing->Files++;
+        Listing->Bytes += Entry->EndOfFile.QuadPart;
+    }
+}
+
+/*++
+ * @name RtlClipPrintEntry
+ *
+ * The RtlClipPrintEntry routine prints an entry as it is listed.
+ *
+ * @param Entry
+ *        Entry to print.
+ *
+ * @param Listing
+ *        Listing in progress.
+ *
+ * @return TRUE to go on, FALSE if the user stopped the listing.
+ *
+ * @remarks None.
+ *
+ *--*/
+BOOLEAN
+RtlClipPrintEntry(IN PVOID Parameter, IN PDIR_LISTING Listing)
+{
+    PFILE_BOTH_DIR_INFORMATION Entry = Parameter;
+
+    RtlCliDumpFileInfo(&Listing->Output, Entry);
+    RtlClipCountEntry(Listing, Entry);
+
+    return RtlClipNextListingLine(Listing);
+}
+
+/*++
+ * @name RtlClipStoreEntry
+ *
+ * The RtlClipStoreEntry routine keeps an entry for a sorted listing.
+ *
+ * @param Entry
+ *        Entry to keep.
+ *
+ * @param Listing
+ *        Listing in progress.
+ *
+ * @return TRUE to go on, FALSE if the record or name space is used up
+ *         (Listing->Overflow is set).
+ *
+ * @remarks The record goes into an array of fixed-size records, the names
+ *          into a separate name heap, so a directory costs two growing
+ *          regions rather than one heap block per entry.
+ *
+ *--*/
+BOOLEAN
+RtlClipStoreEntry(IN PVOID Parameter, IN PDIR_LISTING Listing)
+{
+    PFILE_BOTH_DIR_INFORMATION Entry = Parameter;
+    PDIR_RECORD Record;
+    PWSTR Names;
+    ULONG NameLength = Entry->FileNameLength / sizeof(WCHAR);
+    ULONG ShortNameLength = Entry->ShortNameLength / sizeof(WCHAR);
+    ULONG NameOffset = (ULONG)(Listing->Names.Used / sizeof(WCHAR));
+
+    if (NameLength > MAXUSHORT)
+    {
+        Listing->Overflow = TRUE;
+        return FALSE;
+    }
+
+    Record = RtlClipGrowRegion(&Listing->Records, sizeof(DIR_RECORD));
+    Names = RtlClipGrowRegion(&Listing->Names, (NameLength + ShortNameLength) * sizeof(WCHAR));
+    if (!Record || !Names)
+    {
+        Listing->Overflow = TRUE;
+        return FALSE;
+    }
+
+    Record->CreationTime = Entry->CreationTime;
+    Record->EndOfFile = Entry->EndOfFile;
+    Record->FileAttributes = Entry->FileAttributes;
+    Record->NameOffset = NameOffset;
+    Record->NameLength = (USHORT)NameLength;
+    Record->ShortNameLength = (USHORT)ShortNameLength;
+    RtlCopyMemory(Names, Entry->FileName, NameLength * sizeof(WCHAR));
+    RtlCopyMemory(Names + NameLength, Entry->ShortName, ShortNameLength * sizeof(WCHAR));
+
+    Listing->Count++;
+    RtlClipCountEntry(Listing, Entry);
+
+    return TRUE;
+}
+
+/*++
+ * @name RtlClipIsDotEntry
+ *
+ * The RtlClipIsDotEntry routine checks for the "." and ".." entries.
+ *
+ * @param Name
+ *        Name of the entry, not null-terminated.
+ *
+ * @param NameLength
+ *        Length of Name in bytes.
+ *
+ * @return TRUE for "." and "..".
+ *
+ * @remarks None.
+ *
+ *--*/
+BOOLEAN
+RtlClipIsDotEntry(IN PCWSTR Name, IN ULONG NameLength)
+{
+    NameLength /= sizeof(WCHAR);
+
+    return Name[0] == L'.' && (NameLength == 1 || (NameLength == 2 && Name[1] == L'.'));
+}
+
+/*++
+ * @name RtlClipPrintName
+ *
+ * The RtlClipPrintName routine prints the name of an entry, for dir /b.
+ *
+ * @param Parameter
+ *        The FILE_NAMES_INFORMATION of the entry.
+ *
+ * @param Listing
+ *        Listing in progress.
+ *
+ * @return TRUE, a bare listing is never stopped.
+ *
+ * @remarks "." and ".." are left out.
+ *
+ *--*/
+BOOLEAN
+RtlClipPrintName(IN PVOID Parameter, IN PDIR_LISTING Listing)
+{
+    PFILE_NAMES_INFORMATION Entry = Parameter;
+
+    if (!RtlClipIsDotEntry(Entry->FileName, Entry->FileNameLength))
+    {
+        RtlCliBufferPrint(&Listing->Output, "%.*S\n", Entry->FileNameLength / sizeof(WCHAR), Entry->FileName);
+        Listing->Entries++;
+    }
+
+    return TRUE;
+}
+
+/*++
+ * @name RtlClipCountName
+ *
+ * The RtlClipCountName routine counts an entry, for dir /c.
+ *
+ * @param Parameter
+ *        The FILE_NAMES_INFORMATION of the entry.
+ *
+ * @param Listing
+ *        Listing in progress.
+ *
+ * @return TRUE, counting is never stopped.
+ *
+ * @remarks "." and ".." are left out.
+ *
+ *--*/
+BOOLEAN
+RtlClipCountName(IN PVOID Parameter, IN PDIR_LISTING Listing)
+{
+    PFILE_NAMES_INFORMATION Entry = Parameter;
+
+    if (!RtlClipIsDotEntry(Entry->FileName, Entry->FileNameLength))
+        Listing->Entries++;
+
+    return TRUE;
+}
+
+/*++
+ * @name RtlClipEnumerateDirectory
+ *
+ * The RtlClipEnumerateDirectory routine calls a routine for every entry
+ * of an open directory.
+ *
+ * @param DirectoryHandle
+ *        Directory opened for asynchronous I/O.
+ *
+ * @param EventHandle
+ *        Event to wait for the queries on.
+ *
+ * @param Buffers
+ *        Two buffers of DIR_QUERY_BUFFER_SIZE bytes, back to back.
+ *
+ * @param InformationClass
+ *        Information to query, FileNamesInformation fits the most entries
+ *        in a buffer.
+ *
+ * @param Pattern
+ *        Optional wildcard, matched by the file system.
+ *
+ * @param Routine
+ *        Routine to call. Returning FALSE ends the enumeration.
+ *
+ * @param Listing
+ *        Parameter for Routine.
+ *
+ * @return STATUS_SUCCESS, also when nothing matches Pattern, or the
+ *         status of a failing query.
+ *
+ * @remarks The query for the next batch is already running while Routine
+ *          handles the current one. Only one query is ever running, so one
+ *          IoStatusBlock will do, and none is left running on return.
+ *
+ *--*/
+NTSTATUS
+RtlClipEnumerateDirectory(IN HANDLE DirectoryHandle,
+                          IN HANDLE EventHandle,
+                          IN PUCHAR Buffers,
+                          IN FILE_INFORMATION_CLASS InformationClass,
+                          IN PUNICODE_STRING Pattern,
+                          IN PDIR_ENTRY_ROUTINE Routine,
+                          IN PDIR_LISTING Listing)
+{
+    IO_STATUS_BLOCK IoStatusBlock;
+    PUCHAR Entry;
+    ULONG NextEntryOffset;
+    ULONG Current = 0;
+    BOOLEAN Stop = FALSE;
+    NTSTATUS Status, NextStatus;
+
+    Status = ZwQueryDirectoryFile(DirectoryHandle,
+                                  EventHandle,
+                                  NULL,
+                                  NULL,
+                                  &IoStatusBlock,
+                                  Buffers,
+                                  DIR_QUERY_BUFFER_SIZE,
+                                  InformationClass,
+                                  FALSE,
+                                  Pattern,
+                                  TRUE);
+
+    for (;;)
+    {
+        if (Status == STATUS_PENDING)
+        {
+            NtWaitForSingleObject(EventHandle, FALSE, NULL);
+            Status = IoStatusBlock.Status;
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            // Nothing left to enumerate, or nothing matched
+            if (Status == STATUS_NO_MORE_FILES || Status == STATUS_NO_SUCH_FILE)
+                Status = STATUS_SUCCESS;
+            break;
+        }
+
+        // Read ahead into the other buffer
+        NextStatus = ZwQueryDirectoryFile(DirectoryHandle,
+                                          EventHandle,
+                                          NULL,
+                                          NULL,
+                                          &IoStatusBlock,
+                                          Buffers + (Current ^ 1) * DIR_QUERY_BUFFER_SIZE,
+                                          DIR_QUERY_BUFFER_SIZE,
+                                          InformationClass,
+                                          FALSE,
+                                          Pattern,
+                                          FALSE);
+
+        Entry = Buffers + Current * DIR_QUERY_BUFFER_SIZE;
+        for (;;)
+        {
+            // Every information class starts with NextEntryOffset
+            NextEntryOffset = *(PULONG)Entry;
+
+            if (!Routine(Entry, Listing))
+            {
+                Stop = TRUE;
+                break;
+            }
+
+            // Make sure we still have a file
+            if (!NextEntryOffset)
+                break;
+
+            // Move to the next one
+            Entry += NextEntryOffset;
+        }
+
+        Current ^= 1;
+        Status = NextStatus;
+
+        if (Stop)
+        {
+            // The read ahead must be done before its buffer is freed
+            if (Status == STATUS_PENDING)
+                NtWaitForSingleObject(EventHandle, FALSE, NULL);
+
+            Status = STATUS_SUCCESS;
+            break;
+        }
     }
 
-    if (DirInfo->FileNameLength)
+    return Status;
+}
+
+/*++
+ * @name RtlClipMergeSortByName
+ *
+ * The RtlClipMergeSortByName routine orders records by name.
+ *
+ * @param Listing
+ *        Listing with the records.
+ *
+ * @param Order
+ *        Count record indexes, sorted on return.
+ *
+ * @param Temp
+ *        Scratch space for Count indexes.
+ *
+ * @param Descending
+ *        TRUE for Z to A.
+ *
+ * @return Order or Temp, whichever holds the result.
+ *
+ * @remarks Bottom-up merge sort: every pass streams through both arrays
+ *          once, and only the indexes move, never the records.
+ *
+ *--*/
+PULONG
+RtlClipMergeSortByName(IN PDIR_LISTING Listing, IN PULONG Order, IN PULONG Temp, IN BOOLEAN Descending)
+{
+    PDIR_RECORD Records = (PDIR_RECORD)Listing->Records.Base;
+    PWSTR Names = (PWSTR)Listing->Names.Base;
+    PDIR_RECORD A, B;
+    PULONG Source = Order, Target = Temp, Swap;
+    ULONG Width, Left, Middle, Right, i, j, k;
+    LONG Result;
+
+    for (Width = 1; Width < Listing->Count; Width *= 2)
     {
-        memset(FileString, 0x00, (MAX_PATH + 1) * sizeof(WCHAR));
-        wcsncpy(FileString, DirInfo->FileName, file_size);
+        for (Left = 0; Left < Listing->Count; Left += 2 * Width)
+        {
+            Middle = min(Left + Width, Listing->Count);
+            Right = min(Left + 2 * Width, Listing->Count);
+
+            i = Left;
+            j = Middle;
+            for (k = Left; k < Right; k++)
+            {
+                if (i < Middle && j < Right)
+                {
+                    A = &Records[Source[i]];
+                    B = &Records[Source[j]];
+                    Result = _wcsnicmp(Names + A->NameOffset,
+                                       Names + B->NameOffset,
+                                       min(A->NameLength, B->NameLength));
+                    if (!Result)
+                        Result = (LONG)A->NameLength - (LONG)B->NameLength;
+                    if (Descending)
+                        Result = -Result;
+
+                    Target[k] = Result <= 0 ? Source[i++] : Source[j++];
+                }
+                else
+                {
+                    Target[k] = i < Middle ? Source[i++] : Source[j++];
+                }
+            }
+        }
+
+        Swap = Source;
+        Source = Target;
+        Target = Swap;
+    }
+
+    return Source;
+}
+
+/*++
+ * @name RtlClipRadixSort
+ *
+ * The RtlClipRadixSort routine orders sort keys by value.
+ *
+ * @param Keys
+ *        Keys to sort.
+ *
+ * @param Temp
+ *        Scratch space for as many keys.
+ *
+ * @param Count
+ *        Number of keys.
+ *
+ * @return Keys or Temp, whichever holds the result.
+ *
+ * @remarks LSD radix sort, one byte per pass. All eight histograms are
+ *          built in a single read of the keys, and passes where every key
+ *          has the same byte are skipped, so sizes below 4 GB cost about
+ *          four passes. The sort is stable.
+ *
+ *--*/
+PDIR_SORT_KEY
+RtlClipRadixSort(IN PDIR_SORT_KEY Keys, IN PDIR_SORT_KEY Temp, IN ULONG Count)
+{
+    ULONG Histogram[8][256];
+    PDIR_SORT_KEY Source = Keys, Target = Temp, Swap;
+    ULONG Pass, i, Sum, Bucket;
+
+    RtlZeroMemory(Histogram, sizeof(Histogram));
+
+    for (i = 0; i < Count; i++)
+    {
+        for (Pass = 0; Pass < 8; Pass++)
+            Histogram[Pass][(UCHAR)(Keys[i].Key >> (Pass * 8))]++;
+    }
+
+    for (Pass = 0; Pass < 8; Pass++)
+    {
+        // Every key in one bucket, nothing would move
+        if (Histogram[Pass][(UCHAR)(Keys[0].Key >> (Pass * 8))] == Count)
+            continue;
+
+        for (Sum = 0, Bucket = 0; Bucket < 256; Bucket++)
+        {
+            i = Histogram[Pass][Bucket];
+            Histogram[Pass][Bucket] = Sum;
+            Sum += i;
+        }
+
+        for (i = 0; i < Count; i++)
+            Target[Histogram[Pass][(UCHAR)(Source[i].Key >> (Pass * 8))]++] = Source[i];
+
+        Swap = Source;
+        Source = Target;
+        Target = Swap;
+    }
+
+    return Source;
+}
+
+/*++
+ * @name RtlClipPrintSortedListing
+ *
+ * The RtlClipPrintSortedListing routine sorts the stored records and
+ * prints them.
+ *
+ * @param Listing
+ *        Listing with the records.
+ *
+ * @return STATUS_SUCCESS or STATUS_INSUFFICIENT_RESOURCES.
+ *
+ * @remarks Names are merge sorted through an index array; sizes and dates
+ *          are radix sorted as 64-bit keys. Descending keys are inverted
+ *          rather than read backwards, so entries that compare equal stay
+ *          in directory order either way.
+ *
+ *--*/
+NTSTATUS
+RtlClipPrintSortedListing(IN PDIR_LISTING Listing)
+{
+    PDIR_RECORD Records = (PDIR_RECORD)Listing->Records.Base;
+    PWSTR Names = (PWSTR)Listing->Names.Base;
+    PDIR_RECORD Record;
+    PVOID Scratch = NULL;
+    SIZE_T ScratchSize;
+    PULONG Order = NULL;
+    PDIR_SORT_KEY Keys = NULL;
+    ULONG Sort = Listing->Flags & DIR_SORT_MASK;
+    BOOLEAN Descending = (Listing->Flags & DIR_SORT_DESCENDING) != 0;
+    ULONG i;
+    NTSTATUS Status;
+
+    if (!Listing->Count)
+        return STATUS_SUCCESS;
+
+    ScratchSize = 2 * (SIZE_T)Listing->Count *
+                  (Sort == DIR_SORT_NAME ? sizeof(ULONG) : sizeof(DIR_SORT_KEY));
+
+    Status = NtAllocateVirtualMemory(NtCurrentProcess(),
+                                     &Scratch,
+                                     0,
+                                     &ScratchSize,
+                                     MEM_RESERVE | MEM_COMMIT,
+                                     PAGE_READWRITE);
+    if (!NT_SUCCESS(Status))
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    if (Sort == DIR_SORT_NAME)
+    {
+        Order = Scratch;
+        for (i = 0; i < Listing->Count; i++)
+            Order[i] = i;
+
+        Order = RtlClipMergeSortByName(Listing, Order, Order + Listing->Count, Descending);
     }
     else
     {
-        swprintf(FileString, L" ");
+        Keys = Scratch;
+        for (i = 0; i < Listing->Count; i++)
+        {
+            Keys[i].Key = Sort == DIR_SORT_SIZE ? Records[i].EndOfFile.QuadPart
+                                                : Records[i].CreationTime.QuadPart;
+            if (Descending)
+                Keys[i].Key = ~Keys[i].Key;
+            Keys[i].Index = i;
+        }
+
+        Keys = RtlClipRadixSort(Keys, Keys + Listing->Count, Listing->Count);
+    }
+
+    for (i = 0; i < Listing->Count; i++)
+    {
+        Record = &Records[Order ? Order[i] : Keys[i].Index];
+
+        RtlClipFormatDirectoryLine(&Listing->Output,
+                                   &Record->CreationTime,
+                                   Record->EndOfFile.QuadPart,
+                                   Record->FileAttributes,
+                                   Names + Record->NameOffset,
+                                   Record->NameLength,
+                                   Names + Record->NameOffset + Record->NameLength,
+                                   Record->ShortNameLength);
+
+        if (!RtlClipNextListingLine(Listing))
+            break;
     }
 
-    RtlCliDisplayString("%02d.%02d.%04d %02d:%02d %s %9s %-28S %12S\n",
-                        Time.Day,
-                        Time.Month,
-                        Time.Year,
-                        Time.Hour,
-                        Time.Minute,
-                        DirInfo->FileAttributes & FILE_ATTRIBUTE_DIRECTORY ? "<DIR>" : "     ",
-                        SizeString,
-                        FileString,
-                        ShortString);
-
-    // Restore the character that was here before
-    *Null = Save;
+    ScratchSize = 0;
+    NtFreeVirtualMemory(NtCurrentProcess(), &Scratch, &ScratchSize, MEM_RELEASE);
+
+    return STATUS_SUCCESS;
 }
 
 /*++
  * @name RtlCliListDirectory
  *
- * The RtlCliListDirectory routine lists the current directory contents.
+ * The RtlCliListDirectory routine lists the contents of a directory.
  *
- * @param None.
+ * @param CurrentDirectory
+ *        Directory to list, full path in DOS format.
  *
- * @return NTSTATUS
+ * @param Pattern
+ *        Optional wildcard the names must match, such as "*.dll".
  *
- * @remarks Documentation for this routine needs to be completed.
+ * @param Flags
+ *        DIR_SORT_* order of the listing, or DIR_BARE or DIR_COUNT.
+ *
+ * @return STATUS_SUCCESS or the status of a failing open or query.
+ *
+ * @remarks The directory is read DIR_QUERY_BUFFER_SIZE bytes at a time
+ *          with read-ahead, see RtlClipEnumerateDirectory. Lines are
+ *          collected in a print buffer and displayed a few kilobytes at a
+ *          time. Answering 'a' at the prompt lists the rest without
+ *          stopping. A sorted listing keeps up to DIR_SORT_MAX_ENTRIES
+ *          entries in reserved regions that are committed as they fill.
+ *          DIR_BARE prints the names only and DIR_COUNT only counts them;
+ *          both query FileNamesInformation. Pattern is passed to the file
+ *          system, which skips the entries that don't match.
  *
  *--*/
 NTSTATUS
-RtlCliListDirectory(PWCHAR CurrentDirectory)
+RtlCliListDirectory(PWCHAR CurrentDirectory, PCWSTR Pattern, ULONG Flags)
 {
     UNICODE_STRING DirectoryString;
+    UNICODE_STRING PatternString;
+    PUNICODE_STRING FileName = NULL;
     OBJECT_ATTRIBUTES ObjectAttributes;
     HANDLE DirectoryHandle;
-    NTSTATUS Status;
-    IO_STATUS_BLOCK IoStatusBlock;
-    BOOLEAN FirstQuery = TRUE;
-
-    PFILE_BOTH_DIR_INFORMATION DirectoryInfo, Entry;
     HANDLE EventHandle;
-    CHAR i, c;
+    IO_STATUS_BLOCK IoStatusBlock;
+    PUCHAR Buffers;
+    PDIR_LISTING Listing;
+    NTSTATUS Status;
 
     // Convert dir to NT Format
     if (!RtlDosPathNameToNtPathName_U(CurrentDirectory,
@@ -186,15 +1019,24 @@ RtlCliListDirectory(PWCHAR CurrentDirectory)
         return STATUS_UNSUCCESSFUL;
     }
 
+    if (Pattern)
+    {
+        RtlInitUnicodeString(&PatternString, Pattern);
+        FileName = &PatternString;
+    }
+
+    // Bare and count listings are for scripts, no header
+    if (!(Flags & (DIR_BARE | DIR_COUNT)))
+        RtlCliDisplayString(" Directory of %S\n\n", CurrentDirectory);
+
     // Initialize the object attributes
-    RtlCliDisplayString(" Directory of %S\n\n", CurrentDirectory);
     InitializeObjectAttributes(&ObjectAttributes,
                                &DirectoryString,
                                OBJ_CASE_INSENSITIVE,
                                NULL,
                                NULL);
 
-    // Open the directory
+    // Open the directory for asynchronous queries
     Status = ZwCreateFile(&DirectoryHandle,
                           FILE_LIST_DIRECTORY,
                           &ObjectAttributes,
@@ -207,19 +1049,13 @@ RtlCliListDirectory(PWCHAR CurrentDirectory)
                           NULL,
                           0);
 
+    RtlFreeUnicodeString(&DirectoryString);
+
     if (!NT_SUCCESS(Status))
     {
         return Status;
     }
 
-    // Allocate space for directory entry information
-    DirectoryInfo = RtlAllocateHeap(RtlGetProcessHeap(), 0, 4096);
-
-    if (!DirectoryInfo)
-    {
-        return STATUS_INSUFFICIENT_RESOURCES;
-    }
-
     // Create the event to wait on
     InitializeObjectAttributes(&ObjectAttributes, NULL, 0, NULL, NULL);
     Status = NtCreateEvent(&EventHandle,
@@ -230,80 +1066,88 @@ RtlCliListDirectory(PWCHAR CurrentDirectory)
 
     if (!NT_SUCCESS(Status))
     {
+        ZwClose(DirectoryHandle);
         return Status;
     }
 
-    // Start loop
+    // The query buffers are followed by the listing state
+    Buffers = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY,
+                              2 * DIR_QUERY_BUFFER_SIZE + sizeof(DIR_LISTING));
+    if (!Buffers)
+    {
+        NtClose(EventHandle);
+        ZwClose(DirectoryHandle);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
 
-    i = 0;
-    for (;;)
+    Listing = (PDIR_LISTING)(Buffers + 2 * DIR_QUERY_BUFFER_SIZE);
+    Listing->Flags = Flags;
+    Listing->Paging = !(Flags & DIR_BARE);
+
+    if (Flags & (DIR_BARE | DIR_COUNT))
     {
-        // Get the contents of the directory, adding up the size as we go
-        Status = ZwQueryDirectoryFile(DirectoryHandle,
-                                      EventHandle,
-                                      NULL,
-                                      0,
-                                      &IoStatusBlock,
-                                      DirectoryInfo,
-                                      4096,
-                                      FileBothDirectoryInformation,
-                                      FALSE,
-                                      NULL,
-                                      FirstQuery);
-        if (Status == STATUS_PENDING)
-        {
-            // Wait on the event
-            NtWaitForSingleObject(EventHandle, FALSE, NULL);
-            Status = IoStatusBlock.Status;
-        }
+        Status = RtlClipEnumerateDirectory(DirectoryHandle,
+                                           EventHandle,
+                                           Buffers,
+                                           FileNamesInformation,
+                                           FileName,
+                                           (Flags & DIR_BARE) ? RtlClipPrintName : RtlClipCountName,
+                                           Listing);
 
-        // Check for success
-        if (!NT_SUCCESS(Status))
-        {
-            // Nothing left to enumerate. Close handles and free memory
-            ZwClose(DirectoryHandle);
-            RtlFreeHeap(RtlGetProcessHeap(), 0, DirectoryInfo);
-            return STATUS_SUCCESS;
-        }
+        if (NT_SUCCESS(Status) && (Flags & DIR_COUNT))
+            RtlCliBufferPrint(&Listing->Output, "%u\n", Listing->Entries);
+    }
+    else if (!(Flags & DIR_SORT_MASK))
+    {
+        Status = RtlClipEnumerateDirectory(DirectoryHandle,
+                                           EventHandle,
+                                           Buffers,
+                                           FileBothDirectoryInformation,
+                                           FileName,
+                                           RtlClipPrintEntry,
+                                           Listing);
+    }
+    else
+    {
+        Status = RtlClipReserveRegion(&Listing->Records, DIR_SORT_MAX_ENTRIES * sizeof(DIR_RECORD));
+        if (NT_SUCCESS(Status))
+            Status = RtlClipReserveRegion(&Listing->Names, DIR_SORT_MAX_NAMES);
 
-        // Loop every directory
-        Entry = DirectoryInfo;
+        if (NT_SUCCESS(Status))
+            Status = RtlClipEnumerateDirectory(DirectoryHandle,
+                                               EventHandle,
+                                               Buffers,
+                                               FileBothDirectoryInformation,
+                                               FileName,
+                                               RtlClipStoreEntry,
+                                               Listing);
 
-        while (Entry)
+        if (NT_SUCCESS(Status) && Listing->Overflow)
         {
-            // List the file
-            RtlCliDumpFileInfo(Entry);
-
-            if (++i > 20)
-            {
-                i = 0;
-                RtlCliDisplayString("Continue listing (y/n):");
-                while (TRUE)
-                {
-                    c = RtlCliGetChar(hKeyboard);
-                    if (c == 'n' || c == 'N')
-                    {
-                        RtlCliDisplayString("\n");
-                        return STATUS_SUCCESS;
-                    }
-                    if (c == 'y' || c == 'Y')
-                    {
-                        break;
-                    }
-                }
-                RtlCliDisplayString("\n");
-            }
+            RtlCliDisplayString("Too many entries to sort after %u, use dir without /o.\n", Listing->Count);
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+        }
 
-            // Make sure we still have a file
-            if (!Entry->NextEntryOffset)
-                break;
+        if (NT_SUCCESS(Status))
+            Status = RtlClipPrintSortedListing(Listing);
 
-            // Move to the next one
-            Entry = (PFILE_BOTH_DIR_INFORMATION)((ULONG_PTR)Entry +
-                                                 Entry->NextEntryOffset);
-        }
+        RtlClipFreeRegion(&Listing->Names);
+        RtlClipFreeRegion(&Listing->Records);
+    }
 
-        // This isn't the first scan anymore
-        FirstQuery = FALSE;
+    if (NT_SUCCESS(Status) && !Listing->Stopped && !(Flags & (DIR_BARE | DIR_COUNT)))
+    {
+        RtlCliBufferPrint(&Listing->Output,
+                          "%16u File(s) %15I64u bytes\n%16u Dir(s)\n",
+                          Listing->Files,
+                          Listing->Bytes,
+                          Listing->Directories);
     }
+    RtlCliFlushPrintBuffer(&Listing->Output);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Buffers);
+    NtClose(EventHandle);
+    ZwClose(DirectoryHandle);
+
+    return Status;
 }
@@ -0,0 +1,755 @@
+/**
+ * PROJECT:         Native Shell
+ * COPYRIGHT:       LGPL; See LICENSE in the top level directory
+ * FILE:            find.c
+ * DESCRIPTION:     Text search over mapped files.
+ * DEVELOPERS:      See CONTRIBUTORS.md in the top level directory
+ */
+
+#include "precomp.h"
+#include "ntfile.h"
+
+// Each view searches FIND_VIEW_SIZE bytes and maps FIND_VIEW_OVERLAP more
+// on both sides, so matches and lines crossing the boundaries are whole
+#define FIND_VIEW_SIZE (16 * 1024 * 1024)
+#define FIND_VIEW_OVERLAP (64 * 1024)
+
+// Bytes looked at to tell UTF-16 from ANSI when there is no BOM
+#define FIND_SNIFF_SIZE 4096
+
+// Characters of a matching line that are printed
+#define FIND_LINE_CHARS 200
+
+// Boyer-Moore-Horspool matcher for one encoding of the pattern
+typedef struct _FIND_MATCHER
+{
+    UCHAR Pattern[FIND_MAX_PATTERN * sizeof(WCHAR)]; // folded
+    ULONG Length;
+    ULONG Skip[256];
+} FIND_MATCHER, *PFIND_MATCHER;
+
+// Search state shared by the walker and the pool threads
+typedef struct _FIND_CONTEXT
+{
+    CLI_THREAD_POOL Pool;
+    RTL_CRITICAL_SECTION Lock;
+    UCHAR Fold[256];
+    FIND_MATCHER Ansi;
+    FIND_MATCHER Wide;
+    WCHAR WidePattern[FIND_MAX_PATTERN]; // not folded
+    ULONG Files;
+    ULONG FilesMatched;
+    ULONG Matches;
+    ULONG Failures;
+} FIND_CONTEXT, *PFIND_CONTEXT;
+
+// One file to search, the path follows the structure
+typedef struct _FIND_JOB
+{
+    PFIND_CONTEXT Context;
+    PWSTR Path;
+} FIND_JOB, *PFIND_JOB;
+
+// Position in the file being searched
+typedef struct _FIND_FILE_STATE
+{
+    ULONG Line;          // line number at ScanOffset
+    LONGLONG LineStart;  // offset of that line
+    LONGLONG ScanOffset; // line feeds before this offset are counted
+    LONGLONG NextSearch; // first offset a match may start at
+    ULONG Matches;
+} FIND_FILE_STATE, *PFIND_FILE_STATE;
+
+/*++
+ * @name RtlClipFindBuildMatcher
+ *
+ * The RtlClipFindBuildMatcher routine prepares the skip table for a
+ * pattern.
+ *
+ * @param Matcher
+ *        Matcher to fill in.
+ *
+ * @param Pattern
+ *        Pattern bytes.
+ *
+ * @param Length
+ *        Size of the pattern, 1 to FIND_MAX_PATTERN * sizeof(WCHAR).
+ *
+ * @param Fold
+ *        Byte folding table.
+ *
+ * @return None.
+ *
+ * @remarks The pattern is stored folded and the table is indexed by
+ *          folded bytes, so case insensitive search costs one table lookup
+ *          per byte.
+ *
+ *--*/
+VOID
+RtlClipFindBuildMatcher(OUT PFIND_MATCHER Matcher, IN const UCHAR *Pattern, IN ULONG Length, IN const UCHAR *Fold)
+{
+    ULONG i;
+
+    Matcher->Length = Length;
+
+    for (i = 0; i < Length; i++)
+        Matcher->Pattern[i] = Fold[Pattern[i]];
+
+    for (i = 0; i < 256; i++)
+        Matcher->Skip[i] = Length;
+
+    // The last byte is left out, so a mismatch always moves forward
+    for (i = 0; i + 1 < Length; i++)
+        Matcher->Skip[Matcher->Pattern[i]] = Length - 1 - i;
+}
+
+/*++
+ * @name RtlClipFindSearch
+ *
+ * The RtlClipFindSearch routine finds the first match of a pattern.
+ *
+ * @param Matcher
+ *        Pattern to look for.
+ *
+ * @param Fold
+ *        Byte folding table.
+ *
+ * @param Start
+ *        First byte to search.
+ *
+ * @param End
+ *        End of the data, a match must end at or before it.
+ *
+ * @return Start of the match, or NULL.
+ *
+ * @remarks Horspool's variant of Boyer-Moore: the byte under the end of
+ *          the pattern decides how far to move, so long patterns skip most
+ *          of the data without looking at it.
+ *
+ *--*/
+const UCHAR *
+RtlClipFindSearch(IN PFIND_MATCHER Matcher, IN const UCHAR *Fold, IN const UCHAR *Start, IN const UCHAR *End)
+{
+    ULONG Last = Matcher->Length - 1;
+    UCHAR LastByte = Matcher->Pattern[Last];
+    const UCHAR *Current = Start;
+    UCHAR Byte;
+    ULONG i;
+
+    while ((ULONG_PTR)(End - Current) >= Matcher->Length)
+    {
+        Byte = Fold[Current[Last]];
+
+        if (Byte == LastByte)
+        {
+            for (i = 0; i < Last && Fold[Current[i]] == Matcher->Pattern[i]; i++)
+                ;
+
+            if (i == Last)
+                return Current;
+        }
+
+        Current += Matcher->Skip[Byte];
+    }
+
+    return NULL;
+}
+
+/*++
+ * @name RtlClipFindWideEqual
+ *
+ * The RtlClipFindWideEqual routine checks a match found in UTF-16 data.
+ *
+ * @param Context
+ *        Search context.
+ *
+ * @param Match
+ *        Start of the match, on an even offset.
+ *
+ * @return TRUE if the characters match the pattern.
+ *
+ * @remarks The byte matcher folds the high byte of a character as well,
+ *          so U+4100 would match U+6100. Only characters below U+0100 are
+ *          folded here, the rest must be equal.
+ *
+ *--*/
+BOOLEAN
+RtlClipFindWideEqual(IN PFIND_CONTEXT Context, IN const UCHAR *Match)
+{
+    ULONG Count = Context->Wide.Length / sizeof(WCHAR);
+    WCHAR Char, Pattern;
+    ULONG i;
+
+    for (i = 0; i < Count; i++)
+    {
+        Char = (WCHAR)(Match[i * 2] | (Match[i * 2 + 1] << 8));
+        Pattern = Context->WidePattern[i];
+
+        if (Char == Pattern)
+            continue;
+
+        if (Char > 0xFF || Pattern > 0xFF ||
+            Context->Fold[Char] != Context->Fold[Pattern])
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*++
+ * @name RtlClipFindLineFeed
+ *
+ * The RtlClipFindLineFeed routine finds the next line feed.
+ *
+ * @param Data
+ *        Start of the view.
+ *
+ * @param From
+ *        Index to start at, even for UTF-16.
+ *
+ * @param To
+ *        Index to stop at.
+ *
+ * @param Wide
+ *        TRUE for UTF-16 data.
+ *
+ * @return Index of the line feed, or To if there is none.
+ *
+ * @remarks None.
+ *
+ *--*/
+ULONG
+RtlClipFindLineFeed(IN const UCHAR *Data, IN ULONG From, IN ULONG To, IN BOOLEAN Wide)
+{
+    const UCHAR *LineFeed;
+
+    if (!Wide)
+    {
+        LineFeed = (From < To) ? memchr(Data + From, '\n', To - From) : NULL;
+        return LineFeed ? (ULONG)(LineFeed - Data) : To;
+    }
+
+    for (; From + 1 < To; From += 2)
+    {
+        if (Data[From] == '\n' && Data[From + 1] == 0)
+            return From;
+    }
+
+    return To;
+}
+
+/*++
+ * @name RtlClipFindCountLines
+ *
+ * The RtlClipFindCountLines routine moves the line count of a file up to
+ * an offset in the current view.
+ *
+ * @param State
+ *        Search state of the file.
+ *
+ * @param Data
+ *        Start of the view.
+ *
+ * @param ViewOffset
+ *        File offset of the view.
+ *
+ * @param Offset
+ *        File offset to count up to.
+ *
+ * @param Wide
+ *        TRUE for UTF-16 data.
+ *
+ * @return None.
+ *
+ * @remarks Lines are only counted up to the matches, never past them twice.
+ *
+ *--*/
+VOID
+RtlClipFindCountLines(IN OUT PFIND_FILE_STATE State,
+                      IN const UCHAR *Data,
+                      IN LONGLONG ViewOffset,
+                      IN LONGLONG Offset,
+                      IN BOOLEAN Wide)
+{
+    ULONG To = (ULONG)(Offset - ViewOffset);
+    ULONG Index = (ULONG)(State->ScanOffset - ViewOffset);
+    ULONG Unit = Wide ? sizeof(WCHAR) : 1;
+
+    for (;;)
+    {
+        Index = RtlClipFindLineFeed(Data, Index, To, Wide);
+        if (Index >= To)
+            break;
+
+        Index += Unit;
+        State->Line++;
+        State->LineStart = ViewOffset + Index;
+    }
+
+    State->ScanOffset = Offset;
+}
+
+/*++
+ * @name RtlClipFindInView
+ *
+ * The RtlClipFindInView routine reports the matching lines that start in
+ * one view of a file.
+ *
+ * @param Context
+ *        Search context.
+ *
+ * @param Output
+ *        Where the matching lines go.
+ *
+ * @param Path
+ *        Path of the file, for the output.
+ *
+ * @param State
+ *        Search state of the file.
+ *
+ * @param Data
+ *        Start of the view.
+ *
+ * @param ViewOffset
+ *        File offset of the view.
+ *
+ * @param ViewLength
+ *        Bytes in the view.
+ *
+ * @param Limit
+ *        File offset where the next view takes over.
+ *
+ * @param Wide
+ *        TRUE for UTF-16 data.
+ *
+ * @return None.
+ *
+ * @remarks Each line is printed once, with the first FIND_LINE_CHARS
+ *          characters, and the search resumes on the next line.
+ *
+ *--*/
+VOID
+RtlClipFindInView(IN PFIND_CONTEXT Context,
+                  IN OUT PCLI_PRINT_BUFFER Output,
+                  IN PCWSTR Path,
+                  IN OUT PFIND_FILE_STATE State,
+                  IN const UCHAR *Data,
+                  IN LONGLONG ViewOffset,
+                  IN ULONG ViewLength,
+                  IN LONGLONG Limit,
+                  IN BOOLEAN Wide)
+{
+    PFIND_MATCHER Matcher = Wide ? &Context->Wide : &Context->Ansi;
+    ULONG Unit = Wide ? sizeof(WCHAR) : 1;
+    ULONG SearchEnd, LineFrom, LineEnd, Chars;
+    LONGLONG MatchOffset;
+    const UCHAR *Match;
+
+    // A match has to start before Limit and end inside the view
+    SearchEnd = (ULONG)min(Limit - ViewOffset + Matcher->Length - 1, (LONGLONG)ViewLength);
+
+    while (State->NextSearch < Limit)
+    {
+        Match = RtlClipFindSearch(Matcher,
+                                  Context->Fold,
+                                  Data + (ULONG)(State->NextSearch - ViewOffset),
+                                  Data + SearchEnd);
+        if (!Match)
+            break;
+
+        MatchOffset = ViewOffset + (Match - Data);
+
+        // UTF-16 characters start on even offsets
+        if (Wide && ((MatchOffset & 1) || !RtlClipFindWideEqual(Context, Match)))
+        {
+            State->NextSearch = MatchOffset + 1;
+            continue;
+        }
+
+        RtlClipFindCountLines(State, Data, ViewOffset, MatchOffset, Wide);
+
+        LineFrom = (ULONG)(max(State->LineStart, ViewOffset) - ViewOffset);
+        LineEnd = RtlClipFindLineFeed(Data, (ULONG)(MatchOffset - ViewOffset), ViewLength, Wide);
+
+        Chars = (LineEnd - LineFrom) / Unit;
+        if (Chars && (Wide ? ((PCWSTR)(Data + LineFrom))[Chars - 1] == L'\r' : Data[LineEnd - 1] == '\r'))
+            Chars--;
+        Chars = min(Chars, FIND_LINE_CHARS);
+
+        if (Wide)
+        {
+            RtlCliBufferPrint(Output, "%S(%u): %.*S\n", Path, State->Line, Chars, (PCWSTR)(Data + LineFrom));
+        }
+        else
+        {
+            RtlCliBufferPrint(Output, "%S(%u): %.*s\n", Path, State->Line, Chars, (PCSTR)(Data + LineFrom));
+        }
+
+        State->Matches++;
+
+        if (LineEnd < ViewLength)
+        {
+            // Go on after the line feed, which starts a new line
+            State->NextSearch = ViewOffset + LineEnd + Unit;
+            State->ScanOffset = State->NextSearch;
+            State->LineStart = State->NextSearch;
+            State->Line++;
+        }
+        else
+        {
+            // The line runs past the view, nothing more to find here
+            State->NextSearch = ViewOffset + ViewLength;
+        }
+    }
+
+    if (State->ScanOffset < Limit)
+        RtlClipFindCountLines(State, Data, ViewOffset, Limit, Wide);
+
+    State->NextSearch = max(State->NextSearch, Limit);
+}
+
+/*++
+ * @name RtlClipFindInFile
+ *
+ * The RtlClipFindInFile routine searches one file.
+ *
+ * @param Context
+ *        Search context.
+ *
+ * @param Path
+ *        File to search, full path in DOS format.
+ *
+ * @return STATUS_SUCCESS or the status of the failing call.
+ *
+ * @remarks The file is mapped in FIND_VIEW_SIZE views, so the data is
+ *          searched where the cache manager keeps it, without copies. A
+ *          UTF-16 BOM, or mostly zero odd bytes at the start of the file,
+ *          selects the UTF-16 pattern. Read errors on the views raise an
+ *          in-page exception, which is turned back into a status here.
+ *
+ *--*/
+NTSTATUS
+RtlClipFindInFile(IN PFIND_CONTEXT Context, IN PCWSTR Path)
+{
+    WCHAR FileName[TREE_MAX_PATH + 4] = L"\\??\\";
+    CLI_PRINT_BUFFER Output;
+    FIND_FILE_STATE State;
+    UNICODE_STRING FileNameString;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    HANDLE hFile, hSection;
+    LONGLONG FileSize;
+    LONGLONG Base;
+    LARGE_INTEGER ViewOffset;
+    SIZE_T ViewSize;
+    PVOID View;
+    ULONG ViewLength, i, OddZeros;
+    BOOLEAN Wide = FALSE;
+    NTSTATUS Status;
+
+    wcsncat(FileName, Path, RTL_NUMBER_OF(FileName) - 5);
+    RtlInitUnicodeString(&FileNameString, FileName);
+    InitializeObjectAttributes(&ObjectAttributes, &FileNameString, OBJ_CASE_INSENSITIVE, NULL, NULL);
+
+    Status = NtOpenFile(&hFile,
+                        FILE_READ_DATA | SYNCHRONIZE,
+                        &ObjectAttributes,
+                        &IoStatusBlock,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    // Empty files can't be mapped and have nothing to find
+    if (!NtFileGetFileSize(hFile, &FileSize) || FileSize == 0)
+    {
+        NtClose(hFile);
+        return STATUS_SUCCESS;
+    }
+
+    Status = NtCreateSection(&hSection, SECTION_MAP_READ | SECTION_QUERY, NULL, NULL,
+                             PAGE_READONLY, SEC_COMMIT, hFile);
+    NtClose(hFile);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    Output.Length = 0;
+    State.Line = 1;
+    State.LineStart = 0;
+    State.ScanOffset = 0;
+    State.NextSearch = 0;
+    State.Matches = 0;
+
+    for (Base = 0; Base < FileSize; Base += FIND_VIEW_SIZE)
+    {
+        // FIND_VIEW_OVERLAP keeps the offset on the allocation granularity
+        ViewOffset.QuadPart = max(Base - FIND_VIEW_OVERLAP, 0);
+        ViewLength = (ULONG)(min(FileSize, Base + FIND_VIEW_SIZE + FIND_VIEW_OVERLAP) - ViewOffset.QuadPart);
+
+        View = NULL;
+        ViewSize = ViewLength;
+        Status = NtMapViewOfSection(hSection, NtCurrentProcess(), &View, 0, 0, &ViewOffset,
+                                    &ViewSize, ViewUnmap, 0, PAGE_READONLY);
+        if (!NT_SUCCESS(Status))
+            break;
+
+        __try
+        {
+            if (Base == 0)
+            {
+                if (ViewLength >= 2 && ((PUCHAR)View)[0] == 0xFF && ((PUCHAR)View)[1] == 0xFE)
+                {
+                    Wide = TRUE;
+                    State.NextSearch = State.ScanOffset = State.LineStart = 2;
+                }
+                else
+                {
+                    OddZeros = 0;
+                    for (i = 1; i < min(ViewLength, FIND_SNIFF_SIZE); i += 2)
+                        OddZeros += (((PUCHAR)View)[i] == 0);
+
+                    Wide = (ViewLength >= 2 && OddZeros * 4 >= min(ViewLength, FIND_SNIFF_SIZE));
+                }
+            }
+
+            if (State.NextSearch < FileSize)
+            {
+                RtlClipFindInView(Context,
+                                  &Output,
+                                  Path,
+                                  &State,
+                                  View,
+                                  ViewOffset.QuadPart,
+                                  ViewLength,
+                                  min(Base + FIND_VIEW_SIZE, FileSize),
+                                  Wide);
+            }
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            Status = GetExceptionCode();
+        }
+
+        NtUnmapViewOfSection(NtCurrentProcess(), View);
+
+        if (!NT_SUCCESS(Status))
+            break;
+    }
+
+    NtClose(hSection);
+
+    RtlCliFlushPrintBuffer(&Output);
+
+    RtlEnterCriticalSection(&Context->Lock);
+    Context->Files++;
+    Context->Matches += State.Matches;
+    if (State.Matches)
+        Context->FilesMatched++;
+    RtlLeaveCriticalSection(&Context->Lock);
+
+    return Status;
+}
+
+/*++
+ * @name RtlClipFindReportFailure
+ *
+ * The RtlClipFindReportFailure routine prints and counts a file that
+ * couldn't be searched.
+ *
+ * @param Context
+ *        Search context.
+ *
+ * @param Path
+ *        The file.
+ *
+ * @param Status
+ *        Why it failed.
+ *
+ * @return None.
+ *
+ * @remarks None.
+ *
+ *--*/
+VOID
+RtlClipFindReportFailure(IN PFIND_CONTEXT Context, IN PCWSTR Path, IN NTSTATUS Status)
+{
+    RtlCliDisplayString("Can't search %S (0x%.8X)\n", Path, Status);
+
+    RtlEnterCriticalSection(&Context->Lock);
+    Context->Failures++;
+    RtlLeaveCriticalSection(&Context->Lock);
+}
+
+/*++
+ * @name RtlClipFindWorker
+ *
+ * The RtlClipFindWorker routine searches one file on a pool thread.
+ *
+ * @param Parameter
+ *        The FIND_JOB, freed here.
+ *
+ * @return None.
+ *
+ * @remarks None.
+ *
+ *--*/
+VOID
+RtlClipFindWorker(IN PVOID Parameter)
+{
+    PFIND_JOB Job = Parameter;
+    NTSTATUS Status;
+
+    Status = RtlClipFindInFile(Job->Context, Job->Path);
+    if (!NT_SUCCESS(Status))
+        RtlClipFindReportFailure(Job->Context, Job->Path, Status);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Job);
+}
+
+/*++
+ * @name RtlClipFindVisit
+ *
+ * The RtlClipFindVisit routine hands every file of the tree to the pool.
+ *
+ * @param Visit
+ *        Kind of visit.
+ *
+ * @param Entry
+ *        Entry in the tree.
+ *
+ * @param Parameter
+ *        The FIND_CONTEXT.
+ *
+ * @return STATUS_SUCCESS, the walk always goes on.
+ *
+ * @remarks None.
+ *
+ *--*/
+NTSTATUS
+RtlClipFindVisit(IN CLI_TREE_VISIT Visit, IN PCLI_TREE_ENTRY Entry, IN PVOID Parameter)
+{
+    PFIND_CONTEXT Context = Parameter;
+    PFIND_JOB Job;
+    SIZE_T PathLength;
+
+    if (Visit == TreeVisitError)
+    {
+        RtlClipFindReportFailure(Context, Entry->Path, Entry->Status);
+        return STATUS_SUCCESS;
+    }
+
+    if (Visit != TreeVisitFile)
+        return STATUS_SUCCESS;
+
+    PathLength = wcslen(Entry->Path) + 1;
+
+    Job = RtlAllocateHeap(RtlGetProcessHeap(), 0, sizeof(FIND_JOB) + PathLength * sizeof(WCHAR));
+    if (!Job)
+    {
+        RtlClipFindReportFailure(Context, Entry->Path, STATUS_INSUFFICIENT_RESOURCES);
+        return STATUS_SUCCESS;
+    }
+
+    Job->Context = Context;
+    Job->Path = (PWSTR)(Job + 1);
+    RtlCopyMemory(Job->Path, Entry->Path, PathLength * sizeof(WCHAR));
+
+    RtlCliQueueWorkItem(&Context->Pool, RtlClipFindWorker, Job);
+    return STATUS_SUCCESS;
+}
+
+/*++
+ * @name RtlCliFindText
+ *
+ * The RtlCliFindText routine prints the lines of one or more files that
+ * contain a string.
+ *
+ * @param Text
+ *        String to look for, 1 to FIND_MAX_PATTERN characters.
+ *
+ * @param Path
+ *        File or directory to search, full path in DOS format.
+ *
+ * @param Recurse
+ *        TRUE to search the subdirectories of a directory as well.
+ *
+ * @param IgnoreCase
+ *        TRUE to match A-Z and a-z alike.
+ *
+ * @param ThreadCount
+ *        Number of search threads for a directory.
+ *
+ * @return STATUS_SUCCESS if every file was searched, STATUS_UNSUCCESSFUL
+ *         if some could not be, or the status of a failure that stopped
+ *         the search.
+ *
+ * @remarks Matching lines are printed as "path(line): text". The files of
+ *          a directory are searched on a pool of threads, each collecting
+ *          its output in a print buffer so lines of different files don't
+ *          mix. ANSI files are searched for Text as is, UTF-16 files for
+ *          Text converted from the ANSI code page.
+ *
+ *--*/
+NTSTATUS
+RtlCliFindText(IN PCSTR Text, IN PCWSTR Path, IN BOOLEAN Recurse, IN BOOLEAN IgnoreCase, IN ULONG ThreadCount)
+{
+    WCHAR WideText[FIND_MAX_PATTERN];
+    PFIND_CONTEXT Context;
+    ULONG Length = strlen(Text);
+    ULONG WideLength;
+    NTSTATUS Status;
+    ULONG i;
+
+    if (Length == 0 || Length > FIND_MAX_PATTERN)
+        return STATUS_INVALID_PARAMETER;
+
+    Status = RtlMultiByteToUnicodeN(WideText, sizeof(WideText), &WideLength, Text, Length);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    // The pool is too large for the stack
+    Context = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(FIND_CONTEXT));
+    if (!Context)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    for (i = 0; i < 256; i++)
+        Context->Fold[i] = (IgnoreCase && i >= 'A' && i <= 'Z') ? (UCHAR)(i + 'a' - 'A') : (UCHAR)i;
+
+    RtlClipFindBuildMatcher(&Context->Ansi, (const UCHAR *)Text, Length, Context->Fold);
+    RtlClipFindBuildMatcher(&Context->Wide, (const UCHAR *)WideText, WideLength, Context->Fold);
+    RtlCopyMemory(Context->WidePattern, WideText, WideLength);
+
+    RtlInitializeCriticalSection(&Context->Lock);
+
+    if (!FolderExists(Path))
+    {
+        Status = RtlClipFindInFile(Context, Path);
+    }
+    else
+    {
+        Status = RtlCliCreateThreadPool(&Context->Pool, ThreadCount);
+        if (NT_SUCCESS(Status))
+        {
+            Status = RtlCliWalkTree(Path, Recurse, RtlClipFindVisit, Context);
+
+            // Let the searches in flight finish before reporting
+            RtlCliDestroyThreadPool(&Context->Pool);
+        }
+    }
+
+    RtlCliDisplayString("%u matches in %u of %u files, %u failed\n",
+                        Context->Matches,
+                        Context->FilesMatched,
+                        Context->Files,
+                        Context->Failures);
+
+    if (NT_SUCCESS(Status) && Context->Failures)
+        Status = STATUS_UNSUCCESSFUL;
+
+    RtlDeleteCriticalSection(&Context->Lock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Context);
+
+    return Status;
+}
@@ -0,0 +1,176 @@
+/**
+ * PROJECT:         Native Shell
+ * COPYRIGHT:       LGPL; See LICENSE in the top level directory
+ * FILE:            hash.c
+ * DESCRIPTION:     File hashing and hash benchmarks.
+ * DEVELOPERS:      See CONTRIBUTORS.md in the top level directory
+ */
+
+#include "precomp.h"
+#include "ntfile.h"
+
+#define HASH_BUFFER_SIZE (4 * 1024 * 1024)
+#define HASH_BENCH_BUFFER_SIZE (16 * 1024 * 1024)
+#define HASH_BENCH_MIN_MILLISECONDS 250
+
+/*++
+ * @name RtlCliHashFile
+ *
+ * The RtlCliHashFile routine computes the digest of a file.
+ *
+ * @param Path
+ *        File to hash, full path in DOS format.
+ *
+ * @param Algorithm
+ *        Algorithm to use.
+ *
+ * @param Digest
+ *        Receives Algorithm->DigestSize bytes.
+ *
+ * @param Bytes
+ *        Receives the number of bytes hashed.
+ *
+ * @return STATUS_SUCCESS, or STATUS_UNSUCCESSFUL if the file couldn't be
+ *         opened or read to the end.
+ *
+ * @remarks The file is streamed through one HASH_BUFFER_SIZE page aligned
+ *          buffer with NtFileReadFile, so each read is large and the
+ *          kernel runs over long runs of memory. The buffer comes from
+ *          NtFileAllocateCopyBuffer and may be smaller if memory is short.
+ *          The bytes read are checked against the file size only when
+ *          the size could be queried.
+ *
+ *--*/
+NTSTATUS
+RtlCliHashFile(IN PCWSTR Path, IN PCLI_HASH_ALGORITHM Algorithm, OUT PUCHAR Digest, OUT PLONGLONG Bytes)
+{
+    CLI_HASH_CONTEXT Context;
+    HANDLE hFile;
+    PVOID Buffer;
+    ULONG BufferSize = HASH_BUFFER_SIZE;
+    LONGLONG FileSize;
+    DWORD ReadSize;
+    BOOLEAN SizeKnown;
+
+    *Bytes = 0;
+
+    if (!NtFileOpenFileForRead(&hFile, Path))
+        return STATUS_UNSUCCESSFUL;
+
+    if (!NT_SUCCESS(NtFileAllocateCopyBuffer(&Buffer, &BufferSize)))
+    {
+        RtlCliDisplayString("Out of memory for the read buffer.\n");
+        NtFileCloseFile(hFile);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    SizeKnown = NtFileGetFileSize(hFile, &FileSize);
+
+    Algorithm->Init(&Context);
+
+    // NtFileReadFile fails at the end of the file, the size tells it from an error
+    while (NtFileReadFile(hFile, Buffer, BufferSize, &ReadSize) && ReadSize)
+    {
+        Algorithm->Update(&Context, Buffer, ReadSize);
+        *Bytes += ReadSize;
+    }
+
+    Algorithm->Final(&Context, Digest);
+
+    NtFileFreeCopyBuffer(Buffer);
+    NtFileCloseFile(hFile);
+
+    if (SizeKnown && *Bytes != FileSize)
+    {
+        RtlCliDisplayString("Read stopped at %I64u of %I64u bytes.\n", *Bytes, FileSize);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*++
+ * @name RtlCliBenchmarkHashes
+ *
+ * The RtlCliBenchmarkHashes routine measures how fast every hash
+ * algorithm runs over data in memory.
+ *
+ * @param None.
+ *
+ * @return None.
+ *
+ * @remarks Each algorithm hashes a HASH_BENCH_BUFFER_SIZE buffer once to
+ *          warm the caches and the TLB, then repeatedly for at least
+ *          HASH_BENCH_MIN_MILLISECONDS. The rate is printed in GB/s with
+ *          the kernel picked for this processor. The buffer is smaller if
+ *          memory is short.
+ *
+ *--*/
+VOID
+RtlCliBenchmarkHashes(VOID)
+{
+    CLI_HASH_CONTEXT Context;
+    UCHAR Digest[CLI_HASH_MAX_DIGEST];
+    PCLI_HASH_ALGORITHM Algorithm;
+    LARGE_INTEGER StartTime, EndTime, Frequency;
+    ULONGLONG Microseconds, Bytes, Rate;
+    PULONG Buffer;
+    ULONG BufferSize = HASH_BENCH_BUFFER_SIZE;
+    ULONG Seed = 0x12345678;
+    ULONG i;
+
+    NtQueryPerformanceCounter(&StartTime, &Frequency);
+    if (!Frequency.QuadPart)
+    {
+        RtlCliDisplayString("No performance counter.\n");
+        return;
+    }
+
+    if (!NT_SUCCESS(NtFileAllocateCopyBuffer((PVOID *)&Buffer, &BufferSize)))
+    {
+        RtlCliDisplayString("Out of memory for the benchmark buffer.\n");
+        return;
+    }
+
+    // Data the kernels can't shortcut
+    for (i = 0; i < BufferSize / sizeof(ULONG); i++)
+    {
+        Seed = Seed * 1664525 + 1013904223;
+        Buffer[i] = Seed;
+    }
+
+    RtlCliDisplayString("%u KB buffer\n", BufferSize / 1024);
+
+    for (i = 0; i < RtlCliHashAlgorithmCount; i++)
+    {
+        Algorithm = &RtlCliHashAlgorithms[i];
+
+        Algorithm->Init(&Context);
+        Algorithm->Update(&Context, Buffer, BufferSize);
+        Algorithm->Final(&Context, Digest);
+
+        Bytes = 0;
+        NtQueryPerformanceCounter(&StartTime, NULL);
+        do
+        {
+            Algorithm->Init(&Context);
+            Algorithm->Update(&Context, Buffer, BufferSize);
+            Algorithm->Final(&Context, Digest);
+            Bytes += BufferSize;
+
+            NtQueryPerformanceCounter(&EndTime, NULL);
+            Microseconds = (ULONGLONG)(EndTime.QuadPart - StartTime.QuadPart) * 1000000 / Frequency.QuadPart;
+        } while (Microseconds < HASH_BENCH_MIN_MILLISECONDS * 1000);
+
+        // Hundredths of GB/s
+        Rate = Bytes * 100 * 1000000 / Microseconds / (1024 * 1024 * 1024);
+
+        RtlCliDisplayString("%-8s %-10s %I64u.%02u GB/s\n",
+                            Algorithm->Name,
+                            Algorithm->KernelName ? Algorithm->KernelName() : "portable",
+                            Rate / 100,
+                            (ULONG)(Rate % 100));
+    }
+
+    NtFileFreeCopyBuffer(Buffer);
+}
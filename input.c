@@ -14,16 +14,28 @@ NTSTATUS
 RtlClipBackspace(
     VOID);
 
+NTSTATUS
+RtlClipPutAnsiChar(
+    IN CHAR Char);
+
 // Event to wait on for keyboard input
 HANDLE hEvent;
 
-// Raw keyboard character buffer
+// Raw keyboard event queue, filled by as many events as one read returns.
+// It outlives the keyboard handle, so typeahead survives process launches.
+#define INPUT_QUEUE_SIZE 128
+
+KEYBOARD_INPUT_DATA InputQueue[INPUT_QUEUE_SIZE];
+ULONG QueueHead = 0;
+ULONG QueueCount = 0;
 
-ULONG CurrentChar = 0;
+// Keyboard read left running into the queue by RtlCliWaitForKeyOrObject
+IO_STATUS_BLOCK KeyWaitIosb;
+BOOLEAN KeyWaitPending = FALSE;
 
 // Input buffer
 CHAR Line[1024];
-CHAR CurrentPosition = 0;
+ULONG CurrentPosition = 0;
 
 /*++
  * @name RtlCliOpenInputDevice
@@ -39,6 +51,7 @@ CHAR CurrentPosition = 0;
  * @return STATUS_SUCCESS or error code when attemping to open the device.
  *
  * @remarks This routine supports both mouse and keyboard input devices.
+ *          On failure the handle returned is NULL.
  *
  *--*/
 NTSTATUS
@@ -79,10 +92,20 @@ RtlCliOpenInputDevice(OUT PHANDLE Handle,
                           FILE_DIRECTORY_FILE,
                           NULL,
                           0);
+    if (!NT_SUCCESS(Status))
+    {
+        *Handle = NULL;
+        return Status;
+    }
 
     // Now create an event that will be used to wait on the device
     InitializeObjectAttributes(&ObjectAttributes, NULL, 0, NULL, NULL);
     Status = NtCreateEvent(&hEvent, EVENT_ALL_ACCESS, &ObjectAttributes, 1, 0);
+    if (!NT_SUCCESS(Status))
+    {
+        NtClose(hDriver);
+        hDriver = NULL;
+    }
 
     // Return the handle
     *Handle = hDriver;
@@ -150,15 +173,68 @@ RtlClipWaitForInput(IN HANDLE hDriver,
     return Status;
 }
 
+/*++
+ * @name RtlClipFillInputQueue
+ *
+ * The RtlClipFillInputQueue routine reads keyboard events into the queue.
+ *
+ * @param hDriver
+ *        Handle of the keyboard device.
+ *
+ * @return STATUS_SUCCESS or error code from the read operation.
+ *
+ * @remarks A single read returns every event the class driver has buffered,
+ *          up to the free space at the end of the queue, so fast typing and
+ *          pasted text don't cost one round trip per key.
+ *
+ *--*/
+NTSTATUS
+RtlClipFillInputQueue(IN HANDLE hDriver)
+{
+    NTSTATUS Status;
+    ULONG Tail, Free, BufferLength;
+
+    // Read into the contiguous free space after the last queued event
+    Tail = (QueueHead + QueueCount) % INPUT_QUEUE_SIZE;
+    Free = INPUT_QUEUE_SIZE - QueueCount;
+    if (Free > INPUT_QUEUE_SIZE - Tail)
+        Free = INPUT_QUEUE_SIZE - Tail;
+
+    if (!Free)
+        return STATUS_SUCCESS;
+
+    BufferLength = Free * sizeof(KEYBOARD_INPUT_DATA);
+    Status = RtlClipWaitForInput(hDriver, &InputQueue[Tail], &BufferLength);
+
+    if (NT_SUCCESS(Status))
+        QueueCount += BufferLength / sizeof(KEYBOARD_INPUT_DATA);
+
+    return Status;
+}
+
 CHAR RtlCliGetChar(IN HANDLE hDriver)
 {
-    KEYBOARD_INPUT_DATA KeyboardData;
+    PKEYBOARD_INPUT_DATA KeyboardData;
     KBD_RECORD kbd_rec;
-    ULONG BufferLength = sizeof(KEYBOARD_INPUT_DATA);
 
-    RtlClipWaitForInput(hDriver, &KeyboardData, &BufferLength);
+    if (!QueueCount)
+    {
+        // Anything still buffered (prompt, echo, pager text) must be visible
+        // before we block on the keyboard
+        RtlCliFlush();
+
+        RtlClipFillInputQueue(hDriver);
 
-    IntTranslateKey(&KeyboardData, &kbd_rec);
+        if (!QueueCount)
+            return (-1);
+    }
+
+    // Take the oldest event
+    KeyboardData = &InputQueue[QueueHead];
+    QueueHead = (QueueHead + 1) % INPUT_QUEUE_SIZE;
+    QueueCount--;
+
+    IntTranslateKey(KeyboardData, &kbd_rec);
 
     if (!kbd_rec.bKeyDown)
     {
@@ -167,6 +243,118 @@ CHAR RtlCliGetChar(IN HANDLE hDriver)
     return kbd_rec.AsciiChar;
 }
 
+/*++
+ * @name RtlCliWaitForKeyOrObject
+ *
+ * The RtlCliWaitForKeyOrObject routine waits until a key is pressed or an
+ * object is signaled.
+ *
+ * @param hDriver
+ *        Keyboard handle.
+ *
+ * @param Object
+ *        Object to wait on along with the keyboard.
+ *
+ * @param Timeout
+ *        Optional timeout, as for NtWaitForMultipleObjects.
+ *
+ * @return STATUS_WAIT_0 if Object is signaled, STATUS_WAIT_1 if a key was
+ *         pressed, STATUS_TIMEOUT, or the status of a failed wait.
+ *
+ * @remarks The key is consumed. A keyboard read stays pending between
+ *          calls so no key is lost, call RtlCliCancelKeyWait before the
+ *          keyboard is read any other way. Releases of keys, such as the
+ *          Enter that started the command, don't count.
+ *
+ *--*/
+NTSTATUS
+RtlCliWaitForKeyOrObject(IN HANDLE hDriver, IN HANDLE Object, IN PLARGE_INTEGER Timeout)
+{
+    KBD_RECORD kbd_rec;
+    HANDLE Handles[2];
+    LARGE_INTEGER ByteOffset;
+    NTSTATUS Status;
+
+    for (;;)
+    {
+        // Typeahead comes first
+        while (QueueCount)
+        {
+            IntTranslateKey(&InputQueue[QueueHead], &kbd_rec);
+            QueueHead = (QueueHead + 1) % INPUT_QUEUE_SIZE;
+            QueueCount--;
+
+            if (kbd_rec.bKeyDown)
+                return STATUS_WAIT_1;
+        }
+
+        if (!KeyWaitPending)
+        {
+            // The queue is empty, the read can use all of it
+            QueueHead = 0;
+            RtlZeroMemory(&KeyWaitIosb, sizeof(KeyWaitIosb));
+            RtlZeroMemory(&ByteOffset, sizeof(ByteOffset));
+
+            Status = NtReadFile(hDriver, hEvent, NULL, NULL, &KeyWaitIosb,
+                                InputQueue, sizeof(InputQueue), &ByteOffset, NULL);
+            if (Status == STATUS_PENDING)
+            {
+                KeyWaitPending = TRUE;
+            }
+            else if (NT_SUCCESS(Status))
+            {
+                QueueCount = (ULONG)KeyWaitIosb.Information / sizeof(KEYBOARD_INPUT_DATA);
+                continue;
+            }
+            else
+            {
+                // No keyboard to wait for
+                return NtWaitForSingleObject(Object, FALSE, Timeout);
+            }
+        }
+
+        Handles[0] = Object;
+        Handles[1] = hEvent;
+
+        Status = NtWaitForMultipleObjects(2, Handles, WaitAny, FALSE, Timeout);
+        if (Status != STATUS_WAIT_1)
+            return Status;
+
+        KeyWaitPending = FALSE;
+        QueueCount = (ULONG)KeyWaitIosb.Information / sizeof(KEYBOARD_INPUT_DATA);
+    }
+}
+
+/*++
+ * @name RtlCliCancelKeyWait
+ *
+ * The RtlCliCancelKeyWait routine stops the keyboard read left running by
+ * RtlCliWaitForKeyOrObject.
+ *
+ * @param hDriver
+ *        Keyboard handle.
+ *
+ * @return None.
+ *
+ * @remarks Keys the read got before it was cancelled stay in the queue as
+ *          typeahead.
+ *
+ *--*/
+VOID
+RtlCliCancelKeyWait(IN HANDLE hDriver)
+{
+    IO_STATUS_BLOCK Iosb;
+
+    if (!KeyWaitPending)
+        return;
+
+    NtCancelIoFile(hDriver, &Iosb);
+    NtWaitForSingleObject(hEvent, FALSE, NULL);
+
+    KeyWaitPending = FALSE;
+    QueueCount = (ULONG)KeyWaitIosb.Information / sizeof(KEYBOARD_INPUT_DATA);
+}
+
 /*++
  * @name RtlCliGetLine
  *
@@ -210,22 +398,12 @@ RtlCliGetLine(IN HANDLE hDriver)
             // Make sure we don't back-space beyond the limit
             if (CurrentPosition)
             {
-                // NtDisplayString does not properly handle backspace, so
-                // we unfortunately have to rely on a hack.
-
-                // We have to call in the display subsystem to redisplay the
-                // current text buffer and replace last character with space.
-
-                RtlCliPutChar('\r');
+                // NtDisplayString does not properly handle backspace, so the
+                // display subsystem redraws the changed part of the line on
+                // the next flush.
                 RtlClipBackspace();
 
-                RtlCliPutChar(' ');
-
-                RtlCliPutChar('\r');
-                RtlClipBackspace();
-
-                // Now we do the only thing we're supposed to do, which is to
-                // remove a character in the command buffer as well.
+                // Remove the character in the command buffer as well.
                 CurrentPosition--;
             }
 
@@ -237,12 +415,16 @@ RtlCliGetLine(IN HANDLE hDriver)
         if (!Char || Char == -1)
             continue;
 
+        // Keep room for the terminator
+        if (CurrentPosition >= sizeof(Line) - 1)
+            continue;
+
         // Add it to our line buffer
         Line[CurrentPosition] = Char;
         CurrentPosition++;
 
         // Again, as noted earlier, we combine input with display in a very
         // unholy way, so we also have to display it on screen.
-        RtlCliPutChar(Char);
+        RtlClipPutAnsiChar(Char);
     }
 }
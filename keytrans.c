@@ -8,74 +8,219 @@
 
 #include "precomp.h"
 
-typedef struct _SCANTOASCII
+/*
+ * Scan code translation tables.
+ *
+ * Every plane is indexed directly by the set 1 make code, with 0x80 added
+ * for keys that come with the E0 prefix. Each layout lists the main block
+ * (make codes 00-5F) row by row, and the shared E0 block is appended by
+ * the preprocessor. Characters are in the ANSI code page (1252), zero means
+ * the key doesn't produce one. Adding a layout only takes a new set of
+ * rows and an entry in KeyboardLayouts[].
+ */
+
+#define KBD_PLANE_SIZE 0x100
+#define KBD_MAIN_KEYS 0x60
+#define KBD_E0_PREFIX 0x80
+
+// E0-prefixed keys (60-BF): keypad Enter (E0 1C) and keypad / (E0 35)
+#define KBD_E0_KEYS \
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 60 */ \
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 70 */ \
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 80 */ \
+    "\0\0\0\0\0\0\0\0\0\0\0\0\r\0\0\0" /* 90 */ \
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* A0 */ \
+    "\0\0\0\0\0/\0\0\0\0\0\0\0\0\0\0" /* B0 */
+
+// Keypad with NumLock on, the same for all layouts
+static const UCHAR KbdNumLockPlane[KBD_PLANE_SIZE] =
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 00 */
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 10 */
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 20 */
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 30 */
+    "\0\0\0\0\0\0\0" "789-456+1" /* 40 */
+    "230.";                        /* 50 */
+
+// United States
+
+#define KBD_US_NORMAL \
+    "\0\0" "1234567890-=\b\0" /* 00 */ \
+    "qwertyuiop[]\r\0as" /* 10 */ \
+    "dfghjkl;'`\0\\zxcv" /* 20 */ \
+    "bnm,./\0*\0 \0\0\0\0\0\0" /* 30 */ \
+    "\0\0\0\0\0\0\0\0\0\0-\0\0\0+\0" /* 40 */ \
+    "\0\0\0\0\0\0\\\0\0\0\0\0\0\0\0\0" /* 50 */
+
+#define KBD_US_SHIFT \
+    "\0\0!@#$%^&*()_+\b\0" /* 00 */ \
+    "QWERTYUIOP{}\r\0AS" /* 10 */ \
+    "DFGHJKL:\"~\0|ZXCV" /* 20 */ \
+    "BNM<>?\0*\0 \0\0\0\0\0\0" /* 30 */ \
+    "\0\0\0\0\0\0\0\0\0\0-\0\0\0+\0" /* 40 */ \
+    "\0\0\0\0\0\0|\0\0\0\0\0\0\0\0\0" /* 50 */
+
+#define KBD_US_CAPS \
+    "\0\0" "1234567890-=\b\0" /* 00 */ \
+    "QWERTYUIOP[]\r\0AS" /* 10 */ \
+    "DFGHJKL;'`\0\\ZXCV" /* 20 */ \
+    "BNM,./\0*\0 \0\0\0\0\0\0" /* 30 */ \
+    "\0\0\0\0\0\0\0\0\0\0-\0\0\0+\0" /* 40 */ \
+    "\0\0\0\0\0\0\\\0\0\0\0\0\0\0\0\0" /* 50 */
+
+C_ASSERT(sizeof(KBD_US_NORMAL) == KBD_MAIN_KEYS + 1 &&
+         sizeof(KBD_US_SHIFT) == KBD_MAIN_KEYS + 1 &&
+         sizeof(KBD_US_CAPS) == KBD_MAIN_KEYS + 1);
+
+// United Kingdom
+
+#define KBD_UK_NORMAL \
+    "\0\0" "1234567890-=\b\0" /* 00 */ \
+    "qwertyuiop[]\r\0as" /* 10 */ \
+    "dfghjkl;'`\0#zxcv" /* 20 */ \
+    "bnm,./\0*\0 \0\0\0\0\0\0" /* 30 */ \
+    "\0\0\0\0\0\0\0\0\0\0-\0\0\0+\0" /* 40 */ \
+    "\0\0\0\0\0\0\\\0\0\0\0\0\0\0\0\0" /* 50 */
+
+#define KBD_UK_SHIFT \
+    "\0\0!\"\xA3$%^&*()_+\b\0" /* 00 */ \
+    "QWERTYUIOP{}\r\0AS" /* 10 */ \
+    "DFGHJKL:@\xAC\0~ZXCV" /* 20 */ \
+    "BNM<>?\0*\0 \0\0\0\0\0\0" /* 30 */ \
+    "\0\0\0\0\0\0\0\0\0\0-\0\0\0+\0" /* 40 */ \
+    "\0\0\0\0\0\0|\0\0\0\0\0\0\0\0\0" /* 50 */
+
+#define KBD_UK_CAPS \
+    "\0\0" "1234567890-=\b\0" /* 00 */ \
+    "QWERTYUIOP[]\r\0AS" /* 10 */ \
+    "DFGHJKL;'`\0#ZXCV" /* 20 */ \
+    "BNM,./\0*\0 \0\0\0\0\0\0" /* 30 */ \
+    "\0\0\0\0\0\0\0\0\0\0-\0\0\0+\0" /* 40 */ \
+    "\0\0\0\0\0\0\\\0\0\0\0\0\0\0\0\0" /* 50 */
+
+#define KBD_UK_ALTGR \
+    "\0\0\0\0\0\x80\0\0\0\0\0\0\0\0\0\0" /* 00 */ \
+    "\0\0\xE9\0\0\0\xFA\xED\xF3\0\0\0\0\0\xE1\0" /* 10 */ \
+    "\0\0\0\0\0\0\0\0\0\xA6\0\0\0\0\0\0" /* 20 */ \
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 30 */ \
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 40 */ \
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 50 */
+
+C_ASSERT(sizeof(KBD_UK_NORMAL) == KBD_MAIN_KEYS + 1 &&
+         sizeof(KBD_UK_SHIFT) == KBD_MAIN_KEYS + 1 &&
+         sizeof(KBD_UK_CAPS) == KBD_MAIN_KEYS + 1 &&
+         sizeof(KBD_UK_ALTGR) == KBD_MAIN_KEYS + 1);
+
+// German
+
+#define KBD_DE_NORMAL \
+    "\0\0" "1234567890\xDF\xB4\b\0" /* 00 */ \
+    "qwertzuiop\xFC+\r\0as" /* 10 */ \
+    "dfghjkl\xF6\xE4^\0#yxcv" /* 20 */ \
+    "bnm,.-\0*\0 \0\0\0\0\0\0" /* 30 */ \
+    "\0\0\0\0\0\0\0\0\0\0-\0\0\0+\0" /* 40 */ \
+    "\0\0\0\0\0\0<\0\0\0\0\0\0\0\0\0" /* 50 */
+
+#define KBD_DE_SHIFT \
+    "\0\0!\"\xA7$%&/()=?`\b\0" /* 00 */ \
+    "QWERTZUIOP\xDC*\r\0AS" /* 10 */ \
+    "DFGHJKL\xD6\xC4\xB0\0'YXCV" /* 20 */ \
+    "BNM;:_\0*\0 \0\0\0\0\0\0" /* 30 */ \
+    "\0\0\0\0\0\0\0\0\0\0-\0\0\0+\0" /* 40 */ \
+    "\0\0\0\0\0\0>\0\0\0\0\0\0\0\0\0" /* 50 */
+
+#define KBD_DE_CAPS \
+    "\0\0" "1234567890\xDF\xB4\b\0" /* 00 */ \
+    "QWERTZUIOP\xDC+\r\0AS" /* 10 */ \
+    "DFGHJKL\xD6\xC4^\0#YXCV" /* 20 */ \
+    "BNM,.-\0*\0 \0\0\0\0\0\0" /* 30 */ \
+    "\0\0\0\0\0\0\0\0\0\0-\0\0\0+\0" /* 40 */ \
+    "\0\0\0\0\0\0<\0\0\0\0\0\0\0\0\0" /* 50 */
+
+#define KBD_DE_ALTGR \
+    "\0\0\0\xB2\xB3\0\0\0{[]}\\\0\0\0" /* 00 */ \
+    "@\0\x80\0\0\0\0\0\0\0\0~\0\0\0\0" /* 10 */ \
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 20 */ \
+    "\0\0\xB5\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 30 */ \
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 40 */ \
+    "\0\0\0\0\0\0|\0\0\0\0\0\0\0\0\0" /* 50 */
+
+C_ASSERT(sizeof(KBD_DE_NORMAL) == KBD_MAIN_KEYS + 1 &&
+         sizeof(KBD_DE_SHIFT) == KBD_MAIN_KEYS + 1 &&
+         sizeof(KBD_DE_CAPS) == KBD_MAIN_KEYS + 1 &&
+         sizeof(KBD_DE_ALTGR) == KBD_MAIN_KEYS + 1);
+
+// French
+
+#define KBD_FR_NORMAL \
+    "\0\0&\xE9\"'(-\xE8_\xE7\xE0)=\b\0" /* 00 */ \
+    "azertyuiop^$\r\0qs" /* 10 */ \
+    "dfghjklm\xF9\xB2\0*wxcv" /* 20 */ \
+    "bn,;:!\0*\0 \0\0\0\0\0\0" /* 30 */ \
+    "\0\0\0\0\0\0\0\0\0\0-\0\0\0+\0" /* 40 */ \
+    "\0\0\0\0\0\0<\0\0\0\0\0\0\0\0\0" /* 50 */
+
+#define KBD_FR_SHIFT \
+    "\0\0" "1234567890\xB0+\b\0" /* 00 */ \
+    "AZERTYUIOP\xA8\xA3\r\0QS" /* 10 */ \
+    "DFGHJKLM%\0\0\xB5WXCV" /* 20 */ \
+    "BN?./\xA7\0*\0 \0\0\0\0\0\0" /* 30 */ \
+    "\0\0\0\0\0\0\0\0\0\0-\0\0\0+\0" /* 40 */ \
+    "\0\0\0\0\0\0>\0\0\0\0\0\0\0\0\0" /* 50 */
+
+#define KBD_FR_CAPS \
+    "\0\0" "1234567890)=\b\0" /* 00 */ \
+    "AZERTYUIOP^$\r\0QS" /* 10 */ \
+    "DFGHJKLM\xD9\xB2\0*WXCV" /* 20 */ \
+    "BN,;:!\0*\0 \0\0\0\0\0\0" /* 30 */ \
+    "\0\0\0\0\0\0\0\0\0\0-\0\0\0+\0" /* 40 */ \
+    "\0\0\0\0\0\0<\0\0\0\0\0\0\0\0\0" /* 50 */
+
+#define KBD_FR_ALTGR \
+    "\0\0\0~#{[|`\\^@]}\0\0" /* 00 */ \
+    "\0\0\x80\0\0\0\0\0\0\0\0\xA4\0\0\0\0" /* 10 */ \
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 20 */ \
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 30 */ \
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 40 */ \
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" /* 50 */
+
+C_ASSERT(sizeof(KBD_FR_NORMAL) == KBD_MAIN_KEYS + 1 &&
+         sizeof(KBD_FR_SHIFT) == KBD_MAIN_KEYS + 1 &&
+         sizeof(KBD_FR_CAPS) == KBD_MAIN_KEYS + 1 &&
+         sizeof(KBD_FR_ALTGR) == KBD_MAIN_KEYS + 1);
+
+typedef struct _KBD_LAYOUT
 {
-    USHORT ScanCode;
-    UCHAR Normal;
-    UCHAR Shift;
-} SCANTOASCII, *PSCANTOASCII;
-
-SCANTOASCII ScanToAscii[] = {
-    {0x1e, 'a', 'A'},
-    {0x30, 'b', 'B'},
-    {0x2e, 'c', 'C'},
-    {0x20, 'd', 'D'},
-    {0x12, 'e', 'E'},
-    {0x21, 'f', 'F'},
-    {0x22, 'g', 'G'},
-    {0x23, 'h', 'H'},
-    {0x17, 'i', 'I'},
-    {0x24, 'j', 'J'},
-    {0x25, 'k', 'K'},
-    {0x26, 'l', 'L'},
-    {0x32, 'm', 'M'},
-    {0x31, 'n', 'N'},
-    {0x18, 'o', 'O'},
-    {0x19, 'p', 'P'},
-    {0x10, 'q', 'Q'},
-    {0x13, 'r', 'R'},
-    {0x1f, 's', 'S'},
-    {0x14, 't', 'T'},
-    {0x16, 'u', 'U'},
-    {0x2f, 'v', 'V'},
-    {0x11, 'w', 'W'},
-    {0x2d, 'x', 'X'},
-    {0x15, 'y', 'Y'},
-    {0x2c, 'z', 'Z'},
-
-    {0x02, '1', '!'},
-    {0x03, '2', '@'},
-    {0x04, '3', '#'},
-    {0x05, '4', '$'},
-    {0x06, '5', '%'},
-    {0x07, '6', '^'},
-    {0x08, '7', '&'},
-    {0x09, '8', '*'},
-    {0x0a, '9', '('},
-    {0x0b, '0', ')'},
-
-    {0x29, '\'', '~'},
-    {0x0c, '-', '_'},
-    {0x0d, '=', '+'},
-    {0x1a, '[', '{'},
-    {0x1b, ']', '}'},
-    {0x2b, '\\', '|'},
-    {0x27, ';', ':'},
-    {0x28, '\'', '"'},
-    {0x33, ',', '<'},
-    {0x34, '.', '>'},
-    {0x35, '/', '?'},
-
-    {0x4a, '-', '-'},
-    {0x4e, '+', '+'},
-    {0x37, '*', '*'},
-
-    {0x39, ' ', ' '},
-
-    {0x1c, '\r', '\r'},
-    {0x0e, 0x08, 0x08}, /* backspace */
-
-    {0, 0, 0}};
+    PCSTR Name;
+    PCSTR Description;
+    UCHAR Normal[KBD_PLANE_SIZE];
+    UCHAR Shift[KBD_PLANE_SIZE];
+    UCHAR Caps[KBD_PLANE_SIZE];
+    UCHAR AltGr[KBD_PLANE_SIZE];
+} KBD_LAYOUT, *PKBD_LAYOUT;
+
+static const KBD_LAYOUT KeyboardLayouts[] = {
+    {"us", "United States",
+     KBD_US_NORMAL KBD_E0_KEYS,
+     KBD_US_SHIFT KBD_E0_KEYS,
+     KBD_US_CAPS KBD_E0_KEYS,
+     ""},
+    {"uk", "United Kingdom",
+     KBD_UK_NORMAL KBD_E0_KEYS,
+     KBD_UK_SHIFT KBD_E0_KEYS,
+     KBD_UK_CAPS KBD_E0_KEYS,
+     KBD_UK_ALTGR},
+    {"de", "German",
+     KBD_DE_NORMAL KBD_E0_KEYS,
+     KBD_DE_SHIFT KBD_E0_KEYS,
+     KBD_DE_CAPS KBD_E0_KEYS,
+     KBD_DE_ALTGR},
+    {"fr", "French",
+     KBD_FR_NORMAL KBD_E0_KEYS,
+     KBD_FR_SHIFT KBD_E0_KEYS,
+     KBD_FR_CAPS KBD_E0_KEYS,
+     KBD_FR_ALTGR}};
+
+static const KBD_LAYOUT *CurrentLayout = &KeyboardLayouts[0];
 
 static void IntUpdateControlKeyState(LPDWORD State, PKEYBOARD_INPUT_DATA InputData)
 {
@@ -103,6 +248,11 @@ static void IntUpdateControlKeyState(LPDWORD State, PKEYBOARD_INPUT_DATA InputDa
             if (!(InputData->Flags & KEY_BREAK))
                 *State ^= Value;
             return;
+        case 0x3a:
+            Value = CAPSLOCK_ON;
+            if (!(InputData->Flags & KEY_BREAK))
+                *State ^= Value;
+            return;
         default:
             return;
         }
@@ -130,19 +280,83 @@ static void IntUpdateControlKeyState(LPDWORD State, PKEYBOARD_INPUT_DATA InputDa
 
 static UCHAR IntAsciiFromInput(PKEYBOARD_INPUT_DATA InputData, DWORD KeyState)
 {
-    UINT Counter = 0;
+    const KBD_LAYOUT *Layout = CurrentLayout;
+    UINT Index;
 
-    while (ScanToAscii[Counter].ScanCode != 0)
+    if (InputData->MakeCode >= KBD_E0_PREFIX)
+        return 0;
+
+    Index = InputData->MakeCode;
+    if (InputData->Flags & KEY_E0)
+        Index |= KBD_E0_PREFIX;
+
+    // Right Alt or Ctrl+Alt, keys without an AltGr character type as usual
+    if (((KeyState & RIGHT_ALT_PRESSED) ||
+         ((KeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) &&
+          (KeyState & LEFT_ALT_PRESSED))) &&
+        Layout->AltGr[Index])
     {
-        if (ScanToAscii[Counter].ScanCode == InputData->MakeCode)
+        return Layout->AltGr[Index];
+    }
+
+    if ((KeyState & NUMLOCK_ON) && !(KeyState & SHIFT_PRESSED) &&
+        KbdNumLockPlane[Index])
+    {
+        return KbdNumLockPlane[Index];
+    }
+
+    if (KeyState & CAPSLOCK_ON)
+    {
+        // Shift undoes CapsLock on the keys it affects
+        if (!(KeyState & SHIFT_PRESSED))
+            return Layout->Caps[Index];
+        if (Layout->Caps[Index] != Layout->Normal[Index])
+            return Layout->Normal[Index];
+        return Layout->Shift[Index];
+    }
+
+    if (KeyState & SHIFT_PRESSED)
+        return Layout->Shift[Index];
+
+    return Layout->Normal[Index];
+}
+
+/*++
+ * @name RtlCliSetKeyboardLayout
+ *
+ * The RtlCliSetKeyboardLayout routine selects the keyboard layout.
+ *
+ * @param Name
+ *        Short name of the layout, like "us" or "de". If NULL, the list of
+ *        known layouts is displayed.
+ *
+ * @return STATUS_SUCCESS or STATUS_INVALID_PARAMETER if the layout is unknown.
+ *
+ * @remarks None.
+ *
+ *--*/
+NTSTATUS
+RtlCliSetKeyboardLayout(IN PCHAR Name)
+{
+    ULONG i;
+
+    for (i = 0; i < RTL_NUMBER_OF(KeyboardLayouts); i++)
+    {
+        if (!Name)
         {
-            if (KeyState & SHIFT_PRESSED)
-                return ScanToAscii[Counter].Shift;
-            return ScanToAscii[Counter].Normal;
+            RtlCliDisplayString("%c %-4s %s\n",
+                                (&KeyboardLayouts[i] == CurrentLayout) ? '*' : ' ',
+                                KeyboardLayouts[i].Name,
+                                KeyboardLayouts[i].Description);
+        }
+        else if (!_stricmp(Name, KeyboardLayouts[i].Name))
+        {
+            CurrentLayout = &KeyboardLayouts[i];
+            return STATUS_SUCCESS;
         }
-        Counter++;
     }
-    return 0;
+
+    return Name ? STATUS_INVALID_PARAMETER : STATUS_SUCCESS;
 }
 
 /*
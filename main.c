@@ -19,292 +19,1441 @@ HANDLE hKey;
 #define __NCLI_VER__ __APP_VER__ " x86"
 #endif
 
-WCHAR *helpstr[] =
-    {
-        {L"\n"
-         L"cd X     - Change directory to X    md X     - Make directory X\n"
-         L"copy X Y - Copy file X to Y         poweroff - Power off PC\n"
-         L"dir X    - Show directory contents  pwd      - Print working directory\n"
-         L"del X    - Delete file X            reboot   - Reboot PC\n"
-         L"devtree  - Dump device tree         shutdown - Shutdown PC\n"
-         L"\x0000"},
-        {L"exit     - Exit shell            sysinfo     - Dump system information\n"
-         L"lm       - List modules          drawtext X  - Draw string X\n"
-         L"lp       - List processes        move X Y    - Move file X to Y\n"
-         L"testvid  - Test screen output    testarg X Y - Test argument parsing\n"
-         L"\n"
-         L"X: - change drive letter to X\n"
-         L"If a command is not in the list, it is treated as an executable name\n"
-         L"\n"
-         L"\x0000"}};
+// Command table
 
-VOID RtlClipProcessMessage(PCHAR Command)
+#define COMMAND_HASH_BUCKETS 64
+
+PCLI_COMMAND CommandHash[COMMAND_HASH_BUCKETS];
+PCLI_COMMAND CommandList[COMMAND_HASH_BUCKETS * 2];
+ULONG CommandCount = 0;
+
+/*++
+ * @name RtlClipHashCommandName
+ *
+ * The RtlClipHashCommandName routine computes a case-insensitive hash
+ * of a command name.
+ *
+ * @param Name
+ *        Command name.
+ *
+ * @return 32-bit FNV-1a hash of the lower case name.
+ *
+ * @remarks None.
+ *
+ *--*/
+ULONG
+RtlClipHashCommandName(IN PCSTR Name)
+{
+    ULONG Hash = 2166136261UL;
+    CHAR c;
+
+    while (*Name)
+    {
+        c = *Name++;
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+
+        Hash ^= (UCHAR)c;
+        Hash *= 16777619UL;
+    }
+
+    return Hash;
+}
+
+/*++
+ * @name RtlCliRegisterCommand
+ *
+ * The RtlCliRegisterCommand routine adds a command to the command table.
+ *
+ * @param Command
+ *        Command descriptor. It must stay valid while the shell runs.
+ *
+ * @return STATUS_SUCCESS, STATUS_OBJECT_NAME_COLLISION if a command with that
+ *         name exists or STATUS_INSUFFICIENT_RESOURCES if the table is full.
+ *
+ * @remarks The name hash is computed once here, lookups only hash the
+ *          typed name and compare within one bucket.
+ *
+ *--*/
+NTSTATUS
+RtlCliRegisterCommand(IN PCLI_COMMAND Command)
+{
+    ULONG Bucket;
+    PCLI_COMMAND Entry;
+
+    if (CommandCount == RTL_NUMBER_OF(CommandList))
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    Command->Hash = RtlClipHashCommandName(Command->Name);
+    Bucket = Command->Hash % COMMAND_HASH_BUCKETS;
+
+    for (Entry = CommandHash[Bucket]; Entry; Entry = Entry->Next)
+    {
+        if (Entry->Hash == Command->Hash && !_stricmp(Entry->Name, Command->Name))
+            return STATUS_OBJECT_NAME_COLLISION;
+    }
+
+    Command->Next = CommandHash[Bucket];
+    CommandHash[Bucket] = Command;
+
+    // Keep registration order for the help text
+    CommandList[CommandCount++] = Command;
+
+    return STATUS_SUCCESS;
+}
+
+/*++
+ * @name RtlClipFindCommand
+ *
+ * The RtlClipFindCommand routine looks up a command by name.
+ *
+ * @param Name
+ *        Name typed by the user, any case.
+ *
+ * @return Command descriptor or NULL if there is no such command.
+ *
+ * @remarks Only exact matches are returned.
+ *
+ *--*/
+PCLI_COMMAND
+RtlClipFindCommand(IN PCSTR Name)
+{
+    ULONG Hash = RtlClipHashCommandName(Name);
+    PCLI_COMMAND Entry;
+
+    for (Entry = CommandHash[Hash % COMMAND_HASH_BUCKETS]; Entry; Entry = Entry->Next)
+    {
+        if (Entry->Hash == Hash && !_stricmp(Entry->Name, Name))
+            return Entry;
+    }
+
+    return NULL;
+}
+
+// Built-in commands
+
+VOID RtlClipCmdExit(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Exit from shell
+    RtlCliFlush();
+    DeinitHeapMemory(hHeap);
+    NtTerminateProcess(NtCurrentProcess(), 0);
+}
+
+VOID RtlClipCmdTestArg(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    UINT i = 0;
+
+    RtlCliDisplayString("Args: %d\n", argc);
+
+    if (argc > 1)
+    {
+        for (i = 1; i < argc; i++)
+        {
+            if (NULL != argv[i])
+                RtlCliDisplayString("Arg %d: %s\n", i, argv[i]);
+            else
+            {
+                RtlCliDisplayString("Arg %d: NULL\n", i);
+                break;
+            }
+        }
+    }
+}
+
+VOID RtlClipCmdHelp(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    ULONG i, Columns;
+    INT NameWidth = 0, HelpWidth = 0;
+    PCLI_COMMAND Entry;
+
+    // Size the columns from the longest entries
+    for (i = 0; i < CommandCount; i++)
+    {
+        Entry = CommandList[i];
+        NameWidth = max(NameWidth, (INT)(strlen(Entry->Name) + 1 + strlen(Entry->Arguments)));
+        HelpWidth = max(HelpWidth, (INT)strlen(Entry->Help));
+    }
+
+    // Two columns of "name args - help" if they fit on a line, else one
+    Columns = (2 * (NameWidth + 3 + HelpWidth) + 2 < DISPLAY_COLUMNS) ? 2 : 1;
+
+    RtlCliDisplayString("\n");
+
+    for (i = 0; i < CommandCount; i++)
+    {
+        Entry = CommandList[i];
+
+        RtlCliDisplayString("%s %-*s- %-*s",
+                            Entry->Name,
+                            NameWidth - (INT)strlen(Entry->Name),
+                            Entry->Arguments,
+                            (Columns == 2) ? HelpWidth : 0,
+                            Entry->Help);
+
+        RtlCliDisplayString(((i + 1) % Columns) ? "  " : "\n");
+    }
+    if (i % Columns)
+        RtlCliDisplayString("\n");
+
+    RtlCliDisplayString("\n"
+                        "X: - change drive letter to X\n"
+                        "If a command is not in the list, it is treated as an executable name\n"
+                        "\n");
+}
+
+VOID RtlClipCmdListModules(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // List Modules (!lm)
+    RtlCliListDrivers();
+}
+
+VOID RtlClipCmdListProcesses(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // List Processes (!lp)
+    RtlCliListProcesses();
+}
+
+VOID RtlClipCmdSysInfo(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Dump System Information (sysinfo)
+    RtlCliDumpSysInfo();
+}
+
+VOID RtlClipCmdCd(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Set the current directory, unquoted spaces are part of the path
+    if (argc == 2)
+    {
+        RtlCliSetCurrentDirectory(argv[1]);
+    }
+    else
+    {
+        RtlCliSetCurrentDirectory((PCHAR)Args->Tail[1]);
+    }
+}
+
+VOID RtlClipCmdDrawText(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+#if (NTDDI_VERSION >= NTDDI_WIN7)
+    UNICODE_STRING us;
+    ANSI_STRING as;
+    RtlInitAnsiString(&as, Args->Tail[1]);
+    RtlAnsiStringToUnicodeString(&us, &as, TRUE);
+    NtDrawText(&us);
+    RtlFreeUnicodeString(&us);
+#else
+    RtlCliDisplayString("\nNot supported prior to Win7\n");
+#endif
+}
+
+VOID RtlClipCmdPwd(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
 {
     WCHAR CurrentDirectory[MAX_PATH] = {0};
     UNICODE_STRING CurrentDirectoryString;
-    CHAR CommandBuf[BUFFER_SIZE] = {0};
-    UINT argc;
-    CHAR **argv;
 
-    strncpy(CommandBuf, Command, strnlen(Command, BUFFER_SIZE));
+    // Get the current directory
+    RtlCliGetCurrentDirectory(CurrentDirectory);
+
+    // Display it
+    RtlInitUnicodeString(&CurrentDirectoryString, CurrentDirectory);
+    RtlCliPrintString(&CurrentDirectoryString);
+}
+
+BOOLEAN RtlClipParseSortOrder(IN PCSTR Value, OUT PULONG Flags)
+{
+    // Sort order of dir /o, "-" in front reverses it, /o alone sorts by name
+    *Flags = 0;
+    if (!Value)
+    {
+        *Flags = DIR_SORT_NAME;
+        return TRUE;
+    }
+
+    if (*Value == '-')
+    {
+        *Flags |= DIR_SORT_DESCENDING;
+        Value++;
+    }
+
+    if (!_stricmp(Value, "n"))
+        *Flags |= DIR_SORT_NAME;
+    else if (!_stricmp(Value, "s"))
+        *Flags |= DIR_SORT_SIZE;
+    else if (!_stricmp(Value, "d"))
+        *Flags |= DIR_SORT_DATE;
+    else
+        return FALSE;
+
+    return TRUE;
+}
+
+VOID RtlClipCmdDir(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    WCHAR Dir[MAX_PATH];
+    WCHAR Pattern[MAX_PATH];
+    PCHAR Path = NULL;
+    PWCHAR Name;
+    ULONG Flags = DIR_SORT_NONE, Sort = DIR_SORT_NONE;
+    BOOLEAN Wildcard = FALSE, Usage = FALSE;
+    PCSTR Switch;
+    UINT i;
+
+    for (i = 1; i < argc && !Usage; i++)
+    {
+        if (RtlCliMatchSwitch(argv[i], "o", &Switch) && RtlClipParseSortOrder(Switch, &Sort))
+        {
+            continue;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "b", NULL))
+        {
+            Flags |= DIR_BARE;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "c", NULL))
+        {
+            Flags |= DIR_COUNT;
+        }
+        else if (argv[i][0] == '/' || Path)
+        {
+            Usage = TRUE;
+        }
+        else
+        {
+            Path = argv[i];
+        }
+    }
+
+    // /b and /c exclude each other, and names have nothing to sort by
+    if (Usage || Flags == (DIR_BARE | DIR_COUNT) || (Flags && Sort))
+    {
+        RtlCliDisplayString("dir [X] [/o:[-]n|s|d] [/b] [/c]\n"
+                            "  X       Directory below the current one to list, the last part\n"
+                            "          may be a wildcard such as *.dll\n"
+                            "  /o:n    Sort by name\n"
+                            "  /o:s    Sort by size\n"
+                            "  /o:d    Sort by creation date\n"
+                            "  /o:-... Sort in reverse, /o:-s lists the largest files first\n"
+                            "  /b      List the names only, without paging\n"
+                            "  /c      Print the number of entries only\n");
+        return;
+    }
+    Flags |= Sort;
+
+    RtlCliGetCurrentDirectory(Dir);
+    if (Path)
+    {
+        UNICODE_STRING us;
+        ANSI_STRING as;
+        RtlInitAnsiString(&as, Path);
+        RtlAnsiStringToUnicodeString(&us, &as, TRUE);
+
+        // A wildcard in the last part is matched by the file system
+        Name = wcsrchr(us.Buffer, L'\\');
+        Name = Name ? Name + 1 : us.Buffer;
+        if (wcspbrk(Name, L"*?") && wcslen(Name) < MAX_PATH)
+        {
+            wcscpy(Pattern, Name);
+            *Name = UNICODE_NULL;
+            Wildcard = TRUE;
+        }
+
+        if (us.Buffer[0])
+        {
+            AppendString(Dir, L"\\");
+            AppendString(Dir, us.Buffer);
+        }
+
+        RtlFreeUnicodeString(&us);
+    }
+
+    // List directory
+    RtlCliListDirectory(Dir, Wildcard ? Pattern : NULL, Flags);
+}
+
+VOID RtlClipCmdLayout(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // List or select keyboard layouts
+    if (!NT_SUCCESS(RtlCliSetKeyboardLayout(argc > 1 ? argv[1] : NULL)))
+    {
+        RtlCliDisplayString("Unknown keyboard layout %s\n", argv[1]);
+    }
+}
+
+VOID RtlClipCmdDevTree(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Dump hardware tree
+    RtlCliListHardwareTree();
+}
+
+VOID RtlClipCmdShutdown(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    RtlCliShutdown();
+}
+
+VOID RtlClipCmdReboot(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    RtlCliReboot();
+}
+
+VOID RtlClipCmdPowerOff(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    RtlCliPowerOff();
+}
+
+VOID RtlClipCmdTestVid(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    UINT j;
+    WCHAR w;
+
+    LARGE_INTEGER delay;
+    memset(&delay, 0x00, sizeof(LARGE_INTEGER));
+    delay.LowPart = 100000000;
+
+    // 75x23
+    RtlCliDisplayString("\nVid mode is 75x23\n\nCharacter test:");
+
+    j = 0;
+    for (w = L'A'; w < 0xFFFF; w++)
+    {
+        j++;
+        NtDelayExecution(FALSE, &delay);
+        if (w != L'\n' && w != L'\r')
+        {
+            RtlCliPutChar(w);
+        }
+        else
+        {
+            RtlCliPutChar(L' ');
+        }
+        RtlCliFlush();
+        if (j > 70)
+        {
+            j = 0;
+            RtlCliPutChar(L'\n');
+        }
+    }
+}
+
+VOID RtlClipCmdCopy(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Copy file
+    WCHAR buf1[MAX_PATH] = {0};
+    WCHAR buf2[MAX_PATH] = {0};
+    NT_FILE_COPY_OPTIONS Options;
+    NT_FILE_COPY_STATS Stats;
+    PCHAR Files[2];
+    UINT FileCount = 0;
+    ULONGLONG Value;
+    PCSTR Switch;
+    UINT i;
+
+    Options.QueueDepth = 4;
+    Options.ChunkSize = 0;
+    Options.Flags = 0;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (RtlCliMatchSwitch(argv[i], "q", &Switch) &&
+            RtlCliParseSize(Switch, &Value) && Value >= 1 && Value <= COPY_MAX_QUEUE_DEPTH)
+        {
+            Options.QueueDepth = (ULONG)Value;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "c", &Switch) &&
+                 RtlCliParseSize(Switch, &Value) && Value >= 4096 && Value <= MAXLONG)
+        {
+            Options.ChunkSize = (ULONG)Value;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "nomap", NULL))
+        {
+            Options.Flags |= NT_FILE_COPY_NO_MAP;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "v", NULL))
+        {
+            Options.Flags |= NT_FILE_COPY_VERIFY;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "sparse", NULL))
+        {
+            Options.Flags |= NT_FILE_COPY_SPARSE;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "unbuffered", NULL))
+        {
+            Options.Flags |= NT_FILE_COPY_UNBUFFERED;
+        }
+        else if (argv[i][0] == '/')
+        {
+            RtlCliDisplayString("copy [/q:N] [/c:SIZE] [/nomap] [/v] [/sparse] [/unbuffered] X Y\n"
+                                "  /q:N         Keep N chunks in flight, 1 to %u (default 4, 1 is synchronous)\n"
+                                "  /c:SIZE      Chunk size, e.g. 512k or 4m (default depends on the file size)\n"
+                                "  /nomap       Don't copy files of 64 MB or more from mapped views\n"
+                                "  /v           Verify the copy against a CRC32 of the source\n"
+                                "  /sparse      Copy only the allocated ranges, into a sparse file\n"
+                                "  /unbuffered  Bypass the file cache, for large images\n",
+                                COPY_MAX_QUEUE_DEPTH);
+            return;
+        }
+        else if (FileCount < 2)
+        {
+            Files[FileCount++] = argv[i];
+        }
+    }
+
+    if (FileCount < 2)
+    {
+        RtlCliDisplayString("Not enough arguments.\n");
+        return;
+    }
+
+    GetFullPath(Files[0], buf1, FALSE);
+    GetFullPath(Files[1], buf2, FALSE);
+    RtlCliDisplayString("\nCopy %S to %S\n", buf1, buf2);
+    if (FileExists(buf1))
+    {
+        if (!NtFileCopyFileEx(buf1, buf2, &Options, &Stats))
+        {
+            RtlCliDisplayString("Failed.\n");
+        }
+        else
+        {
+            RtlCliDisplayCopyStats(&Stats);
+        }
+    }
+    else
+    {
+        RtlCliDisplayString("File does not exist.\n");
+    }
+}
+
+VOID RtlClipCmdXcopy(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Copy a directory tree
+    WCHAR buf1[MAX_PATH] = {0};
+    WCHAR buf2[MAX_PATH] = {0};
+    PCHAR Files[2];
+    UINT FileCount = 0;
+    BOOLEAN Recurse = FALSE;
+    BOOLEAN Verify = FALSE;
+    ULONG ThreadCount = max(RtlCliGetProcessorCount() * 2, 4);
+    ULONGLONG Value;
+    PCSTR Switch;
+    NTSTATUS Status;
+    UINT i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (RtlCliMatchSwitch(argv[i], "s", NULL))
+        {
+            Recurse = TRUE;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "v", NULL))
+        {
+            Verify = TRUE;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "t", &Switch) &&
+                 RtlCliParseSize(Switch, &Value) && Value >= 1 && Value <= CLI_POOL_MAX_THREADS)
+        {
+            ThreadCount = (ULONG)Value;
+        }
+        else if (argv[i][0] == '/')
+        {
+            RtlCliDisplayString("xcopy [/s] [/v] [/t:N] X Y\n"
+                                "  /s    Copy subdirectories too\n"
+                                "  /v    Verify every file against a CRC32 of its source\n"
+                                "  /t:N  Copy with N threads, 1 to %u (default twice the processors, at least 4)\n",
+                                CLI_POOL_MAX_THREADS);
+            return;
+        }
+        else if (FileCount < 2)
+        {
+            Files[FileCount++] = argv[i];
+        }
+    }
+
+    if (FileCount < 2)
+    {
+        RtlCliDisplayString("Not enough arguments.\n");
+        return;
+    }
+
+    ThreadCount = min(ThreadCount, CLI_POOL_MAX_THREADS);
+
+    GetFullPath(Files[0], buf1, FALSE);
+    GetFullPath(Files[1], buf2, FALSE);
+
+    if (!FolderExists(buf1))
+    {
+        RtlCliDisplayString("Directory does not exist.\n");
+        return;
+    }
+
+    RtlCliDisplayString("\nCopy %S to %S\n", buf1, buf2);
+
+    Status = RtlCliCopyTree(buf1, buf2, Recurse, Verify, ThreadCount);
+    if (!NT_SUCCESS(Status) && Status != STATUS_UNSUCCESSFUL)
+    {
+        RtlCliDisplayString("Failed (0x%.8X).\n", Status);
+    }
+}
+
+VOID RtlClipCmdHash(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Hash files
+    WCHAR buf1[MAX_PATH] = {0};
+    UCHAR Digest[CLI_HASH_MAX_DIGEST];
+    PCLI_HASH_ALGORITHM Algorithm = RtlCliFindHashAlgorithm("crc32");
+    LARGE_INTEGER StartTime, EndTime, Frequency;
+    LONGLONG Bytes, TotalBytes = 0;
+    ULONG FileCount = 0;
+    PCSTR Switch;
+    UINT i, j;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (RtlCliMatchSwitch(argv[i], "bench", NULL))
+        {
+            RtlCliBenchmarkHashes();
+            return;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "algo", &Switch) && RtlCliFindHashAlgorithm(Switch))
+        {
+            Algorithm = RtlCliFindHashAlgorithm(Switch);
+        }
+        else if (argv[i][0] == '/')
+        {
+            RtlCliDisplayString("hash [/algo:NAME] X...\n"
+                                "hash /bench\n"
+                                "  /algo:NAME  crc32 (default), xxh64 or sha256\n"
+                                "  /bench      Measure every algorithm on data in memory\n");
+            return;
+        }
+    }
+
+    NtQueryPerformanceCounter(&StartTime, &Frequency);
+
+    for (i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '/')
+            continue;
+
+        GetFullPath(argv[i], buf1, FALSE);
+
+        if (!NT_SUCCESS(RtlCliHashFile(buf1, Algorithm, Digest, &Bytes)))
+        {
+            RtlCliDisplayString("Can't hash %S\n", buf1);
+            continue;
+        }
+
+        for (j = 0; j < Algorithm->DigestSize; j++)
+            RtlCliDisplayString("%02x", Digest[j]);
+        RtlCliDisplayString("  %S\n", buf1);
+
+        TotalBytes += Bytes;
+        FileCount++;
+    }
+
+    NtQueryPerformanceCounter(&EndTime, NULL);
+
+    if (FileCount > 1)
+    {
+        RtlCliDisplayString("%u files, ", FileCount);
+        RtlCliDisplayThroughput(TotalBytes, EndTime.QuadPart - StartTime.QuadPart, Frequency.QuadPart);
+        RtlCliDisplayString("\n");
+    }
+}
+
+VOID RtlClipCmdFind(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Find text in files
+    WCHAR buf1[MAX_PATH] = {0};
+    PCHAR Arguments[2];
+    ULONG ArgumentCount = 0;
+    BOOLEAN Recurse = FALSE, IgnoreCase = FALSE;
+    ULONG ThreadCount = max(RtlCliGetProcessorCount() * 2, 4);
+    ULONGLONG Value;
+    PCSTR Switch;
+    NTSTATUS Status;
+    UINT i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (RtlCliMatchSwitch(argv[i], "s", NULL))
+        {
+            Recurse = TRUE;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "i", NULL))
+        {
+            IgnoreCase = TRUE;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "t", &Switch) &&
+                 RtlCliParseSize(Switch, &Value) && Value >= 1 && Value <= CLI_POOL_MAX_THREADS)
+        {
+            ThreadCount = (ULONG)Value;
+        }
+        else if (argv[i][0] == '/')
+        {
+            RtlCliDisplayString("find \"X\" Y [/s] [/i] [/t:N]\n"
+                                "  Y     File, or directory whose files are searched\n"
+                                "  /s    Search the subdirectories of Y too\n"
+                                "  /i    Ignore the case of A-Z\n"
+                                "  /t:N  Search with N threads, 1 to %u (default twice the processors, at least 4)\n",
+                                CLI_POOL_MAX_THREADS);
+            return;
+        }
+        else if (ArgumentCount < 2)
+        {
+            Arguments[ArgumentCount++] = argv[i];
+        }
+    }
+
+    if (ArgumentCount < 2)
+    {
+        RtlCliDisplayString("Not enough arguments.\n");
+        return;
+    }
+
+    if (strlen(Arguments[0]) == 0 || strlen(Arguments[0]) > FIND_MAX_PATTERN)
+    {
+        RtlCliDisplayString("The text must be 1 to %u characters.\n", FIND_MAX_PATTERN);
+        return;
+    }
+
+    GetFullPath(Arguments[1], buf1, FALSE);
+
+    Status = RtlCliFindText(Arguments[0], buf1, Recurse, IgnoreCase, ThreadCount);
+    if (Status == STATUS_OBJECT_NAME_NOT_FOUND)
+    {
+        RtlCliDisplayString("File does not exist.\n");
+    }
+    else if (!NT_SUCCESS(Status) && Status != STATUS_UNSUCCESSFUL)
+    {
+        RtlCliDisplayString("Failed (0x%.8X).\n", Status);
+    }
+}
+
+VOID RtlClipCmdIoBench(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Compare contiguous and scatter/gather unbuffered I/O
+    WCHAR buf1[MAX_PATH] = {0};
+    ULONGLONG Size = 256 * 1024 * 1024;
+    PCHAR Path = NULL;
+    ULONGLONG Value;
+    PCSTR Switch;
+    NTSTATUS Status;
+    UINT i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (RtlCliMatchSwitch(argv[i], "size", &Switch) &&
+            RtlCliParseSize(Switch, &Value) && Value >= 1024 * 1024 && Value <= MAXLONGLONG / 2)
+        {
+            Size = Value;
+        }
+        else if (argv[i][0] == '/')
+        {
+            RtlCliDisplayString("iobench [/size:SIZE] X\n"
+                                "  X           Test file to create, deleted afterwards\n"
+                                "  /size:SIZE  Size of the test file, e.g. 1g (default 256m)\n");
+            return;
+        }
+        else if (!Path)
+        {
+            Path = argv[i];
+        }
+    }
+
+    if (!Path)
+    {
+        RtlCliDisplayString("Not enough arguments.\n");
+        return;
+    }
+
+    GetFullPath(Path, buf1, FALSE);
+
+    if (FileExists(buf1))
+    {
+        RtlCliDisplayString("File exists, give a new file.\n");
+        return;
+    }
+
+    Status = RtlCliBenchmarkScatterGather(buf1, (LONGLONG)Size);
+    if (!NT_SUCCESS(Status) && Status != STATUS_UNSUCCESSFUL)
+    {
+        RtlCliDisplayString("Failed (0x%.8X).\n", Status);
+    }
+}
+
+VOID RtlClipCmdWatch(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Print the changes made in a directory
+    WCHAR buf1[MAX_PATH] = {0};
+    BOOLEAN Recurse = FALSE;
+    PCHAR Path = NULL;
+    NTSTATUS Status;
+    UINT i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (RtlCliMatchSwitch(argv[i], "s", NULL))
+        {
+            Recurse = TRUE;
+        }
+        else if (argv[i][0] == '/')
+        {
+            RtlCliDisplayString("watch [/s] X\n"
+                                "  /s  Watch the subdirectories of X too\n"
+                                "Press any key to stop.\n");
+            return;
+        }
+        else if (!Path)
+        {
+            Path = argv[i];
+        }
+    }
+
+    if (!Path)
+    {
+        RtlCliDisplayString("Not enough arguments.\n");
+        return;
+    }
+
+    GetFullPath(Path, buf1, FALSE);
+
+    Status = RtlCliWatchDirectory(hKeyboard, buf1, Recurse);
+    if (Status == STATUS_OBJECT_NAME_NOT_FOUND || Status == STATUS_OBJECT_PATH_NOT_FOUND ||
+        Status == STATUS_NOT_A_DIRECTORY)
+    {
+        RtlCliDisplayString("Directory does not exist.\n");
+    }
+    else if (!NT_SUCCESS(Status))
+    {
+        RtlCliDisplayString("Watch stopped (0x%.8X).\n", Status);
+    }
+}
+
+/*++
+ * @name RtlClipCopyImage
+ *
+ * The RtlClipCopyImage routine implements imgdump and imgrestore.
+ *
+ * @param argc
+ *        Number of arguments.
+ *
+ * @param argv
+ *        Arguments, the command name first.
+ *
+ * @param Restore
+ *        FALSE for imgdump, TRUE for imgrestore.
+ *
+ * @return None.
+ *
+ * @remarks Arguments starting with a backslash are NT paths, such as
+ *          \Device\Harddisk0\Partition1, and are used as is. Anything else
+ *          is a file relative to the current directory.
+ *
+ *--*/
+VOID
+RtlClipCopyImage(IN UINT argc, IN CHAR **argv, IN BOOLEAN Restore)
+{
+    WCHAR Paths[2][MAX_PATH];
+    NT_FILE_COPY_OPTIONS Options;
+    NT_FILE_COPY_STATS Stats;
+    ANSI_STRING as;
+    UNICODE_STRING us;
+    PCHAR Files[2];
+    UINT FileCount = 0;
+    ULONGLONG Value;
+    PCSTR Switch;
+    UINT i;
+
+    Options.QueueDepth = 4;
+    Options.ChunkSize = 4 * 1024 * 1024;
+    Options.Flags = NT_FILE_COPY_PROGRESS;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (RtlCliMatchSwitch(argv[i], "q", &Switch) &&
+            RtlCliParseSize(Switch, &Value) && Value >= 2 && Value <= COPY_MAX_QUEUE_DEPTH)
+        {
+            Options.QueueDepth = (ULONG)Value;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "c", &Switch) &&
+                 RtlCliParseSize(Switch, &Value) && Value >= 64 * 1024 && Value <= 64 * 1024 * 1024)
+        {
+            Options.ChunkSize = (ULONG)Value;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "skipzero", NULL))
+        {
+            Options.Flags |= NT_FILE_COPY_SKIP_ZEROS;
+        }
+        else if (argv[i][0] == '/')
+        {
+            if (Restore)
+            {
+                RtlCliDisplayString("imgrestore [/q:N] [/c:SIZE] [/skipzero] X Y\n"
+                                    "  X          Image file\n"
+                                    "  Y          Disk or partition, e.g. \\Device\\Harddisk0\\Partition1,\n"
+                                    "             not mounted, or a file\n");
+            }
+            else
+            {
+                RtlCliDisplayString("imgdump [/q:N] [/c:SIZE] [/skipzero] X Y\n"
+                                    "  X          Disk or partition, e.g. \\Device\\Harddisk0\\Partition1, or a file\n"
+                                    "  Y          Image file to create\n");
+            }
+            RtlCliDisplayString("  /q:N       Keep N chunks in flight, 2 to %u (default 4)\n"
+                                "  /c:SIZE    Chunk size, 64k to 64m (default 4m)\n"
+                                "  /skipzero  Don't write chunks that are all zeros%s\n",
+                                COPY_MAX_QUEUE_DEPTH,
+                                Restore ? ", only for a zeroed Y" : ", Y is made sparse");
+            return;
+        }
+        else if (FileCount < 2)
+        {
+            Files[FileCount++] = argv[i];
+        }
+    }
+
+    if (FileCount < 2)
+    {
+        RtlCliDisplayString("Not enough arguments.\n");
+        return;
+    }
 
-    argv = StringToArguments(&CommandBuf[0], &argc);
+    for (i = 0; i < 2; i++)
+    {
+        if (Files[i][0] == '\\')
+        {
+            RtlInitAnsiString(&as, Files[i]);
+            RtlAnsiStringToUnicodeString(&us, &as, TRUE);
+            wcsncpy(Paths[i], us.Buffer, MAX_PATH - 1);
+            Paths[i][MAX_PATH - 1] = UNICODE_NULL;
+            RtlFreeUnicodeString(&us);
+        }
+        else
+        {
+            GetFullPath(Files[i], Paths[i], FALSE);
+        }
+    }
 
-    if (0 == argc)
-        return;
+    RtlCliDisplayString("\n%s %S to %S\n", Restore ? "Restore" : "Dump", Paths[0], Paths[1]);
 
-    if (!_strnicmp(argv[0], CMDSTR("exit")))
+    if (!NtFileCopyImage(Paths[0], Paths[1], Restore, &Options, &Stats))
     {
-        // Exit from shell
-        DeinitHeapMemory(hHeap);
-        NtTerminateProcess(NtCurrentProcess(), 0);
+        RtlCliDisplayString("Failed.\n");
     }
-    else if (!_strnicmp(argv[0], CMDSTR("testarg")))
+    else
     {
-        UINT i = 0;
+        RtlCliDisplayCopyStats(&Stats);
+    }
+}
+
+VOID RtlClipCmdImgDump(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Dump a disk or a partition to an image file
+    RtlClipCopyImage(argc, argv, FALSE);
+}
+
+VOID RtlClipCmdImgRestore(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Write an image file back to a disk or a partition
+    RtlClipCopyImage(argc, argv, TRUE);
+}
 
-        RtlCliDisplayString("Args: %d\n", argc);
+VOID RtlClipCmdCompress(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Compress a file into a chunked archive
+    WCHAR buf1[MAX_PATH] = {0};
+    WCHAR buf2[MAX_PATH] = {0};
+    PCHAR Files[2];
+    UINT FileCount = 0;
+    USHORT Format = 0;
+    ULONG ChunkSize = CLI_ARCHIVE_DEFAULT_CHUNK;
+    ULONG ThreadCount = RtlCliGetProcessorCount();
+    ULONGLONG Value;
+    PCSTR Switch;
+    NTSTATUS Status;
+    UINT i;
 
-        if (argc > 1)
+    for (i = 1; i < argc; i++)
+    {
+        if (RtlCliMatchSwitch(argv[i], "lznt1", NULL))
         {
-            for (i = 1; i < argc; i++)
-            {
-                if (NULL != argv[i])
-                    RtlCliDisplayString("Arg %d: %s\n", i, argv[i]);
-                else
-                {
-                    RtlCliDisplayString("Arg %d: NULL\n", i);
-                    break;
-                }
-            }
+            Format = COMPRESSION_FORMAT_LZNT1;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "xpress", NULL))
+        {
+            Format = COMPRESSION_FORMAT_XPRESS;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "c", &Switch) &&
+                 RtlCliParseSize(Switch, &Value) && Value >= CLI_ARCHIVE_MIN_CHUNK && Value <= CLI_ARCHIVE_MAX_CHUNK)
+        {
+            ChunkSize = (ULONG)Value;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "t", &Switch) &&
+                 RtlCliParseSize(Switch, &Value) && Value >= 1 && Value <= CLI_POOL_MAX_THREADS)
+        {
+            ThreadCount = (ULONG)Value;
+        }
+        else if (argv[i][0] == '/')
+        {
+            RtlCliDisplayString("compress [/lznt1|/xpress] [/c:SIZE] [/t:N] X Y\n"
+                                "  /lznt1   Use LZNT1, which every version of Windows expands\n"
+                                "  /xpress  Use XPRESS, Windows 8 and later (default where available)\n"
+                                "  /c:SIZE  Chunk size, 64k to 16m (default 1m)\n"
+                                "  /t:N     Compress with N threads, 1 to %u (default one per processor)\n",
+                                CLI_POOL_MAX_THREADS);
+            return;
+        }
+        else if (FileCount < 2)
+        {
+            Files[FileCount++] = argv[i];
         }
     }
-    else if (!_strnicmp(argv[0], CMDSTR("help")))
+
+    if (FileCount < 2)
     {
-        RtlCliDisplayString("%S", helpstr[0]);
-        RtlCliDisplayString("%S", helpstr[1]);
+        RtlCliDisplayString("Not enough arguments.\n");
+        return;
     }
-    else if (!_strnicmp(argv[0], CMDSTR("lm")))
+
+    GetFullPath(Files[0], buf1, FALSE);
+    GetFullPath(Files[1], buf2, FALSE);
+
+    if (!FileExists(buf1))
     {
-        // List Modules (!lm)
-        RtlCliListDrivers();
+        RtlCliDisplayString("File does not exist.\n");
+        return;
     }
-    else if (!_strnicmp(argv[0], CMDSTR("lp")))
+
+    Status = RtlCliCompressFile(buf1, buf2, Format, ChunkSize, ThreadCount);
+    if (!NT_SUCCESS(Status) && Status != STATUS_UNSUCCESSFUL)
     {
-        // List Processes (!lp)
-        RtlCliListProcesses();
+        RtlCliDisplayString("Failed (0x%.8X).\n", Status);
     }
-    else if (!_strnicmp(argv[0], CMDSTR("sysinfo")))
+}
+
+VOID RtlClipCmdExpand(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Expand an archive, or a byte range of it
+    WCHAR buf1[MAX_PATH] = {0};
+    WCHAR buf2[MAX_PATH] = {0};
+    PCHAR Files[2];
+    UINT FileCount = 0;
+    LONGLONG Offset = 0;
+    LONGLONG Length = -1;
+    ULONG ThreadCount = RtlCliGetProcessorCount();
+    ULONGLONG Value;
+    PCSTR Switch;
+    NTSTATUS Status;
+    UINT i;
+
+    for (i = 1; i < argc; i++)
     {
-        // Dump System Information (sysinfo)
-        RtlCliDumpSysInfo();
+        if (RtlCliMatchSwitch(argv[i], "o", &Switch) &&
+            RtlCliParseSize(Switch, &Value) && Value <= MAXLONGLONG)
+        {
+            Offset = (LONGLONG)Value;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "l", &Switch) &&
+                 RtlCliParseSize(Switch, &Value) && Value <= MAXLONGLONG)
+        {
+            Length = (LONGLONG)Value;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "t", &Switch) &&
+                 RtlCliParseSize(Switch, &Value) && Value >= 1 && Value <= CLI_POOL_MAX_THREADS)
+        {
+            ThreadCount = (ULONG)Value;
+        }
+        else if (argv[i][0] == '/')
+        {
+            RtlCliDisplayString("expand [/o:OFFSET] [/l:LENGTH] [/t:N] X Y\n"
+                                "  X          Archive made by compress\n"
+                                "  /o:OFFSET  Start at this byte of the original file, e.g. 512m (default 0)\n"
+                                "  /l:LENGTH  Expand this many bytes (default up to the end)\n"
+                                "  /t:N       Expand with N threads, 1 to %u (default one per processor)\n",
+                                CLI_POOL_MAX_THREADS);
+            return;
+        }
+        else if (FileCount < 2)
+        {
+            Files[FileCount++] = argv[i];
+        }
     }
-    else if (!_strnicmp(argv[0], CMDSTR("cd")))
+
+    if (FileCount < 2)
     {
-        // Set the current directory
-        RtlCliSetCurrentDirectory(&Command[3]);
+        RtlCliDisplayString("Not enough arguments.\n");
+        return;
     }
-    else if (!_strnicmp(argv[0], CMDSTR("drawtext")))
+
+    GetFullPath(Files[0], buf1, FALSE);
+    GetFullPath(Files[1], buf2, FALSE);
+
+    if (!FileExists(buf1))
     {
-#if (NTDDI_VERSION >= NTDDI_WIN7)
-        UNICODE_STRING us;
-        ANSI_STRING as;
-        RtlInitAnsiString(&as, &Command[9]);
-        RtlAnsiStringToUnicodeString(&us, &as, TRUE);
-        NtDrawText(&us);
-        RtlFreeUnicodeString(&us);
-#else
-        RtlCliDisplayString("\nNot supported prior to Win7\n");
-#endif
+        RtlCliDisplayString("File does not exist.\n");
+        return;
     }
-    else if (!_strnicmp(argv[0], CMDSTR("pwd")))
-    {
-        // Get the current directory
-        RtlCliGetCurrentDirectory(CurrentDirectory);
 
-        // Display it
-        RtlInitUnicodeString(&CurrentDirectoryString, CurrentDirectory);
-        RtlCliPrintString(&CurrentDirectoryString);
+    Status = RtlCliExpandFile(buf1, buf2, Offset, Length, ThreadCount);
+    if (!NT_SUCCESS(Status) && Status != STATUS_UNSUCCESSFUL)
+    {
+        RtlCliDisplayString("Failed (0x%.8X).\n", Status);
     }
-    else if (!_strnicmp(argv[0], CMDSTR("dir")))
+}
+
+VOID RtlClipCmdMove(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Move/rename file
+    WCHAR buf1[MAX_PATH] = {0};
+    WCHAR buf2[MAX_PATH] = {0};
+    GetFullPath(argv[1], buf1, FALSE);
+    GetFullPath(argv[2], buf2, FALSE);
+    RtlCliDisplayString("\nMove %S to %S\n", buf1, buf2);
+    if (FileExists(buf1))
     {
-        WCHAR Dir[MAX_PATH];
-        WCHAR ArgDir[MAX_PATH];
-        RtlCliGetCurrentDirectory(Dir);
-        if (argc > 1)
+        if (!NtFileMoveFile(buf1, buf2, FALSE))
         {
-            UNICODE_STRING us;
-            ANSI_STRING as;
-            RtlInitAnsiString(&as, argv[1]);
-            RtlAnsiStringToUnicodeString(&us, &as, TRUE);
+            RtlCliDisplayString("Failed.\n");
+        }
+    }
+    else
+    {
+        RtlCliDisplayString("File does not exist.\n");
+    }
+}
 
-            AppendString(Dir, L"\\");
-            AppendString(Dir, us.Buffer);
+/*++
+ * @name RtlClipParseDeleteSwitches
+ *
+ * The RtlClipParseDeleteSwitches routine reads the switches shared by del
+ * and rd.
+ *
+ * @param argc
+ *        Number of arguments.
+ *
+ * @param argv
+ *        Arguments, argv[0] is the command.
+ *
+ * @param Recurse
+ *        Set to TRUE by /s.
+ *
+ * @param ThreadCount
+ *        Set by /t:N, left alone otherwise.
+ *
+ * @return The path argument, or NULL if there is none or a switch is
+ *         unknown.
+ *
+ * @remarks None.
+ *
+ *--*/
+PCHAR RtlClipParseDeleteSwitches(IN UINT argc, IN CHAR **argv, OUT PBOOLEAN Recurse, IN OUT PULONG ThreadCount)
+{
+    PCHAR Path = NULL;
+    ULONGLONG Value;
+    PCSTR Switch;
+    UINT i;
 
-            RtlFreeUnicodeString(&us);
+    *Recurse = FALSE;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (RtlCliMatchSwitch(argv[i], "s", NULL))
+        {
+            *Recurse = TRUE;
+        }
+        else if (RtlCliMatchSwitch(argv[i], "t", &Switch) &&
+                 RtlCliParseSize(Switch, &Value) && Value >= 1 && Value <= CLI_POOL_MAX_THREADS)
+        {
+            *ThreadCount = (ULONG)Value;
+        }
+        else if (argv[i][0] == '/')
+        {
+            return NULL;
         }
+        else if (!Path)
+        {
+            Path = argv[i];
+        }
+    }
+
+    return Path;
+}
+
+VOID RtlClipCmdDel(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Delete file, or every file below a directory
+    WCHAR buf1[MAX_PATH] = {0};
+    BOOLEAN Recurse;
+    ULONG ThreadCount = max(RtlCliGetProcessorCount() * 2, 4);
+    PCHAR Path;
+    NTSTATUS Status;
 
-        // List directory
-        RtlCliListDirectory(Dir);
+    Path = RtlClipParseDeleteSwitches(argc, argv, &Recurse, &ThreadCount);
+    if (!Path)
+    {
+        RtlCliDisplayString("del [/s] [/t:N] X\n"
+                            "  /s    Delete every file below directory X, keep the directories\n"
+                            "  /t:N  Delete with N threads, 1 to %u (default twice the processors, at least 4)\n",
+                            CLI_POOL_MAX_THREADS);
+        return;
     }
-    else if (!_strnicmp(argv[0], CMDSTR("devtree")))
+
+    GetFullPath(Path, buf1, FALSE);
+
+    RtlCliDisplayString("\nDelete %S\n", buf1);
+
+    if (Recurse)
     {
-        // Dump hardware tree
-        RtlCliListHardwareTree();
+        Status = RtlCliDeleteTree(buf1, FALSE, min(ThreadCount, CLI_POOL_MAX_THREADS));
     }
-    else if (!_strnicmp(argv[0], CMDSTR("shutdown")))
+    else
     {
-        RtlCliShutdown();
+        Status = NtFileDeleteByDisposition(buf1, 0);
     }
-    else if (!_strnicmp(argv[0], CMDSTR("reboot")))
+
+    // A tree delete has already reported its failures
+    if (Status == STATUS_OBJECT_NAME_NOT_FOUND)
     {
-        RtlCliReboot();
+        RtlCliDisplayString(Recurse ? "Directory does not exist.\n" : "File does not exist.\n");
     }
-    else if (!_strnicmp(argv[0], CMDSTR("poweroff")))
+    else if (!NT_SUCCESS(Status) && !(Recurse && Status == STATUS_UNSUCCESSFUL))
     {
-        RtlCliPowerOff();
+        RtlCliDisplayString("Failed (0x%.8X).\n", Status);
     }
-    else if (!_strnicmp(argv[0], CMDSTR("testvid")))
+}
+
+VOID RtlClipCmdRd(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Remove directory, or a whole tree
+    WCHAR buf1[MAX_PATH] = {0};
+    BOOLEAN Recurse;
+    ULONG ThreadCount = max(RtlCliGetProcessorCount() * 2, 4);
+    PCHAR Path;
+    NTSTATUS Status;
+
+    Path = RtlClipParseDeleteSwitches(argc, argv, &Recurse, &ThreadCount);
+    if (!Path)
     {
-        UINT j;
-        WCHAR i, w;
-        UNICODE_STRING us;
+        RtlCliDisplayString("rd [/s] [/t:N] X\n"
+                            "  /s    Remove directory X with everything in it\n"
+                            "  /t:N  Delete with N threads, 1 to %u (default twice the processors, at least 4)\n",
+                            CLI_POOL_MAX_THREADS);
+        return;
+    }
 
-        LARGE_INTEGER delay;
-        memset(&delay, 0x00, sizeof(LARGE_INTEGER));
-        delay.LowPart = 100000000;
+    GetFullPath(Path, buf1, FALSE);
 
-        RtlInitUnicodeString(&us, L" ");
+    RtlCliDisplayString("\nRemove directory %S\n", buf1);
 
-        // 75x23
-        RtlCliDisplayString("\nVid mode is 75x23\n\nCharacter test:");
+    if (Recurse)
+    {
+        Status = RtlCliDeleteTree(buf1, TRUE, min(ThreadCount, CLI_POOL_MAX_THREADS));
+    }
+    else
+    {
+        Status = NtFileDeleteByDisposition(buf1, FILE_ATTRIBUTE_DIRECTORY);
+    }
 
-        j = 0;
-        for (w = L'A'; w < 0xFFFF; w++)
-        {
-            j++;
-            NtDelayExecution(FALSE, &delay);
-            // w = i;
-            if (w != L'\n' && w != L'\r')
-            {
-                RtlCliPutChar(w);
-            }
-            else
-            {
-                RtlCliPutChar(L' ');
-            }
-            if (j > 70)
-            {
-                j = 0;
-                RtlCliPutChar(L'\n');
-            }
-        }
+    // A tree delete has already reported its failures
+    if (Status == STATUS_OBJECT_NAME_NOT_FOUND)
+    {
+        RtlCliDisplayString("Directory does not exist.\n");
+    }
+    else if (Status == STATUS_DIRECTORY_NOT_EMPTY)
+    {
+        RtlCliDisplayString("Directory is not empty, use rd /s.\n");
     }
-    else if (!_strnicmp(argv[0], CMDSTR("copy")))
+    else if (!NT_SUCCESS(Status) && !(Recurse && Status == STATUS_UNSUCCESSFUL))
     {
-        // Copy file
-        if (argc > 2)
+        RtlCliDisplayString("Failed (0x%.8X).\n", Status);
+    }
+}
+
+VOID RtlClipCmdDu(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Disk usage of a directory tree
+    WCHAR buf1[MAX_PATH] = {0};
+    PCHAR Path = NULL;
+    ULONG MaxDepth = 1;
+    BOOLEAN SortBySize = FALSE;
+    ULONG ThreadCount = max(RtlCliGetProcessorCount() * 2, 4);
+    ULONGLONG Value;
+    PCSTR Switch;
+    NTSTATUS Status;
+    UINT i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (RtlCliMatchSwitch(argv[i], "d", &Switch) && RtlCliParseSize(Switch, &Value))
         {
-            WCHAR buf1[MAX_PATH] = {0};
-            WCHAR buf2[MAX_PATH] = {0};
-            GetFullPath(argv[1], buf1, FALSE);
-            GetFullPath(argv[2], buf2, FALSE);
-            RtlCliDisplayString("\nCopy %S to %S\n", buf1, buf2);
-            if (FileExists(buf1))
-            {
-                if (!NtFileCopyFile(buf1, buf2))
-                {
-                    RtlCliDisplayString("Failed.\n");
-                }
-            }
-            else
-            {
-                RtlCliDisplayString("File does not exist.\n");
-            }
+            MaxDepth = (ULONG)min(Value, MAXULONG);
         }
-        else
+        else if (RtlCliMatchSwitch(argv[i], "s", NULL))
         {
-            RtlCliDisplayString("Not enough arguments.\n");
+            SortBySize = TRUE;
         }
-    }
-    else if (!_strnicmp(argv[0], CMDSTR("move")))
-    {
-        // Move/rename file
-        if (argc > 2)
+        else if (RtlCliMatchSwitch(argv[i], "t", &Switch) &&
+                 RtlCliParseSize(Switch, &Value) && Value >= 1 && Value <= CLI_POOL_MAX_THREADS)
         {
-            WCHAR buf1[MAX_PATH] = {0};
-            WCHAR buf2[MAX_PATH] = {0};
-            GetFullPath(argv[1], buf1, FALSE);
-            GetFullPath(argv[2], buf2, FALSE);
-            RtlCliDisplayString("\nMove %S to %S\n", buf1, buf2);
-            if (FileExists(buf1))
-            {
-                if (!NtFileMoveFile(buf1, buf2, FALSE))
-                {
-                    RtlCliDisplayString("Failed.\n");
-                }
-            }
-            else
-            {
-                RtlCliDisplayString("File does not exist.\n");
-            }
+            ThreadCount = (ULONG)Value;
+        }
+        else if (argv[i][0] == '/' || Path)
+        {
+            RtlCliDisplayString("du [X] [/d:N] [/s] [/t:N]\n"
+                                "  X     Directory to measure (default the current one)\n"
+                                "  /d:N  Print the subdirectories N levels deep (default 1, 0 for the total only)\n"
+                                "  /s    Print the largest subdirectories first\n"
+                                "  /t:N  List with N threads, 1 to %u (default twice the processors, at least 4)\n",
+                                CLI_POOL_MAX_THREADS);
+            return;
         }
         else
         {
-            RtlCliDisplayString("Not enough arguments.\n");
+            Path = argv[i];
         }
     }
-    else if (!_strnicmp(argv[0], CMDSTR("del")))
+
+    if (Path)
     {
-        // Delete file
-        if (argc > 1)
-        {
-            WCHAR buf1[MAX_PATH] = {0};
-            GetFullPath(argv[1], buf1, FALSE);
-            if (FileExists(buf1))
-            {
-                RtlCliDisplayString("\nDelete %S\n", buf1);
+        GetFullPath(Path, buf1, FALSE);
+    }
+    else
+    {
+        RtlCliGetCurrentDirectory(buf1);
+    }
 
-                if (!NtFileDeleteFile(buf1))
-                {
-                    RtlCliDisplayString("Failed.\n");
-                }
-            }
-            else
-            {
-                RtlCliDisplayString("File does not exist.\n");
-            }
-        }
-        else
-        {
-            RtlCliDisplayString("Not enough arguments.\n");
-        }
+    RtlCliDisplayString("\nDisk usage of %S\n", buf1);
+
+    Status = RtlCliDiskUsage(buf1, MaxDepth, SortBySize, ThreadCount);
+    if (Status == STATUS_OBJECT_NAME_NOT_FOUND || Status == STATUS_OBJECT_PATH_NOT_FOUND)
+    {
+        RtlCliDisplayString("Directory does not exist.\n");
     }
-    else if (!_strnicmp(argv[0], CMDSTR("md")))
+    else if (!NT_SUCCESS(Status) && Status != STATUS_UNSUCCESSFUL)
     {
-        // Make directory
-        if (argc > 1)
-        {
-            WCHAR buf1[MAX_PATH] = {0};
-            GetFullPath(argv[1], buf1, FALSE);
+        RtlCliDisplayString("Failed (0x%.8X).\n", Status);
+    }
+}
 
-            RtlCliDisplayString("\nCreate directory %S\n", buf1);
+VOID RtlClipCmdMd(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args)
+{
+    // Make directory
+    WCHAR buf1[MAX_PATH] = {0};
+    GetFullPath(argv[1], buf1, FALSE);
 
-            if (!NtFileCreateDirectory(buf1))
-            {
-                RtlCliDisplayString("Failed.\n");
-            }
+    RtlCliDisplayString("\nCreate directory %S\n", buf1);
+
+    if (!NtFileCreateDirectory(buf1))
+    {
+        RtlCliDisplayString("Failed.\n");
+    }
+}
+
+// Name, arguments, help, minimum argument count, needs keyboard, routine
+CLI_COMMAND BuiltinCommands[] = {
+    {"cd", "X", "Change directory to X", 1, FALSE, RtlClipCmdCd},
+    {"md", "X", "Make directory X", 1, FALSE, RtlClipCmdMd},
+    {"rd", "X", "Remove directory X (/?)", 1, FALSE, RtlClipCmdRd},
+    {"copy", "X Y", "Copy file X to Y (/?)", 1, FALSE, RtlClipCmdCopy},
+    {"xcopy", "X Y", "Copy directory X to Y (/?)", 1, FALSE, RtlClipCmdXcopy},
+    {"hash", "X...", "Hash files (/?)", 1, FALSE, RtlClipCmdHash},
+    {"find", "\"X\" Y", "Find text X in files Y (/?)", 1, FALSE, RtlClipCmdFind},
+    {"iobench", "X", "Compare contiguous and scatter/gather I/O on file X (/?)", 1, FALSE, RtlClipCmdIoBench},
+    {"watch", "X", "Print changes in directory X (/?)", 1, TRUE, RtlClipCmdWatch},
+    {"imgdump", "X Y", "Dump disk or partition X to image file Y (/?)", 1, FALSE, RtlClipCmdImgDump},
+    {"imgrestore", "X Y", "Write image file X to disk or partition Y (/?)", 1, FALSE, RtlClipCmdImgRestore},
+    {"compress", "X Y", "Compress file X into archive Y (/?)", 1, FALSE, RtlClipCmdCompress},
+    {"expand", "X Y", "Expand archive X, or a range of it, to file Y (/?)", 1, FALSE, RtlClipCmdExpand},
+    {"poweroff", "", "Power off PC", 0, FALSE, RtlClipCmdPowerOff},
+    {"dir", "X", "Show directory contents (/?)", 0, TRUE, RtlClipCmdDir},
+    {"du", "X", "Show disk usage of directory X (/?)", 0, FALSE, RtlClipCmdDu},
+    {"pwd", "", "Print working directory", 0, FALSE, RtlClipCmdPwd},
+    {"del", "X", "Delete file X (/?)", 1, FALSE, RtlClipCmdDel},
+    {"reboot", "", "Reboot PC", 0, FALSE, RtlClipCmdReboot},
+    {"devtree", "", "Dump device tree", 0, FALSE, RtlClipCmdDevTree},
+    {"shutdown", "", "Shutdown PC", 0, FALSE, RtlClipCmdShutdown},
+    {"exit", "", "Exit shell", 0, FALSE, RtlClipCmdExit},
+    {"sysinfo", "", "Dump system information", 0, FALSE, RtlClipCmdSysInfo},
+    {"lm", "", "List modules", 0, TRUE, RtlClipCmdListModules},
+    {"drawtext", "X", "Draw string X", 1, FALSE, RtlClipCmdDrawText},
+    {"lp", "", "List processes", 0, FALSE, RtlClipCmdListProcesses},
+    {"move", "X Y", "Move file X to Y", 2, FALSE, RtlClipCmdMove},
+    {"testvid", "", "Test screen output", 0, FALSE, RtlClipCmdTestVid},
+    {"testarg", "X Y", "Test argument parsing", 0, FALSE, RtlClipCmdTestArg},
+    {"layout", "X", "Set keyboard layout X", 0, FALSE, RtlClipCmdLayout},
+    {"help", "", "Show this list", 0, FALSE, RtlClipCmdHelp}};
+
+/*++
+ * @name RtlClipRegisterBuiltinCommands
+ *
+ * The RtlClipRegisterBuiltinCommands routine fills the command table.
+ *
+ * @param None.
+ *
+ * @return None.
+ *
+ * @remarks None.
+ *
+ *--*/
+VOID RtlClipRegisterBuiltinCommands(VOID)
+{
+    ULONG i;
+
+    for (i = 0; i < RTL_NUMBER_OF(BuiltinCommands); i++)
+    {
+        RtlCliRegisterCommand(&BuiltinCommands[i]);
+    }
+}
+
+VOID RtlClipProcessMessage(PCHAR Command)
+{
+    CLI_ARENA Arena;
+    CLI_ARGUMENTS Args;
+    UINT argc;
+    CHAR **argv;
+    PCLI_COMMAND Entry;
+
+    RtlCliArenaInit(&Arena);
+
+    if (!NT_SUCCESS(RtlCliParseArguments(Command, &Arena, &Args)))
+    {
+        RtlCliDisplayString("Out of memory.\n");
+        RtlCliArenaFree(&Arena);
+        return;
+    }
+
+    argc = Args.Argc;
+    argv = Args.Argv;
+
+    if (0 == argc)
+    {
+        RtlCliArenaFree(&Arena);
+        return;
+    }
+
+    Entry = RtlClipFindCommand(argv[0]);
+    if (Entry)
+    {
+        if (argc - 1 < Entry->MinArgs)
+        {
+            RtlCliDisplayString("Not enough arguments.\n");
+        }
+        // Pagers and prompts read from the keyboard, make sure it's there
+        else if (Entry->NeedsKeyboard && !hKeyboard &&
+                 !NT_SUCCESS(RtlCliOpenInputDevice(&hKeyboard, KeyboardType)))
+        {
+            RtlCliDisplayString("%s needs the keyboard, which is not available.\n",
+                                Entry->Name);
         }
         else
         {
-            RtlCliDisplayString("Not enough arguments.\n");
+            Entry->Routine(argc, argv, &Args);
         }
     }
     else if ((strlen(argv[0]) == 2) && (argv[0][1] == ':'))
     {
         // Change disk
         RtlCliSetCurrentDirectory(argv[0]);
-        return;
     }
     else
     {
@@ -332,6 +1481,9 @@ VOID RtlClipProcessMessage(PCHAR Command)
 
             NtClose(hKeyboard);
 
+            // The child process owns the screen from now on
+            RtlCliFlush();
+
             status = CreateNativeProcess(filename, us.Buffer, &hProcess);
             if (NT_SUCCESS(status))
             {
@@ -351,6 +1503,8 @@ VOID RtlClipProcessMessage(PCHAR Command)
                                 Command);
         }
     }
+
+    RtlCliArenaFree(&Arena);
 }
 
 /*++
@@ -375,11 +1529,13 @@ VOID RtlClipDisplayPrompt(VOID)
     if (!RtlDosPathNameToNtPathName_U(CurrentDirectory, &DirString, NULL, NULL))
     {
         RtlCliDisplayString("%S>", CurrentDirectory);
+        RtlCliFlush();
         return;
     }
 
     RtlCliPrintString(&DirString);
     RtlCliPutChar(L'>');
+    RtlCliFlush();
 }
 
 NTSTATUS
@@ -392,9 +1548,13 @@ __cdecl main(INT argc,
     NTSTATUS Status;
     PCHAR Command;
 
+    RtlCliInitializeDisplay();
+
     hHeap = InitHeapMemory();
     hKey = NULL;
 
+    RtlClipRegisterBuiltinCommands();
+
     // Show banner
     RtlCliDisplayString("Native Shell v" __NCLI_VER__ " (build " __DATE__ " " __TIME__ ")\n\n");
 
@@ -9,6 +9,37 @@
 #include "precomp.h"
 #include "ntfile.h"
 
+// Disk length query, not in the headers this tree includes
+#ifndef IOCTL_DISK_GET_LENGTH_INFO
+#define IOCTL_DISK_GET_LENGTH_INFO CTL_CODE(FILE_DEVICE_DISK, 0x0017, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+typedef struct _GET_LENGTH_INFORMATION
+{
+    LARGE_INTEGER Length;
+} GET_LENGTH_INFORMATION, *PGET_LENGTH_INFORMATION;
+#endif
+
+/*
+Appends a DOS path to what Buffer already holds, normally the "\??\" prefix.
+BufferLength is the size of Buffer in characters. If the result doesn't fit,
+Buffer is left alone and the path isn't cut short.
+*/
+
+NTSTATUS NtFileAppendPath(PWSTR Buffer, SIZE_T BufferLength, PCWSTR pwszFileName)
+{
+    SIZE_T Length = wcslen(Buffer);
+    SIZE_T PathLength = wcslen(pwszFileName);
+
+    if (Length + PathLength >= BufferLength)
+    {
+        return STATUS_NAME_TOO_LONG;
+    }
+
+    RtlCopyMemory(Buffer + Length, pwszFileName, (PathLength + 1) * sizeof(WCHAR));
+
+    return STATUS_SUCCESS;
+}
+
 BOOLEAN NtFileOpenDirectory(HANDLE *phRetFile, WCHAR *pwszFileName, BOOLEAN bWrite, BOOLEAN bOverwrite)
 {
     HANDLE hFile;
@@ -18,7 +49,11 @@ BOOLEAN NtFileOpenDirectory(HANDLE *phRetFile, WCHAR *pwszFileName, BOOLEAN bWri
     WCHAR wszFileName[1024] = L"\\??\\";
     OBJECT_ATTRIBUTES ObjectAttributes;
 
-    wcscat(wszFileName, pwszFileName);
+    if (!NT_SUCCESS(NtFileAppendPath(wszFileName, RTL_NUMBER_OF(wszFileName), pwszFileName)))
+    {
+        RtlCliDisplayString("Path too long: %S\n", pwszFileName);
+        return FALSE;
+    }
 
     RtlInitUnicodeString(&ustrFileName, wszFileName);
 
@@ -71,7 +106,11 @@ BOOLEAN NtFileOpenFile(HANDLE *phRetFile, WCHAR *pwszFileName, BOOLEAN bWrite, B
     OBJECT_ATTRIBUTES ObjectAttributes;
     NTSTATUS ntStatus;
 
-    wcscat(wszFileName, pwszFileName);
+    if (!NT_SUCCESS(NtFileAppendPath(wszFileName, RTL_NUMBER_OF(wszFileName), pwszFileName)))
+    {
+        RtlCliDisplayString("Path too long: %S\n", pwszFileName);
+        return FALSE;
+    }
 
     RtlInitUnicodeString(&ustrFileName, wszFileName);
 
@@ -112,97 +151,291 @@ BOOLEAN NtFileOpenFile(HANDLE *phRetFile, WCHAR *pwszFileName, BOOLEAN bWrite, B
     return TRUE;
 }
 
-BOOLEAN NtFileWriteFile(HANDLE hFile, LPVOID lpData, DWORD dwBufferSize, DWORD *pRetWrittenSize)
+/*
+Opens an existing file for sequential reading, shared with other readers
+and writers, so files in use and read-only files can be read.
+*/
+
+BOOLEAN NtFileOpenFileForRead(HANDLE *phRetFile, PCWSTR pwszFileName)
 {
-    IO_STATUS_BLOCK sIoStatus;
-    NTSTATUS ntStatus = 0;
+    HANDLE hFile;
+    UNICODE_STRING ustrFileName;
+    IO_STATUS_BLOCK IoStatusBlock;
+    WCHAR wszFileName[1024] = L"\\??\\";
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    NTSTATUS ntStatus;
 
-    memset(&sIoStatus, 0, sizeof(IO_STATUS_BLOCK));
+    ntStatus = NtFileAppendPath(wszFileName, RTL_NUMBER_OF(wszFileName), pwszFileName);
+    if (!NT_SUCCESS(ntStatus))
+    {
+        RtlCliDisplayString("Path too long: %S\n", pwszFileName);
+        return FALSE;
+    }
 
-    ntStatus = NtWriteFile(hFile, NULL, NULL, NULL, &sIoStatus, lpData, dwBufferSize, NULL, NULL);
+    RtlInitUnicodeString(&ustrFileName, wszFileName);
 
-    if (ntStatus == STATUS_SUCCESS)
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &ustrFileName,
+                               OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+
+    ntStatus = NtCreateFile(&hFile, GENERIC_READ | SYNCHRONIZE,
+                            &ObjectAttributes, &IoStatusBlock, 0, FILE_ATTRIBUTE_NORMAL,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE, FILE_OPEN,
+                            FILE_NON_DIRECTORY_FILE | FILE_SEQUENTIAL_ONLY | FILE_SYNCHRONOUS_IO_NONALERT,
+                            NULL, 0);
+
+    if (!NT_SUCCESS(ntStatus))
     {
-        if (pRetWrittenSize)
-        {
-            *pRetWrittenSize = sIoStatus.Information & MAXULONG;
-        }
-        return TRUE;
+        RtlCliDisplayString("NtCreateFile() failed 0x%.8X\n", ntStatus);
+        return FALSE;
     }
 
-    return FALSE;
+    *phRetFile = hFile;
+
+    return TRUE;
 }
 
-BOOLEAN NtFileCopyFile(WCHAR *pszSrc, WCHAR *pszDst)
+/*
+Opens a file with FILE_NO_INTERMEDIATE_BUFFERING, for the page I/O below.
+bWrite creates or overwrites the file for reading and writing, otherwise an
+existing file is opened for reading, shared with other readers and writers.
+*/
+
+BOOLEAN NtFileOpenUnbuffered(HANDLE *phRetFile, PCWSTR pwszFileName, BOOLEAN bWrite)
 {
-    HANDLE hSrc = NULL;
-    HANDLE hDst = NULL;
-    BYTE byData[8192];
-    LONGLONG lFileSize = 0;
-    LONGLONG lWrittenSizeTotal = 0;
-    DWORD dwReadSize = 0;
-    DWORD dwWrittenSize = 0;
-    BOOLEAN bResult = 0;
-
-    bResult = NtFileOpenFile(&hSrc, pszSrc, FALSE, FALSE);
-    if (bResult == FALSE)
+    HANDLE hFile;
+    UNICODE_STRING ustrFileName;
+    IO_STATUS_BLOCK IoStatusBlock;
+    WCHAR wszFileName[1024] = L"\\??\\";
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    NTSTATUS ntStatus;
+
+    ntStatus = NtFileAppendPath(wszFileName, RTL_NUMBER_OF(wszFileName), pwszFileName);
+    if (!NT_SUCCESS(ntStatus))
     {
+        RtlCliDisplayString("Path too long: %S\n", pwszFileName);
         return FALSE;
     }
 
-    bResult = NtFileOpenFile(&hDst, pszDst, TRUE, TRUE);
+    RtlInitUnicodeString(&ustrFileName, wszFileName);
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &ustrFileName,
+                               OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
 
-    if (bResult == FALSE)
+    ntStatus = NtCreateFile(&hFile,
+                            (bWrite ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ) | SYNCHRONIZE,
+                            &ObjectAttributes, &IoStatusBlock, 0, FILE_ATTRIBUTE_NORMAL,
+                            bWrite ? 0 : FILE_SHARE_READ | FILE_SHARE_WRITE,
+                            bWrite ? FILE_OVERWRITE_IF : FILE_OPEN,
+                            FILE_NON_DIRECTORY_FILE | FILE_NO_INTERMEDIATE_BUFFERING | FILE_SYNCHRONOUS_IO_NONALERT,
+                            NULL, 0);
+
+    if (!NT_SUCCESS(ntStatus))
     {
-        NtFileCloseFile(hSrc);
+        RtlCliDisplayString("NtCreateFile() failed 0x%.8X\n", ntStatus);
         return FALSE;
     }
 
-    if (NtFileGetFileSize(hSrc, &lFileSize) == FALSE)
+    *phRetFile = hFile;
+
+    return TRUE;
+}
+
+/*
+hFile - handle from NtFileOpenUnbuffered
+Pages - NT_FILE_PAGE_SIZE bytes each, page aligned, in any order in memory
+Length - bytes to move, a multiple of the sector size, at most
+         NT_FILE_PAGE_SIZE times the number of pages
+Offset - file offset, a multiple of the sector size
+
+Moves NT_FILE_MAX_SEGMENTS pages per NtReadFileScatter/NtWriteFileGather
+call, so a buffer pool hands its pages to the disk without copying them
+into one contiguous buffer. A read stops at end of file, reporting the bytes
+read, and fails with STATUS_END_OF_FILE only if there was nothing to read.
+*/
+
+NTSTATUS NtFileTransferPages(HANDLE hFile, PVOID *Pages, ULONG Length, LONGLONG Offset, BOOLEAN bWrite, PULONG pRetSize)
+{
+    FILE_SEGMENT_ELEMENT Segments[NT_FILE_MAX_SEGMENTS + 1];
+    IO_STATUS_BLOCK sIoStatus;
+    LARGE_INTEGER ByteOffset;
+    ULONG Chunk, PageCount, Done, i;
+    NTSTATUS ntStatus;
+
+    *pRetSize = 0;
+
+    while (Length)
     {
-        NtFileCloseFile(hSrc);
-        NtFileCloseFile(hDst);
+        Chunk = min(Length, NT_FILE_MAX_SEGMENTS * NT_FILE_PAGE_SIZE);
+        PageCount = (Chunk + NT_FILE_PAGE_SIZE - 1) / NT_FILE_PAGE_SIZE;
+
+        // The list is NULL terminated, Alignment is the 64-bit pointer
+        for (i = 0; i < PageCount; i++)
+            Segments[i].Alignment = (ULONGLONG)(ULONG_PTR)Pages[i];
+        Segments[PageCount].Alignment = 0;
+
+        ByteOffset.QuadPart = Offset;
+        memset(&sIoStatus, 0, sizeof(IO_STATUS_BLOCK));
+
+        if (bWrite)
+            ntStatus = NtWriteFileGather(hFile, NULL, NULL, NULL, &sIoStatus, Segments, Chunk, &ByteOffset, NULL);
+        else
+            ntStatus = NtReadFileScatter(hFile, NULL, NULL, NULL, &sIoStatus, Segments, Chunk, &ByteOffset, NULL);
+
+        if (ntStatus == STATUS_END_OF_FILE && !bWrite)
+            return *pRetSize ? STATUS_SUCCESS : STATUS_END_OF_FILE;
+        if (!NT_SUCCESS(ntStatus))
+            return ntStatus;
+
+        Done = sIoStatus.Information & MAXULONG;
+        *pRetSize += Done;
+
+        if (Done < Chunk)
+            break;
+
+        Pages += PageCount;
+        Length -= Chunk;
+        Offset += Chunk;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS NtFileReadPages(HANDLE hFile, PVOID *Pages, ULONG Length, LONGLONG Offset, PULONG pRetReadSize)
+{
+    return NtFileTransferPages(hFile, Pages, Length, Offset, FALSE, pRetReadSize);
+}
+
+NTSTATUS NtFileWritePages(HANDLE hFile, PVOID *Pages, ULONG Length, LONGLONG Offset, PULONG pRetWrittenSize)
+{
+    return NtFileTransferPages(hFile, Pages, Length, Offset, TRUE, pRetWrittenSize);
+}
+
+/*
+Opens a disk, a partition or a file for overlapped FILE_NO_INTERMEDIATE_BUFFERING
+I/O at explicit offsets, for streaming disk images. A name starting with a
+backslash is an NT path such as \Device\Harddisk0\Partition1 and is used as
+is, anything else is a full path in DOS format. bWrite opens for reading
+and writing, creating a file that doesn't exist, and bOverwrite truncates
+an existing file first. Devices are always opened in place. Sharing allows
+other readers and writers, as the system keeps its disks open.
+*/
+
+NTSTATUS NtFileOpenRaw(HANDLE *phRetFile, PCWSTR pwszFileName, BOOLEAN bWrite, BOOLEAN bOverwrite)
+{
+    UNICODE_STRING ustrFileName;
+    IO_STATUS_BLOCK IoStatusBlock;
+    WCHAR wszFileName[1024] = L"\\??\\";
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    ULONG CreateDisposition = FILE_OPEN;
+    NTSTATUS ntStatus;
+
+    if (pwszFileName[0] == L'\\')
+        wszFileName[0] = UNICODE_NULL;
+
+    ntStatus = NtFileAppendPath(wszFileName, RTL_NUMBER_OF(wszFileName), pwszFileName);
+    if (!NT_SUCCESS(ntStatus))
+    {
+        return ntStatus;
+    }
+
+    RtlInitUnicodeString(&ustrFileName, wszFileName);
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &ustrFileName,
+                               OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+
+    if (bWrite)
+        CreateDisposition = bOverwrite ? FILE_OVERWRITE_IF : FILE_OPEN_IF;
+
+    ntStatus = NtCreateFile(phRetFile,
+                            (bWrite ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ) | SYNCHRONIZE,
+                            &ObjectAttributes, &IoStatusBlock, 0, FILE_ATTRIBUTE_NORMAL,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE,
+                            CreateDisposition,
+                            FILE_NON_DIRECTORY_FILE | FILE_NO_INTERMEDIATE_BUFFERING | FILE_SEQUENTIAL_ONLY,
+                            NULL, 0);
+
+    if (!NT_SUCCESS(ntStatus))
+    {
+        RtlCliDisplayString("NtCreateFile() failed 0x%.8X\n", ntStatus);
+    }
+
+    return ntStatus;
+}
+
+/*
+hFile - handle from NtFileOpenRaw
+pbDevice - optional, TRUE if hFile is a disk or a partition
+
+Disks and partitions report their length with IOCTL_DISK_GET_LENGTH_INFO,
+files don't support it and report their end of file instead.
+*/
+
+BOOLEAN NtFileGetRawSize(HANDLE hFile, LONGLONG *pRetSize, BOOLEAN *pbDevice)
+{
+    IO_STATUS_BLOCK sIoStatus;
+    GET_LENGTH_INFORMATION LengthInfo;
+    HANDLE hEvent;
+    NTSTATUS ntStatus;
+
+    if (pbDevice)
+        *pbDevice = FALSE;
+
+    // The handle is overlapped, wait for the request on an event of our own
+    ntStatus = NtCreateEvent(&hEvent, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE);
+    if (!NT_SUCCESS(ntStatus))
         return FALSE;
+
+    memset(&sIoStatus, 0, sizeof(IO_STATUS_BLOCK));
+
+    ntStatus = NtDeviceIoControlFile(hFile, hEvent, NULL, NULL, &sIoStatus, IOCTL_DISK_GET_LENGTH_INFO,
+                                     NULL, 0, &LengthInfo, sizeof(GET_LENGTH_INFORMATION));
+    if (ntStatus == STATUS_PENDING)
+    {
+        NtWaitForSingleObject(hEvent, FALSE, NULL);
+        ntStatus = sIoStatus.Status;
     }
 
-    lWrittenSizeTotal = 0;
-    while (1)
+    NtClose(hEvent);
+
+    if (NT_SUCCESS(ntStatus))
     {
-        dwReadSize = 0;
+        *pRetSize = LengthInfo.Length.QuadPart;
+        if (pbDevice)
+            *pbDevice = TRUE;
+        return TRUE;
+    }
 
-        if (NtFileReadFile(hSrc, byData, 8192, &dwReadSize) == FALSE)
-        {
-            NtFileCloseFile(hSrc);
-            NtFileCloseFile(hDst);
-            return FALSE;
-        }
+    return NtFileGetFileSize(hFile, pRetSize);
+}
 
-        if (NtFileWriteFile(hDst, byData, dwReadSize, &dwWrittenSize) == FALSE)
-        {
-            NtFileCloseFile(hSrc);
-            NtFileCloseFile(hDst);
-            return FALSE;
-        }
+BOOLEAN NtFileWriteFile(HANDLE hFile, LPVOID lpData, DWORD dwBufferSize, DWORD *pRetWrittenSize)
+{
+    IO_STATUS_BLOCK sIoStatus;
+    NTSTATUS ntStatus = 0;
 
-        if (dwReadSize != dwWrittenSize)
-        {
-            NtFileCloseFile(hSrc);
-            NtFileCloseFile(hDst);
-            return FALSE;
-        }
+    memset(&sIoStatus, 0, sizeof(IO_STATUS_BLOCK));
+
+    ntStatus = NtWriteFile(hFile, NULL, NULL, NULL, &sIoStatus, lpData, dwBufferSize, NULL, NULL);
 
-        lWrittenSizeTotal += dwWrittenSize;
-        if (lWrittenSizeTotal == lFileSize)
+    if (ntStatus == STATUS_SUCCESS)
+    {
+        if (pRetWrittenSize)
         {
-            // End of File...
-            break;
+            *pRetWrittenSize = sIoStatus.Information & MAXULONG;
         }
+        return TRUE;
     }
 
-    NtFileCloseFile(hSrc);
-    NtFileCloseFile(hDst);
-
-    return TRUE;
+    return FALSE;
 }
 
 BOOLEAN NtFileReadFile(HANDLE hFile, LPVOID pOutBuffer, DWORD dwOutBufferSize, DWORD *pRetReadSize)
@@ -328,6 +561,82 @@ BOOLEAN NtFileDeleteFile(PCWSTR filename)
     return TRUE;
 }
 
+/*
+filename - full path in DOS format
+FileAttributes - attributes from a directory listing, FILE_ATTRIBUTE_DIRECTORY
+                 alone for a directory, or 0 for a file
+
+Deletes through a handle with FileDispositionInformation, without any query
+first. The open fails if the directory attribute doesn't match what's on disk.
+A read-only attribute passed in is cleared on the same handle. Reparse points
+are deleted themselves, not their targets.
+*/
+
+NTSTATUS NtFileDeleteByDisposition(PCWSTR filename, ULONG FileAttributes)
+{
+    UNICODE_STRING us;
+    OBJECT_ATTRIBUTES oa;
+    IO_STATUS_BLOCK iosb;
+    FILE_DISPOSITION_INFORMATION fdi;
+    FILE_BASIC_INFORMATION fbi;
+    WCHAR wszFileName[1024] = L"\\??\\";
+    ACCESS_MASK Access = DELETE | SYNCHRONIZE;
+    ULONG Options = FILE_OPEN_REPARSE_POINT | FILE_OPEN_FOR_BACKUP_INTENT | FILE_SYNCHRONOUS_IO_NONALERT;
+    HANDLE hFile;
+    NTSTATUS status;
+
+    status = NtFileAppendPath(wszFileName, RTL_NUMBER_OF(wszFileName), filename);
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+    RtlInitUnicodeString(&us, wszFileName);
+    InitializeObjectAttributes(&oa, &us, OBJ_CASE_INSENSITIVE, NULL, NULL);
+
+    if (FileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+    {
+        Options |= FILE_DIRECTORY_FILE;
+    }
+    else
+    {
+        Options |= FILE_NON_DIRECTORY_FILE;
+    }
+
+    if (FileAttributes & FILE_ATTRIBUTE_READONLY)
+    {
+        Access |= FILE_WRITE_ATTRIBUTES;
+    }
+
+    status = NtOpenFile(&hFile,
+                        Access,
+                        &oa,
+                        &iosb,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                        Options);
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    if (FileAttributes & FILE_ATTRIBUTE_READONLY)
+    {
+        memset(&fbi, 0, sizeof(fbi));
+        fbi.FileAttributes = FileAttributes & ~FILE_ATTRIBUTE_READONLY;
+        if (!fbi.FileAttributes)
+        {
+            fbi.FileAttributes = FILE_ATTRIBUTE_NORMAL;
+        }
+        NtSetInformationFile(hFile, &iosb, &fbi, sizeof(fbi), FileBasicInformation);
+    }
+
+    fdi.DeleteFile = TRUE;
+    status = NtSetInformationFile(hFile, &iosb, &fdi, sizeof(fdi), FileDispositionInformation);
+
+    NtClose(hFile);
+
+    return status;
+}
+
 BOOLEAN NtFileCreateDirectory(PCWSTR dirname)
 {
     UNICODE_STRING us;
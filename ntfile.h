@@ -4,7 +4,10 @@
 
 #include <ntndk.h>
 
+NTSTATUS NtFileAppendPath(PWSTR Buffer, SIZE_T BufferLength, PCWSTR pwszFileName);
+
 BOOLEAN NtFileOpenFile(HANDLE *phRetFile, WCHAR *pwszFileName, BOOLEAN bWrite, BOOLEAN bOverwrite);
+BOOLEAN NtFileOpenFileForRead(HANDLE *phRetFile, PCWSTR pwszFileName);
 BOOLEAN NtFileOpenDirectory(HANDLE *phRetFile, WCHAR *pwszFileName, BOOLEAN bWrite, BOOLEAN bOverwrite);
 
 BOOLEAN NtFileReadFile(HANDLE hFile, LPVOID pOutBuffer, DWORD dwOutBufferSize, DWORD *pRetReadSize);
@@ -16,9 +19,59 @@ BOOLEAN NtFileGetFileSize(HANDLE hFile, LONGLONG *pRetFileSize);
 
 BOOLEAN NtFileCloseFile(HANDLE hFile);
 
+// Scatter/gather I/O on pages anywhere in memory
+#define NT_FILE_PAGE_SIZE 4096
+#define NT_FILE_MAX_SEGMENTS 256 // pages moved by one system call
+
+BOOLEAN NtFileOpenUnbuffered(HANDLE *phRetFile, PCWSTR pwszFileName, BOOLEAN bWrite);
+NTSTATUS NtFileReadPages(HANDLE hFile, PVOID *Pages, ULONG Length, LONGLONG Offset, PULONG pRetReadSize);
+NTSTATUS NtFileWritePages(HANDLE hFile, PVOID *Pages, ULONG Length, LONGLONG Offset, PULONG pRetWrittenSize);
+
+// Disks, partitions and files as raw images
+NTSTATUS NtFileOpenRaw(HANDLE *phRetFile, PCWSTR pwszFileName, BOOLEAN bWrite, BOOLEAN bOverwrite);
+BOOLEAN NtFileGetRawSize(HANDLE hFile, LONGLONG *pRetSize, BOOLEAN *pbDevice);
+
+#define COPY_MAX_QUEUE_DEPTH 32
+
+// Page aligned transfer buffers, halved until they can be committed
+NTSTATUS NtFileAllocateCopyBuffer(PVOID *Buffer, PULONG Size);
+VOID NtFileFreeCopyBuffer(PVOID Buffer);
+
+// Copy flags
+#define NT_FILE_COPY_NO_MAP 0x0001 // never copy from mapped views of the source
+#define NT_FILE_COPY_VERIFY 0x0002 // CRC32 the source while copying, then read the destination back
+#define NT_FILE_COPY_UNBUFFERED 0x0004 // bypass the file cache on both files, implies NO_MAP
+#define NT_FILE_COPY_SPARSE 0x0008 // copy the allocated ranges only, into a sparse destination
+#define NT_FILE_COPY_SKIP_ZEROS 0x0010 // don't write chunks that are all zeros, with a queue depth of 2 or more
+#define NT_FILE_COPY_PROGRESS 0x0020 // print the progress every few seconds, with a queue depth of 2 or more
+
+typedef struct _NT_FILE_COPY_OPTIONS
+{
+    ULONG QueueDepth; // 1 copies synchronously, more keeps that many chunks in flight
+    ULONG ChunkSize;  // 0 picks a size from the file size
+    ULONG Flags;
+} NT_FILE_COPY_OPTIONS, *PNT_FILE_COPY_OPTIONS;
+
+typedef struct _NT_FILE_COPY_STATS
+{
+    LONGLONG BytesCopied;
+    LONGLONG ElapsedTicks;
+    LONGLONG Frequency;
+    ULONG QueueDepth;
+    ULONG ChunkSize;
+    BOOLEAN Mapped;
+    BOOLEAN Verified; // Checksum matched the destination read back
+    ULONG Checksum;   // CRC32 of the data, with NT_FILE_COPY_VERIFY
+    ULONG Flags;      // flags the copy ran with
+    LONGLONG HoleBytes; // holes not copied, with NT_FILE_COPY_SPARSE or NT_FILE_COPY_SKIP_ZEROS
+} NT_FILE_COPY_STATS, *PNT_FILE_COPY_STATS;
+
 BOOLEAN NtFileCopyFile(WCHAR *pszSrc, WCHAR *pszDst);
+BOOLEAN NtFileCopyFileEx(WCHAR *pszSrc, WCHAR *pszDst, PNT_FILE_COPY_OPTIONS pOptions, PNT_FILE_COPY_STATS pStats);
+BOOLEAN NtFileCopyImage(PCWSTR pszSrc, PCWSTR pszDst, BOOLEAN bRestore, PNT_FILE_COPY_OPTIONS pOptions, PNT_FILE_COPY_STATS pStats);
 
 BOOLEAN NtFileDeleteFile(PCWSTR filename);
+NTSTATUS NtFileDeleteByDisposition(PCWSTR filename, ULONG FileAttributes);
 BOOLEAN NtFileCreateDirectory(PCWSTR dirname);
 
 BOOLEAN NtFileMoveFile(IN LPCWSTR lpExistingFileName, IN LPCWSTR lpNewFileName, BOOLEAN ReplaceIfExists);
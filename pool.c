@@ -0,0 +1,257 @@
+/**
+ * PROJECT:         Native Shell
+ * COPYRIGHT:       LGPL; See LICENSE in the top level directory
+ * FILE:            pool.c
+ * DESCRIPTION:     Worker thread pool.
+ * DEVELOPERS:      See CONTRIBUTORS.md in the top level directory
+ */
+
+#include "precomp.h"
+
+/*++
+ * @name RtlClipPoolWorker
+ *
+ * The RtlClipPoolWorker routine is the body of every pool thread.
+ *
+ * @param Parameter
+ *        The pool.
+ *
+ * @return Thread exit code.
+ *
+ * @remarks Takes work items off the queue until the pool shuts down and
+ *          the queue is empty.
+ *
+ *--*/
+ULONG
+NTAPI
+RtlClipPoolWorker(IN PVOID Parameter)
+{
+    PCLI_THREAD_POOL Pool = Parameter;
+    CLI_WORK_ITEM Item;
+
+    for (;;)
+    {
+        NtWaitForSingleObject(Pool->ItemSemaphore, FALSE, NULL);
+
+        RtlEnterCriticalSection(&Pool->Lock);
+        if (Pool->Count == 0)
+        {
+            // Only a shutdown wakes us up with nothing queued
+            RtlLeaveCriticalSection(&Pool->Lock);
+            break;
+        }
+
+        Item = Pool->Queue[Pool->Head];
+        Pool->Head = (Pool->Head + 1) % CLI_POOL_QUEUE_SIZE;
+        Pool->Count--;
+        RtlLeaveCriticalSection(&Pool->Lock);
+
+        NtReleaseSemaphore(Pool->SpaceSemaphore, 1, NULL);
+
+        Item.Routine(Item.Context);
+
+        RtlEnterCriticalSection(&Pool->Lock);
+        if (--Pool->Pending == 0)
+            NtSetEvent(Pool->IdleEvent, NULL);
+        RtlLeaveCriticalSection(&Pool->Lock);
+    }
+
+    RtlExitUserThread(STATUS_SUCCESS);
+    return 0;
+}
+
+/*++
+ * @name RtlCliGetProcessorCount
+ *
+ * The RtlCliGetProcessorCount routine returns the number of processors.
+ *
+ * @param None.
+ *
+ * @return Number of processors, at least 1.
+ *
+ * @remarks Used to size thread pools.
+ *
+ *--*/
+ULONG
+RtlCliGetProcessorCount(VOID)
+{
+    SYSTEM_BASIC_INFORMATION BasicInfo;
+
+    if (!NT_SUCCESS(NtQuerySystemInformation(SystemBasicInformation,
+                                             &BasicInfo,
+                                             sizeof(BasicInfo),
+                                             NULL)) ||
+        BasicInfo.NumberOfProcessors < 1)
+    {
+        return 1;
+    }
+
+    return BasicInfo.NumberOfProcessors;
+}
+
+/*++
+ * @name RtlCliCreateThreadPool
+ *
+ * The RtlCliCreateThreadPool routine starts a pool of worker threads.
+ *
+ * @param Pool
+ *        Pool to initialize. It must stay valid until the pool is
+ *        destroyed.
+ *
+ * @param ThreadCount
+ *        Number of threads, 1 to CLI_POOL_MAX_THREADS.
+ *
+ * @return STATUS_SUCCESS or the status of the failing call.
+ *
+ * @remarks The threads are started with RtlCreateUserThread.
+ *
+ *--*/
+NTSTATUS
+RtlCliCreateThreadPool(OUT PCLI_THREAD_POOL Pool, IN ULONG ThreadCount)
+{
+    NTSTATUS Status;
+    ULONG i;
+
+    RtlZeroMemory(Pool, sizeof(CLI_THREAD_POOL));
+    RtlInitializeCriticalSection(&Pool->Lock);
+
+    ThreadCount = min(max(ThreadCount, 1), CLI_POOL_MAX_THREADS);
+
+    Status = NtCreateSemaphore(&Pool->ItemSemaphore, SEMAPHORE_ALL_ACCESS, NULL,
+                               0, CLI_POOL_QUEUE_SIZE + CLI_POOL_MAX_THREADS);
+    if (NT_SUCCESS(Status))
+    {
+        Status = NtCreateSemaphore(&Pool->SpaceSemaphore, SEMAPHORE_ALL_ACCESS, NULL,
+                                   CLI_POOL_QUEUE_SIZE, CLI_POOL_QUEUE_SIZE);
+    }
+    if (NT_SUCCESS(Status))
+    {
+        Status = NtCreateEvent(&Pool->IdleEvent, EVENT_ALL_ACCESS, NULL, NotificationEvent, TRUE);
+    }
+
+    for (i = 0; NT_SUCCESS(Status) && i < ThreadCount; i++)
+    {
+        Status = RtlCreateUserThread(NtCurrentProcess(),
+                                     NULL,
+                                     FALSE,
+                                     0,
+                                     0,
+                                     0,
+                                     RtlClipPoolWorker,
+                                     Pool,
+                                     &Pool->Threads[i],
+                                     NULL);
+        if (NT_SUCCESS(Status))
+            Pool->ThreadCount++;
+    }
+
+    // Run with the threads we got, if any
+    if (Pool->ThreadCount)
+        return STATUS_SUCCESS;
+
+    RtlCliDestroyThreadPool(Pool);
+    return Status;
+}
+
+/*++
+ * @name RtlCliQueueWorkItem
+ *
+ * The RtlCliQueueWorkItem routine hands a work item to the pool.
+ *
+ * @param Pool
+ *        Pool to use.
+ *
+ * @param Routine
+ *        Routine to call on a pool thread.
+ *
+ * @param Context
+ *        Parameter for Routine.
+ *
+ * @return None.
+ *
+ * @remarks Blocks while CLI_POOL_QUEUE_SIZE items are waiting, which
+ *          keeps a fast producer from queueing an unbounded amount of
+ *          work. For that reason work routines must not queue items to
+ *          their own pool.
+ *
+ *--*/
+VOID
+RtlCliQueueWorkItem(IN PCLI_THREAD_POOL Pool, IN PCLI_WORK_ROUTINE Routine, IN PVOID Context)
+{
+    ULONG Tail;
+
+    NtWaitForSingleObject(Pool->SpaceSemaphore, FALSE, NULL);
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    Tail = (Pool->Head + Pool->Count) % CLI_POOL_QUEUE_SIZE;
+    Pool->Queue[Tail].Routine = Routine;
+    Pool->Queue[Tail].Context = Context;
+    Pool->Count++;
+    if (Pool->Pending++ == 0)
+        NtResetEvent(Pool->IdleEvent, NULL);
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    NtReleaseSemaphore(Pool->ItemSemaphore, 1, NULL);
+}
+
+/*++
+ * @name RtlCliWaitThreadPool
+ *
+ * The RtlCliWaitThreadPool routine waits until every queued work item
+ * has run.
+ *
+ * @param Pool
+ *        Pool to wait for.
+ *
+ * @return None.
+ *
+ * @remarks None.
+ *
+ *--*/
+VOID
+RtlCliWaitThreadPool(IN PCLI_THREAD_POOL Pool)
+{
+    NtWaitForSingleObject(Pool->IdleEvent, FALSE, NULL);
+}
+
+/*++
+ * @name RtlCliDestroyThreadPool
+ *
+ * The RtlCliDestroyThreadPool routine runs the remaining work, stops the
+ * threads and releases the pool.
+ *
+ * @param Pool
+ *        Pool to destroy.
+ *
+ * @return None.
+ *
+ * @remarks None.
+ *
+ *--*/
+VOID
+RtlCliDestroyThreadPool(IN PCLI_THREAD_POOL Pool)
+{
+    ULONG i;
+
+    if (Pool->ThreadCount)
+    {
+        RtlCliWaitThreadPool(Pool);
+
+        // Wake every thread with an empty queue, which makes it exit
+        NtReleaseSemaphore(Pool->ItemSemaphore, Pool->ThreadCount, NULL);
+        NtWaitForMultipleObjects(Pool->ThreadCount, Pool->Threads, WaitAll, FALSE, NULL);
+
+        for (i = 0; i < Pool->ThreadCount; i++)
+            NtClose(Pool->Threads[i]);
+    }
+
+    if (Pool->IdleEvent)
+        NtClose(Pool->IdleEvent);
+    if (Pool->SpaceSemaphore)
+        NtClose(Pool->SpaceSemaphore);
+    if (Pool->ItemSemaphore)
+        NtClose(Pool->ItemSemaphore);
+
+    RtlDeleteCriticalSection(&Pool->Lock);
+    RtlZeroMemory(Pool, sizeof(CLI_THREAD_POOL));
+}
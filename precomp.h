@@ -29,6 +29,10 @@ typedef enum _CON_DEVICE_TYPE
 
 // Display functions
 
+VOID
+RtlCliInitializeDisplay(
+    VOID);
+
 NTSTATUS
 __cdecl RtlCliDisplayString(
     IN PCH Message,
@@ -42,6 +46,33 @@ NTSTATUS
 RtlCliPutChar(
     IN WCHAR Char);
 
+NTSTATUS
+RtlCliFlush(
+    VOID);
+
+// Boot video text area: 640 pixels wide with an 8 pixel font
+#define DISPLAY_COLUMNS 80
+
+#define CLI_PRINT_BUFFER_SIZE 4096
+#define CLI_PRINT_LINE_SIZE 512
+
+// Output collected by one thread and displayed in whole lines
+typedef struct _CLI_PRINT_BUFFER
+{
+    ULONG Length;
+    CHAR Buffer[CLI_PRINT_BUFFER_SIZE];
+} CLI_PRINT_BUFFER, *PCLI_PRINT_BUFFER;
+
+VOID
+__cdecl RtlCliBufferPrint(
+    IN OUT PCLI_PRINT_BUFFER PrintBuffer,
+    IN PCH Format,
+    ...);
+
+VOID
+RtlCliFlushPrintBuffer(
+    IN OUT PCLI_PRINT_BUFFER PrintBuffer);
+
 // Input functions
 
 NTSTATUS
@@ -56,6 +87,16 @@ PCHAR
 RtlCliGetLine(
     IN HANDLE hDriver);
 
+NTSTATUS
+RtlCliWaitForKeyOrObject(
+    IN HANDLE hDriver,
+    IN HANDLE Object,
+    IN PLARGE_INTEGER Timeout);
+
+VOID
+RtlCliCancelKeyWait(
+    IN HANDLE hDriver);
+
 // System information functions
 
 NTSTATUS
@@ -90,9 +131,21 @@ RtlCliListHardwareTree(
 
 // File functions
 
+// Orders for RtlCliListDirectory
+#define DIR_SORT_NONE 0x0000
+#define DIR_SORT_NAME 0x0001
+#define DIR_SORT_SIZE 0x0002
+#define DIR_SORT_DATE 0x0003
+#define DIR_SORT_MASK 0x000F
+#define DIR_SORT_DESCENDING 0x0010
+#define DIR_BARE 0x0020  // names only
+#define DIR_COUNT 0x0040 // number of entries only
+
 NTSTATUS
 RtlCliListDirectory(
-    PWCHAR CurrentDirectory);
+    PWCHAR CurrentDirectory,
+    PCWSTR Pattern,
+    ULONG Flags);
 
 NTSTATUS
 RtlCliSetCurrentDirectory(
@@ -102,6 +155,92 @@ ULONG
 RtlCliGetCurrentDirectory(
     IN OUT PWSTR CurrentDirectory);
 
+VOID
+RtlCliDisplayCopyStats(
+    IN PNT_FILE_COPY_STATS Stats);
+
+VOID
+RtlCliDisplayThroughput(
+    IN LONGLONG Bytes,
+    IN LONGLONG ElapsedTicks,
+    IN LONGLONG Frequency);
+
+NTSTATUS
+RtlCliCopyTree(
+    IN PCWSTR Source,
+    IN PCWSTR Destination,
+    IN BOOLEAN Recurse,
+    IN BOOLEAN Verify,
+    IN ULONG ThreadCount);
+
+NTSTATUS
+RtlCliBenchmarkScatterGather(
+    IN PCWSTR Path,
+    IN LONGLONG Size);
+
+NTSTATUS
+RtlCliDeleteTree(
+    IN PCWSTR Path,
+    IN BOOLEAN RemoveDirectories,
+    IN ULONG ThreadCount);
+
+NTSTATUS
+RtlCliDiskUsage(
+    IN PCWSTR Path,
+    IN ULONG MaxDepth,
+    IN BOOLEAN SortBySize,
+    IN ULONG ThreadCount);
+
+// Text search:
+
+#define FIND_MAX_PATTERN 255
+
+NTSTATUS
+RtlCliFindText(
+    IN PCSTR Text,
+    IN PCWSTR Path,
+    IN BOOLEAN Recurse,
+    IN BOOLEAN IgnoreCase,
+    IN ULONG ThreadCount);
+
+// Directory watcher:
+
+NTSTATUS
+RtlCliWatchDirectory(
+    IN HANDLE hDriver,
+    IN PCWSTR Path,
+    IN BOOLEAN Recurse);
+
+// Chunked compression:
+
+// Compression formats, not in the headers this tree includes
+#ifndef COMPRESSION_FORMAT_LZNT1
+#define COMPRESSION_FORMAT_NONE 0
+#define COMPRESSION_FORMAT_LZNT1 2
+#define COMPRESSION_FORMAT_XPRESS 3
+#define COMPRESSION_ENGINE_STANDARD 0
+#endif
+
+#define CLI_ARCHIVE_MIN_CHUNK (64 * 1024)
+#define CLI_ARCHIVE_MAX_CHUNK (16 * 1024 * 1024)
+#define CLI_ARCHIVE_DEFAULT_CHUNK (1024 * 1024)
+
+NTSTATUS
+RtlCliCompressFile(
+    IN PCWSTR Source,
+    IN PCWSTR Destination,
+    IN USHORT Format,
+    IN ULONG ChunkSize,
+    IN ULONG ThreadCount);
+
+NTSTATUS
+RtlCliExpandFile(
+    IN PCWSTR Source,
+    IN PCWSTR Destination,
+    IN LONGLONG Offset,
+    IN LONGLONG Length,
+    IN ULONG ThreadCount);
+
 // Keyboard:
 
 HANDLE hKeyboard;
@@ -116,6 +255,10 @@ typedef struct _KBD_RECORD
 
 void IntTranslateKey(PKEYBOARD_INPUT_DATA InputData, KBD_RECORD *kbd_rec);
 
+NTSTATUS
+RtlCliSetKeyboardLayout(
+    IN PCHAR Name);
+
 #define RIGHT_ALT_PRESSED 0x0001  // the right alt key is pressed.
 #define LEFT_ALT_PRESSED 0x0002   // the left alt key is pressed.
 #define RIGHT_CTRL_PRESSED 0x0004 // the right ctrl key is pressed.
@@ -131,14 +274,64 @@ void IntTranslateKey(PKEYBOARD_INPUT_DATA InputData, KBD_RECORD *kbd_rec);
 NTSTATUS CreateNativeProcess(IN PCWSTR file_name, IN PCWSTR cmd_line, OUT PHANDLE hProcess);
 
 #define BUFFER_SIZE 1024
-#define NUM_ARGS 256
+
+// Arena allocator:
+
+#define ARENA_BLOCK_SIZE 0x10000
+
+typedef struct _CLI_ARENA_BLOCK
+{
+    struct _CLI_ARENA_BLOCK *Next;
+    SIZE_T Size;
+    SIZE_T Used;
+    SIZE_T Reserved;
+} CLI_ARENA_BLOCK, *PCLI_ARENA_BLOCK;
+
+typedef struct _CLI_ARENA
+{
+    PCLI_ARENA_BLOCK Blocks;
+} CLI_ARENA, *PCLI_ARENA;
+
+VOID RtlCliArenaInit(OUT PCLI_ARENA Arena);
+PVOID RtlCliArenaAlloc(IN OUT PCLI_ARENA Arena, IN SIZE_T Size);
+VOID RtlCliArenaFree(IN OUT PCLI_ARENA Arena);
 
 // Command processing:
-#define CMDSTR(x) x, strlen(x)
-CHAR **StringToArguments(CHAR *string, UINT *argc);
+
+typedef struct _CLI_ARGUMENTS
+{
+    UINT Argc;
+    PCHAR *Argv;
+    PCSTR *Tail;
+    PCSTR Line;
+    PCLI_ARENA Arena;
+} CLI_ARGUMENTS, *PCLI_ARGUMENTS;
+
+NTSTATUS RtlCliParseArguments(IN PCSTR Line, IN OUT PCLI_ARENA Arena, OUT PCLI_ARGUMENTS Args);
+BOOLEAN RtlCliMatchSwitch(IN PCSTR Argument, IN PCSTR Name, OUT PCSTR *Value);
+BOOLEAN RtlCliParseSize(IN PCSTR String, OUT PULONGLONG Value);
+
+typedef VOID (*PCLI_COMMAND_ROUTINE)(IN UINT argc, IN CHAR **argv, IN PCLI_ARGUMENTS Args);
+
+typedef struct _CLI_COMMAND
+{
+    PCSTR Name;
+    PCSTR Arguments;
+    PCSTR Help;
+    UINT MinArgs;
+    BOOLEAN NeedsKeyboard;
+    PCLI_COMMAND_ROUTINE Routine;
+    ULONG Hash;
+    struct _CLI_COMMAND *Next;
+} CLI_COMMAND, *PCLI_COMMAND;
+
+NTSTATUS
+RtlCliRegisterCommand(
+    IN PCLI_COMMAND Command);
 
 BOOL GetFullPath(IN PCSTR filename, OUT PWSTR out, IN BOOL add_slash);
 BOOL FileExists(PCWSTR fname);
+BOOL FolderExists(PCWSTR foldername);
 
 // Registry
 
@@ -147,6 +340,112 @@ NTSTATUS RegWrite(HANDLE hKey, INT type, PWCHAR key_name, PVOID data, DWORD size
 
 NTSTATUS RegReadValue(HANDLE hKey, PWCHAR key_name, OUT PULONG type, OUT PVOID data, IN ULONG buf_size, OUT PULONG out_size);
 
+// Thread pool
+
+#define CLI_POOL_MAX_THREADS 32
+#define CLI_POOL_QUEUE_SIZE 256
+
+typedef VOID (*PCLI_WORK_ROUTINE)(IN PVOID Context);
+
+typedef struct _CLI_WORK_ITEM
+{
+    PCLI_WORK_ROUTINE Routine;
+    PVOID Context;
+} CLI_WORK_ITEM, *PCLI_WORK_ITEM;
+
+typedef struct _CLI_THREAD_POOL
+{
+    RTL_CRITICAL_SECTION Lock;
+    HANDLE ItemSemaphore;  // queued items
+    HANDLE SpaceSemaphore; // free queue entries
+    HANDLE IdleEvent;      // set while nothing is queued or running
+    HANDLE Threads[CLI_POOL_MAX_THREADS];
+    ULONG ThreadCount;
+    CLI_WORK_ITEM Queue[CLI_POOL_QUEUE_SIZE];
+    ULONG Head;
+    ULONG Count;
+    ULONG Pending; // queued plus running
+} CLI_THREAD_POOL, *PCLI_THREAD_POOL;
+
+ULONG RtlCliGetProcessorCount(VOID);
+NTSTATUS RtlCliCreateThreadPool(OUT PCLI_THREAD_POOL Pool, IN ULONG ThreadCount);
+VOID RtlCliQueueWorkItem(IN PCLI_THREAD_POOL Pool, IN PCLI_WORK_ROUTINE Routine, IN PVOID Context);
+VOID RtlCliWaitThreadPool(IN PCLI_THREAD_POOL Pool);
+VOID RtlCliDestroyThreadPool(IN PCLI_THREAD_POOL Pool);
+
+// Checksums
+
+ULONG RtlCliCrc32(IN ULONG Crc, IN PVOID Buffer, IN ULONG Length);
+PCSTR RtlCliCrc32KernelName(VOID);
+
+#define CLI_HASH_MAX_DIGEST 32
+
+typedef struct _CLI_XXH64_STATE
+{
+    ULONGLONG Total;
+    ULONGLONG Accumulators[4];
+    UCHAR Buffer[32];
+    ULONG BufferSize;
+} CLI_XXH64_STATE, *PCLI_XXH64_STATE;
+
+typedef struct _CLI_SHA256_STATE
+{
+    ULONG State[8];
+    ULONGLONG Total;
+    UCHAR Buffer[64];
+    ULONG BufferSize;
+} CLI_SHA256_STATE, *PCLI_SHA256_STATE;
+
+typedef union _CLI_HASH_CONTEXT
+{
+    ULONG Crc32;
+    CLI_XXH64_STATE Xxh64;
+    CLI_SHA256_STATE Sha256;
+} CLI_HASH_CONTEXT, *PCLI_HASH_CONTEXT;
+
+typedef struct _CLI_HASH_ALGORITHM
+{
+    PCSTR Name;
+    ULONG DigestSize; // bytes, at most CLI_HASH_MAX_DIGEST
+    VOID (*Init)(OUT PCLI_HASH_CONTEXT Context);
+    VOID (*Update)(IN OUT PCLI_HASH_CONTEXT Context, IN PVOID Buffer, IN ULONG Length);
+    VOID (*Final)(IN PCLI_HASH_CONTEXT Context, OUT PUCHAR Digest); // big endian
+    PCSTR (*KernelName)(VOID);
+} CLI_HASH_ALGORITHM, *PCLI_HASH_ALGORITHM;
+
+extern CLI_HASH_ALGORITHM RtlCliHashAlgorithms[];
+extern ULONG RtlCliHashAlgorithmCount;
+
+PCLI_HASH_ALGORITHM RtlCliFindHashAlgorithm(IN PCSTR Name);
+NTSTATUS RtlCliHashFile(IN PCWSTR Path, IN PCLI_HASH_ALGORITHM Algorithm, OUT PUCHAR Digest, OUT PLONGLONG Bytes);
+VOID RtlCliBenchmarkHashes(VOID);
+
+// Directory tree walker
+
+#define TREE_MAX_PATH 1024
+
+typedef enum _CLI_TREE_VISIT
+{
+    TreeVisitFile,
+    TreeEnterDirectory,
+    TreeLeaveDirectory,
+    TreeVisitError
+} CLI_TREE_VISIT;
+
+typedef struct _CLI_TREE_ENTRY
+{
+    PCWSTR Path;             // full DOS path
+    PCWSTR RelativePath;     // path below the root of the walk
+    ULONG Attributes;
+    LONGLONG Size;           // end of file, for TreeVisitFile
+    LONGLONG AllocationSize; // bytes allocated on disk
+    NTSTATUS Status;         // failure, for TreeVisitError
+} CLI_TREE_ENTRY, *PCLI_TREE_ENTRY;
+
+typedef NTSTATUS (*PCLI_TREE_ROUTINE)(IN CLI_TREE_VISIT Visit, IN PCLI_TREE_ENTRY Entry, IN PVOID Context);
+
+NTSTATUS RtlCliWalkTree(IN PCWSTR Root, IN BOOLEAN Recurse, IN PCLI_TREE_ROUTINE Routine, IN PVOID Context);
+
 //===========================================================
 
 // Helper Functions for ntreg.c
@@ -66,66 +66,348 @@ BOOL GetFullPath(IN PCSTR filename, OUT PWSTR out, IN BOOL add_slash)
     return TRUE;
 }
 
-// Argument processing functions:
-static CHAR *xargv[NUM_ARGS];
+/*
+ *****************************************************************************
+ * RtlCliArenaInit - Initialize an empty arena.
+ *
+ * Arena: Arena to initialize
+ *
+ * An arena hands out memory from large blocks taken from the process heap
+ * and releases everything at once in RtlCliArenaFree. It holds no global
+ * state, so every caller can use its own arena concurrently.
+ *****************************************************************************
+ */
 
-CHAR **StringToArguments(CHAR *string, UINT *argc)
+VOID RtlCliArenaInit(OUT PCLI_ARENA Arena)
 {
-    /* Extract whitespace- and quotes- delimited tokens from the given string
-       and put them into the tokens array. Returns number of tokens
-       extracted. Length specifies the current size of tokens[].
-       THIS METHOD MODIFIES string.  */
+    Arena->Blocks = NULL;
+}
 
-    const char *whitespace = " \t\r\n";
-    char *tokenEnd;
-    const char *quoteCharacters = "\"\'";
-    char *end = string + strlen(string);
-    UINT length = NUM_ARGS;
+/*
+ *****************************************************************************
+ * RtlCliArenaAlloc - Allocate memory from an arena.
+ *
+ * Arena: Arena to allocate from
+ * Size: Number of bytes
+ *
+ * Returns: Pointer aligned to 16 bytes or NULL if out of memory
+ *
+ * The heap only guarantees 8 bytes on 32-bit systems, so each block takes
+ * 15 bytes more and its data starts at the first 16-byte boundary.
+ *****************************************************************************
+ */
 
-    if ((NULL == string) || (NULL == argc) || (0 == length))
-        return NULL;
+PVOID RtlCliArenaAlloc(IN OUT PCLI_ARENA Arena, IN SIZE_T Size)
+{
+    PCLI_ARENA_BLOCK Block = Arena->Blocks;
+    SIZE_T BlockSize;
+    PUCHAR Data;
 
-    *argc = 0;
+    Size = (Size + 15) & ~(SIZE_T)15;
 
-    while (1)
+    if (!Block || Block->Size - Block->Used < Size)
     {
-        const char *q;
-        /* Skip over initial whitespace.  */
-        string += strspn(string, whitespace);
-        if (!*string)
-            break;
+        BlockSize = max(Size, ARENA_BLOCK_SIZE);
+
+        Block = RtlAllocateHeap(RtlGetProcessHeap(), 0, sizeof(CLI_ARENA_BLOCK) + BlockSize + 15);
+        if (!Block)
+            return NULL;
+
+        Block->Size = BlockSize;
+        Block->Used = 0;
+        Block->Next = Arena->Blocks;
+        Arena->Blocks = Block;
+    }
+
+    Data = (PUCHAR)(((ULONG_PTR)(Block + 1) + 15) & ~(ULONG_PTR)15);
+    Data += Block->Used;
+    Block->Used += Size;
+
+    return Data;
+}
 
-        for (q = quoteCharacters; *q; ++q)
+/*
+ *****************************************************************************
+ * RtlCliArenaFree - Release all memory of an arena.
+ *
+ * Arena: Arena to release
+ *****************************************************************************
+ */
+
+VOID RtlCliArenaFree(IN OUT PCLI_ARENA Arena)
+{
+    PCLI_ARENA_BLOCK Block;
+
+    while (Arena->Blocks)
+    {
+        Block = Arena->Blocks;
+        Arena->Blocks = Block->Next;
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Block);
+    }
+}
+
+// Argument processing functions:
+
+#define IS_ARG_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
+#define IS_ARG_QUOTE(c) ((c) == '"' || (c) == '\'')
+
+/*
+ *****************************************************************************
+ * RtlClipScanArgument - Scan one argument of a command line.
+ *
+ * Cursor: Current position, advanced past the argument
+ * Out: Receives the unquoted argument or NULL to only measure it
+ * Length: Receives the unquoted length
+ *
+ * Returns: TRUE if an argument was found, FALSE at the end of the line
+ *
+ * Quotes (" or ') may start and stop anywhere inside an argument and are
+ * removed, so a"b c"d is the single argument ab cd. Inside quotes the quote
+ * character doubled stands for itself. Backslashes are literal, except that
+ * 2n backslashes before a quote become n backslashes and 2n+1 backslashes
+ * become n backslashes and a literal quote, as in CommandLineToArgvW. Paths
+ * like C:\dir\file keep working unquoted.
+ *****************************************************************************
+ */
+
+static BOOLEAN RtlClipScanArgument(IN OUT PCSTR *Cursor, OUT PCHAR Out, OUT PULONG Length)
+{
+    PCSTR p = *Cursor;
+    CHAR Quote = 0;
+    ULONG Slashes, i;
+    ULONG Count = 0;
+
+    while (IS_ARG_SPACE(*p))
+        p++;
+
+    if (!*p)
+    {
+        *Cursor = p;
+        return FALSE;
+    }
+
+    while (*p && (Quote || !IS_ARG_SPACE(*p)))
+    {
+        if (*p == '\\')
+        {
+            Slashes = 0;
+            while (*p == '\\')
+            {
+                Slashes++;
+                p++;
+            }
+
+            if (IS_ARG_QUOTE(*p))
+            {
+                // Escaped quote characters pair the backslashes
+                for (i = 0; i < Slashes / 2; i++)
+                {
+                    if (Out)
+                        Out[Count] = '\\';
+                    Count++;
+                }
+
+                if (Slashes % 2)
+                {
+                    if (Out)
+                        Out[Count] = *p;
+                    Count++;
+                    p++;
+                }
+            }
+            else
+            {
+                for (i = 0; i < Slashes; i++)
+                {
+                    if (Out)
+                        Out[Count] = '\\';
+                    Count++;
+                }
+            }
+        }
+        else if (Quote && *p == Quote)
         {
-            if (*string == *q)
-                break;
+            if (p[1] == Quote)
+            {
+                // Doubled quote inside quotes
+                if (Out)
+                    Out[Count] = Quote;
+                Count++;
+                p += 2;
+            }
+            else
+            {
+                Quote = 0;
+                p++;
+            }
         }
-        if (*q)
+        else if (!Quote && IS_ARG_QUOTE(*p))
         {
-            /* Token is quoted.  */
-            char quote = *string++;
-            tokenEnd = strchr(string, quote);
-            /* If there is no endquote, the token is the rest of the string.  */
-            if (!tokenEnd)
-                tokenEnd = end;
+            Quote = *p++;
         }
         else
         {
-            tokenEnd = string + strcspn(string, whitespace);
+            if (Out)
+                Out[Count] = *p;
+            Count++;
+            p++;
         }
+    }
 
-        *tokenEnd = 0;
+    if (Out)
+        Out[Count] = 0;
 
-        xargv[*argc] = string;
+    *Length = Count;
+    *Cursor = p;
+    return TRUE;
+}
 
-        *argc = *argc + 1;
+/*
+ *****************************************************************************
+ * RtlCliParseArguments - Split a command line into arguments.
+ *
+ * Line: Command line, not modified
+ * Arena: Arena that receives argv and the argument strings
+ * Args: Receives the arguments
+ *
+ * Returns: STATUS_SUCCESS or STATUS_NO_MEMORY
+ *
+ * Args->Argv[Args->Argc] is NULL. Args->Tail[i] points into Line at the
+ * first character of argument i, for commands that want the rest of the
+ * line as typed. The line can be of any length and the routine is
+ * reentrant, all memory comes from Arena.
+ *****************************************************************************
+ */
 
-        if ((tokenEnd == end) || (*argc >= length))
-            break;
-        string = tokenEnd + 1;
+NTSTATUS RtlCliParseArguments(IN PCSTR Line, IN OUT PCLI_ARENA Arena, OUT PCLI_ARGUMENTS Args)
+{
+    PCSTR Cursor;
+    PCHAR Strings;
+    ULONG Length;
+    SIZE_T Total = 0;
+    UINT Count = 0;
+
+    RtlZeroMemory(Args, sizeof(CLI_ARGUMENTS));
+    Args->Line = Line;
+    Args->Arena = Arena;
+
+    // First pass: count the arguments and the space they need
+    Cursor = Line;
+    while (RtlClipScanArgument(&Cursor, NULL, &Length))
+    {
+        Total += Length + 1;
+        Count++;
+    }
+
+    Args->Argv = RtlCliArenaAlloc(Arena, (Count + 1) * sizeof(PCHAR));
+    Args->Tail = RtlCliArenaAlloc(Arena, (Count + 1) * sizeof(PCSTR));
+    Strings = RtlCliArenaAlloc(Arena, Total + 1);
+    if (!Args->Argv || !Args->Tail || !Strings)
+        return STATUS_NO_MEMORY;
+
+    // Second pass: copy them out
+    Cursor = Line;
+    while (Args->Argc < Count)
+    {
+        while (IS_ARG_SPACE(*Cursor))
+            Cursor++;
+
+        Args->Tail[Args->Argc] = Cursor;
+        Args->Argv[Args->Argc] = Strings;
+
+        RtlClipScanArgument(&Cursor, Strings, &Length);
+        Strings += Length + 1;
+        Args->Argc++;
+    }
+
+    Args->Argv[Count] = NULL;
+    Args->Tail[Count] = Cursor;
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ *****************************************************************************
+ * RtlCliMatchSwitch - Check whether an argument is a given switch.
+ *
+ * Argument: Command line argument
+ * Name: Switch name without the slash, e.g. "q"
+ * Value: Optional, receives the text after "/name:" or NULL
+ *
+ * Returns: TRUE if Argument is /name or /name:value, any case
+ *****************************************************************************
+ */
+
+BOOLEAN RtlCliMatchSwitch(IN PCSTR Argument, IN PCSTR Name, OUT PCSTR *Value)
+{
+    SIZE_T Length = strlen(Name);
+
+    if (Argument[0] != '/' || _strnicmp(Argument + 1, Name, Length))
+        return FALSE;
+
+    Argument += Length + 1;
+    if (*Argument != 0 && *Argument != ':')
+        return FALSE;
+
+    if (Value)
+        *Value = (*Argument == ':') ? Argument + 1 : NULL;
+
+    return TRUE;
+}
+
+/*
+ *****************************************************************************
+ * RtlCliParseSize - Parse a decimal number with an optional K, M or G suffix.
+ *
+ * String: Text to parse, e.g. "512", "64k", "4M"
+ * Value: Receives the number, multiplied by 1024 for each suffix step
+ *
+ * Returns: TRUE if the whole string is a valid number that fits in 64 bits
+ *****************************************************************************
+ */
+
+BOOLEAN RtlCliParseSize(IN PCSTR String, OUT PULONGLONG Value)
+{
+    ULONGLONG Result = 0;
+    ULONG Digit, Shift = 0;
+
+    if (!String || *String < '0' || *String > '9')
+        return FALSE;
+
+    while (*String >= '0' && *String <= '9')
+    {
+        Digit = *String++ - '0';
+        if (Result > (~(ULONGLONG)0 - Digit) / 10)
+            return FALSE;
+        Result = Result * 10 + Digit;
+    }
+
+    switch (*String)
+    {
+    case 'g':
+    case 'G':
+        Shift += 10;
+        // Fall through
+    case 'm':
+    case 'M':
+        Shift += 10;
+        // Fall through
+    case 'k':
+    case 'K':
+        Shift += 10;
+        String++;
+        break;
     }
 
-    return xargv;
+    if (Result > (~(ULONGLONG)0 >> Shift))
+        return FALSE;
+    Result <<= Shift;
+
+    if (*String)
+        return FALSE;
+
+    *Value = Result;
+    return TRUE;
 }
 
 /******************************************************************************\
@@ -207,7 +489,7 @@ BOOLEAN DisplayString(WCHAR *pwszData)
     if (bRet == FALSE)
         return FALSE;
 
-    NtDisplayString(&ustrData);
+    RtlCliPrintString(&ustrData);
 
     return TRUE;
 }
@@ -0,0 +1,333 @@
+/**
+ * PROJECT:         Native Shell
+ * COPYRIGHT:       LGPL; See LICENSE in the top level directory
+ * FILE:            tests/checksum/checksum_test.c
+ * DESCRIPTION:     Host test and benchmark of the checksum and hash kernels.
+ * DEVELOPERS:      See CONTRIBUTORS.md in the top level directory
+ */
+
+#include <stdio.h>
+#include <strings.h>
+#include <time.h>
+
+#include "checksum.c"
+
+#define DATA_SIZE 100000
+#define BENCH_SIZE (16 << 20)
+
+typedef struct _HASH_VECTOR
+{
+    ULONG Length; // of Pattern, or 0 with Text
+    PCSTR Text;
+    PCSTR Digest;
+} HASH_VECTOR;
+
+// Lengths around the 32 byte stripe and the last stripe and lane
+HASH_VECTOR Xxh64Vectors[] =
+{
+    { 0, "", "ef46db3751d8e999" },
+    { 0, "a", "d24ec4f1a98c6e5b" },
+    { 0, "abc", "44bc2cf5ad770999" },
+    { 1, NULL, "a96c7f0ce858bbb7" },
+    { 3, NULL, "bed43740ee6332bb" },
+    { 4, NULL, "fa212ae44b3bb23d" },
+    { 7, NULL, "2744460dd675d2c0" },
+    { 8, NULL, "994b676b71ce94dd" },
+    { 15, NULL, "09e6451ed2ff8b1d" },
+    { 16, NULL, "94ad0095e72b24d5" },
+    { 31, NULL, "6711d55e306b5d8f" },
+    { 32, NULL, "07f7b8e3bc5d6e25" },
+    { 33, NULL, "09f85eeb4e1cbe9f" },
+    { 63, NULL, "b7c9968c066cb6a5" },
+    { 64, NULL, "50d4159a0411632e" },
+    { 65, NULL, "d277176bff863efc" },
+    { 100, NULL, "9ddada11d3dc2d8f" },
+    { 1000, NULL, "0bf0bdbcc82eb373" },
+};
+
+// Lengths around the 64 byte block and the 56 byte padding limit
+HASH_VECTOR Sha256Vectors[] =
+{
+    { 0, "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+    { 0, "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+    { 1, NULL, "ca358758f6d27e6cf45272937977a748fd88391db679ceda7dc7bf1f005ee879" },
+    { 55, NULL, "16ed9c4697ca11d5f6fb25ea7900252dd4cb97215d7f6d0b2bb3e2a86ac0ec72" },
+    { 56, NULL, "939ada93b2fe1e9c596d767bb408567c83e253667f0b25e5be8e16f35f2cbac9" },
+    { 63, NULL, "6073f83b09ae82016cdbe24c18996c48f0eaa08ca675d0f6b90b807fc29e0149" },
+    { 64, NULL, "b337ba9b0c69c391364e985fdcb23a889887e59800832c92fbfa22b8a3c40304" },
+    { 65, NULL, "9d6a3fb113b586b4ab97bc11c993a27bd9b7bbcb756e0646083dc47a679600e6" },
+    { 119, NULL, "9773fbac8194c3d789af101b49b6a26073076895ef6e0f658432849dd477a43f" },
+    { 120, NULL, "070a538f085dd94821d4dc197c5c8b791051891d4fa2a1bf25d3c275236676f7" },
+    { 127, NULL, "5072b7a9a4cda7f6d80f1eff09b8b9653201dba22319daf32c6c05339d57f483" },
+    { 128, NULL, "485a94e53eba9717a5d8b7b4489cad92a752f1c5722e7dfd29dd164b7c438d11" },
+    { 129, NULL, "72b63785704123441e7405a2620b859d1f107604ef5882e2674e82cc40d173a6" },
+    { 1000, NULL, "533b698850849b7908b20a22658f639c0b2a476f1791f85f50188287c31a9aba" },
+};
+
+// Pattern[i] = i * 131 + 7, the input of the vectors without text
+UCHAR Pattern[1000];
+
+UCHAR Data[DATA_SIZE];
+ULONG CrcTable[256];
+ULONG Failures;
+
+// Keeps the benchmarked results alive
+volatile ULONG Sink;
+
+// Byte-table CRC32, the way ntdll's RtlComputeCrc32 works
+int
+_stricmp(const char *String1, const char *String2)
+{
+    return strcasecmp(String1, String2);
+}
+
+ULONG
+RtlComputeCrc32(IN ULONG Crc, IN const void *Buffer, IN ULONG Length)
+{
+    const UCHAR *Bytes = Buffer;
+
+    Crc = ~Crc;
+    while (Length--)
+        Crc = CrcTable[(Crc ^ *Bytes++) & 0xFF] ^ (Crc >> 8);
+
+    return ~Crc;
+}
+
+// Bit at a time CRC32, the reference
+ULONG
+ReferenceCrc32(IN ULONG Crc, IN const UCHAR *Bytes, IN ULONG Length)
+{
+    ULONG Bit;
+
+    Crc = ~Crc;
+    while (Length--)
+    {
+        Crc ^= *Bytes++;
+        for (Bit = 0; Bit < 8; Bit++)
+            Crc = (Crc & 1) ? (Crc >> 1) ^ 0xEDB88320 : Crc >> 1;
+    }
+
+    return ~Crc;
+}
+
+VOID
+InitData(VOID)
+{
+    ULONG i, j, Crc;
+
+    for (i = 0; i < 256; i++)
+    {
+        Crc = i;
+        for (j = 0; j < 8; j++)
+            Crc = (Crc & 1) ? (Crc >> 1) ^ 0xEDB88320 : Crc >> 1;
+        CrcTable[i] = Crc;
+    }
+
+    for (i = 0; i < sizeof(Pattern); i++)
+        Pattern[i] = (UCHAR)(i * 131 + 7);
+
+    srand(1);
+    for (i = 0; i < DATA_SIZE; i++)
+        Data[i] = (UCHAR)rand();
+}
+
+/*
+ * Checks RtlCliCrc32 with the given kernel against the reference: every
+ * length from 0 to 3000 at changing alignments, random lengths up to the
+ * whole buffer and the same data added in random pieces.
+ */
+VOID
+TestCrc32(IN LONG Kernel)
+{
+    ULONG Length, Offset, Expected, Crc, Piece;
+    PCSTR Name;
+    ULONG i;
+
+    Crc32Kernel = Kernel;
+    Name = RtlCliCrc32KernelName();
+
+    if (RtlCliCrc32(0, "123456789", 9) != 0xCBF43926)
+    {
+        printf("FAIL %s: check value %08lx\n", Name, (unsigned long)RtlCliCrc32(0, "123456789", 9));
+        Failures++;
+    }
+
+    for (Length = 0; Length <= 3000; Length++)
+    {
+        Offset = Length % 16;
+        Expected = ReferenceCrc32(Length, Data + Offset, Length);
+        if (RtlCliCrc32(Length, Data + Offset, Length) != Expected)
+        {
+            printf("FAIL %s: %lu bytes at offset %lu\n", Name, (unsigned long)Length, (unsigned long)Offset);
+            Failures++;
+            break;
+        }
+    }
+
+    for (i = 0; i < 50; i++)
+    {
+        Length = rand() % DATA_SIZE;
+        Expected = ReferenceCrc32(0, Data, Length);
+
+        if (RtlCliCrc32(0, Data, Length) != Expected)
+        {
+            printf("FAIL %s: %lu bytes\n", Name, (unsigned long)Length);
+            Failures++;
+            break;
+        }
+
+        // Chained calls give the same CRC as one call
+        Crc = 0;
+        for (Offset = 0; Offset < Length; Offset += Piece)
+        {
+            Piece = rand() % 300;
+            Piece = min(Piece, Length - Offset);
+            Crc = RtlCliCrc32(Crc, Data + Offset, Piece);
+        }
+
+        if (Crc != Expected)
+        {
+            printf("FAIL %s: %lu bytes in pieces\n", Name, (unsigned long)Length);
+            Failures++;
+            break;
+        }
+    }
+}
+
+/*
+ * Hashes the input of each vector in one update, in three pieces and a
+ * byte at a time, and compares the digests in hex.
+ */
+VOID
+TestHash(IN PCSTR Name, IN HASH_VECTOR *Vectors, IN ULONG Count)
+{
+    PCLI_HASH_ALGORITHM Algorithm = RtlCliFindHashAlgorithm(Name);
+    CLI_HASH_CONTEXT Context;
+    UCHAR Digest[CLI_HASH_MAX_DIGEST];
+    CHAR Hex[CLI_HASH_MAX_DIGEST * 2 + 1];
+    const UCHAR *Input;
+    ULONG Length, Split, i, j;
+
+    for (i = 0; i < Count; i++)
+    {
+        Input = Vectors[i].Text ? (const UCHAR *)Vectors[i].Text : Pattern;
+        Length = Vectors[i].Text ? (ULONG)strlen(Vectors[i].Text) : Vectors[i].Length;
+
+        for (Split = 0; Split < 3; Split++)
+        {
+            Algorithm->Init(&Context);
+            if (Split == 0)
+            {
+                Algorithm->Update(&Context, (PVOID)Input, Length);
+            }
+            else if (Split == 1)
+            {
+                Algorithm->Update(&Context, (PVOID)Input, Length / 3);
+                Algorithm->Update(&Context, (PVOID)(Input + Length / 3), Length / 3);
+                Algorithm->Update(&Context, (PVOID)(Input + Length / 3 * 2), Length - Length / 3 * 2);
+            }
+            else
+            {
+                for (j = 0; j < Length; j++)
+                    Algorithm->Update(&Context, (PVOID)(Input + j), 1);
+            }
+            Algorithm->Final(&Context, Digest);
+
+            for (j = 0; j < Algorithm->DigestSize; j++)
+                sprintf(Hex + j * 2, "%02x", Digest[j]);
+
+            if (strcmp(Hex, Vectors[i].Digest))
+            {
+                printf("FAIL %s of %lu bytes, %lu pieces: %s\n",
+                       Name, (unsigned long)Length, (unsigned long)(Split == 2 ? Length : Split * 2 + 1), Hex);
+                Failures++;
+            }
+        }
+    }
+}
+
+double
+Now(VOID)
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return Time.tv_sec + Time.tv_nsec / 1e9;
+}
+
+VOID
+Benchmark(VOID)
+{
+    PUCHAR Buffer = malloc(BENCH_SIZE);
+    double Start, Table = 1e9, Kernel = 1e9;
+    PCLI_HASH_ALGORITHM Algorithm;
+    CLI_HASH_CONTEXT Context;
+    UCHAR Digest[CLI_HASH_MAX_DIGEST];
+    ULONG i, j;
+
+    for (i = 0; i < BENCH_SIZE; i++)
+        Buffer[i] = (UCHAR)rand();
+
+    for (i = 0; i < 5; i++)
+    {
+        Start = Now();
+        Sink = RtlComputeCrc32(0, Buffer, BENCH_SIZE);
+        Table = min(Table, Now() - Start);
+    }
+
+    for (i = 0; i < 5; i++)
+    {
+        Start = Now();
+        Sink = RtlCliCrc32(0, Buffer, BENCH_SIZE);
+        Kernel = min(Kernel, Now() - Start);
+    }
+
+    printf("crc32 16 MB: byte table %.2f GB/s, %s kernel %.2f GB/s\n",
+           BENCH_SIZE / Table / 1073741824.0,
+           RtlCliCrc32KernelName(),
+           BENCH_SIZE / Kernel / 1073741824.0);
+
+    // The hash command's algorithms, one update of the whole buffer
+    for (j = 0; j < RtlCliHashAlgorithmCount; j++)
+    {
+        Algorithm = &RtlCliHashAlgorithms[j];
+        Kernel = 1e9;
+
+        for (i = 0; i < 5; i++)
+        {
+            Start = Now();
+            Algorithm->Init(&Context);
+            Algorithm->Update(&Context, Buffer, BENCH_SIZE);
+            Algorithm->Final(&Context, Digest);
+            Kernel = min(Kernel, Now() - Start);
+        }
+
+        printf("%-6s 16 MB: %.2f GB/s\n", Algorithm->Name, BENCH_SIZE / Kernel / 1073741824.0);
+    }
+
+    free(Buffer);
+}
+
+int
+main(int argc, char **argv)
+{
+    InitData();
+
+    if (argc > 1 && !strcmp(argv[1], "/bench"))
+    {
+        Benchmark();
+        return 0;
+    }
+
+    TestCrc32(CRC32_KERNEL_PORTABLE);
+    if (RtlClipSelectCrc32Kernel() == CRC32_KERNEL_PCLMUL)
+        TestCrc32(CRC32_KERNEL_PCLMUL);
+    else
+        printf("no PCLMULQDQ, only the portable kernel was tested\n");
+
+    TestHash("xxh64", Xxh64Vectors, RTL_NUMBER_OF(Xxh64Vectors));
+    TestHash("sha256", Sha256Vectors, RTL_NUMBER_OF(Sha256Vectors));
+
+    printf("checksum: %s\n", Failures ? "FAILED" : "ok");
+    return Failures ? 1 : 0;
+}
@@ -0,0 +1,371 @@
+/**
+ * PROJECT:         Native Shell
+ * COPYRIGHT:       LGPL; See LICENSE in the top level directory
+ * FILE:            tests/copy/copy_test.c
+ * DESCRIPTION:     Host test and benchmark of the synchronous copy engine.
+ * DEVELOPERS:      See CONTRIBUTORS.md in the top level directory
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "copy.c"
+
+/*
+ * File handles are host file descriptors. Reads and writes without an
+ * offset use the file position, like a handle opened for synchronous I/O.
+ */
+#define FD(Handle) ((int)(LONG_PTR)(Handle))
+#define HANDLE_OF(File) ((HANDLE)(LONG_PTR)fileno(File))
+
+ULONG Reads, Writes;
+ULONG CrcTable[256];
+ULONG Failures;
+
+NTSTATUS
+NtReadFile(IN HANDLE FileHandle,
+           IN HANDLE Event,
+           IN PIO_APC_ROUTINE ApcRoutine,
+           IN PVOID ApcContext,
+           OUT PIO_STATUS_BLOCK IoStatusBlock,
+           OUT PVOID Buffer,
+           IN ULONG Length,
+           IN PLARGE_INTEGER ByteOffset,
+           IN PULONG Key)
+{
+    ssize_t Result;
+
+    Reads++;
+    if (ByteOffset)
+        Result = pread(FD(FileHandle), Buffer, Length, ByteOffset->QuadPart);
+    else
+        Result = read(FD(FileHandle), Buffer, Length);
+
+    if (Result < 0)
+        return STATUS_UNSUCCESSFUL;
+    if (Result == 0)
+        return STATUS_END_OF_FILE;
+
+    IoStatusBlock->Status = STATUS_SUCCESS;
+    IoStatusBlock->Information = (ULONG_PTR)Result;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+NtWriteFile(IN HANDLE FileHandle,
+            IN HANDLE Event,
+            IN PIO_APC_ROUTINE ApcRoutine,
+            IN PVOID ApcContext,
+            OUT PIO_STATUS_BLOCK IoStatusBlock,
+            IN PVOID Buffer,
+            IN ULONG Length,
+            IN PLARGE_INTEGER ByteOffset,
+            IN PULONG Key)
+{
+    ssize_t Result;
+
+    Writes++;
+    if (ByteOffset)
+        Result = pwrite(FD(FileHandle), Buffer, Length, ByteOffset->QuadPart);
+    else
+        Result = write(FD(FileHandle), Buffer, Length);
+
+    if (Result < 0)
+        return STATUS_UNSUCCESSFUL;
+
+    IoStatusBlock->Status = STATUS_SUCCESS;
+    IoStatusBlock->Information = (ULONG_PTR)Result;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+NtAllocateVirtualMemory(IN HANDLE ProcessHandle,
+                        IN OUT PVOID *BaseAddress,
+                        IN ULONG_PTR ZeroBits,
+                        IN OUT PSIZE_T RegionSize,
+                        IN ULONG AllocationType,
+                        IN ULONG Protect)
+{
+    return posix_memalign(BaseAddress, PAGE_SIZE, *RegionSize) ? STATUS_NO_MEMORY : STATUS_SUCCESS;
+}
+
+NTSTATUS
+NtFreeVirtualMemory(IN HANDLE ProcessHandle,
+                    IN OUT PVOID *BaseAddress,
+                    IN OUT PSIZE_T RegionSize,
+                    IN ULONG FreeType)
+{
+    free(*BaseAddress);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+__cdecl RtlCliDisplayString(IN PCH Message, ...)
+{
+    printf("message: %s", Message);
+    return STATUS_SUCCESS;
+}
+
+// Byte-wise CRC32, checksum.c is tested on its own
+ULONG
+RtlCliCrc32(IN ULONG Crc, IN PVOID Buffer, IN ULONG Length)
+{
+    PUCHAR Data = Buffer;
+
+    Crc = ~Crc;
+    while (Length--)
+        Crc = CrcTable[(Crc ^ *Data++) & 0xFF] ^ (Crc >> 8);
+
+    return ~Crc;
+}
+
+VOID
+InitCrcTable(VOID)
+{
+    ULONG i, j, Crc;
+
+    for (i = 0; i < 256; i++)
+    {
+        Crc = i;
+        for (j = 0; j < 8; j++)
+            Crc = (Crc & 1) ? (Crc >> 1) ^ 0xEDB88320 : Crc >> 1;
+        CrcTable[i] = Crc;
+    }
+}
+
+/*
+ * Returns a temporary file holding Size bytes of a pattern that differs
+ * between pages, positioned at its start.
+ */
+FILE *
+CreateSource(IN LONGLONG Size)
+{
+    static UCHAR Block[1 << 20];
+    FILE *File = tmpfile();
+    LONGLONG Offset;
+    size_t Length;
+    ULONG i;
+
+    for (Offset = 0; Offset < Size; Offset += Length)
+    {
+        for (i = 0; i < sizeof(Block); i++)
+            Block[i] = (UCHAR)((Offset + i) * 31 + (Offset + i) / PAGE_SIZE);
+
+        Length = (size_t)min(Size - Offset, (LONGLONG)sizeof(Block));
+        fwrite(Block, 1, Length, File);
+    }
+
+    fflush(File);
+    rewind(File);
+    return File;
+}
+
+BOOLEAN
+SameContents(IN FILE *First, IN FILE *Second)
+{
+    static UCHAR Block1[1 << 16], Block2[1 << 16];
+    size_t Length1, Length2;
+
+    rewind(First);
+    rewind(Second);
+
+    do
+    {
+        Length1 = fread(Block1, 1, sizeof(Block1), First);
+        Length2 = fread(Block2, 1, sizeof(Block2), Second);
+        if (Length1 != Length2 || memcmp(Block1, Block2, Length1))
+            return FALSE;
+    } while (Length1);
+
+    return TRUE;
+}
+
+/*
+ * Copies a Size byte file in ChunkSize transfers, or with the size
+ * NtFileCopyBufferSize picks if ChunkSize is 0, and checks the copy, the
+ * CRC and the number of transfers.
+ */
+VOID
+TestCopy(IN LONGLONG Size, IN ULONG ChunkSize)
+{
+    FILE *Source = CreateSource(Size);
+    FILE *Destination = tmpfile();
+    LONGLONG Copied;
+    ULONG Crc, Chunks;
+
+    if (!ChunkSize)
+        ChunkSize = NtFileCopyBufferSize(Size);
+
+    Reads = Writes = 0;
+    if (!NtFileCopySynchronous(HANDLE_OF(Source), HANDLE_OF(Destination), &ChunkSize, &Copied, &Crc, FALSE))
+    {
+        printf("FAIL %lld bytes: copy failed\n", Size);
+        Failures++;
+    }
+    else
+    {
+        Chunks = (ULONG)((Size + ChunkSize - 1) / ChunkSize);
+
+        rewind(Source);
+        if (Copied != Size || !SameContents(Source, Destination))
+        {
+            printf("FAIL %lld bytes: %lld copied, contents differ\n", Size, Copied);
+            Failures++;
+        }
+        else if (Writes != Chunks || Reads != Chunks + 1)
+        {
+            printf("FAIL %lld bytes: %lu reads and %lu writes of %lu bytes\n",
+                   Size, (unsigned long)Reads, (unsigned long)Writes, (unsigned long)ChunkSize);
+            Failures++;
+        }
+    }
+
+    // The CRC is of the data that was read
+    if (Size <= (1 << 20))
+    {
+        static UCHAR Data[1 << 20];
+
+        rewind(Source);
+        fread(Data, 1, (size_t)Size, Source);
+        if (Crc != RtlCliCrc32(0, Data, (ULONG)Size))
+        {
+            printf("FAIL %lld bytes: CRC %08lx\n", Size, (unsigned long)Crc);
+            Failures++;
+        }
+    }
+
+    fclose(Source);
+    fclose(Destination);
+}
+
+VOID
+ExpectBufferSize(IN LONGLONG FileSize, IN ULONG Expected)
+{
+    ULONG Size = NtFileCopyBufferSize(FileSize);
+
+    if (Size != Expected)
+    {
+        printf("FAIL buffer for %lld bytes: %lu, expected %lu\n",
+               FileSize, (unsigned long)Size, (unsigned long)Expected);
+        Failures++;
+    }
+}
+
+VOID
+TestBufferSize(VOID)
+{
+    ExpectBufferSize(0, 4096);
+    ExpectBufferSize(1, 4096);
+    ExpectBufferSize(4097, 8192);
+    ExpectBufferSize(COPY_MIN_BUFFER - 1, COPY_MIN_BUFFER);
+    ExpectBufferSize(64 * (LONGLONG)COPY_MIN_BUFFER, COPY_MIN_BUFFER);
+    ExpectBufferSize(64 * (LONGLONG)COPY_MIN_BUFFER + 64, 2 * COPY_MIN_BUFFER);
+    ExpectBufferSize((LONGLONG)256 << 20, 4 << 20);
+    ExpectBufferSize((LONGLONG)64 << 30, COPY_MAX_BUFFER);
+}
+
+/*
+ * The copy loop the shell had before: an 8 KB stack buffer, stopping at
+ * the size seen at open.
+ */
+BOOLEAN
+StackBufferCopy(IN HANDLE Source, IN HANDLE Destination, IN LONGLONG Size)
+{
+    UCHAR Buffer[8192];
+    IO_STATUS_BLOCK IoStatus;
+    LONGLONG Total = 0;
+
+    while (Total < Size)
+    {
+        if (!NT_SUCCESS(NtReadFile(Source, NULL, NULL, NULL, &IoStatus, Buffer, sizeof(Buffer), NULL, NULL)))
+            return FALSE;
+        if (!NT_SUCCESS(NtWriteFile(Destination, NULL, NULL, NULL, &IoStatus, Buffer, (ULONG)IoStatus.Information, NULL, NULL)))
+            return FALSE;
+        Total += IoStatus.Information;
+    }
+
+    return TRUE;
+}
+
+double
+Now(VOID)
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return Time.tv_sec + Time.tv_nsec / 1e9;
+}
+
+VOID
+Benchmark(VOID)
+{
+    LONGLONG Sizes[] = { 64 << 10, 4 << 20, (LONGLONG)256 << 20 };
+    FILE *Source, *Destination;
+    ULONG OldCalls = 0, NewCalls = 0, ChunkSize = 0;
+    LONGLONG Copied;
+    double Start, OldTime, NewTime;
+    ULONG i, Run;
+
+    for (i = 0; i < RTL_NUMBER_OF(Sizes); i++)
+    {
+        Source = CreateSource(Sizes[i]);
+        OldTime = NewTime = 1e9;
+
+        // Best of three, the file stays in the page cache
+        for (Run = 0; Run < 3; Run++)
+        {
+            Destination = tmpfile();
+            rewind(Source);
+            Reads = Writes = 0;
+            Start = Now();
+            StackBufferCopy(HANDLE_OF(Source), HANDLE_OF(Destination), Sizes[i]);
+            OldTime = min(OldTime, Now() - Start);
+            OldCalls = Reads + Writes;
+            fclose(Destination);
+
+            Destination = tmpfile();
+            rewind(Source);
+            Reads = Writes = 0;
+            ChunkSize = NtFileCopyBufferSize(Sizes[i]);
+            Start = Now();
+            NtFileCopySynchronous(HANDLE_OF(Source), HANDLE_OF(Destination), &ChunkSize, &Copied, NULL, FALSE);
+            NewTime = min(NewTime, Now() - Start);
+            NewCalls = Reads + Writes;
+            fclose(Destination);
+        }
+
+        printf("%8lld KB: 8 KB loop %6lu calls %7.1f MB/s | %5lu KB buffer %4lu calls %7.1f MB/s\n",
+               Sizes[i] >> 10,
+               (unsigned long)OldCalls, Sizes[i] / 1048576.0 / OldTime,
+               (unsigned long)(ChunkSize >> 10),
+               (unsigned long)NewCalls, Sizes[i] / 1048576.0 / NewTime);
+
+        fclose(Source);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    InitCrcTable();
+
+    if (argc > 1 && !strcmp(argv[1], "/bench"))
+    {
+        Benchmark();
+        return 0;
+    }
+
+    TestBufferSize();
+
+    TestCopy(0, 0);
+    TestCopy(1, 0);
+    TestCopy(4095, 0);
+    TestCopy(4096, 0);
+    TestCopy(65537, 0);
+    TestCopy((3 << 20) + 5, 0);
+    TestCopy(100000, 4096);
+
+    printf("copy: %s\n", Failures ? "FAILED" : "ok");
+    return Failures ? 1 : 0;
+}
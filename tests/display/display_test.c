@@ -0,0 +1,284 @@
+/**
+ * PROJECT:         Native Shell
+ * COPYRIGHT:       LGPL; See LICENSE in the top level directory
+ * FILE:            tests/display/display_test.c
+ * DESCRIPTION:     Host test and benchmark of the display output path.
+ * DEVELOPERS:      See CONTRIBUTORS.md in the top level directory
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "display.c"
+
+// Everything sent to NtDisplayString since the last check
+WCHAR Captured[0x10000];
+ULONG CapturedLength;
+ULONG Calls;
+
+// Heap allocations and frees, for the benchmark
+ULONG HeapOperations;
+
+ULONG Failures;
+
+NTSTATUS
+NtDisplayString(IN PUNICODE_STRING String)
+{
+    ULONG Length = String->Length / sizeof(WCHAR);
+
+    if (CapturedLength + Length <= RTL_NUMBER_OF(Captured))
+        RtlCopyMemory(Captured + CapturedLength, String->Buffer, String->Length);
+    CapturedLength += Length;
+    Calls++;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+RtlMultiByteToUnicodeN(OUT PWCH UnicodeString,
+                       IN ULONG MaxBytesInUnicodeString,
+                       OUT PULONG BytesInUnicodeString,
+                       IN const CHAR *MultiByteString,
+                       IN ULONG BytesInMultiByteString)
+{
+    ULONG i;
+
+    for (i = 0; i < BytesInMultiByteString && i < MaxBytesInUnicodeString / sizeof(WCHAR); i++)
+        UnicodeString[i] = (UCHAR)MultiByteString[i];
+    if (BytesInUnicodeString)
+        *BytesInUnicodeString = i * sizeof(WCHAR);
+
+    return STATUS_SUCCESS;
+}
+
+PVOID
+RtlAllocateHeap(IN HANDLE HeapHandle, IN ULONG Flags, IN SIZE_T Size)
+{
+    HeapOperations++;
+    return malloc(Size);
+}
+
+BOOLEAN
+RtlFreeHeap(IN HANDLE HeapHandle, IN ULONG Flags, IN PVOID BaseAddress)
+{
+    HeapOperations++;
+    free(BaseAddress);
+    return TRUE;
+}
+
+HANDLE
+RtlGetProcessHeap(VOID)
+{
+    return NULL;
+}
+
+BOOLEAN
+RtlCreateUnicodeStringFromAsciiz(OUT PUNICODE_STRING Destination, IN PCSZ Source)
+{
+    ULONG Length = (ULONG)strlen(Source);
+    ULONG i;
+
+    Destination->Buffer = RtlAllocateHeap(RtlGetProcessHeap(), 0, (Length + 1) * sizeof(WCHAR));
+    for (i = 0; i <= Length; i++)
+        Destination->Buffer[i] = (UCHAR)Source[i];
+    Destination->Length = (USHORT)(Length * sizeof(WCHAR));
+    Destination->MaximumLength = Destination->Length + sizeof(WCHAR);
+
+    return TRUE;
+}
+
+VOID
+RtlFreeUnicodeString(IN PUNICODE_STRING UnicodeString)
+{
+    RtlFreeHeap(RtlGetProcessHeap(), 0, UnicodeString->Buffer);
+}
+
+int
+_vsnprintf(char *Buffer, size_t Count, const char *Format, va_list Arguments)
+{
+    return vsnprintf(Buffer, Count, Format, Arguments);
+}
+
+NTSTATUS RtlInitializeCriticalSection(PRTL_CRITICAL_SECTION CriticalSection) { return STATUS_SUCCESS; }
+NTSTATUS RtlEnterCriticalSection(PRTL_CRITICAL_SECTION CriticalSection) { return STATUS_SUCCESS; }
+NTSTATUS RtlLeaveCriticalSection(PRTL_CRITICAL_SECTION CriticalSection) { return STATUS_SUCCESS; }
+
+/*
+ * RtlCliDisplayString as it was before the formatter: a 512 byte heap
+ * buffer, _vsnprintf and a second heap copy for the UNICODE_STRING.
+ */
+NTSTATUS
+__cdecl HeapDisplayString(IN PCH Message, ...)
+{
+    va_list MessageList;
+    PCHAR MessageBuffer;
+    UNICODE_STRING MessageString;
+    NTSTATUS Status;
+
+    MessageBuffer = RtlAllocateHeap(RtlGetProcessHeap(), 0, 512);
+
+    va_start(MessageList, Message);
+    _vsnprintf(MessageBuffer, 512, Message, MessageList);
+    va_end(MessageList);
+
+    RtlCreateUnicodeStringFromAsciiz(&MessageString, MessageBuffer);
+    Status = RtlCliPrintString(&MessageString);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, MessageBuffer);
+    RtlFreeUnicodeString(&MessageString);
+
+    return Status;
+}
+
+/*
+ * Compares the captured output with Text and the number of NtDisplayString
+ * calls with ExpectedCalls, then starts a new capture.
+ */
+VOID
+Expect(IN PCSTR Name, IN PCSTR Text, IN ULONG ExpectedCalls)
+{
+    ULONG Length = (ULONG)strlen(Text);
+    ULONG i;
+
+    for (i = 0; i < Length && i < CapturedLength; i++)
+    {
+        if (Captured[i] != (UCHAR)Text[i])
+            break;
+    }
+
+    if (i != Length || CapturedLength != Length || Calls != ExpectedCalls)
+    {
+        printf("FAIL %s: %lu of %lu characters match, %lu calls, expected %lu\n",
+               Name, (unsigned long)i, (unsigned long)Length,
+               (unsigned long)Calls, (unsigned long)ExpectedCalls);
+        Failures++;
+    }
+
+    CapturedLength = 0;
+    Calls = 0;
+}
+
+VOID
+TestLines(VOID)
+{
+    static CHAR Long[5002];
+
+    RtlCliDisplayString("hello %s\n", "world");
+    Expect("one line", "hello world\n", 1);
+
+    RtlCliDisplayString("a\nbb\nccc\n");
+    Expect("three lines", "a\nbb\nccc\n", 3);
+
+    // A partial line waits for the flush
+    RtlCliDisplayString("prompt> ");
+    Expect("partial line", "", 0);
+    RtlCliFlush();
+    Expect("flushed line", "prompt> ", 1);
+
+    RtlCliFlush();
+    Expect("empty flush", "", 0);
+
+    // A line longer than the output buffer goes out in two calls
+    memset(Long, 'x', 5000);
+    Long[5000] = '\n';
+    RtlCliDisplayString("%s", Long);
+    Expect("long line", Long, 2);
+}
+
+VOID
+TestFormat(VOID)
+{
+    static CHAR Long[2002];
+    CHAR Counted[4] = { 'a', 'b', 'c', 'd' };
+
+    RtlCliDisplayString("%d|%5d|%-5d|%05d|%.3d\n", -42, 42, 42, 42, 5);
+    Expect("%d", "-42|   42|42   |00042|005\n", 1);
+
+    RtlCliDisplayString("%u %x %X %08x %*d|%-*d|\n", 4000000000u, 0xbeef, 0xbeef, 0x1a, 4, 7, 4, 7);
+    Expect("%u %x", "4000000000 beef BEEF 0000001a    7|7   |\n", 1);
+
+    RtlCliDisplayString("%I64u %I64d %llx\n",
+                        ~(ULONGLONG)0, -MAXLONGLONG - 1, ~(ULONGLONG)0);
+    Expect("%I64u", "18446744073709551615 -9223372036854775808 ffffffffffffffff\n", 1);
+
+    RtlCliDisplayString("%c%C%%\n", 'a', L'b');
+    Expect("%c", "ab%\n", 1);
+
+    RtlCliDisplayString("[%s] [%6s] [%-6s] [%.2s] [%s]\n", "abc", "abc", "abc", "abc", NULL);
+    Expect("%s", "[abc] [   abc] [abc   ] [ab] [(null)]\n", 1);
+
+    RtlCliDisplayString("[%S] [%.*S] [%5S]\n", L"wide", 3, L"wider", L"w");
+    Expect("%S", "[wide] [wid] [    w]\n", 1);
+
+    // Counted strings need no terminator
+    RtlCliDisplayString("[%.*s]\n", 4, Counted);
+    Expect("%.*s", "[abcd]\n", 1);
+
+    // The old path cut lines at 511 characters
+    memset(Long, 'y', 2000);
+    Long[2000] = '\n';
+    RtlCliDisplayString("%s", Long);
+    Expect("2000 characters", Long, 1);
+}
+
+/*
+ * Prints dir and tlist style listings through Display and reports the
+ * NtDisplayString calls and heap operations per line.
+ */
+VOID
+Benchmark(IN PCSTR Name, IN NTSTATUS (__cdecl *Display)(IN PCH Message, ...))
+{
+    ULONG Lines = 0, Characters = 0;
+    clock_t Start;
+    double Seconds;
+    int Round, i;
+
+    Calls = 0;
+    HeapOperations = 0;
+    Start = clock();
+
+    for (Round = 0; Round < 200; Round++)
+    {
+        for (i = 0; i < 100; i++)
+        {
+            Display("%02d.%02d.%04d  %02d:%02d %12u %s\n",
+                    i % 28 + 1, i % 12 + 1, 2024, i % 24, i % 60,
+                    i * 1234567u, "some_file_name.txt");
+            Lines++;
+        }
+
+        for (i = 0; i < 50; i++)
+        {
+            Display("%5u %-24s %4u %8u K\n", i * 4, "process.exe", i % 40, i * 1000u);
+            Lines++;
+        }
+
+        Characters += CapturedLength;
+        CapturedLength = 0;
+    }
+
+    Seconds = (double)(clock() - Start) / CLOCKS_PER_SEC;
+
+    printf("%-9s %lu lines, %lu characters: %.2f NtDisplayString calls and %.2f heap operations per line, %.0f ns per line\n",
+           Name, (unsigned long)Lines, (unsigned long)Characters,
+           (double)Calls / Lines, (double)HeapOperations / Lines, Seconds * 1e9 / Lines);
+}
+
+int
+main(int argc, char **argv)
+{
+    RtlCliInitializeDisplay();
+
+    if (argc > 1 && !strcmp(argv[1], "/bench"))
+    {
+        Benchmark("heap", HeapDisplayString);
+        Benchmark("formatter", RtlCliDisplayString);
+        return 0;
+    }
+
+    TestLines();
+    TestFormat();
+
+    printf("display: %s\n", Failures ? "FAILED" : "ok");
+    return Failures ? 1 : 0;
+}
@@ -0,0 +1,17 @@
+#
+# Host build of the shell sources for the tests in the subdirectories.
+#
+# A test includes one shell source file and compiles it with gcc against
+# the stand-in headers in include/. It defines the system routines that
+# code reaches itself; everything else is dropped by the linker.
+#
+
+HOST_DIR := $(dir $(lastword $(MAKEFILE_LIST)))
+
+CC = gcc
+CFLAGS = -std=gnu89 -O2 -fshort-wchar -fms-extensions -fcommon \
+         -ffunction-sections -fdata-sections \
+         -I$(HOST_DIR)include -I$(HOST_DIR)..
+LDFLAGS = -Wl,--gc-sections
+
+HOST_HEADERS = $(wildcard $(HOST_DIR)include/*.h) $(HOST_DIR)../precomp.h
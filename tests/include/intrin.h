@@ -0,0 +1,5 @@
+/* Host stand-in for the MSVC __cpuid intrinsic. */
+#include <cpuid.h>
+static __inline void __cpuid_msvc(int *r, int leaf) { __cpuid_count(leaf, 0, r[0], r[1], r[2], r[3]); }
+#undef __cpuid
+#define __cpuid(r, l) __cpuid_msvc(r, l)
@@ -0,0 +1,438 @@
+/**
+ * PROJECT:         Native Shell
+ * COPYRIGHT:       LGPL; See LICENSE in the top level directory
+ * FILE:            tests/include/ntndk.h
+ * DESCRIPTION:     Host stand-in for the NDK headers, used by the tests.
+ * DEVELOPERS:      See CONTRIBUTORS.md in the top level directory
+ */
+
+/*
+ * Just enough of the NT types, constants and prototypes for the shell
+ * sources to compile with gcc -fshort-wchar -fms-extensions on a host.
+ * Each test defines the routines it calls; nothing here is implemented.
+ */
+
+#ifndef HOST_NTNDK_H
+#define HOST_NTNDK_H
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#define __cdecl
+#define __stdcall
+#define NTAPI
+#define __inline inline
+#define UNALIGNED
+#define __forceinline inline
+#define __int64 long long
+#define IN
+#define OUT
+#define OPTIONAL
+#define CONST const
+#define VOID void
+typedef void *PVOID, *LPVOID, *HANDLE, **PHANDLE;
+typedef char CHAR, *PCHAR, *PCH, *PSTR, *LPSTR;
+typedef const char *PCSTR, *LPCSTR, *PCSZ;
+typedef unsigned char UCHAR, *PUCHAR, BYTE, *PBYTE, BOOLEAN, *PBOOLEAN;
+typedef wchar_t WCHAR, *PWCHAR, *PWSTR, *LPWSTR, *PWCH;
+typedef const wchar_t *PCWSTR, *LPCWSTR, *PCWCH;
+typedef short SHORT, CSHORT;
+typedef unsigned short USHORT, *PUSHORT, WORD;
+typedef int INT, BOOL, *PINT;
+typedef unsigned int UINT, *PUINT;
+typedef int LONG, *PLONG, NTSTATUS, KPRIORITY;
+typedef unsigned int ULONG, *PULONG, DWORD, *PDWORD, *LPDWORD, ACCESS_MASK;
+typedef long long LONGLONG, *PLONGLONG;
+typedef unsigned long long ULONGLONG, *PULONGLONG, ULONG64, DWORD64;
+typedef unsigned long ULONG_PTR, SIZE_T, *PSIZE_T, *PULONG_PTR, DWORD_PTR;
+typedef long LONG_PTR;
+typedef double DOUBLE;
+typedef union _LARGE_INTEGER { struct { ULONG LowPart; LONG HighPart; }; LONGLONG QuadPart; } LARGE_INTEGER, *PLARGE_INTEGER;
+typedef union _ULARGE_INTEGER { struct { ULONG LowPart; ULONG HighPart; }; ULONGLONG QuadPart; } ULARGE_INTEGER, *PULARGE_INTEGER;
+#define TRUE 1
+#define FALSE 0
+#define MAX_PATH 260
+#define MAXULONG 0xffffffffUL
+#define MAXLONG 0x7fffffffL
+#define MAXUSHORT 0xffff
+#define MAXLONGLONG 0x7fffffffffffffffLL
+#define PAGE_SIZE 0x1000
+#define ANSI_NULL ((CHAR)0)
+#define UNICODE_NULL ((WCHAR)0)
+#define NT_SUCCESS(s) (((NTSTATUS)(s)) >= 0)
+#define STATUS_SUCCESS ((NTSTATUS)0)
+#define STATUS_PENDING ((NTSTATUS)0x103)
+#define STATUS_TIMEOUT ((NTSTATUS)0x102)
+#define STATUS_WAIT_0 ((NTSTATUS)0)
+#define STATUS_WAIT_1 ((NTSTATUS)0x00000001L)
+#define STATUS_USER_APC ((NTSTATUS)0xC0)
+#define STATUS_ALERTED ((NTSTATUS)0x101)
+#define STATUS_BUFFER_OVERFLOW ((NTSTATUS)0x80000005L)
+#define STATUS_NO_MORE_FILES ((NTSTATUS)0x80000006L)
+#define STATUS_NO_SUCH_FILE ((NTSTATUS)0xC000000FL)
+#define STATUS_NAME_TOO_LONG ((NTSTATUS)0xC0000106L)
+#define STATUS_NOTIFY_ENUM_DIR ((NTSTATUS)0x10C)
+#define STATUS_BUFFER_ALL_ZEROS ((NTSTATUS)0x00000117L)
+#define STATUS_UNSUCCESSFUL ((NTSTATUS)0xC0000001L)
+#define STATUS_NOT_IMPLEMENTED ((NTSTATUS)0xC0000002L)
+#define STATUS_INVALID_PARAMETER ((NTSTATUS)0xC000000DL)
+#define STATUS_END_OF_FILE ((NTSTATUS)0xC0000011L)
+#define STATUS_NO_MEMORY ((NTSTATUS)0xC0000017L)
+#define STATUS_INSUFFICIENT_RESOURCES ((NTSTATUS)0xC000009AL)
+#define STATUS_OBJECT_NAME_COLLISION ((NTSTATUS)0xC0000035L)
+#define STATUS_OBJECT_NAME_NOT_FOUND ((NTSTATUS)0xC0000034L)
+#define STATUS_BUFFER_TOO_SMALL ((NTSTATUS)0xC0000023L)
+#define STATUS_INVALID_DEVICE_REQUEST ((NTSTATUS)0xC0000010L)
+#define STATUS_NOT_SUPPORTED ((NTSTATUS)0xC00000BBL)
+#define STATUS_DATA_ERROR ((NTSTATUS)0xC000003EL)
+#define STATUS_CRC_ERROR ((NTSTATUS)0xC000003FL)
+#define STATUS_MAPPED_FILE_SIZE_ZERO ((NTSTATUS)0xC000011EL)
+#define STATUS_FILE_INVALID ((NTSTATUS)0xC0000098L)
+#define STATUS_DIRECTORY_NOT_EMPTY ((NTSTATUS)0xC0000101L)
+#define STATUS_CANNOT_DELETE ((NTSTATUS)0xC0000121L)
+#define STATUS_CANCELLED ((NTSTATUS)0xC0000120L)
+#define STATUS_UNSUPPORTED_COMPRESSION ((NTSTATUS)0xC000025FL)
+#define STATUS_BAD_COMPRESSION_BUFFER ((NTSTATUS)0xC0000242L)
+#define STATUS_INVALID_DEVICE_STATE ((NTSTATUS)0xC0000184L)
+#define STATUS_NOT_A_DIRECTORY ((NTSTATUS)0xC0000103L)
+#define STATUS_FILE_IS_A_DIRECTORY ((NTSTATUS)0xC00000BAL)
+#define STATUS_DISK_FULL ((NTSTATUS)0xC000007FL)
+#define STATUS_INTEGER_OVERFLOW ((NTSTATUS)0xC0000095L)
+#define STATUS_FILE_CORRUPT_ERROR ((NTSTATUS)0xC0000102L)
+#define STATUS_OBJECT_PATH_NOT_FOUND ((NTSTATUS)0xC000003AL)
+typedef struct _UNICODE_STRING { USHORT Length; USHORT MaximumLength; PWSTR Buffer; } UNICODE_STRING, *PUNICODE_STRING;
+typedef const UNICODE_STRING *PCUNICODE_STRING;
+typedef struct _STRING { USHORT Length; USHORT MaximumLength; PCHAR Buffer; } ANSI_STRING, *PANSI_STRING, STRING, *PSTRING;
+#define RTL_CONSTANT_STRING(s) { sizeof(s) - sizeof((s)[0]), sizeof(s), s }
+typedef struct _OBJECT_ATTRIBUTES { ULONG Length; HANDLE RootDirectory; PUNICODE_STRING ObjectName; ULONG Attributes; PVOID SecurityDescriptor; PVOID SecurityQualityOfService; } OBJECT_ATTRIBUTES, *POBJECT_ATTRIBUTES;
+#define InitializeObjectAttributes(p,n,a,r,s) { (p)->Length = sizeof(OBJECT_ATTRIBUTES); (p)->RootDirectory = r; (p)->Attributes = a; (p)->ObjectName = n; (p)->SecurityDescriptor = s; (p)->SecurityQualityOfService = NULL; }
+#define OBJ_CASE_INSENSITIVE 0x40
+typedef struct _IO_STATUS_BLOCK { union { NTSTATUS Status; PVOID Pointer; }; ULONG_PTR Information; } IO_STATUS_BLOCK, *PIO_STATUS_BLOCK;
+typedef VOID (*PIO_APC_ROUTINE)(PVOID, PIO_STATUS_BLOCK, ULONG);
+typedef struct _KEYBOARD_INPUT_DATA { USHORT UnitId; USHORT MakeCode; USHORT Flags; USHORT Reserved; ULONG ExtraInformation; } KEYBOARD_INPUT_DATA, *PKEYBOARD_INPUT_DATA;
+#define KEY_MAKE 0
+#define KEY_BREAK 1
+#define KEY_E0 2
+#define KEY_E1 4
+typedef struct _CLIENT_ID { HANDLE UniqueProcess; HANDLE UniqueThread; } CLIENT_ID, *PCLIENT_ID;
+typedef struct _FILE_SEGMENT_ELEMENT { ULONGLONG Alignment; } FILE_SEGMENT_ELEMENT, *PFILE_SEGMENT_ELEMENT;
+#define PtrToPtr64(p) ((void*)(p))
+#define RtlZeroMemory(d,l) memset((d),0,(l))
+#define RtlFillMemory(d,l,f) memset((d),(f),(l))
+#define RtlCopyMemory(d,s,l) memcpy((d),(s),(l))
+#define RtlMoveMemory(d,s,l) memmove((d),(s),(l))
+#define RtlCompareMemory(a,b,l) ((SIZE_T)(l))
+#define RtlEqualMemory(a,b,l) (!memcmp((a),(b),(l)))
+#define FIELD_OFFSET(t,f) ((LONG)offsetof(t,f))
+#define RTL_NUMBER_OF(a) (sizeof(a)/sizeof((a)[0]))
+#define ARRAYSIZE(a) RTL_NUMBER_OF(a)
+#define min(a,b) (((a)<(b))?(a):(b))
+#define max(a,b) (((a)>(b))?(a):(b))
+#define UNREFERENCED_PARAMETER(p) (void)(p)
+#define C_ASSERT(e) typedef char __C_ASSERT__[(e)?1:-1]
+#define ALIGN_UP_BY(l,a) (((ULONG_PTR)(l) + (a) - 1) & ~((ULONG_PTR)(a) - 1))
+#define ALIGN_DOWN_BY(l,a) ((ULONG_PTR)(l) & ~((ULONG_PTR)(a) - 1))
+#define NtCurrentProcess() ((HANDLE)(LONG_PTR)-1)
+#define NtCurrentThread() ((HANDLE)(LONG_PTR)-2)
+typedef struct _PEB { PVOID x; } PEB, *PPEB;
+PPEB NtCurrentPeb(void);
+/* Access */
+#define SYNCHRONIZE 0x00100000L
+#define DELETE 0x00010000L
+#define GENERIC_READ 0x80000000L
+#define GENERIC_WRITE 0x40000000L
+#define GENERIC_ALL 0x10000000L
+#define FILE_READ_DATA 1
+#define FILE_LIST_DIRECTORY 1
+#define FILE_WRITE_DATA 2
+#define FILE_APPEND_DATA 4
+#define FILE_READ_ATTRIBUTES 0x80
+#define FILE_WRITE_ATTRIBUTES 0x100
+#define FILE_TRAVERSE 0x20
+#define FILE_GENERIC_READ 0x120089
+#define FILE_GENERIC_WRITE 0x120116
+#define FILE_ALL_ACCESS 0x1F01FF
+#define EVENT_ALL_ACCESS 0x1F0003
+#define SEMAPHORE_ALL_ACCESS 0x1F0003
+#define IO_COMPLETION_ALL_ACCESS 0x1F0003
+#define SECTION_MAP_READ 4
+#define SECTION_QUERY 1
+#define SECTION_ALL_ACCESS 0xF001F
+#define THREAD_ALL_ACCESS 0x1F03FF
+#define STANDARD_RIGHTS_REQUIRED 0x000F0000L
+#define KEY_READ 0x20019
+#define KEY_ALL_ACCESS 0xF003F
+#define PAGE_READONLY 2
+#define PAGE_READWRITE 4
+#define SEC_COMMIT 0x8000000
+#define MEM_COMMIT 0x1000
+#define MEM_RESERVE 0x2000
+#define MEM_RELEASE 0x8000
+#define FILE_ATTRIBUTE_READONLY 1
+#define FILE_ATTRIBUTE_HIDDEN 2
+#define FILE_ATTRIBUTE_SYSTEM 4
+#define FILE_ATTRIBUTE_DIRECTORY 0x10
+#define FILE_ATTRIBUTE_ARCHIVE 0x20
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define FILE_ATTRIBUTE_TEMPORARY 0x100
+#define FILE_ATTRIBUTE_OFFLINE 0x1000
+#define FILE_ATTRIBUTE_NOT_CONTENT_INDEXED 0x2000
+#define FILE_ATTRIBUTE_SPARSE_FILE 0x200
+#define FILE_ATTRIBUTE_REPARSE_POINT 0x400
+#define FILE_ATTRIBUTE_COMPRESSED 0x800
+#define FILE_SHARE_READ 1
+#define FILE_SHARE_WRITE 2
+#define FILE_SHARE_DELETE 4
+#define FILE_SUPERSEDE 0
+#define FILE_OPEN 1
+#define FILE_CREATE 2
+#define FILE_OPEN_IF 3
+#define FILE_OVERWRITE 4
+#define FILE_OVERWRITE_IF 5
+#define FILE_DIRECTORY_FILE 1
+#define FILE_WRITE_THROUGH 2
+#define FILE_SEQUENTIAL_ONLY 4
+#define FILE_NO_INTERMEDIATE_BUFFERING 8
+#define FILE_SYNCHRONOUS_IO_ALERT 0x10
+#define FILE_SYNCHRONOUS_IO_NONALERT 0x20
+#define FILE_NON_DIRECTORY_FILE 0x40
+#define FILE_OPEN_FOR_BACKUP_INTENT 0x4000
+#define FILE_OPEN_REPARSE_POINT 0x200000
+#define FILE_NOTIFY_CHANGE_FILE_NAME 1
+#define FILE_NOTIFY_CHANGE_DIR_NAME 2
+#define FILE_NOTIFY_CHANGE_ATTRIBUTES 4
+#define FILE_NOTIFY_CHANGE_SIZE 8
+#define FILE_NOTIFY_CHANGE_LAST_WRITE 0x10
+#define FILE_NOTIFY_CHANGE_CREATION 0x40
+#define FILE_ACTION_ADDED 1
+#define FILE_ACTION_REMOVED 2
+#define FILE_ACTION_MODIFIED 3
+#define FILE_ACTION_RENAMED_OLD_NAME 4
+#define FILE_ACTION_RENAMED_NEW_NAME 5
+#define FSCTL_QUERY_ALLOCATED_RANGES 0x940CF
+#define FSCTL_SET_SPARSE 0x900C4
+#define FSCTL_SET_ZERO_DATA 0x980C8
+#define IOCTL_DISK_GET_LENGTH_INFO 0x7405C
+#define IOCTL_DISK_GET_DRIVE_GEOMETRY 0x70000
+#define FSCTL_LOCK_VOLUME 0x90018
+#define FSCTL_UNLOCK_VOLUME 0x9001C
+#define FSCTL_DISMOUNT_VOLUME 0x90020
+#define COMPRESSION_FORMAT_NONE 0
+#define COMPRESSION_FORMAT_DEFAULT 1
+#define COMPRESSION_FORMAT_LZNT1 2
+#define COMPRESSION_FORMAT_XPRESS 3
+#define COMPRESSION_FORMAT_XPRESS_HUFF 4
+#define COMPRESSION_ENGINE_STANDARD 0
+#define COMPRESSION_ENGINE_MAXIMUM 0x100
+#define HEAP_GROWABLE 2
+#define HEAP_ZERO_MEMORY 8
+#define IMAGE_SUBSYSTEM_NATIVE 1
+#define PROCESSOR_ARCHITECTURE_INTEL 0
+#define SE_SHUTDOWN_PRIVILEGE 19
+#define REG_SZ 1
+#define REG_BINARY 3
+#define REG_DWORD 4
+#define REG_MULTI_SZ 7
+#define NTDDI_WIN7 0x06010000
+#define NTDDI_VERSION 0x06010000
+#define PF_XMMI64_INSTRUCTIONS_AVAILABLE 10
+#define PF_SSE3_INSTRUCTIONS_AVAILABLE 13
+#define PF_SSE4_2_INSTRUCTIONS_AVAILABLE 38
+#define PF_AVX2_INSTRUCTIONS_AVAILABLE 40
+#define PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE 31
+typedef enum _EVENT_TYPE { NotificationEvent, SynchronizationEvent } EVENT_TYPE;
+typedef enum _WAIT_TYPE { WaitAll, WaitAny } WAIT_TYPE;
+typedef enum _SECTION_INHERIT { ViewShare = 1, ViewUnmap = 2 } SECTION_INHERIT;
+typedef enum _SHUTDOWN_ACTION { ShutdownNoReboot, ShutdownReboot, ShutdownPowerOff } SHUTDOWN_ACTION;
+typedef enum _FILE_INFORMATION_CLASS { FileDirectoryInformation = 1, FileFullDirectoryInformation, FileBothDirectoryInformation, FileBasicInformation, FileStandardInformation, FileInternalInformation, FileEaInformation, FileAccessInformation, FileNameInformation, FileRenameInformation, FileLinkInformation, FileNamesInformation, FileDispositionInformation, FilePositionInformation, FileFullEaInformation, FileModeInformation, FileAlignmentInformation, FileAllInformation, FileAllocationInformation, FileEndOfFileInformation } FILE_INFORMATION_CLASS;
+typedef enum _FS_INFORMATION_CLASS { FileFsVolumeInformation = 1, FileFsLabelInformation, FileFsSizeInformation, FileFsDeviceInformation, FileFsAttributeInformation, FileFsControlInformation, FileFsFullSizeInformation } FS_INFORMATION_CLASS;
+typedef struct _FILE_FS_SIZE_INFORMATION { LARGE_INTEGER TotalAllocationUnits; LARGE_INTEGER AvailableAllocationUnits; ULONG SectorsPerAllocationUnit; ULONG BytesPerSector; } FILE_FS_SIZE_INFORMATION, *PFILE_FS_SIZE_INFORMATION;
+typedef struct _FILE_BASIC_INFORMATION { LARGE_INTEGER CreationTime, LastAccessTime, LastWriteTime, ChangeTime; ULONG FileAttributes; } FILE_BASIC_INFORMATION, *PFILE_BASIC_INFORMATION;
+typedef struct _FILE_STANDARD_INFORMATION { LARGE_INTEGER AllocationSize, EndOfFile; ULONG NumberOfLinks; BOOLEAN DeletePending; BOOLEAN Directory; } FILE_STANDARD_INFORMATION, *PFILE_STANDARD_INFORMATION;
+typedef struct _FILE_POSITION_INFORMATION { LARGE_INTEGER CurrentByteOffset; } FILE_POSITION_INFORMATION, *PFILE_POSITION_INFORMATION;
+typedef struct _FILE_END_OF_FILE_INFORMATION { LARGE_INTEGER EndOfFile; } FILE_END_OF_FILE_INFORMATION, *PFILE_END_OF_FILE_INFORMATION;
+typedef struct _FILE_ALLOCATION_INFORMATION { LARGE_INTEGER AllocationSize; } FILE_ALLOCATION_INFORMATION, *PFILE_ALLOCATION_INFORMATION;
+typedef struct _FILE_DISPOSITION_INFORMATION { BOOLEAN DeleteFile; } FILE_DISPOSITION_INFORMATION, *PFILE_DISPOSITION_INFORMATION;
+typedef struct _FILE_RENAME_INFORMATION { BOOLEAN ReplaceIfExists; HANDLE RootDirectory; ULONG FileNameLength; WCHAR FileName[1]; } FILE_RENAME_INFORMATION, *PFILE_RENAME_INFORMATION;
+typedef struct _FILE_ALIGNMENT_INFORMATION { ULONG AlignmentRequirement; } FILE_ALIGNMENT_INFORMATION;
+typedef struct _FILE_BOTH_DIR_INFORMATION { ULONG NextEntryOffset; ULONG FileIndex; LARGE_INTEGER CreationTime, LastAccessTime, LastWriteTime, ChangeTime, EndOfFile, AllocationSize; ULONG FileAttributes; ULONG FileNameLength; ULONG EaSize; CHAR ShortNameLength; WCHAR ShortName[12]; WCHAR FileName[1]; } FILE_BOTH_DIR_INFORMATION, *PFILE_BOTH_DIR_INFORMATION;
+typedef struct _FILE_FULL_DIR_INFORMATION { ULONG NextEntryOffset; ULONG FileIndex; LARGE_INTEGER CreationTime, LastAccessTime, LastWriteTime, ChangeTime, EndOfFile, AllocationSize; ULONG FileAttributes; ULONG FileNameLength; ULONG EaSize; WCHAR FileName[1]; } FILE_FULL_DIR_INFORMATION, *PFILE_FULL_DIR_INFORMATION;
+typedef struct _FILE_DIRECTORY_INFORMATION { ULONG NextEntryOffset; ULONG FileIndex; LARGE_INTEGER CreationTime, LastAccessTime, LastWriteTime, ChangeTime, EndOfFile, AllocationSize; ULONG FileAttributes; ULONG FileNameLength; WCHAR FileName[1]; } FILE_DIRECTORY_INFORMATION, *PFILE_DIRECTORY_INFORMATION;
+typedef struct _FILE_NAMES_INFORMATION { ULONG NextEntryOffset; ULONG FileIndex; ULONG FileNameLength; WCHAR FileName[1]; } FILE_NAMES_INFORMATION, *PFILE_NAMES_INFORMATION;
+typedef struct _FILE_NOTIFY_INFORMATION { ULONG NextEntryOffset; ULONG Action; ULONG FileNameLength; WCHAR FileName[1]; } FILE_NOTIFY_INFORMATION, *PFILE_NOTIFY_INFORMATION;
+typedef struct _FILE_ALLOCATED_RANGE_BUFFER { LARGE_INTEGER FileOffset; LARGE_INTEGER Length; } FILE_ALLOCATED_RANGE_BUFFER, *PFILE_ALLOCATED_RANGE_BUFFER;
+typedef struct _FILE_SET_SPARSE_BUFFER { BOOLEAN SetSparse; } FILE_SET_SPARSE_BUFFER;
+typedef struct _FILE_ZERO_DATA_INFORMATION { LARGE_INTEGER FileOffset; LARGE_INTEGER BeyondFinalZero; } FILE_ZERO_DATA_INFORMATION;
+typedef struct _GET_LENGTH_INFORMATION { LARGE_INTEGER Length; } GET_LENGTH_INFORMATION;
+typedef struct _DISK_GEOMETRY { LARGE_INTEGER Cylinders; int MediaType; ULONG TracksPerCylinder; ULONG SectorsPerTrack; ULONG BytesPerSector; } DISK_GEOMETRY;
+typedef struct _TIME_FIELDS { CSHORT Year, Month, Day, Hour, Minute, Second, Milliseconds, Weekday; } TIME_FIELDS, *PTIME_FIELDS;
+typedef struct _RTL_HEAP_PARAMETERS { ULONG Length; } RTL_HEAP_PARAMETERS, *PRTL_HEAP_PARAMETERS;
+typedef struct _RTL_CRITICAL_SECTION { PVOID DebugInfo; LONG LockCount; } RTL_CRITICAL_SECTION, *PRTL_CRITICAL_SECTION;
+typedef struct _KUSER_SHARED_DATA { WCHAR NtSystemRoot[260]; ULONG NtMajorVersion, NtMinorVersion; BOOLEAN KdDebuggerEnabled; ULONG SafeBootMode; ULONG NtProductType; ULONG SuiteMask; ULONG NXSupportPolicy; BOOLEAN ProcessorFeatures[64]; ULONG TickCountLowDeprecated; ULONG TickCountMultiplier; } KUSER_SHARED_DATA, *PKUSER_SHARED_DATA;
+#define USER_SHARED_DATA 0x7ffe0000
+typedef struct _RTL_USER_PROCESS_PARAMETERS { ULONG x; } RTL_USER_PROCESS_PARAMETERS, *PRTL_USER_PROCESS_PARAMETERS;
+typedef struct _SECTION_IMAGE_INFORMATION { ULONG SubSystemType; } SECTION_IMAGE_INFORMATION;
+typedef struct _RTL_USER_PROCESS_INFORMATION { ULONG Size; HANDLE ProcessHandle; HANDLE ThreadHandle; CLIENT_ID ClientId; SECTION_IMAGE_INFORMATION ImageInformation; } RTL_USER_PROCESS_INFORMATION, *PRTL_USER_PROCESS_INFORMATION;
+typedef enum _SYSTEM_INFORMATION_CLASS { SystemBasicInformation, SystemProcessorInformation, SystemPerformanceInformation, SystemTimeOfDayInformation, SystemProcessInformation = 5, SystemProcessorPerformanceInformation = 8, SystemModuleInformation = 11, SystemFileCacheInformation = 21 } SYSTEM_INFORMATION_CLASS;
+typedef struct _SYSTEM_BASIC_INFORMATION { ULONG Reserved; ULONG TimerResolution; ULONG PageSize; ULONG NumberOfPhysicalPages; ULONG LowestPhysicalPageNumber; ULONG HighestPhysicalPageNumber; ULONG AllocationGranularity; ULONG_PTR MinimumUserModeAddress; ULONG_PTR MaximumUserModeAddress; ULONG_PTR ActiveProcessorsAffinityMask; CHAR NumberOfProcessors; } SYSTEM_BASIC_INFORMATION, *PSYSTEM_BASIC_INFORMATION;
+typedef struct _SYSTEM_PROCESSOR_INFORMATION { USHORT ProcessorArchitecture, ProcessorLevel, ProcessorRevision, Reserved; ULONG ProcessorFeatureBits; } SYSTEM_PROCESSOR_INFORMATION;
+typedef struct _SYSTEM_PERFORMANCE_INFORMATION { LARGE_INTEGER IoReadTransferCount, IoWriteTransferCount, IoOtherTransferCount; ULONG IoReadOperationCount, IoWriteOperationCount, IoOtherOperationCount, AvailablePages, CommittedPages, CommitLimit, PeakCommitment, PageFaultCount, PagedPoolPages, NonPagedPoolPages, TotalSystemDriverPages, TotalSystemCodePages, ContextSwitches, SystemCalls; } SYSTEM_PERFORMANCE_INFORMATION;
+typedef struct _SYSTEM_TIMEOFDAY_INFORMATION { LARGE_INTEGER BootTime; } SYSTEM_TIMEOFDAY_INFORMATION;
+typedef struct _SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION { LARGE_INTEGER IdleTime, KernelTime, UserTime, DpcTime, InterruptTime; ULONG InterruptCount; } SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION;
+typedef struct _SYSTEM_FILECACHE_INFORMATION { ULONG CurrentSize, PeakSize, PageFaultCount, MinimumWorkingSet, MaximumWorkingSet; } SYSTEM_FILECACHE_INFORMATION;
+typedef struct _SYSTEM_PROCESS_INFORMATION { ULONG NextEntryOffset; ULONG NumberOfThreads; UNICODE_STRING ImageName; HANDLE UniqueProcessId; SIZE_T WorkingSetSize, PagefileUsage, VirtualSize; } SYSTEM_PROCESS_INFORMATION, *PSYSTEM_PROCESS_INFORMATION;
+typedef struct _RTL_PROCESS_MODULE_INFORMATION { PVOID ImageBase; ULONG ImageSize; UCHAR FullPathName[256]; } RTL_PROCESS_MODULE_INFORMATION, *PRTL_PROCESS_MODULE_INFORMATION;
+typedef struct _RTL_PROCESS_MODULES { ULONG NumberOfModules; RTL_PROCESS_MODULE_INFORMATION Modules[1]; } RTL_PROCESS_MODULES, *PRTL_PROCESS_MODULES;
+typedef struct _KEY_VALUE_FULL_INFORMATION { ULONG TitleIndex, Type, DataOffset, DataLength, NameLength; WCHAR Name[1]; } KEY_VALUE_FULL_INFORMATION, *PKEY_VALUE_FULL_INFORMATION;
+typedef struct _KEY_VALUE_PARTIAL_INFORMATION { ULONG TitleIndex, Type, DataLength; UCHAR Data[1]; } KEY_VALUE_PARTIAL_INFORMATION, *PKEY_VALUE_PARTIAL_INFORMATION;
+typedef struct _KEY_VALUE_BASIC_INFORMATION { ULONG TitleIndex, Type, NameLength; WCHAR Name[1]; } KEY_VALUE_BASIC_INFORMATION, *PKEY_VALUE_BASIC_INFORMATION;
+typedef struct _KEY_NODE_INFORMATION { LARGE_INTEGER LastWriteTime; ULONG TitleIndex, ClassOffset, ClassLength, NameLength; WCHAR Name[1]; } KEY_NODE_INFORMATION, *PKEY_NODE_INFORMATION;
+typedef enum { KeyValueBasicInformation, KeyValueFullInformation, KeyValuePartialInformation } KEY_VALUE_INFORMATION_CLASS;
+typedef enum { KeyBasicInformation, KeyNodeInformation } KEY_INFORMATION_CLASS;
+typedef struct _PLUGPLAY_CONTROL_RELATED_DEVICE_DATA { UNICODE_STRING TargetDeviceInstance; ULONG Relation; PWCHAR RelatedDeviceInstance; ULONG RelatedDeviceInstanceLength; } PLUGPLAY_CONTROL_RELATED_DEVICE_DATA;
+#define PNP_GET_PARENT_DEVICE 1
+#define PNP_GET_CHILD_DEVICE 2
+#define PNP_GET_SIBLING_DEVICE 3
+typedef enum { PlugPlayControlGetRelatedDevice = 10 } PLUGPLAY_CONTROL_CLASS;
+typedef ULONG (NTAPI *PTHREAD_START_ROUTINE)(PVOID);
+typedef struct _SECURITY_DESCRIPTOR *PSECURITY_DESCRIPTOR;
+typedef struct _FILE_IO_COMPLETION_INFORMATION { PVOID KeyContext; PVOID ApcContext; IO_STATUS_BLOCK IoStatusBlock; } FILE_IO_COMPLETION_INFORMATION, *PFILE_IO_COMPLETION_INFORMATION;
+typedef struct _FILE_COMPLETION_INFORMATION { HANDLE Port; PVOID Key; } FILE_COMPLETION_INFORMATION;
+#define FileCompletionInformation 30
+typedef enum { MemoryBasicInformation } MEMORY_INFORMATION_CLASS;
+LONG InterlockedIncrement(LONG volatile *);
+LONG InterlockedDecrement(LONG volatile *);
+LONG InterlockedExchangeAdd(LONG volatile *, LONG);
+LONG InterlockedCompareExchange(LONG volatile *, LONG, LONG);
+LONG InterlockedExchange(LONG volatile *, LONG);
+LONGLONG InterlockedExchangeAdd64(LONGLONG volatile *, LONGLONG);
+PVOID InterlockedCompareExchangePointer(PVOID volatile *, PVOID, PVOID);
+PVOID InterlockedExchangePointer(PVOID volatile *, PVOID);
+
+/* Functions */
+NTSTATUS NtDisplayString(PUNICODE_STRING);
+NTSTATUS NtDrawText(PUNICODE_STRING);
+NTSTATUS NtClose(HANDLE);
+NTSTATUS NtCreateEvent(PHANDLE, ACCESS_MASK, POBJECT_ATTRIBUTES, EVENT_TYPE, BOOLEAN);
+NTSTATUS NtSetEvent(HANDLE, PLONG);
+NTSTATUS NtResetEvent(HANDLE, PLONG);
+NTSTATUS NtClearEvent(HANDLE);
+NTSTATUS NtCreateSemaphore(PHANDLE, ACCESS_MASK, POBJECT_ATTRIBUTES, LONG, LONG);
+NTSTATUS NtReleaseSemaphore(HANDLE, LONG, PLONG);
+NTSTATUS NtCreateFile(PHANDLE, ACCESS_MASK, POBJECT_ATTRIBUTES, PIO_STATUS_BLOCK, PLARGE_INTEGER, ULONG, ULONG, ULONG, ULONG, PVOID, ULONG);
+NTSTATUS NtOpenFile(PHANDLE, ACCESS_MASK, POBJECT_ATTRIBUTES, PIO_STATUS_BLOCK, ULONG, ULONG);
+#define ZwCreateFile NtCreateFile
+#define ZwOpenFile NtOpenFile
+#define ZwClose NtClose
+NTSTATUS NtReadFile(HANDLE, HANDLE, PIO_APC_ROUTINE, PVOID, PIO_STATUS_BLOCK, PVOID, ULONG, PLARGE_INTEGER, PULONG);
+NTSTATUS NtWriteFile(HANDLE, HANDLE, PIO_APC_ROUTINE, PVOID, PIO_STATUS_BLOCK, PVOID, ULONG, PLARGE_INTEGER, PULONG);
+NTSTATUS NtReadFileScatter(HANDLE, HANDLE, PIO_APC_ROUTINE, PVOID, PIO_STATUS_BLOCK, FILE_SEGMENT_ELEMENT*, ULONG, PLARGE_INTEGER, PULONG);
+NTSTATUS NtWriteFileGather(HANDLE, HANDLE, PIO_APC_ROUTINE, PVOID, PIO_STATUS_BLOCK, FILE_SEGMENT_ELEMENT*, ULONG, PLARGE_INTEGER, PULONG);
+NTSTATUS NtQueryInformationFile(HANDLE, PIO_STATUS_BLOCK, PVOID, ULONG, FILE_INFORMATION_CLASS);
+NTSTATUS NtSetInformationFile(HANDLE, PIO_STATUS_BLOCK, PVOID, ULONG, FILE_INFORMATION_CLASS);
+NTSTATUS NtQueryVolumeInformationFile(HANDLE, PIO_STATUS_BLOCK, PVOID, ULONG, FS_INFORMATION_CLASS);
+NTSTATUS NtQueryAttributesFile(POBJECT_ATTRIBUTES, PFILE_BASIC_INFORMATION);
+NTSTATUS NtDeleteFile(POBJECT_ATTRIBUTES);
+NTSTATUS NtFlushBuffersFile(HANDLE, PIO_STATUS_BLOCK);
+NTSTATUS NtCancelIoFile(HANDLE, PIO_STATUS_BLOCK);
+NTSTATUS NtQueryDirectoryFile(HANDLE, HANDLE, PIO_APC_ROUTINE, PVOID, PIO_STATUS_BLOCK, PVOID, ULONG, FILE_INFORMATION_CLASS, BOOLEAN, PUNICODE_STRING, BOOLEAN);
+#define ZwQueryDirectoryFile NtQueryDirectoryFile
+NTSTATUS NtNotifyChangeDirectoryFile(HANDLE, HANDLE, PIO_APC_ROUTINE, PVOID, PIO_STATUS_BLOCK, PVOID, ULONG, ULONG, BOOLEAN);
+NTSTATUS NtFsControlFile(HANDLE, HANDLE, PIO_APC_ROUTINE, PVOID, PIO_STATUS_BLOCK, ULONG, PVOID, ULONG, PVOID, ULONG);
+NTSTATUS NtDeviceIoControlFile(HANDLE, HANDLE, PIO_APC_ROUTINE, PVOID, PIO_STATUS_BLOCK, ULONG, PVOID, ULONG, PVOID, ULONG);
+NTSTATUS NtCreateIoCompletion(PHANDLE, ACCESS_MASK, POBJECT_ATTRIBUTES, ULONG);
+NTSTATUS NtRemoveIoCompletion(HANDLE, PVOID*, PVOID*, PIO_STATUS_BLOCK, PLARGE_INTEGER);
+NTSTATUS NtSetIoCompletion(HANDLE, PVOID, PVOID, NTSTATUS, ULONG);
+NTSTATUS NtCreateSection(PHANDLE, ACCESS_MASK, POBJECT_ATTRIBUTES, PLARGE_INTEGER, ULONG, ULONG, HANDLE);
+NTSTATUS NtMapViewOfSection(HANDLE, HANDLE, PVOID*, ULONG_PTR, SIZE_T, PLARGE_INTEGER, PSIZE_T, SECTION_INHERIT, ULONG, ULONG);
+NTSTATUS NtUnmapViewOfSection(HANDLE, PVOID);
+NTSTATUS NtAllocateVirtualMemory(HANDLE, PVOID*, ULONG_PTR, PSIZE_T, ULONG, ULONG);
+NTSTATUS NtFreeVirtualMemory(HANDLE, PVOID*, PSIZE_T, ULONG);
+NTSTATUS NtWaitForSingleObject(HANDLE, BOOLEAN, PLARGE_INTEGER);
+NTSTATUS NtWaitForMultipleObjects(ULONG, HANDLE*, WAIT_TYPE, BOOLEAN, PLARGE_INTEGER);
+NTSTATUS NtDelayExecution(BOOLEAN, PLARGE_INTEGER);
+NTSTATUS NtYieldExecution(void);
+NTSTATUS NtQueryPerformanceCounter(PLARGE_INTEGER, PLARGE_INTEGER);
+NTSTATUS NtQuerySystemTime(PLARGE_INTEGER);
+NTSTATUS NtQuerySystemInformation(SYSTEM_INFORMATION_CLASS, PVOID, ULONG, PULONG);
+NTSTATUS NtTerminateProcess(HANDLE, NTSTATUS);
+NTSTATUS NtTerminateThread(HANDLE, NTSTATUS);
+NTSTATUS NtResumeThread(HANDLE, PULONG);
+NTSTATUS NtOpenKey(PHANDLE, ACCESS_MASK, POBJECT_ATTRIBUTES);
+NTSTATUS NtQueryValueKey(HANDLE, PUNICODE_STRING, KEY_VALUE_INFORMATION_CLASS, PVOID, ULONG, PULONG);
+NTSTATUS NtSetValueKey(HANDLE, PUNICODE_STRING, ULONG, ULONG, PVOID, ULONG);
+NTSTATUS NtDeleteValueKey(HANDLE, PUNICODE_STRING);
+NTSTATUS NtEnumerateKey(HANDLE, ULONG, KEY_INFORMATION_CLASS, PVOID, ULONG, PULONG);
+NTSTATUS NtEnumerateValueKey(HANDLE, ULONG, KEY_VALUE_INFORMATION_CLASS, PVOID, ULONG, PULONG);
+NTSTATUS NtPlugPlayControl(PLUGPLAY_CONTROL_CLASS, PVOID, ULONG);
+NTSTATUS ZwShutdownSystem(SHUTDOWN_ACTION);
+ULONG DbgPrint(PCSTR, ...);
+PVOID RtlAllocateHeap(HANDLE, ULONG, SIZE_T);
+PVOID RtlReAllocateHeap(HANDLE, ULONG, PVOID, SIZE_T);
+BOOLEAN RtlFreeHeap(HANDLE, ULONG, PVOID);
+HANDLE RtlGetProcessHeap(void);
+#define RtlGetProcessHeap RtlGetProcessHeap
+PVOID RtlCreateHeap(ULONG, PVOID, SIZE_T, SIZE_T, PVOID, PRTL_HEAP_PARAMETERS);
+PVOID RtlDestroyHeap(HANDLE);
+VOID RtlInitUnicodeString(PUNICODE_STRING, PCWSTR);
+VOID RtlInitAnsiString(PANSI_STRING, PCSTR);
+NTSTATUS RtlAnsiStringToUnicodeString(PUNICODE_STRING, PANSI_STRING, BOOLEAN);
+NTSTATUS RtlUnicodeStringToAnsiString(PANSI_STRING, PUNICODE_STRING, BOOLEAN);
+VOID RtlFreeAnsiString(PANSI_STRING);
+BOOLEAN RtlCreateUnicodeStringFromAsciiz(PUNICODE_STRING, PCSTR);
+VOID RtlFreeUnicodeString(PUNICODE_STRING);
+NTSTATUS RtlMultiByteToUnicodeN(PWCH, ULONG, PULONG, const CHAR *, ULONG);
+NTSTATUS RtlUnicodeToMultiByteN(PCHAR, ULONG, PULONG, PCWCH, ULONG);
+WCHAR RtlUpcaseUnicodeChar(WCHAR);
+CHAR RtlUpperChar(CHAR);
+BOOLEAN RtlDosPathNameToNtPathName_U(PCWSTR, PUNICODE_STRING, PCWSTR*, PVOID);
+ULONG RtlGetCurrentDirectory_U(ULONG, PWSTR);
+NTSTATUS RtlSetCurrentDirectory_U(PUNICODE_STRING);
+BOOLEAN RtlTimeToTimeFields(PLARGE_INTEGER, PTIME_FIELDS);
+NTSTATUS RtlSystemTimeToLocalTime(PLARGE_INTEGER, PLARGE_INTEGER);
+NTSTATUS RtlAdjustPrivilege(ULONG, BOOLEAN, BOOLEAN, PBOOLEAN);
+NTSTATUS RtlCreateProcessParameters(PRTL_USER_PROCESS_PARAMETERS*, PUNICODE_STRING, PUNICODE_STRING, PUNICODE_STRING, PUNICODE_STRING, PWSTR, PUNICODE_STRING, PUNICODE_STRING, PUNICODE_STRING, PUNICODE_STRING);
+NTSTATUS RtlCreateUserProcess(PUNICODE_STRING, ULONG, PRTL_USER_PROCESS_PARAMETERS, PVOID, PVOID, HANDLE, BOOLEAN, HANDLE, HANDLE, PRTL_USER_PROCESS_INFORMATION);
+NTSTATUS RtlCreateUserThread(HANDLE, PSECURITY_DESCRIPTOR, BOOLEAN, ULONG, SIZE_T, SIZE_T, PTHREAD_START_ROUTINE, PVOID, PHANDLE, PCLIENT_ID);
+VOID RtlExitUserThread(NTSTATUS);
+NTSTATUS RtlInitializeCriticalSection(PRTL_CRITICAL_SECTION);
+NTSTATUS RtlDeleteCriticalSection(PRTL_CRITICAL_SECTION);
+NTSTATUS RtlEnterCriticalSection(PRTL_CRITICAL_SECTION);
+NTSTATUS RtlLeaveCriticalSection(PRTL_CRITICAL_SECTION);
+NTSTATUS RtlCompressBuffer(USHORT, PUCHAR, ULONG, PUCHAR, ULONG, ULONG, PULONG, PVOID);
+NTSTATUS RtlDecompressBuffer(USHORT, PUCHAR, ULONG, PUCHAR, ULONG, PULONG);
+NTSTATUS RtlGetCompressionWorkSpaceSize(USHORT, PULONG, PULONG);
+ULONG RtlComputeCrc32(ULONG, const void *, ULONG);
+ULONG RtlRandom(PULONG);
+/* CRT */
+int _vsnprintf(char *, size_t, const char *, va_list);
+int _snprintf(char *, size_t, const char *, ...);
+int _snwprintf(wchar_t *, size_t, const wchar_t *, ...);
+int swprintf(wchar_t *, const wchar_t *, ...);
+int _strnicmp(const char *, const char *, size_t);
+int _stricmp(const char *, const char *);
+int _wcsicmp(const wchar_t *, const wchar_t *);
+int _wcsnicmp(const wchar_t *, const wchar_t *, size_t);
+size_t wcslen(const wchar_t *);
+size_t wcsnlen(const wchar_t *, size_t);
+wchar_t *wcscpy(wchar_t *, const wchar_t *);
+wchar_t *wcsncpy(wchar_t *, const wchar_t *, size_t);
+wchar_t *wcscat(wchar_t *, const wchar_t *);
+wchar_t *wcsncat(wchar_t *, const wchar_t *, size_t);
+wchar_t *wcschr(const wchar_t *, wchar_t);
+wchar_t *wcsrchr(const wchar_t *, wchar_t);
+wchar_t *wcspbrk(const wchar_t *, const wchar_t *);
+int wcscmp(const wchar_t *, const wchar_t *);
+int wcsncmp(const wchar_t *, const wchar_t *, size_t);
+int tolower(int);
+int toupper(int);
+char *_strlwr(char *);
+int _wtoi(const wchar_t *);
+
+/* MSVC structured exception handling: the __except block never runs */
+#define __try
+#define __except(x) if (0)
+#define GetExceptionCode() ((NTSTATUS)0)
+#define EXCEPTION_EXECUTE_HANDLER 1
+
+#endif
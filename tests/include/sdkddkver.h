@@ -0,0 +1 @@
+/* Host stand-in: everything the shell needs is in ntndk.h. */
@@ -0,0 +1,250 @@
+/**
+ * PROJECT:         Native Shell
+ * COPYRIGHT:       LGPL; See LICENSE in the top level directory
+ * FILE:            tests/tokenizer/tokenizer_test.c
+ * DESCRIPTION:     Host test and benchmark of the command line tokenizer.
+ * DEVELOPERS:      See CONTRIBUTORS.md in the top level directory
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "shell.c"
+
+#define MAX_CASE_ARGS 4
+
+typedef struct _TOKENIZER_CASE
+{
+    PCSTR Line;
+    UINT Argc;
+    PCSTR Argv[MAX_CASE_ARGS];
+} TOKENIZER_CASE;
+
+TOKENIZER_CASE Cases[] =
+{
+    { "", 0 },
+    { " \t\r\n ", 0 },
+    { "cd Program Files", 3, { "cd", "Program", "Files" } },
+    { "  copy \"a b\" 'c d'  ", 3, { "copy", "a b", "c d" } },
+    { "a\"b c\"d", 1, { "ab cd" } },
+
+    // Empty arguments
+    { "\"\" x", 2, { "", "x" } },
+    { "x '' \"\"", 3, { "x", "", "" } },
+
+    // Doubled quotes inside quotes
+    { "say \"he said \"\"hi\"\"\"", 2, { "say", "he said \"hi\"" } },
+    { "\"\"\"\"", 1, { "\"" } },
+
+    // Backslashes are literal unless they come before a quote
+    { "p C:\\dir\\ \\\\srv\\x", 3, { "p", "C:\\dir\\", "\\\\srv\\x" } },
+    { "q \\\"lit\\\"", 2, { "q", "\"lit\"" } },
+    { "q \\\\\\\"", 2, { "q", "\\\"" } },
+    { "q \"C:\\x\\\\\" y", 3, { "q", "C:\\x\\", "y" } },
+
+    // An unterminated quote runs to the end of the line
+    { "unterminated \"abc def", 2, { "unterminated", "abc def" } },
+    { "echo 'it", 2, { "echo", "it" } },
+};
+
+ULONG Failures;
+
+PVOID
+RtlAllocateHeap(IN HANDLE HeapHandle, IN ULONG Flags, IN SIZE_T Size)
+{
+    PUCHAR Block = malloc(Size + 8);
+
+    // Only 8-byte alignment, like the 32-bit process heap
+    return Block ? Block + 8 : NULL;
+}
+
+BOOLEAN
+RtlFreeHeap(IN HANDLE HeapHandle, IN ULONG Flags, IN PVOID BaseAddress)
+{
+    free((PUCHAR)BaseAddress - 8);
+    return TRUE;
+}
+
+HANDLE
+RtlGetProcessHeap(VOID)
+{
+    return NULL;
+}
+
+VOID
+Fail(IN PCSTR Line, IN PCSTR Problem)
+{
+    printf("FAIL [%.60s]: %s\n", Line, Problem);
+    Failures++;
+}
+
+VOID
+TestCases(VOID)
+{
+    CLI_ARENA Arena;
+    CLI_ARGUMENTS Args;
+    ULONG i;
+    UINT j;
+
+    for (i = 0; i < RTL_NUMBER_OF(Cases); i++)
+    {
+        RtlCliArenaInit(&Arena);
+
+        if (!NT_SUCCESS(RtlCliParseArguments(Cases[i].Line, &Arena, &Args)))
+        {
+            Fail(Cases[i].Line, "no memory");
+        }
+        else if (Args.Argc != Cases[i].Argc || Args.Argv[Args.Argc] != NULL)
+        {
+            Fail(Cases[i].Line, "argument count");
+        }
+        else
+        {
+            for (j = 0; j < Args.Argc; j++)
+            {
+                if (strcmp(Args.Argv[j], Cases[i].Argv[j]))
+                    Fail(Cases[i].Line, Args.Argv[j]);
+            }
+        }
+
+        RtlCliArenaFree(&Arena);
+    }
+
+    // Tail points at the rest of the line as typed
+    RtlCliArenaInit(&Arena);
+    RtlCliParseArguments("echo   \"a  b\"  c", &Arena, &Args);
+    if (strcmp(Args.Tail[1], "\"a  b\"  c") || strcmp(Args.Tail[2], "c") || *Args.Tail[3])
+        Fail("echo tail", "tail");
+    RtlCliArenaFree(&Arena);
+}
+
+VOID
+TestLongLines(VOID)
+{
+    static CHAR Line[100000];
+    CLI_ARENA Arena;
+    CLI_ARGUMENTS Args;
+    ULONG i;
+
+    // One argument much larger than an arena block
+    memcpy(Line, "x ", 2);
+    memset(Line + 2, 'a', 99997);
+    Line[99999] = 0;
+
+    RtlCliArenaInit(&Arena);
+    RtlCliParseArguments(Line, &Arena, &Args);
+    if (Args.Argc != 2 || strlen(Args.Argv[1]) != 99997)
+        Fail("100000 characters", "long argument");
+    RtlCliArenaFree(&Arena);
+
+    // Many short arguments, 1200 characters in all
+    for (i = 0; i < 400; i++)
+        memcpy(Line + i * 3, "ab ", 3);
+    Line[1200] = 0;
+
+    RtlCliArenaInit(&Arena);
+    RtlCliParseArguments(Line, &Arena, &Args);
+    if (Args.Argc != 400 || strcmp(Args.Argv[399], "ab"))
+        Fail("400 arguments", "argument count");
+    RtlCliArenaFree(&Arena);
+
+    // A quoted argument over 1 KB with an unterminated quote
+    Line[0] = '"';
+    memset(Line + 1, ' ', 2000);
+    Line[2001] = 0;
+
+    RtlCliArenaInit(&Arena);
+    RtlCliParseArguments(Line, &Arena, &Args);
+    if (Args.Argc != 1 || strlen(Args.Argv[0]) != 2000)
+        Fail("2000 quoted spaces", "quoted argument");
+    RtlCliArenaFree(&Arena);
+}
+
+VOID
+ExpectSize(IN PCSTR String, IN BOOLEAN Valid, IN ULONGLONG Expected)
+{
+    ULONGLONG Value = 0;
+
+    if (RtlCliParseSize(String, &Value) != Valid || (Valid && Value != Expected))
+        Fail(String, "size");
+}
+
+VOID
+TestSizes(VOID)
+{
+    ExpectSize("0", TRUE, 0);
+    ExpectSize("512", TRUE, 512);
+    ExpectSize("64k", TRUE, 64 << 10);
+    ExpectSize("4M", TRUE, 4 << 20);
+    ExpectSize("2g", TRUE, (ULONGLONG)2 << 30);
+    ExpectSize("18446744073709551615", TRUE, ~(ULONGLONG)0);
+    ExpectSize("18446744073709551616", FALSE, 0);
+    ExpectSize("99999999999999999999", FALSE, 0);
+    ExpectSize("17179869183G", TRUE, (ULONGLONG)17179869183 << 30);
+    ExpectSize("17179869184G", FALSE, 0);
+    ExpectSize("18014398509481983k", TRUE, (ULONGLONG)18014398509481983 << 10);
+    ExpectSize("18014398509481984k", FALSE, 0);
+    ExpectSize("", FALSE, 0);
+    ExpectSize("k", FALSE, 0);
+    ExpectSize("12x", FALSE, 0);
+    ExpectSize("1kk", FALSE, 0);
+    ExpectSize("-1", FALSE, 0);
+}
+
+VOID
+TestArena(VOID)
+{
+    CLI_ARENA Arena;
+    PVOID Data;
+    ULONG i;
+
+    RtlCliArenaInit(&Arena);
+    for (i = 0; i < 100000; i++)
+    {
+        Data = RtlCliArenaAlloc(&Arena, 1 + (i * 7919) % 300);
+        if (!Data || ((ULONG_PTR)Data & 15))
+        {
+            Fail("arena", "block not aligned to 16 bytes");
+            break;
+        }
+    }
+    RtlCliArenaFree(&Arena);
+}
+
+VOID
+Benchmark(VOID)
+{
+    CLI_ARENA Arena;
+    CLI_ARGUMENTS Args;
+    clock_t Start;
+    ULONG i;
+
+    Start = clock();
+    for (i = 0; i < 1000000; i++)
+    {
+        RtlCliArenaInit(&Arena);
+        RtlCliParseArguments("copy /v /q:8 \"C:\\Program Files\\a b.txt\" D:\\dest\\", &Arena, &Args);
+        RtlCliArenaFree(&Arena);
+    }
+
+    printf("1000000 copy lines: %.0f ns per line\n",
+           (double)(clock() - Start) / CLOCKS_PER_SEC * 1e3);
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "/bench"))
+    {
+        Benchmark();
+        return 0;
+    }
+
+    TestCases();
+    TestLongLines();
+    TestSizes();
+    TestArena();
+
+    printf("tokenizer: %s\n", Failures ? "FAILED" : "ok");
+    return Failures ? 1 : 0;
+}
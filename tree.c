@@ -0,0 +1,303 @@
+/**
+ * PROJECT:         Native Shell
+ * COPYRIGHT:       LGPL; See LICENSE in the top level directory
+ * FILE:            tree.c
+ * DESCRIPTION:     Directory tree walker.
+ * DEVELOPERS:      See CONTRIBUTORS.md in the top level directory
+ */
+
+#include "precomp.h"
+
+#define TREE_QUERY_BUFFER_SIZE 0x10000
+
+// "\??\" in front of the DOS path, so the walker never copies the path
+#define TREE_NT_PREFIX_LENGTH 4
+
+typedef struct _CLI_TREE_WALK
+{
+    WCHAR Buffer[TREE_NT_PREFIX_LENGTH + TREE_MAX_PATH];
+    PWSTR Path;
+    ULONG RootLength;
+    BOOLEAN Recurse;
+    BOOLEAN Aborted;
+    PCLI_TREE_ROUTINE Routine;
+    PVOID Context;
+} CLI_TREE_WALK, *PCLI_TREE_WALK;
+
+/*++
+ * @name RtlClipTreeVisit
+ *
+ * The RtlClipTreeVisit routine calls the walk routine for the current
+ * path.
+ *
+ * @param Walk
+ *        Walk in progress.
+ *
+ * @param Visit
+ *        Kind of visit.
+ *
+ * @param Attributes
+ *        File attributes of the entry.
+ *
+ * @param Size
+ *        Size of the entry.
+ *
+ * @param AllocationSize
+ *        Bytes allocated on disk for the entry.
+ *
+ * @param Status
+ *        Failure being reported, for TreeVisitError.
+ *
+ * @return Status returned by the walk routine.
+ *
+ * @remarks A failure returned by the walk routine stops the walk.
+ *
+ *--*/
+NTSTATUS
+RtlClipTreeVisit(IN PCLI_TREE_WALK Walk,
+                 IN CLI_TREE_VISIT Visit,
+                 IN ULONG Attributes,
+                 IN LONGLONG Size,
+                 IN LONGLONG AllocationSize,
+                 IN NTSTATUS Status)
+{
+    CLI_TREE_ENTRY Entry;
+    ULONG Skip = Walk->RootLength;
+
+    // Skip the separator after the root as well
+    if (Walk->Path[Skip] == L'\\')
+        Skip++;
+
+    Entry.Path = Walk->Path;
+    Entry.RelativePath = Walk->Path + Skip;
+    Entry.Attributes = Attributes;
+    Entry.Size = Size;
+    Entry.AllocationSize = AllocationSize;
+    Entry.Status = Status;
+
+    Status = Walk->Routine(Visit, &Entry, Walk->Context);
+    if (!NT_SUCCESS(Status))
+        Walk->Aborted = TRUE;
+
+    return Status;
+}
+
+/*++
+ * @name RtlClipWalkDirectory
+ *
+ * The RtlClipWalkDirectory routine visits the entries of the directory in
+ * Walk->Path.
+ *
+ * @param Walk
+ *        Walk in progress.
+ *
+ * @param Length
+ *        Length of Walk->Path in characters.
+ *
+ * @return STATUS_SUCCESS, the status of a failing open or query, or the
+ *         failure returned by the walk routine (Walk->Aborted is set).
+ *
+ * @remarks Directories are reported with TreeEnterDirectory before their
+ *          contents and TreeLeaveDirectory after. Reparse points are not
+ *          followed, which keeps junction loops out of the walk.
+ *
+ *--*/
+NTSTATUS
+RtlClipWalkDirectory(IN PCLI_TREE_WALK Walk, IN ULONG Length)
+{
+    UNICODE_STRING DirectoryString;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    PFILE_DIRECTORY_INFORMATION DirectoryInfo, Entry;
+    HANDLE DirectoryHandle;
+    BOOLEAN FirstQuery = TRUE;
+    ULONG NameLength;
+    ULONG OpenLength = Length;
+    NTSTATUS Status;
+
+    // "C:" is the volume, "C:\" is its root directory
+    if (Length && Walk->Path[Length - 1] == L':')
+    {
+        Walk->Path[OpenLength++] = L'\\';
+        Walk->Path[OpenLength] = UNICODE_NULL;
+    }
+
+    DirectoryString.Buffer = Walk->Buffer;
+    DirectoryString.Length = (USHORT)((TREE_NT_PREFIX_LENGTH + OpenLength) * sizeof(WCHAR));
+    DirectoryString.MaximumLength = DirectoryString.Length;
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &DirectoryString,
+                               OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+
+    Status = NtOpenFile(&DirectoryHandle,
+                        FILE_LIST_DIRECTORY | SYNCHRONIZE,
+                        &ObjectAttributes,
+                        &IoStatusBlock,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                        FILE_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT | FILE_OPEN_FOR_BACKUP_INTENT);
+
+    Walk->Path[Length] = UNICODE_NULL;
+
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    DirectoryInfo = RtlAllocateHeap(RtlGetProcessHeap(), 0, TREE_QUERY_BUFFER_SIZE);
+    if (!DirectoryInfo)
+    {
+        NtClose(DirectoryHandle);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    for (;;)
+    {
+        Status = NtQueryDirectoryFile(DirectoryHandle,
+                                      NULL,
+                                      NULL,
+                                      NULL,
+                                      &IoStatusBlock,
+                                      DirectoryInfo,
+                                      TREE_QUERY_BUFFER_SIZE,
+                                      FileDirectoryInformation,
+                                      FALSE,
+                                      NULL,
+                                      FirstQuery);
+        FirstQuery = FALSE;
+
+        if (Status == STATUS_NO_MORE_FILES)
+        {
+            Status = STATUS_SUCCESS;
+            break;
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Entry = DirectoryInfo;
+        for (;;)
+        {
+            NameLength = Entry->FileNameLength / sizeof(WCHAR);
+
+            // Skip "." and ".."
+            if (!(Entry->FileName[0] == L'.' &&
+                  (NameLength == 1 || (NameLength == 2 && Entry->FileName[1] == L'.'))))
+            {
+                if (Length + 1 + NameLength >= TREE_MAX_PATH)
+                {
+                    Status = RtlClipTreeVisit(Walk, TreeVisitError, Entry->FileAttributes, 0, 0, STATUS_NAME_TOO_LONG);
+                }
+                else
+                {
+                    Walk->Path[Length] = L'\\';
+                    RtlCopyMemory(&Walk->Path[Length + 1], Entry->FileName, Entry->FileNameLength);
+                    Walk->Path[Length + 1 + NameLength] = UNICODE_NULL;
+
+                    if (!(Entry->FileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                    {
+                        Status = RtlClipTreeVisit(Walk, TreeVisitFile, Entry->FileAttributes,
+                                                  Entry->EndOfFile.QuadPart, Entry->AllocationSize.QuadPart,
+                                                  STATUS_SUCCESS);
+                    }
+                    else
+                    {
+                        Status = RtlClipTreeVisit(Walk, TreeEnterDirectory, Entry->FileAttributes,
+                                                  0, Entry->AllocationSize.QuadPart, STATUS_SUCCESS);
+
+                        if (NT_SUCCESS(Status) && Walk->Recurse &&
+                            !(Entry->FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+                        {
+                            Status = RtlClipWalkDirectory(Walk, Length + 1 + NameLength);
+                            if (!NT_SUCCESS(Status) && !Walk->Aborted)
+                            {
+                                Status = RtlClipTreeVisit(Walk, TreeVisitError, Entry->FileAttributes, 0, 0, Status);
+                            }
+                        }
+
+                        if (NT_SUCCESS(Status))
+                        {
+                            Status = RtlClipTreeVisit(Walk, TreeLeaveDirectory, Entry->FileAttributes,
+                                                      0, Entry->AllocationSize.QuadPart, STATUS_SUCCESS);
+                        }
+                    }
+
+                    Walk->Path[Length] = UNICODE_NULL;
+                }
+
+                if (Walk->Aborted)
+                    break;
+            }
+
+            if (!Entry->NextEntryOffset)
+                break;
+
+            Entry = (PFILE_DIRECTORY_INFORMATION)((ULONG_PTR)Entry + Entry->NextEntryOffset);
+        }
+
+        if (Walk->Aborted)
+            break;
+    }
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, DirectoryInfo);
+    NtClose(DirectoryHandle);
+
+    return Status;
+}
+
+/*++
+ * @name RtlCliWalkTree
+ *
+ * The RtlCliWalkTree routine calls a routine for every file and directory
+ * below a directory.
+ *
+ * @param Root
+ *        Directory to walk, full path in DOS format.
+ *
+ * @param Recurse
+ *        TRUE to walk subdirectories, FALSE to visit Root's entries only.
+ *
+ * @param Routine
+ *        Routine to call. Returning a failure stops the walk.
+ *
+ * @param Context
+ *        Parameter for Routine.
+ *
+ * @return STATUS_SUCCESS, the status of opening Root, or the failure
+ *         returned by Routine.
+ *
+ * @remarks Root itself is not visited. Directories below Root that can't
+ *          be read are reported to Routine with TreeVisitError. Paths are
+ *          limited to TREE_MAX_PATH characters. All state lives on the
+ *          stack, so several walks can run at the same time.
+ *
+ *--*/
+NTSTATUS
+RtlCliWalkTree(IN PCWSTR Root, IN BOOLEAN Recurse, IN PCLI_TREE_ROUTINE Routine, IN PVOID Context)
+{
+    CLI_TREE_WALK Walk;
+    ULONG Length = wcslen(Root);
+
+    // Leave room for the separator and at least one character
+    if (Length + 2 >= TREE_MAX_PATH)
+        return STATUS_NAME_TOO_LONG;
+
+    RtlCopyMemory(Walk.Buffer, L"\\??\\", TREE_NT_PREFIX_LENGTH * sizeof(WCHAR));
+    Walk.Path = Walk.Buffer + TREE_NT_PREFIX_LENGTH;
+    RtlCopyMemory(Walk.Path, Root, (Length + 1) * sizeof(WCHAR));
+
+    // Entries are appended as "\name"
+    while (Length && Walk.Path[Length - 1] == L'\\')
+        Walk.Path[--Length] = UNICODE_NULL;
+
+    Walk.RootLength = Length;
+    Walk.Recurse = Recurse;
+    Walk.Aborted = FALSE;
+    Walk.Routine = Routine;
+    Walk.Context = Context;
+
+    return RtlClipWalkDirectory(&Walk, Length);
+}
@@ -0,0 +1,391 @@
+/**
+ * PROJECT:         Native Shell
+ * COPYRIGHT:       LGPL; See LICENSE in the top level directory
+ * FILE:            watch.c
+ * DESCRIPTION:     Directory change watcher.
+ * DEVELOPERS:      See CONTRIBUTORS.md in the top level directory
+ */
+
+#include "precomp.h"
+
+#define WATCH_BUFFER_SIZE (64 * 1024)
+#define WATCH_MAX_CHANGES 256          // distinct names held between two reports
+#define WATCH_NAME_POOL (32 * 1024)    // characters for the held names
+#define WATCH_REPORT_INTERVAL 250      // milliseconds between two reports
+#define WATCH_MAX_LINES 32             // lines per report
+
+#define WATCH_FILTER (FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | \
+                      FILE_NOTIFY_CHANGE_ATTRIBUTES | FILE_NOTIFY_CHANGE_SIZE |    \
+                      FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_CREATION)
+
+// Every change to one name since the last report
+typedef struct _WATCH_CHANGE
+{
+    ULONG Hash;
+    ULONG Actions; // 1 << FILE_ACTION_xxx, bit 0 for unknown actions
+    ULONG Count;
+    ULONG NameOffset; // in Names
+    ULONG NameLength; // in characters
+} WATCH_CHANGE, *PWATCH_CHANGE;
+
+typedef struct _WATCH_STATE
+{
+    ULONG Buffer[WATCH_BUFFER_SIZE / sizeof(ULONG)]; // FILE_NOTIFY_INFORMATION is ULONG aligned
+    WATCH_CHANGE Changes[WATCH_MAX_CHANGES];
+    ULONG ChangeCount;
+    WCHAR Names[WATCH_NAME_POOL];
+    ULONG NamesUsed;
+    ULONG Dropped;    // changes not held, the table was full
+    BOOLEAN Overflow; // the file system lost changes
+    ULONG Total;
+    LONGLONG StartTime;
+    LONGLONG Frequency;
+} WATCH_STATE, *PWATCH_STATE;
+
+/*++
+ * @name RtlClipWatchCollect
+ *
+ * The RtlClipWatchCollect routine adds the changes of one notification to
+ * the changes waiting to be reported.
+ *
+ * @param State
+ *        Watch state.
+ *
+ * @param Length
+ *        Bytes of FILE_NOTIFY_INFORMATION records in State->Buffer.
+ *
+ * @return None.
+ *
+ * @remarks Changes to a name already held only add their action to it, so
+ *          a program rewriting one file a thousand times is one line.
+ *
+ *--*/
+VOID
+RtlClipWatchCollect(IN OUT PWATCH_STATE State, IN ULONG Length)
+{
+    PFILE_NOTIFY_INFORMATION Info;
+    PWATCH_CHANGE Change;
+    ULONG Offset = 0;
+    ULONG NameLength, Hash, i;
+
+    while (Length - Offset >= FIELD_OFFSET(FILE_NOTIFY_INFORMATION, FileName))
+    {
+        Info = (PFILE_NOTIFY_INFORMATION)((PUCHAR)State->Buffer + Offset);
+        NameLength = Info->FileNameLength / sizeof(WCHAR);
+
+        State->Total++;
+
+        // FNV-1a, to skip most names without comparing them
+        Hash = 2166136261u;
+        for (i = 0; i < NameLength; i++)
+            Hash = (Hash ^ Info->FileName[i]) * 16777619u;
+
+        Change = NULL;
+        for (i = 0; i < State->ChangeCount; i++)
+        {
+            if (State->Changes[i].Hash == Hash && State->Changes[i].NameLength == NameLength &&
+                !memcmp(&State->Names[State->Changes[i].NameOffset], Info->FileName, Info->FileNameLength))
+            {
+                Change = &State->Changes[i];
+                break;
+            }
+        }
+
+        if (!Change && State->ChangeCount < WATCH_MAX_CHANGES &&
+            NameLength <= WATCH_NAME_POOL - State->NamesUsed)
+        {
+            Change = &State->Changes[State->ChangeCount++];
+            Change->Hash = Hash;
+            Change->Actions = 0;
+            Change->Count = 0;
+            Change->NameOffset = State->NamesUsed;
+            Change->NameLength = NameLength;
+
+            RtlCopyMemory(&State->Names[State->NamesUsed], Info->FileName, Info->FileNameLength);
+            State->NamesUsed += NameLength;
+        }
+
+        if (Change)
+        {
+            Change->Actions |= 1 << (Info->Action <= FILE_ACTION_RENAMED_NEW_NAME ? Info->Action : 0);
+            Change->Count++;
+        }
+        else
+        {
+            State->Dropped++;
+        }
+
+        if (!Info->NextEntryOffset)
+            break;
+
+        Offset += Info->NextEntryOffset;
+    }
+}
+
+/*++
+ * @name RtlClipWatchActionText
+ *
+ * The RtlClipWatchActionText routine names the actions of a change.
+ *
+ * @param Actions
+ *        1 << FILE_ACTION_xxx for each action.
+ *
+ * @param Text
+ *        Receives the names, joined with '+'.
+ *
+ * @param Size
+ *        Size of Text.
+ *
+ * @return None.
+ *
+ * @remarks None.
+ *
+ *--*/
+VOID
+RtlClipWatchActionText(IN ULONG Actions, OUT PCHAR Text, IN ULONG Size)
+{
+    static const PCSTR Names[] = {"?", "added", "removed", "modified", "renamed from", "renamed to"};
+    ULONG Action, Length = 0;
+
+    Text[0] = 0;
+
+    for (Action = 0; Action < RTL_NUMBER_OF(Names); Action++)
+    {
+        if (!(Actions & (1 << Action)))
+            continue;
+
+        _snprintf(Text + Length, Size - Length, "%s%s",
+                  Length ? "+" : "", Names[Action]);
+        Text[Size - 1] = 0;
+        Length = strlen(Text);
+    }
+}
+
+/*++
+ * @name RtlClipWatchReport
+ *
+ * The RtlClipWatchReport routine prints the changes held since the last
+ * report and forgets them.
+ *
+ * @param State
+ *        Watch state.
+ *
+ * @return None.
+ *
+ * @remarks At most WATCH_MAX_LINES names are printed, the rest is counted
+ *          on one line. The report goes through a print buffer, so a burst
+ *          of changes costs one trip to the screen per report.
+ *
+ *--*/
+VOID
+RtlClipWatchReport(IN OUT PWATCH_STATE State)
+{
+    CLI_PRINT_BUFFER Output;
+    CHAR Actions[64];
+    LARGE_INTEGER Now;
+    ULONG Milliseconds, More, i;
+    PWATCH_CHANGE Change;
+
+    NtQueryPerformanceCounter(&Now, NULL);
+    Milliseconds = (ULONG)((Now.QuadPart - State->StartTime) * 1000 / State->Frequency);
+
+    Output.Length = 0;
+
+    for (i = 0; i < min(State->ChangeCount, WATCH_MAX_LINES); i++)
+    {
+        Change = &State->Changes[i];
+        RtlClipWatchActionText(Change->Actions, Actions, sizeof(Actions));
+
+        if (Change->Count > 1)
+        {
+            RtlCliBufferPrint(&Output, "%6u.%03u %-12s %.*S (%u times)\n",
+                              Milliseconds / 1000, Milliseconds % 1000, Actions,
+                              Change->NameLength, &State->Names[Change->NameOffset], Change->Count);
+        }
+        else
+        {
+            RtlCliBufferPrint(&Output, "%6u.%03u %-12s %.*S\n",
+                              Milliseconds / 1000, Milliseconds % 1000, Actions,
+                              Change->NameLength, &State->Names[Change->NameOffset]);
+        }
+    }
+
+    More = State->Dropped;
+    for (; i < State->ChangeCount; i++)
+        More += State->Changes[i].Count;
+
+    if (More)
+        RtlCliBufferPrint(&Output, "%10s %u more changes\n", "", More);
+
+    if (State->Overflow)
+        RtlCliBufferPrint(&Output, "%10s too many changes at once, some were lost\n", "");
+
+    RtlCliFlushPrintBuffer(&Output);
+
+    // Nobody reads the keyboard to push the text out
+    RtlCliFlush();
+
+    State->ChangeCount = 0;
+    State->NamesUsed = 0;
+    State->Dropped = 0;
+    State->Overflow = FALSE;
+}
+
+/*++
+ * @name RtlCliWatchDirectory
+ *
+ * The RtlCliWatchDirectory routine prints the changes made in a directory
+ * until a key is pressed.
+ *
+ * @param hDriver
+ *        Keyboard handle.
+ *
+ * @param Path
+ *        Directory to watch, full path in DOS format.
+ *
+ * @param Recurse
+ *        TRUE to watch the subdirectories as well.
+ *
+ * @return STATUS_SUCCESS when stopped with a key, or the status that
+ *         ended the watch.
+ *
+ * @remarks One NtNotifyChangeDirectoryFile request is kept pending on a
+ *          WATCH_BUFFER_SIZE buffer, which is reissued as soon as its
+ *          changes are collected. Changes are reported at most every
+ *          WATCH_REPORT_INTERVAL milliseconds: the first change after a
+ *          quiet period is printed at once, a burst is merged by name
+ *          until the interval is over.
+ *
+ *--*/
+NTSTATUS
+RtlCliWatchDirectory(IN HANDLE hDriver, IN PCWSTR Path, IN BOOLEAN Recurse)
+{
+    WCHAR DirectoryName[TREE_MAX_PATH + 4] = L"\\??\\";
+    UNICODE_STRING DirectoryNameString;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock, CancelIoStatusBlock;
+    LARGE_INTEGER Now, Timeout, LastReport;
+    PLARGE_INTEGER pTimeout;
+    LONGLONG Elapsed, Interval;
+    HANDLE hDirectory, hNotify;
+    PWATCH_STATE State;
+    BOOLEAN Pending = FALSE;
+    NTSTATUS Status;
+
+    wcsncat(DirectoryName, Path, RTL_NUMBER_OF(DirectoryName) - 5);
+    RtlInitUnicodeString(&DirectoryNameString, DirectoryName);
+    InitializeObjectAttributes(&ObjectAttributes, &DirectoryNameString, OBJ_CASE_INSENSITIVE, NULL, NULL);
+
+    // Asynchronous, the request is waited for along with the keyboard
+    Status = NtOpenFile(&hDirectory,
+                        FILE_LIST_DIRECTORY | SYNCHRONIZE,
+                        &ObjectAttributes,
+                        &IoStatusBlock,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                        FILE_DIRECTORY_FILE);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    Status = NtCreateEvent(&hNotify, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE);
+    if (!NT_SUCCESS(Status))
+    {
+        NtClose(hDirectory);
+        return Status;
+    }
+
+    // The notification buffer is too large for the stack
+    State = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(WATCH_STATE));
+    if (!State)
+    {
+        NtClose(hNotify);
+        NtClose(hDirectory);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    NtQueryPerformanceCounter(&Now, &Timeout);
+    State->StartTime = Now.QuadPart;
+    State->Frequency = Timeout.QuadPart ? Timeout.QuadPart : 1;
+    Interval = State->Frequency * WATCH_REPORT_INTERVAL / 1000;
+    LastReport.QuadPart = Now.QuadPart - Interval;
+
+    RtlCliDisplayString("Watching %S%s, press any key to stop\n", Path, Recurse ? " and below" : "");
+    RtlCliFlush();
+
+    for (;;)
+    {
+        if (!Pending)
+        {
+            Status = NtNotifyChangeDirectoryFile(hDirectory, hNotify, NULL, NULL, &IoStatusBlock,
+                                                 State->Buffer, sizeof(State->Buffer), WATCH_FILTER, Recurse);
+            if (!NT_SUCCESS(Status))
+                break;
+
+            Pending = TRUE;
+        }
+
+        // Wake up for the next report only if there is something to report
+        pTimeout = NULL;
+        if (State->ChangeCount || State->Dropped || State->Overflow)
+        {
+            NtQueryPerformanceCounter(&Now, NULL);
+            Elapsed = Now.QuadPart - LastReport.QuadPart;
+            Timeout.QuadPart = -(max(Interval - Elapsed, 0) * 10000000 / State->Frequency);
+            pTimeout = &Timeout;
+        }
+
+        Status = RtlCliWaitForKeyOrObject(hDriver, hNotify, pTimeout);
+        if (Status == STATUS_WAIT_0)
+        {
+            Pending = FALSE;
+
+            // The directory went away, or the handle can't be watched
+            if (!NT_SUCCESS(IoStatusBlock.Status))
+            {
+                Status = IoStatusBlock.Status;
+                break;
+            }
+
+            // More changes than the buffer holds, only the fact is known
+            if (IoStatusBlock.Status == STATUS_NOTIFY_ENUM_DIR || IoStatusBlock.Information == 0)
+                State->Overflow = TRUE;
+            else
+                RtlClipWatchCollect(State, (ULONG)IoStatusBlock.Information);
+        }
+        else if (Status == STATUS_WAIT_1)
+        {
+            Status = STATUS_SUCCESS;
+            break;
+        }
+        else if (Status != STATUS_TIMEOUT)
+        {
+            break;
+        }
+
+        NtQueryPerformanceCounter(&Now, NULL);
+        if ((State->ChangeCount || State->Dropped || State->Overflow) &&
+            Now.QuadPart - LastReport.QuadPart >= Interval)
+        {
+            RtlClipWatchReport(State);
+            LastReport = Now;
+        }
+    }
+
+    if (State->ChangeCount || State->Dropped || State->Overflow)
+        RtlClipWatchReport(State);
+
+    if (Pending)
+    {
+        NtCancelIoFile(hDirectory, &CancelIoStatusBlock);
+        NtWaitForSingleObject(hNotify, FALSE, NULL);
+    }
+
+    RtlCliCancelKeyWait(hDriver);
+
+    RtlCliDisplayString("%u changes\n", State->Total);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, State);
+    NtClose(hNotify);
+    NtClose(hDirectory);
+
+    return Status;
+}